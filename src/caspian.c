@@ -77,19 +77,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <omp.h>
 
+#include "coordinate_cache.h"
 #include "coordinate_reader.h"
 #include "data_handling.h"
 #include "gridding.h"
 #include "grid.h"
 #include "io_helper.h"
 #include "kd_tree.h"
+#include "observation_list.h"
 #include "proj_projector.h"
 #include "projector.h"
 #include "rawfile_coordinate_reader.h"
 #include "reduction_functions.h"
+#include "run_metrics.h"
 #include "spatial_index.h"
+#include "validity_mask.h"
 
 /**
   * Polar circumference of the earth according to WGS84 - used for calculating
@@ -102,6 +106,178 @@
   */
 #define WGS84_EQUATORIAL_CIRCUMFERENCE 40075017.0
 
+/**
+  * The command line options and open files relating to a single input variable
+  *(a data file sharing the geolocation of the index), and the outputs to be
+  *produced from it.
+  */
+typedef struct {
+   /** The filename of the input data. */
+   char *input_filename;
+
+   /** The dtype of the input data. */
+   dtype input_dtype;
+
+   /** Whether the input dtype was given for this variable specifically. */
+   int input_dtype_set;
+
+   /** The filename of the output data (reduced using the selected reduction
+    *function), or NULL. */
+   char *output_filename;
+
+   /** The dtype of the output data and statistics. */
+   dtype output_dtype;
+
+   /** Whether the output dtype was given for this variable specifically. */
+   int output_dtype_set;
+
+   /** The statistics to be stored. */
+   statistic *statistics;
+
+   /** The filenames of the statistics to be stored. */
+   char **statistic_filenames;
+
+   /** The number of statistics to be stored. */
+   int number_statistics;
+
+   /** The opened input data file. */
+   memory_mapped_file *input_file;
+} variable_options;
+
+/**
+  * Add a new, empty, variable to a list of variables.
+  *
+  * @param variables Pointer to the list of variables (which may be
+  *reallocated).
+  * @param number_variables Pointer to the number of variables in the list.
+  * @return A pointer to the new variable.
+  */
+static variable_options *add_variable(variable_options **variables,
+                                      int *number_variables) {
+   (*number_variables)++;
+   *variables = realloc(*variables,
+                        sizeof(variable_options) * (*number_variables));
+   if (*variables == NULL) {
+      fprintf(stderr, "Failed to allocate space to store variable options\n");
+      exit(EXIT_FAILURE);
+   }
+
+   variable_options *new_variable = &(*variables)[*number_variables - 1];
+   memset(new_variable, 0, sizeof(variable_options));
+   return new_variable;
+}
+
+/**
+  * The command line options and open files relating to a single output grid.
+  *Every grid receives all of the outputs; the first grid writes them to the
+  *filenames given, and each grid added with --grid writes them to those
+  *filenames with its suffix appended.
+  */
+typedef struct {
+   /** The suffix appended to output filenames, or NULL for the first grid. */
+   char *suffix;
+
+   /** The PROJ.4 string for the projection of the grid, or NULL to use the
+    *projection of the index. */
+   char *projection_string;
+
+   /** The projector for projection_string, or NULL. */
+   projector *grid_projector;
+
+   /** The level of the pyramid this grid is an overview of the first grid
+    *at, or 0 (the size, resolutions and centre of an overview are derived
+    *from the first grid). */
+   int overview_level;
+
+   /** The size of the grid, in cells. */
+   int height, width;
+
+   /** The resolution of the grid, in projection units (0 until defaulted). */
+   double vertical_resolution, horizontal_resolution;
+
+   /** The centre of the grid, in projection units. */
+   double central_y, central_x;
+
+   /** The sampling resolution of the grid (0 to use the resolution). */
+   double vertical_sampling, horizontal_sampling;
+
+   /** The opened output data files (one per variable of each time bin, or
+    *NULL). */
+   memory_mapped_file **output_files;
+
+   /** The opened statistic files (one list per variable of each time bin). */
+   memory_mapped_file ***statistic_files;
+
+   /** The opened latitude and longitude files, or NULL. */
+   memory_mapped_file *latitude_file, *longitude_file;
+
+   /** Whether the latitudes and longitudes were read from the cache. */
+   int lats_cached, lons_cached;
+
+   /** The opened query diagnostic files (nodes visited, observations tested
+    *and observations found by the query of each cell), or NULL. */
+   memory_mapped_file *nodes_visited_file, *leaves_tested_file, *hits_file;
+} grid_options;
+
+/**
+  * Add a new grid, with the default size and resolutions, to a list of grids.
+  *
+  * @param grids Pointer to the list of grids (which may be reallocated).
+  * @param number_grids Pointer to the number of grids in the list.
+  * @return A pointer to the new grid.
+  */
+static grid_options *add_grid(grid_options **grids, int *number_grids) {
+   (*number_grids)++;
+   *grids = realloc(*grids, sizeof(grid_options) * (*number_grids));
+   if (*grids == NULL) {
+      fprintf(stderr, "Failed to allocate space to store grid options\n");
+      exit(EXIT_FAILURE);
+   }
+
+   grid_options *new_grid = &(*grids)[*number_grids - 1];
+   memset(new_grid, 0, sizeof(grid_options));
+   new_grid->height = 360;
+   new_grid->width = 720;
+   return new_grid;
+}
+
+/**
+  * Open an output file for a grid, appending the suffix of the grid and the
+  *number of the time bin (where there are any) to the filename.
+  *
+  * @param output_grid The grid the output belongs to.
+  * @param time_bin The number of the time bin the output belongs to, or -1.
+  * @param filename The filename given on the command line.
+  * @param number_bytes The size of the output file.
+  * @param open_output_file The function used to open the file.
+  * @return The opened file.
+  */
+static memory_mapped_file *open_grid_output_file(
+   grid_options *output_grid, int time_bin, char *filename,
+   size_t number_bytes,
+   memory_mapped_file *(*open_output_file)(char *, size_t)) {
+   if (output_grid->suffix == NULL && time_bin < 0) {
+      return open_output_file(filename, number_bytes);
+   }
+
+   // Leave room for the suffix, and for a separator and bin number
+   char *suffix = (output_grid->suffix != NULL) ? output_grid->suffix : "";
+   size_t length = strlen(filename) + strlen(suffix) + 24;
+   char *grid_filename = malloc(length);
+   if (grid_filename == NULL) {
+      fprintf(stderr, "Failed to allocate space for an output filename\n");
+      exit(EXIT_FAILURE);
+   }
+   int used = snprintf(grid_filename, length, "%s%s%s", filename,
+                       (output_grid->suffix != NULL) ? "." : "", suffix);
+   if (time_bin >= 0) {
+      snprintf(grid_filename + used, length - used, ".%d", time_bin);
+   }
+   memory_mapped_file *file = open_output_file(grid_filename, number_bytes);
+   free(grid_filename);
+   return file;
+}
+
 /**
   * Display the help text for the main executable program
   * @param executable The name or full path of the executable
@@ -133,18 +309,43 @@ void help(char *executable) {
    printf(" Input data\n");
    printf(
       "  -d/--input-data <filename>                                    "\
-      "Specify filename for input data\n");
+      "Specify filename for input data (may be repeated)\n");
    printf(
       "  -t/--input-dtype <dtype>         float32                      "\
-      "Specify dtype for input data file\n");
+      "Specify dtype for input data file(s)\n");
    printf(
       "  -f/--input-fill-value <number>   -999.0                       "\
       "Specify fill value for input data file\n");
+   printf(
+      "  -W/--input-weights <filename>                                 "\
+      "Specify filename for per-observation weights (input_weighted_*)\n");
+   printf(
+      "  -X/--weights-dtype <dtype>       float32                      "\
+      "Specify dtype for the weights file\n");
+   printf(
+      "  -u/--input-qa <filename>                                      "\
+      "Specify filename for per-observation quality (QA) values\n");
+   printf(
+      "  -U/--qa-dtype <dtype>            uint8                        "\
+      "Specify dtype for the QA file\n");
+   printf(
+      "  -m/--qa-reject-mask <integer>    0                            "\
+      "Reject observations whose QA value has any of these bits set\n");
+   printf(
+      "  -M/--qa-min <number>             -inf                         "\
+      "Reject observations whose QA value is less than this\n");
+   printf(
+      "  -v/--validity-mask                                            "\
+      "Skip fill values using a bitmap cached in <input data>.valid\n");
    printf("\n");
    printf(" Output data\n");
    printf(
       "  -D/--output-data <filename>                                   "\
-      "Specify filename for output data\n");
+      "Specify filename for output data (one per --input-data)\n");
+   printf(
+      "  -D/--output-data <stat>=<file>                                "\
+      "Store a statistic of the input data in a file (may be repeated)\n");
+
    printf(
       "  -T/--output-dtype <dtype>        value of --input-dtype       "\
       "Specify dtype for output data file\n");
@@ -157,6 +358,24 @@ void help(char *executable) {
    printf(
       "  -O/--output-lons <filename>                                   "\
       "Specify filename for output longitude\n");
+   printf(
+      "  -C/--coordinate-cache <dirname>                               "\
+      "Reuse output latitudes and longitudes cached in this directory\n");
+   printf(
+      "  -J/--diag-visited <filename>                                  "\
+      "Store the number of index nodes visited by each cell's query (uint32)\n");
+   printf(
+      "  -l/--diag-leaves <filename>                                   "\
+      "Store the number of observations tested by each cell's query (uint32)\n");
+   printf(
+      "  -N/--diag-hits <filename>                                     "\
+      "Store the number of observations found by each cell's query (uint32)\n");
+   printf(
+      "  Several variables sharing the same geolocation may be gridded at once "\
+      "by\n  repeating --input-data. --input-dtype, --output-data and "\
+      "--output-dtype apply\n  to the most recent --input-data; dtypes given "\
+      "before any --input-data are\n  defaults for every variable, and outputs "\
+      "given before any --input-data\n  apply to the first.\n");
    printf("\n");
    printf(" Image generation\n");
    printf(
@@ -183,26 +402,95 @@ void help(char *executable) {
    printf(
       "  -s/--hsample <number>            value of --hres              "\
       "Horizontal sampling resolution\n");
+   printf(
+      "  -g/--grid <suffix>[=<string>]    projection of index          "\
+      "Add a grid, in this projection, writing every output to\n"\
+      "                                                                "\
+      "  <filename>.<suffix>\n");
+   printf(
+      "  -L/--pyramid-levels <integer>                                 "\
+      "Add this many overviews of the grid, each half the resolution of\n"\
+      "                                                                "\
+      "  the one before, writing level k to <filename>.level<k> (a\n"\
+      "                                                                "\
+      "  point on the edge of two overview cells may count in only one)\n");
    printf(
       "  -r/--reduction-function <string> mean                         "\
       "Choose reduction function to use\n");
+   printf(
+      "  -P/--percentile <number>         50.0                         "\
+      "Percentile (0 to 100) for the percentile reduction function\n");
+   printf(
+      "  -E/--percentile-error <number>   0.01                         "\
+      "Permitted rank error (fraction) for the percentile reduction function\n");
+   printf(
+      "  -k/--kernel <string>             idw                          "\
+      "Distance weighting for the kernel_mean reduction function (idw or gaussian)\n");
+   printf(
+      "  -K/--kernel-power <number>       2.0                          "\
+      "Power of distance for the idw kernel\n");
+   printf(
+      "  -G/--kernel-sigma <number>       half the smaller sampling    "\
+      "Standard deviation of the gaussian kernel, in projection units (metres)\n");
+   printf(
+      "  -c/--scatter                                                  "\
+      "Visit each observation once rather than querying each cell (mean,\n"\
+      "                                                                "\
+      "  newest, and count/sum/mean/min/max statistics only)\n");
+   printf(
+      "  -R/--running-sums                                             "\
+      "Grid sums and counts once and derive each sampling box from running\n"\
+      "                                                                "\
+      "  sums (mean, input_weighted_mean, and count/sum/mean statistics\n"\
+      "                                                                "\
+      "  only)\n");
+   printf(
+      "  -B/--memory-budget <MiB>                                      "\
+      "Grid a band of rows at a time, buffering at most this much output\n"\
+      "                                                                "\
+      "  in memory, and write each band to the output files in turn\n");
    printf(
       "  -q/--time-min                    -inf                         "\
       "Earliest time to select from\n");
    printf(
       "  -Q/--time-max                    +inf                         "\
       "Latest time to select from\n");
+   printf(
+      "  -j/--time-step <number>                                       "\
+      "Divide the observations of each cell into time bins of this length\n"\
+      "                                                                "\
+      "  from --time-min, writing each bin to <filename>.<bin number>\n");
+   printf(
+      "  -n/--time-bins <integer>         up to --time-max             "\
+      "Number of time bins\n");
+   printf(
+      "  -z/--update-from <integer>                                    "\
+      "Update existing outputs in place, regridding only the cells near\n"\
+      "                                                                "\
+      "  observations from this record onwards (appended since the\n"\
+      "                                                                "\
+      "  outputs were made)\n");
+   printf(
+      "  --height to --hsample apply to the most recent --grid (or, before "\
+      "any --grid, to\n  the first grid). Grids in another projection than "\
+      "the index are queried\n  by re-projecting each sampling box.\n");
    printf("\n");
    printf(" General\n");
    printf(
       "  -+/--verbose                                                  "\
       "Increase verbosity\n");
+   printf(
+      "  -Y/--metrics-out <filename>                                   "\
+      "Write the time taken by each phase of the run, and counts of cells,\n"\
+      "                                                                "\
+      "  queries and hits, to this file as JSON\n");
    printf(
       "  -?/--help                                                     "\
       "Show this help message\n");
    printf("\n");
    printf(
-      "Numeric functions: mean, weighted_mean, median, newest,"\
+      "Numeric functions: mean, weighted_mean, kernel_mean, input_weighted_mean, "\
+      "median,\n  input_weighted_median, percentile, newest, "\
       "numeric_nearest_neighbour\n");
    printf("Numeric function dtypes: ");
    printf("uint8, uint16, uint32, ");
@@ -215,8 +503,12 @@ void help(char *executable) {
    #endif
    printf("float32, float64\n");
    printf("\n");
-   printf("Coded functions: coded_nearest_neighbour\n");
+   printf("Coded functions: coded_nearest_neighbour, coded_mode\n");
    printf("Coded function dtypes: coded8, coded16, coded32, coded64\n");
+   printf("\n");
+   printf(
+      "Statistics (--output-data <stat>=<file>): mean, stddev, variance, count, "\
+      "sum, min, max\n");
 }
 
 /**
@@ -248,33 +540,55 @@ int main(int argc, char **argv) {
    char *input_index_filename = NULL;
 
    // Input data
-   char *input_data_filename = NULL;
+   variable_options *variables = NULL;
+   int number_variables = 0;
    dtype input_dtype = {float32, 4, numeric, "float32"};
    NUMERIC_WORKING_TYPE input_fill_value = -999.0;
+   char *input_weights_filename = NULL;
+   dtype weights_dtype = input_dtype;
+   char *input_qa_filename = NULL;
+   dtype qa_dtype = {uint8, 1, numeric, "uint8"};
+   uint64_t qa_reject_mask = 0;
+   NUMERIC_WORKING_TYPE qa_minimum = -INFINITY;
+   int using_validity_mask = 0;
 
    // Output data
-   char *output_data_filename = NULL;
    dtype output_dtype = input_dtype; // Default may be overriden later
    NUMERIC_WORKING_TYPE output_fill_value = -999.0;
    char *output_lat_filename = NULL;
    char *output_lon_filename = NULL;
+   char *coordinate_cache_directory = NULL;
+   char *diag_visited_filename = NULL;
+   char *diag_leaves_filename = NULL;
+   char *diag_hits_filename = NULL;
 
-   // Image generation
-   int height = 360;
-   int width = 720;
-   double vertical_resolution = 0.0; // Default is calculated later
-   double horizontal_resolution = 0.0; // Default is calculated later
-   double central_y = 0.0;
-   double central_x = 0.0;
-   double vertical_sampling = 0.0; // Default is calculated later
-   double horizontal_sampling = 0.0; // Default is calculated later
+   // Image generation (resolutions are defaulted later)
+   grid_options *grids = NULL;
+   int number_grids = 0;
+   add_grid(&grids, &number_grids);
    reduction_function selected_reduction_function =
       get_reduction_function_by_name("mean");
+   float percentile = 50.0;
+   float percentile_rank_error = 0.01;
+   kernel_type kernel = kernel_idw;
+   float kernel_power = 2.0;
+   float kernel_sigma = 0.0; // Default is calculated later
    float time_min = -INFINITY;
    float time_max = +INFINITY;
+   int scatter = 0;
+   int running_sum = 0;
+   size_t memory_budget = 0; // Outputs are mapped whole unless set
+   float time_step = 0.0; // Observations are not divided by time unless set
+   int number_time_bins = 0; // Default is calculated later
+   size_t first_new_observation = 0; // Only used when updating
+   int pyramid_levels = 0; // Overviews of the grid are only added if set
 
    // General
    int verbosity = 0;
+   char *metrics_filename = NULL;
+   run_metrics metrics;
+   run_metrics_init(&metrics);
+   uint64_t run_start_time = monotonic_nanoseconds();
 
 
    // Control flow variables
@@ -282,8 +596,8 @@ int main(int argc, char **argv) {
    int loading_index = 0;
    int output_dtype_set = 0;
    int saving_index = 0;
+   int updating_image = 0;
    int using_default_projection_string = 1;
-   int write_data = 0;
    int write_lats = 0;
    int write_lons = 0;
 
@@ -302,6 +616,13 @@ int main(int argc, char **argv) {
       {"input-data", 1, 0, 'd'},
       {"input-dtype", 1, 0, 't'},
       {"input-fill-value", 1, 0, 'f'},
+      {"input-weights", 1, 0, 'W'},
+      {"weights-dtype", 1, 0, 'X'},
+      {"input-qa", 1, 0, 'u'},
+      {"qa-dtype", 1, 0, 'U'},
+      {"qa-reject-mask", 1, 0, 'm'},
+      {"qa-min", 1, 0, 'M'},
+      {"validity-mask", 0, 0, 'v'},
 
       // Output data
       {"output-data", 1, 0, 'D'},
@@ -309,6 +630,10 @@ int main(int argc, char **argv) {
       {"output-fill-value", 1, 0, 'F'},
       {"output-lats", 1, 0, 'A'},
       {"output-lons", 1, 0, 'O'},
+      {"coordinate-cache", 1, 0, 'C'},
+      {"diag-visited", 1, 0, 'J'},
+      {"diag-leaves", 1, 0, 'l'},
+      {"diag-hits", 1, 0, 'N'},
 
       // Image generation
       {"height", 1, 0, 'h'},
@@ -319,12 +644,26 @@ int main(int argc, char **argv) {
       {"central-x", 1, 0, 'x'},
       {"vsample", 1, 0, 'S'},
       {"hsample", 1, 0, 's'},
+      {"grid", 1, 0, 'g'},
+      {"pyramid-levels", 1, 0, 'L'},
       {"reduction-function", 1, 0, 'r'},
+      {"percentile", 1, 0, 'P'},
+      {"percentile-error", 1, 0, 'E'},
+      {"kernel", 1, 0, 'k'},
+      {"kernel-power", 1, 0, 'K'},
+      {"kernel-sigma", 1, 0, 'G'},
       {"time-min", 1, 0, 'q'},
       {"time-max", 1, 0, 'Q'},
+      {"scatter", 0, 0, 'c'},
+      {"running-sums", 0, 0, 'R'},
+      {"memory-budget", 1, 0, 'B'},
+      {"time-step", 1, 0, 'j'},
+      {"time-bins", 1, 0, 'n'},
+      {"update-from", 1, 0, 'z'},
 
       // General
       {"verbose", 0, 0, '+'},
+      {"metrics-out", 1, 0, 'Y'},
       {"help", 0, 0, '?'},
    };
 
@@ -339,6 +678,8 @@ int main(int argc, char **argv) {
    int curarg, option_index = 0;
    while((curarg =
              getopt_long(argc, argv, "", long_options, &option_index)) != -1) {
+      // Grid options apply to the most recent grid
+      grid_options *current_grid = &grids[number_grids - 1];
       switch (curarg) {
       // Index controls
       case 'a':
@@ -364,25 +705,111 @@ int main(int argc, char **argv) {
          break;
 
       // Input data
-      case 'd':
-         save_optarg_string(input_data_filename);
+      case 'd': {
+         // Start a new variable, unless outputs have already been given for a
+         // first variable with no input
+         variable_options *variable;
+         if (number_variables > 0 &&
+             variables[number_variables - 1].input_filename == NULL) {
+            variable = &variables[number_variables - 1];
+         } else {
+            variable = add_variable(&variables, &number_variables);
+         }
+         save_optarg_string(variable->input_filename);
          break;
+      }
       case 't':
-         input_dtype = dtype_string_parse(optarg);
+         if (number_variables > 0 &&
+             variables[number_variables - 1].input_filename != NULL) {
+            variables[number_variables - 1].input_dtype =
+               dtype_string_parse(optarg);
+            variables[number_variables - 1].input_dtype_set = 1;
+         } else {
+            input_dtype = dtype_string_parse(optarg);
+         }
          break;
       case 'f':
          input_fill_value = atof(optarg);
          break;
+      case 'W':
+         save_optarg_string(input_weights_filename);
+         break;
+      case 'X':
+         weights_dtype = dtype_string_parse(optarg);
+         break;
+      case 'u':
+         save_optarg_string(input_qa_filename);
+         break;
+      case 'U':
+         qa_dtype = dtype_string_parse(optarg);
+         break;
+      case 'm':
+         qa_reject_mask = strtoull(optarg, NULL, 0);
+         break;
+      case 'M':
+         qa_minimum = atof(optarg);
+         break;
+      case 'v':
+         using_validity_mask = 1;
+         break;
 
       // Output data
-      case 'D':
-         save_optarg_string(output_data_filename);
+      case 'D': {
+         // Outputs belong to the most recent variable
+         variable_options *variable = (number_variables > 0) ?
+                                      &variables[number_variables - 1] :
+                                      add_variable(&variables,
+                                                   &number_variables);
+
+         // Either <statistic>=<filename>, or <filename> (which may itself
+         // contain '=', where what precedes it is not a statistic)
+         char *separator = strchr(optarg, '=');
+         statistic output_stat = undef_statistic;
+         if (separator != NULL) {
+            *separator = '\0';
+            output_stat = get_statistic_by_name(optarg);
+            *separator = '=';
+         }
+
+         if (output_stat == undef_statistic) {
+            if (variable->output_filename != NULL) {
+               fprintf(stderr,
+                       "Only one --output-data <filename> may be given for "\
+                       "each --input-data\n");
+               exit(EXIT_FAILURE);
+            }
+            save_optarg_string(variable->output_filename);
+         } else {
+            int number_statistics = ++variable->number_statistics;
+            variable->statistics = realloc(
+               variable->statistics, sizeof(statistic) * number_statistics);
+            variable->statistic_filenames = realloc(
+               variable->statistic_filenames,
+               sizeof(char *) * number_statistics);
+            if (variable->statistics == NULL ||
+                variable->statistic_filenames == NULL) {
+               fprintf(stderr,
+                       "Failed to allocate space to store output statistics\n");
+               exit(EXIT_FAILURE);
+            }
+            variable->statistics[number_statistics - 1] = output_stat;
+            optarg = separator + 1;
+            save_optarg_string(
+               variable->statistic_filenames[number_statistics - 1]);
+         }
          generating_image = 1;
-         write_data = 1;
          break;
+      }
       case 'T':
-         output_dtype = dtype_string_parse(optarg);
-         output_dtype_set = 1;
+         if (number_variables > 0 &&
+             variables[number_variables - 1].input_filename != NULL) {
+            variables[number_variables - 1].output_dtype =
+               dtype_string_parse(optarg);
+            variables[number_variables - 1].output_dtype_set = 1;
+         } else {
+            output_dtype = dtype_string_parse(optarg);
+            output_dtype_set = 1;
+         }
          break;
       case 'F':
          output_fill_value = atof(optarg);
@@ -397,66 +824,108 @@ int main(int argc, char **argv) {
          generating_image = 1;
          write_lons = 1;
          break;
+      case 'C':
+         save_optarg_string(coordinate_cache_directory);
+         break;
+      case 'J':
+         save_optarg_string(diag_visited_filename);
+         generating_image = 1;
+         break;
+      case 'l':
+         save_optarg_string(diag_leaves_filename);
+         generating_image = 1;
+         break;
+      case 'N':
+         save_optarg_string(diag_hits_filename);
+         generating_image = 1;
+         break;
 
       // Image generation
       case 'h':
-         height = atoi(optarg);
-         if (height <= 0) {
+         current_grid->height = atoi(optarg);
+         if (current_grid->height <= 0) {
             fprintf(stderr, "Height must be a positive integer (got %d)\n",
-                    height);
+                    current_grid->height);
             exit(EXIT_FAILURE);
          }
          break;
       case 'w':
-         width = atoi(optarg);
-         if (width <= 0) {
+         current_grid->width = atoi(optarg);
+         if (current_grid->width <= 0) {
             fprintf(stderr, "Width must be a positive integer (got %d)\n",
-                    width);
+                    current_grid->width);
             exit(EXIT_FAILURE);
          }
          break;
       case 'V':
-         vertical_resolution = atof(optarg);
-         if (vertical_resolution <= 0.0) {
+         current_grid->vertical_resolution = atof(optarg);
+         if (current_grid->vertical_resolution <= 0.0) {
             fprintf(stderr,
                     "Vertical resolution must be a positive number (got %f)\n",
-                    vertical_resolution);
+                    current_grid->vertical_resolution);
             exit(EXIT_FAILURE);
          }
          break;
       case 'H':
-         horizontal_resolution = atof(optarg);
-         if (horizontal_resolution <= 0.0) {
+         current_grid->horizontal_resolution = atof(optarg);
+         if (current_grid->horizontal_resolution <= 0.0) {
             fprintf(
                stderr,
                "Horizontal resolution must be a positive number (got %f)\n",
-               horizontal_resolution);
+               current_grid->horizontal_resolution);
             exit(EXIT_FAILURE);
          }
          break;
       case 'y':
-         central_y = atof(optarg);
+         current_grid->central_y = atof(optarg);
          break;
       case 'x':
-         central_x = atof(optarg);
+         current_grid->central_x = atof(optarg);
          break;
       case 'S':
-         vertical_sampling = atof(optarg);
-         if (vertical_sampling <= 0.0) {
+         current_grid->vertical_sampling = atof(optarg);
+         if (current_grid->vertical_sampling <= 0.0) {
             fprintf(
                stderr,
                "Vertical sampling resolution must be a positive number (got %f)\n",
-               vertical_sampling);
+               current_grid->vertical_sampling);
             exit(EXIT_FAILURE);
          }
          break;
       case 's':
-         horizontal_sampling = atof(optarg);
-         if (horizontal_sampling <= 0.0) {
+         current_grid->horizontal_sampling = atof(optarg);
+         if (current_grid->horizontal_sampling <= 0.0) {
             fprintf(
                stderr,
                "Horizontal sampling resolution must be a positive number (got %f)\n",
-               horizontal_sampling);
+               current_grid->horizontal_sampling);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case 'g': {
+         // Either <suffix>, or <suffix>=<projection string>
+         grid_options *output_grid = add_grid(&grids, &number_grids);
+         char *separator = strchr(optarg, '=');
+         if (separator != NULL) {
+            *separator = '\0';
+         }
+         if (optarg[0] == '\0') {
+            fprintf(stderr, "Each --grid must be given a suffix\n");
+            exit(EXIT_FAILURE);
+         }
+         save_optarg_string(output_grid->suffix);
+         if (separator != NULL) {
+            optarg = separator + 1;
+            save_optarg_string(output_grid->projection_string);
+         }
+         break;
+      }
+      case 'L':
+         pyramid_levels = atoi(optarg);
+         if (pyramid_levels <= 0) {
+            fprintf(stderr,
+                    "Number of pyramid levels must be a positive integer "\
+                    "(got %d)\n", pyramid_levels);
             exit(EXIT_FAILURE);
          }
          break;
@@ -467,17 +936,94 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
          }
          break;
+      case 'P':
+         percentile = atof(optarg);
+         if (percentile < 0.0 || percentile > 100.0) {
+            fprintf(stderr, "Percentile must be between 0 and 100 (got %f)\n",
+                    percentile);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case 'E':
+         percentile_rank_error = atof(optarg);
+         if (percentile_rank_error <= 0.0 || percentile_rank_error >= 1.0) {
+            fprintf(stderr,
+                    "Percentile error must be between 0 and 1 (got %f)\n",
+                    percentile_rank_error);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case 'k':
+         kernel = get_kernel_by_name(optarg);
+         if (kernel == undef_kernel) {
+            fprintf(stderr, "Unknown kernel '%s'\n", optarg);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case 'K':
+         kernel_power = atof(optarg);
+         if (kernel_power <= 0.0) {
+            fprintf(stderr, "Kernel power must be a positive number (got %f)\n",
+                    kernel_power);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case 'G':
+         kernel_sigma = atof(optarg);
+         if (kernel_sigma <= 0.0) {
+            fprintf(stderr, "Kernel sigma must be a positive number (got %f)\n",
+                    kernel_sigma);
+            exit(EXIT_FAILURE);
+         }
+         break;
       case 'q':
          time_min = atof(optarg);
          break;
       case 'Q':
          time_max = atof(optarg);
          break;
+      case 'c':
+         scatter = 1;
+         break;
+      case 'R':
+         running_sum = 1;
+         break;
+      case 'B':
+         memory_budget = (size_t) (atof(optarg) * 1024 * 1024);
+         if (memory_budget == 0) {
+            fprintf(stderr, "The memory budget must be positive\n");
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case 'j':
+         time_step = atof(optarg);
+         if (time_step <= 0.0) {
+            fprintf(stderr, "Time step must be a positive number (got %f)\n",
+                    time_step);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case 'z':
+         first_new_observation = strtoull(optarg, NULL, 0);
+         updating_image = 1;
+         break;
+      case 'n':
+         number_time_bins = atoi(optarg);
+         if (number_time_bins <= 0) {
+            fprintf(stderr,
+                    "Number of time bins must be a positive integer (got %d)\n",
+                    number_time_bins);
+            exit(EXIT_FAILURE);
+         }
+         break;
 
       // General
       case '+':
          verbosity++;
          break;
+      case 'Y':
+         save_optarg_string(metrics_filename);
+         break;
       case '?':
          help(argv[0]);
          return EXIT_SUCCESS;
@@ -494,9 +1040,10 @@ int main(int argc, char **argv) {
    printf("generating image: %d\n", generating_image);
    printf("loading index: %d\n", loading_index);
    printf("saving index: %d\n", saving_index);
+   printf("updating image: %d\n", updating_image);
    printf("using default projection string: %d\n",
           using_default_projection_string);
-   printf("writing data: %d\n", write_data);
+   printf("number of variables: %d\n", number_variables);
    printf("writing lats: %d\n", write_lats);
    printf("writing lons: %d\n", write_lons);
    #endif
@@ -525,43 +1072,270 @@ int main(int argc, char **argv) {
    }
 
    if (generating_image) {
-      if (input_data_filename == NULL || output_data_filename == NULL) {
+      int outputs_complete = (number_variables > 0);
+      for (int v=0; v<number_variables; v++) {
+         if (variables[v].input_filename == NULL ||
+             (variables[v].output_filename == NULL &&
+              variables[v].number_statistics == 0)) {
+            outputs_complete = 0;
+         }
+      }
+      if (!outputs_complete) {
          fprintf( stderr,
             "When generating an image, you must provide --input-data and "\
-            "--output-data\nSee --help for more information.");
+            "--output-data (for each --input-data)\nSee --help for more "\
+            "information.");
          return EXIT_FAILURE;
       }
    }
 
-   // Validate coded/non-coded functions/data types
-   if (!output_dtype_set) {
-      output_dtype = input_dtype;
+   // Apply default dtypes, and validate coded/non-coded functions/data types
+   for (int v=0; v<number_variables; v++) {
+      variable_options *variable = &variables[v];
+      if (!variable->input_dtype_set) {
+         variable->input_dtype = input_dtype;
+      }
+      if (!variable->output_dtype_set) {
+         variable->output_dtype = (output_dtype_set) ? output_dtype :
+                                  variable->input_dtype;
+      }
+
+      if (variable->output_filename != NULL) {
+         if (selected_reduction_function.data_style == coded) {
+            // Input and output dtype must be the same and coded
+            if (variable->input_dtype.data_style != coded ||
+                variable->output_dtype.data_style != coded ||
+                !dtype_equal(variable->input_dtype, variable->output_dtype)) {
+               fprintf( stderr,
+                  "When using a coded mapping function, input and output dtype "\
+                  "must be the same, and of coded style\n");
+               return EXIT_FAILURE;
+            }
+         } else if (selected_reduction_function.data_style == numeric) {
+            if (variable->input_dtype.data_style != numeric ||
+                variable->output_dtype.data_style != numeric) {
+               fprintf( stderr,
+                  "When using a numeric mapping function, input and output dtype "\
+                  "must be numeric\n");
+               return EXIT_FAILURE;
+            }
+         }
+      }
+
+      if (variable->number_statistics > 0) {
+         if (variable->input_dtype.data_style != numeric ||
+             variable->output_dtype.data_style != numeric) {
+            fprintf( stderr,
+               "When storing statistics, input and output dtype must be "\
+               "numeric\n");
+            return EXIT_FAILURE;
+         }
+      }
    }
-   if (selected_reduction_function.data_style == coded) {
-      // Input and output dtype must be the same and coded
-      if (input_dtype.data_style != coded || output_dtype.data_style !=
-          coded || !dtype_equal(input_dtype, output_dtype)) {
-         fprintf( stderr,
-            "When using a coded mapping function, input and output dtype must "\
-            "be the same, and of coded style\n");
+
+   // Validate the reductions for scatter gridding
+   if (scatter) {
+      for (int v=0; v<number_variables; v++) {
+         if (variables[v].output_filename != NULL &&
+             !scatter_reduction_supported(selected_reduction_function)) {
+            fprintf(stderr,
+                    "The %s reduction function cannot be used with --scatter\n",
+                    selected_reduction_function.name);
+            return EXIT_FAILURE;
+         }
+         for (int i=0; i<variables[v].number_statistics; i++) {
+            if (!scatter_statistic_supported(variables[v].statistics[i])) {
+               fprintf(stderr,
+                       "Only the count, sum, mean, min and max statistics can "\
+                       "be used with --scatter\n");
+               return EXIT_FAILURE;
+            }
+         }
+      }
+   }
+
+   // Validate the reductions for running sum gridding
+   if (running_sum) {
+      if (scatter) {
+         fprintf(stderr, "--scatter and --running-sums cannot be combined\n");
          return EXIT_FAILURE;
       }
-   } else if (selected_reduction_function.data_style == numeric) {
-      if (input_dtype.data_style != numeric || output_dtype.data_style !=
-          numeric) {
-         fprintf( stderr,
-            "When using a numeric mapping function, input and output dtype must"\
-            "be numeric\n");
+      for (int v=0; v<number_variables; v++) {
+         if (variables[v].output_filename != NULL &&
+             !running_sum_reduction_supported(selected_reduction_function)) {
+            fprintf(stderr,
+                    "The %s reduction function cannot be used with "\
+                    "--running-sums\n", selected_reduction_function.name);
+            return EXIT_FAILURE;
+         }
+         for (int i=0; i<variables[v].number_statistics; i++) {
+            if (!running_sum_statistic_supported(variables[v].statistics[i])) {
+               fprintf(stderr,
+                       "Only the count, sum and mean statistics can be used "\
+                       "with --running-sums\n");
+               return EXIT_FAILURE;
+            }
+         }
+      }
+   }
+
+   // Tiled gridding replaces the standard gridding engine, and writes the
+   // outputs without mapping them
+   if (memory_budget > 0) {
+      if (scatter || running_sum) {
+         fprintf(stderr,
+                 "--memory-budget cannot be combined with --scatter or "\
+                 "--running-sums\n");
+         return EXIT_FAILURE;
+      }
+      if (coordinate_cache_directory != NULL) {
+         fprintf(stderr,
+                 "--memory-budget cannot be combined with "\
+                 "--coordinate-cache\n");
          return EXIT_FAILURE;
       }
    }
 
-   // Set horizontal and vertical resolutions to default values if not set
-   if (horizontal_resolution == 0.0) {
-      horizontal_resolution = WGS84_EQUATORIAL_CIRCUMFERENCE / (float) width;
+   // Validate weights and QA options
+   if (strncmp(selected_reduction_function.name, "input_weighted_", 15) == 0 &&
+       input_weights_filename == NULL) {
+      fprintf(stderr,
+              "The %s reduction function requires --input-weights\n",
+              selected_reduction_function.name);
+      return EXIT_FAILURE;
    }
-   if (vertical_resolution == 0.0) {
-      vertical_resolution = WGS84_POLAR_CIRCUMFERENCE / (2.0 * (float) height);
+   if (weights_dtype.data_style != numeric || qa_dtype.data_style != numeric) {
+      fprintf(stderr, "Weights and QA dtypes must be numeric\n");
+      return EXIT_FAILURE;
+   }
+   if (input_qa_filename != NULL && qa_reject_mask == 0 &&
+       qa_minimum == -INFINITY) {
+      fprintf(stderr,
+              "When using --input-qa, provide --qa-reject-mask and/or "\
+              "--qa-min\n");
+      return EXIT_FAILURE;
+   }
+
+   // Updating regrids part of a single existing grid in place
+   if (updating_image) {
+      if (scatter || running_sum || memory_budget > 0 || time_step > 0.0 ||
+          number_grids > 1) {
+         fprintf(stderr,
+                 "--update-from cannot be combined with --scatter, "\
+                 "--running-sums, --memory-budget, --time-step or --grid\n");
+         return EXIT_FAILURE;
+      }
+      if (write_lats || write_lons) {
+         fprintf(stderr,
+                 "Latitudes and longitudes do not change when updating, so "\
+                 "--output-lats and\n--output-lons cannot be combined with "\
+                 "--update-from\n");
+         return EXIT_FAILURE;
+      }
+   }
+
+   // The query diagnostics repeat the query of each cell, which only the
+   // standard gridding engine makes
+   int diagnosing = (diag_visited_filename != NULL ||
+                     diag_leaves_filename != NULL ||
+                     diag_hits_filename != NULL);
+   if (diagnosing && (scatter || running_sum || memory_budget > 0 ||
+                      updating_image || pyramid_levels > 0)) {
+      fprintf(stderr,
+              "--diag-visited, --diag-leaves and --diag-hits cannot be "\
+              "combined with --scatter,\n--running-sums, --memory-budget, "\
+              "--update-from or --pyramid-levels\n");
+      return EXIT_FAILURE;
+   }
+
+   // Time bins start at the earliest time, and the grid spans them all
+   if (number_time_bins > 0 && time_step == 0.0) {
+      fprintf(stderr, "--time-bins requires --time-step\n");
+      return EXIT_FAILURE;
+   }
+   if (time_step > 0.0) {
+      if (!isfinite(time_min)) {
+         fprintf(stderr, "--time-step requires --time-min\n");
+         return EXIT_FAILURE;
+      }
+      if (number_time_bins == 0) {
+         if (!isfinite(time_max) || time_max <= time_min) {
+            fprintf(stderr,
+                    "--time-step requires --time-bins, or a --time-max after "\
+                    "--time-min\n");
+            return EXIT_FAILURE;
+         }
+         number_time_bins = (int) ceilf((time_max - time_min) / time_step);
+      }
+      time_max = time_min + number_time_bins * time_step;
+      if (scatter || running_sum || memory_budget > 0) {
+         fprintf(stderr,
+                 "--time-step cannot be combined with --scatter, "\
+                 "--running-sums or --memory-budget\n");
+         return EXIT_FAILURE;
+      }
+   } else {
+      number_time_bins = 1;
+   }
+
+   // Only the standard gridding engine grids several outputs from one pass
+   // over the index
+   if (number_grids > 1) {
+      if (scatter || running_sum || memory_budget > 0) {
+         fprintf(stderr,
+                 "--grid cannot be combined with --scatter, --running-sums "\
+                 "or --memory-budget\n");
+         return EXIT_FAILURE;
+      }
+
+      // One kernel table is shared by every grid, so distances must be
+      // measured in the same projection
+      if (strcmp(selected_reduction_function.name, "kernel_mean") == 0) {
+         for (int g=1; g<number_grids; g++) {
+            if (grids[g].projection_string != NULL) {
+               fprintf(stderr,
+                       "The kernel_mean reduction function requires every "\
+                       "--grid to use the projection of the index\n");
+               return EXIT_FAILURE;
+            }
+         }
+      }
+   }
+
+   // The levels of a pyramid are overviews of a single grid, built together
+   // by the pyramid gridding engine
+   if (pyramid_levels > 0) {
+      if (number_grids > 1 || scatter || running_sum || memory_budget > 0 ||
+          time_step > 0.0 || updating_image) {
+         fprintf(stderr,
+                 "--pyramid-levels cannot be combined with --grid, "\
+                 "--scatter, --running-sums,\n--memory-budget, --time-step "\
+                 "or --update-from\n");
+         return EXIT_FAILURE;
+      }
+      for (int level=1; level<=pyramid_levels; level++) {
+         grid_options *overview = add_grid(&grids, &number_grids);
+         overview->overview_level = level;
+         overview->suffix = malloc(24);
+         if (overview->suffix == NULL) {
+            fprintf(stderr, "Failed to allocate space for a grid suffix\n");
+            return EXIT_FAILURE;
+         }
+         snprintf(overview->suffix, 24, "level%d", level);
+      }
+   }
+
+   // Set horizontal and vertical resolutions to default values if not set
+   for (int g=0; g<number_grids; g++) {
+      grid_options *output_grid = &grids[g];
+      if (output_grid->horizontal_resolution == 0.0) {
+         output_grid->horizontal_resolution =
+            WGS84_EQUATORIAL_CIRCUMFERENCE / (float) output_grid->width;
+      }
+      if (output_grid->vertical_resolution == 0.0) {
+         output_grid->vertical_resolution =
+            WGS84_POLAR_CIRCUMFERENCE / (2.0 * (float) output_grid->height);
+      }
    }
 
    /*****************************************
@@ -569,6 +1343,7 @@ int main(int argc, char **argv) {
      ****************************************/
 
    spatial_index *data_index = NULL;
+   uint64_t index_start_time = monotonic_nanoseconds();
 
    if (loading_index) {
       // Read from disk
@@ -581,6 +1356,8 @@ int main(int argc, char **argv) {
       }
       data_index = read_kdtree_index_from_file(input_index_file);
       fclose(input_index_file);
+      metrics.phase_nanoseconds[phase_index] =
+         monotonic_nanoseconds() - index_start_time;
    } else {
       // Generate the index in memory
 
@@ -601,18 +1378,33 @@ int main(int argc, char **argv) {
          return EXIT_FAILURE;
       }
 
-      // Build the index (kdtree is currently hardcoded)
+      // Time the reading and projection of the coordinates apart from the
+      // building of the index
+      reader = get_timed_coordinate_reader(
+         reader, &metrics.phase_nanoseconds[phase_ingest]);
+
+      // Build the index (kdtree is currently hardcoded). Scatter and running
+      // sum gridding visit each observation once, so unless the index is to
+      // be saved, the observations are just read into a list.
       if (verbosity > 0) printf("Building indices\n");
-      time_t index_start_time = time(NULL);
-      data_index = generate_kdtree_index_from_coordinate_reader(reader);
+      if ((scatter || running_sum) && !saving_index) {
+         data_index = generate_observation_list_from_coordinate_reader(reader);
+      } else {
+         data_index = generate_kdtree_index_from_coordinate_reader(reader);
+      }
       if (!data_index) {
          fprintf(stderr, "Failed to build index\n");
          return EXIT_FAILURE;
       }
-      time_t index_end_time = time(NULL);
+      uint64_t index_end_time = monotonic_nanoseconds();
+      metrics.phase_nanoseconds[phase_index] =
+         index_end_time - index_start_time -
+         metrics.phase_nanoseconds[phase_ingest];
       if (verbosity >
-          0) printf("Building index took %d seconds\n",
-                    (int) (index_end_time - index_start_time));
+          0) printf("Building index took %.3f seconds (%.3f reading "\
+                    "coordinates)\n",
+                    (index_end_time - index_start_time) / 1e9,
+                    metrics.phase_nanoseconds[phase_ingest] / 1e9);
 
       // Get rid of the coordinate reader - no longer needed
       reader->free(reader);
@@ -630,107 +1422,529 @@ int main(int argc, char **argv) {
      ****************************************/
 
    if (generating_image) {
-      // Calculate file sizes from provided information
-      unsigned int input_data_number_bytes = data_index->num_observations *
-                                             input_dtype.size;
-      unsigned int output_data_number_bytes = width * height *
-                                              output_dtype.size;
-      unsigned int output_geo_number_bytes = width * height * sizeof(float32_t);
+      // With a memory budget, the output files are written a band at a time
+      // rather than mapped, and when updating the existing files are mapped
+      memory_mapped_file *(*open_output_file)(char *, size_t) =
+         (memory_budget > 0) ? &open_unmapped_output_file :
+         (updating_image) ? &open_memory_mapped_existing_output_file :
+         &open_memory_mapped_output_file;
+      if (updating_image &&
+          first_new_observation > data_index->num_observations) {
+         fprintf(stderr,
+                 "--update-from %zu is beyond the %zu observations of the "\
+                 "index\n", first_new_observation,
+                 data_index->num_observations);
+         return EXIT_FAILURE;
+      }
 
-      memory_mapped_file *data_input_file = NULL, *data_output_file = NULL,
-      *latitude_output_file = NULL, *longitude_output_file = NULL;
+      memory_mapped_file *weights_file = NULL, *qa_file = NULL;
 
-      // Setup input and output specs, and open files
+      // Setup the input spec, and open the input files
       input_spec in;
-      in.input_dtype = input_dtype;
+      in.number_data_inputs = number_variables;
       in.coordinate_index = data_index;
-
-      output_spec out;
-      out.output_dtype = output_dtype;
-      out.grid_spec =
-         initialise_grid(width, height, vertical_resolution,
-                         horizontal_resolution,
-                         vertical_sampling, horizontal_sampling, central_x,
-                         central_y,
-                         data_index->input_projector);
-      if (out.grid_spec == NULL) {
-         fprintf(stderr, "Failed to initialise output grid\n");
+      in.data_inputs = calloc(number_variables, sizeof(char *));
+      in.input_dtypes = calloc(number_variables, sizeof(dtype));
+      in.qa = NULL;
+      in.valid = NULL;
+      in.metrics = (metrics_filename != NULL) ? &metrics : NULL;
+      output_spec *outs = calloc((size_t) number_grids * number_time_bins,
+                                 sizeof(output_spec));
+      if (in.data_inputs == NULL || in.input_dtypes == NULL || outs == NULL) {
+         fprintf(stderr, "Failed to allocate space for input/output specs\n");
          return EXIT_FAILURE;
       }
-      set_time_constraints(out.grid_spec, time_min, time_max);
 
-      if (write_data) {
-         data_input_file = open_memory_mapped_input_file(
-            input_data_filename, input_data_number_bytes);
-         data_output_file = open_memory_mapped_output_file(
-            output_data_filename, output_data_number_bytes);
+      for (int v=0; v<number_variables; v++) {
+         variable_options *variable = &variables[v];
+         size_t input_data_number_bytes = data_index->num_observations *
+                                          variable->input_dtype.size;
 
-         in.data_input = data_input_file->memory_mapped_data;
-         out.data_output = data_output_file->memory_mapped_data;
-      } else {
-         in.data_input = NULL;
-         out.data_output = NULL;
+         variable->input_file = open_memory_mapped_input_file(
+            variable->input_filename, input_data_number_bytes);
+         in.data_inputs[v] = variable->input_file->memory_mapped_data;
+         in.input_dtypes[v] = variable->input_dtype;
       }
 
-      if (write_lats) {
-         latitude_output_file = open_memory_mapped_output_file(
-            output_lat_filename, output_geo_number_bytes);
-         out.lats_output =
-            (float32_t *) latitude_output_file->memory_mapped_data;
-      } else {
-         out.lats_output = NULL;
+      // Setup an output spec for each time bin of each grid, and open its
+      // output files
+      for (int g=0; g<number_grids; g++) {
+         grid_options *output_grid = &grids[g];
+         size_t number_outputs = (size_t) number_time_bins * number_variables;
+         output_grid->output_files = calloc(number_outputs,
+                                            sizeof(memory_mapped_file *));
+         output_grid->statistic_files = calloc(number_outputs,
+                                               sizeof(memory_mapped_file **));
+         if (output_grid->output_files == NULL ||
+             output_grid->statistic_files == NULL) {
+            fprintf(stderr,
+                    "Failed to allocate space for input/output specs\n");
+            return EXIT_FAILURE;
+         }
+
+         // A grid in another projection is gridded by re-projecting its
+         // sampling boxes into the projection of the index
+         projector *grid_projector = data_index->input_projector;
+         if (output_grid->projection_string != NULL) {
+            output_grid->grid_projector = get_proj_projector_from_string(
+               output_grid->projection_string);
+            if (output_grid->grid_projector == NULL) {
+               fprintf(stderr, "Could not initialize projector for grid %s\n",
+                       output_grid->suffix);
+               return EXIT_FAILURE;
+            }
+            grid_projector = output_grid->grid_projector;
+         }
+
+         grid *grid_spec;
+         if (output_grid->overview_level > 0) {
+            grid_spec = initialise_overview_grid(outs[0].grid_spec,
+                                                 output_grid->overview_level);
+            output_grid->width = grid_spec->width;
+            output_grid->height = grid_spec->height;
+         } else {
+            grid_spec = initialise_grid(output_grid->width,
+                                        output_grid->height,
+                                        output_grid->vertical_resolution,
+                                        output_grid->horizontal_resolution,
+                                        output_grid->vertical_sampling,
+                                        output_grid->horizontal_sampling,
+                                        output_grid->central_x,
+                                        output_grid->central_y,
+                                        grid_projector);
+         }
+         if (grid_spec == NULL) {
+            fprintf(stderr, "Failed to initialise output grid\n");
+            return EXIT_FAILURE;
+         }
+         set_time_constraints(grid_spec, time_min, time_max);
+
+         // Calculate file sizes from provided information
+         size_t number_cells = (size_t) output_grid->width *
+                               output_grid->height;
+         size_t output_geo_number_bytes = number_cells * sizeof(float32_t);
+
+         for (int b=0; b<number_time_bins; b++) {
+            output_spec *out = &outs[g * number_time_bins + b];
+            int time_bin = (time_step > 0.0) ? b : -1;
+            out->grid_spec = grid_spec;
+            out->data_outputs = calloc(number_variables, sizeof(char *));
+            out->output_dtypes = calloc(number_variables, sizeof(dtype));
+            out->statistic_outputs = calloc(number_variables,
+                                            sizeof(statistic_output *));
+            out->number_statistic_outputs = calloc(number_variables,
+                                                   sizeof(int));
+            if (out->data_outputs == NULL || out->output_dtypes == NULL ||
+                out->statistic_outputs == NULL ||
+                out->number_statistic_outputs == NULL) {
+               fprintf(stderr,
+                       "Failed to allocate space for input/output specs\n");
+               return EXIT_FAILURE;
+            }
+
+            for (int v=0; v<number_variables; v++) {
+               variable_options *variable = &variables[v];
+               size_t output_data_number_bytes = number_cells *
+                                                 variable->output_dtype.size;
+               size_t o = (size_t) b * number_variables + v;
+
+               out->output_dtypes[v] = variable->output_dtype;
+               if (variable->output_filename != NULL) {
+                  output_grid->output_files[o] = open_grid_output_file(
+                     output_grid, time_bin, variable->output_filename,
+                     output_data_number_bytes, open_output_file);
+                  out->data_outputs[v] =
+                     output_grid->output_files[o]->memory_mapped_data;
+               }
+
+               out->number_statistic_outputs[v] = variable->number_statistics;
+               if (variable->number_statistics > 0) {
+                  out->statistic_outputs[v] = calloc(
+                     variable->number_statistics, sizeof(statistic_output));
+                  output_grid->statistic_files[o] = calloc(
+                     variable->number_statistics,
+                     sizeof(memory_mapped_file *));
+                  if (out->statistic_outputs[v] == NULL ||
+                      output_grid->statistic_files[o] == NULL) {
+                     fprintf(stderr,
+                             "Failed to allocate space for the statistic "\
+                             "outputs\n");
+                     return EXIT_FAILURE;
+                  }
+               }
+               for (int i=0; i<variable->number_statistics; i++) {
+                  output_grid->statistic_files[o][i] = open_grid_output_file(
+                     output_grid, time_bin, variable->statistic_filenames[i],
+                     output_data_number_bytes, open_output_file);
+                  out->statistic_outputs[v][i].stat = variable->statistics[i];
+                  out->statistic_outputs[v][i].data_output =
+                     output_grid->statistic_files[o][i]->memory_mapped_data;
+                  out->statistic_outputs[v][i].output_dtype =
+                     variable->output_dtype;
+               }
+            }
+         }
+
+         // The latitudes and longitudes are shared by every time bin, and
+         // stored by the first
+         output_spec *out = &outs[g * number_time_bins];
+         if (write_lats) {
+            output_grid->latitude_file = open_grid_output_file(
+               output_grid, -1, output_lat_filename, output_geo_number_bytes,
+               open_output_file);
+            out->lats_output =
+               (float32_t *) output_grid->latitude_file->memory_mapped_data;
+         }
+
+         if (write_lons) {
+            output_grid->longitude_file = open_grid_output_file(
+               output_grid, -1, output_lon_filename, output_geo_number_bytes,
+               open_output_file);
+            out->lons_output =
+               (float32_t *) output_grid->longitude_file->memory_mapped_data;
+         }
+
+         // The query diagnostics are shared by every time bin (each cell is
+         // queried once), and stored by the first
+         size_t diagnostic_number_bytes = number_cells * sizeof(uint32_t);
+         if (diag_visited_filename != NULL) {
+            output_grid->nodes_visited_file = open_grid_output_file(
+               output_grid, -1, diag_visited_filename,
+               diagnostic_number_bytes, open_output_file);
+            out->nodes_visited_output =
+               (uint32_t *) output_grid->nodes_visited_file->memory_mapped_data;
+         }
+         if (diag_leaves_filename != NULL) {
+            output_grid->leaves_tested_file = open_grid_output_file(
+               output_grid, -1, diag_leaves_filename,
+               diagnostic_number_bytes, open_output_file);
+            out->leaves_tested_output =
+               (uint32_t *) output_grid->leaves_tested_file->memory_mapped_data;
+         }
+         if (diag_hits_filename != NULL) {
+            output_grid->hits_file = open_grid_output_file(
+               output_grid, -1, diag_hits_filename, diagnostic_number_bytes,
+               open_output_file);
+            out->hits_output =
+               (uint32_t *) output_grid->hits_file->memory_mapped_data;
+         }
+
+         // Fill the latitude and longitude outputs from the cache where it
+         // holds them, so that only the others are calculated while gridding
+         if (coordinate_cache_directory != NULL) {
+            if (write_lats) {
+               output_grid->lats_cached = load_cached_coordinates(
+                  coordinate_cache_directory, out->grid_spec, "lats",
+                  out->lats_output);
+            }
+            if (write_lons) {
+               output_grid->lons_cached = load_cached_coordinates(
+                  coordinate_cache_directory, out->grid_spec, "lons",
+                  out->lons_output);
+            }
+            if (output_grid->lats_cached) out->lats_output = NULL;
+            if (output_grid->lons_cached) out->lons_output = NULL;
+            if (verbosity > 0 &&
+                (output_grid->lats_cached || output_grid->lons_cached)) {
+               printf("Using cached coordinates from %s\n",
+                      coordinate_cache_directory);
+            }
+         }
       }
 
-      if (write_lons) {
-         longitude_output_file = open_memory_mapped_output_file(
-            output_lon_filename, output_geo_number_bytes);
-         out.lons_output =
-            (float32_t *) longitude_output_file->memory_mapped_data;
-      } else {
-         out.lons_output = NULL;
+      // Build (or load) the validity masks, and combine them into a mask of
+      // observations valid in any variable. Coded data has no fill value, so
+      // this only applies to numeric reductions.
+      if (using_validity_mask &&
+          selected_reduction_function.data_style == numeric) {
+         for (int v=0; v<number_variables; v++) {
+            validity_mask *mask = get_cached_validity_mask(
+               variables[v].input_filename, in.data_inputs[v],
+               variables[v].input_dtype, data_index->num_observations,
+               input_fill_value, verbosity);
+            if (in.valid == NULL) {
+               in.valid = mask;
+            } else {
+               in.valid->merge(in.valid, mask);
+               mask->free(mask);
+            }
+         }
+         if (verbosity > 0) {
+            printf("%zu of %zu observations are valid\n",
+                   in.valid->number_valid, in.valid->num_observations);
+         }
+
+         // If nothing can be skipped, checking the mask would be wasted work
+         if (in.valid->number_valid == in.valid->num_observations) {
+            in.valid->free(in.valid);
+            in.valid = NULL;
+         }
+      }
+
+      // Open the QA file, and set up the filter
+      qa_filter filter;
+      if (input_qa_filename != NULL) {
+         qa_file = open_memory_mapped_input_file(
+            input_qa_filename, data_index->num_observations * qa_dtype.size);
+         filter.qa_data = qa_file->memory_mapped_data;
+         filter.qa_dtype = qa_dtype;
+         filter.reject_mask = qa_reject_mask;
+         filter.minimum = qa_minimum;
+         in.qa = &filter;
       }
 
       // Setup reduction options
       reduction_attrs r_attrs;
       r_attrs.input_fill_value = input_fill_value;
       r_attrs.output_fill_value = output_fill_value;
+      r_attrs.percentile = percentile;
+      r_attrs.percentile_rank_error = percentile_rank_error;
+      r_attrs.kernel = NULL;
+      r_attrs.input_weights = NULL;
+      r_attrs.input_weights_dtype = weights_dtype;
+      if (input_weights_filename != NULL) {
+         weights_file = open_memory_mapped_input_file(
+            input_weights_filename,
+            data_index->num_observations * weights_dtype.size);
+         r_attrs.input_weights = weights_file->memory_mapped_data;
+      }
+      if (strcmp(selected_reduction_function.name, "kernel_mean") == 0) {
+         // Tabulate the kernel out to the corners of the largest search box
+         float x_offset = 0.0, y_offset = 0.0;
+         for (int g=0; g<number_grids; g++) {
+            grid *grid_spec = outs[g].grid_spec;
+            if (grid_spec->horizontal_sampling_offset > x_offset) {
+               x_offset = grid_spec->horizontal_sampling_offset;
+            }
+            if (grid_spec->vertical_sampling_offset > y_offset) {
+               y_offset = grid_spec->vertical_sampling_offset;
+            }
+         }
+         if (kernel_sigma == 0.0) {
+            float first_x_offset =
+               outs[0].grid_spec->horizontal_sampling_offset;
+            float first_y_offset = outs[0].grid_spec->vertical_sampling_offset;
+            kernel_sigma = (first_x_offset < first_y_offset) ?
+                           first_x_offset : first_y_offset;
+         }
+         r_attrs.kernel = kernel_table_init(
+            kernel, (kernel == kernel_idw) ? kernel_power : kernel_sigma,
+            x_offset * x_offset + y_offset * y_offset);
+      }
 
       // Perform gridding
       if (verbosity > 0) printf("Gridding\n");
-      time_t gridding_start_time = time(NULL);
-      perform_gridding(in, out, selected_reduction_function, &r_attrs,
-                       verbosity);
-      time_t gridding_end_time = time(NULL);
+      uint64_t gridding_start_time = monotonic_nanoseconds();
+      if (scatter) {
+         perform_scatter_gridding(in, outs[0], selected_reduction_function,
+                                  &r_attrs, verbosity);
+      } else if (running_sum) {
+         perform_running_sum_gridding(in, outs[0],
+                                      selected_reduction_function,
+                                      &r_attrs, verbosity);
+      } else if (memory_budget > 0) {
+         // Pass the files which each output is written to
+         output_files files;
+         files.data_outputs = calloc(number_variables, sizeof(int));
+         files.statistic_outputs = calloc(number_variables, sizeof(int *));
+         if (files.data_outputs == NULL || files.statistic_outputs == NULL) {
+            fprintf(stderr, "Failed to allocate space for the output files\n");
+            return EXIT_FAILURE;
+         }
+         for (int v=0; v<number_variables; v++) {
+            variable_options *variable = &variables[v];
+            files.data_outputs[v] = (grids[0].output_files[v] != NULL) ?
+                                    grids[0].output_files[v]->file_descriptor :
+                                    -1;
+            if (variable->number_statistics > 0) {
+               files.statistic_outputs[v] = calloc(variable->number_statistics,
+                                                   sizeof(int));
+               if (files.statistic_outputs[v] == NULL) {
+                  fprintf(stderr,
+                          "Failed to allocate space for the output files\n");
+                  return EXIT_FAILURE;
+               }
+            }
+            for (int i=0; i<variable->number_statistics; i++) {
+               files.statistic_outputs[v][i] =
+                  grids[0].statistic_files[v][i]->file_descriptor;
+            }
+         }
+         files.lats_output = write_lats ?
+                             grids[0].latitude_file->file_descriptor : -1;
+         files.lons_output = write_lons ?
+                             grids[0].longitude_file->file_descriptor : -1;
+
+         perform_tiled_gridding(in, outs[0], files,
+                                selected_reduction_function, &r_attrs,
+                                memory_budget, verbosity);
+
+         for (int v=0; v<number_variables; v++) {
+            free(files.statistic_outputs[v]);
+         }
+         free(files.data_outputs);
+         free(files.statistic_outputs);
+      } else if (updating_image) {
+         perform_incremental_gridding(in, outs[0], first_new_observation,
+                                      selected_reduction_function, &r_attrs,
+                                      verbosity);
+      } else if (pyramid_levels > 0) {
+         perform_pyramid_gridding(in, outs, number_grids,
+                                  selected_reduction_function, &r_attrs,
+                                  verbosity);
+      } else if (time_step > 0.0) {
+         perform_time_binned_gridding(in, outs, number_grids,
+                                      number_time_bins, time_step,
+                                      selected_reduction_function, &r_attrs,
+                                      verbosity);
+      } else {
+         perform_multiple_gridding(in, outs, number_grids,
+                                   selected_reduction_function, &r_attrs,
+                                   verbosity);
+      }
+      uint64_t gridding_end_time = monotonic_nanoseconds();
+      metrics.phase_nanoseconds[phase_gridding] =
+         gridding_end_time - gridding_start_time;
       if (verbosity >
-          0) printf("Gridding took %d seconds\n",
-                    (int) (gridding_end_time - gridding_start_time));
+          0) printf("Gridding took %.3f seconds\n",
+                    (gridding_end_time - gridding_start_time) / 1e9);
+
+      // Cache the newly calculated latitudes and longitudes
+      if (coordinate_cache_directory != NULL) {
+         for (int g=0; g<number_grids; g++) {
+            output_spec *out = &outs[g * number_time_bins];
+            if (write_lats && !grids[g].lats_cached) {
+               save_cached_coordinates(coordinate_cache_directory,
+                                       out->grid_spec, "lats",
+                                       out->lats_output);
+            }
+            if (write_lons && !grids[g].lons_cached) {
+               save_cached_coordinates(coordinate_cache_directory,
+                                       out->grid_spec, "lons",
+                                       out->lons_output);
+            }
+         }
+      }
 
-      // Free the grid
-      out.grid_spec->free(out.grid_spec);
+      // Free the kernel
+      if (r_attrs.kernel != NULL) {
+         kernel_table_free(r_attrs.kernel);
+      }
 
       // Unmap and close files
-      if (write_data) {
-         data_input_file->close(data_input_file);
-         data_output_file->close(data_output_file);
+      for (int v=0; v<number_variables; v++) {
+         variable_options *variable = &variables[v];
+         variable->input_file->close(variable->input_file);
+      }
+      free(in.data_inputs);
+      free(in.input_dtypes);
+
+      // Free each grid and its outputs
+      for (int g=0; g<number_grids; g++) {
+         grid_options *output_grid = &grids[g];
+         outs[g * number_time_bins].grid_spec->free(
+            outs[g * number_time_bins].grid_spec);
+         if (output_grid->grid_projector != NULL) {
+            output_grid->grid_projector->free(output_grid->grid_projector);
+         }
+         for (int b=0; b<number_time_bins; b++) {
+            output_spec *out = &outs[g * number_time_bins + b];
+            for (int v=0; v<number_variables; v++) {
+               size_t o = (size_t) b * number_variables + v;
+               if (output_grid->output_files[o] != NULL) {
+                  output_grid->output_files[o]->close(
+                     output_grid->output_files[o]);
+               }
+               for (int i=0; i<variables[v].number_statistics; i++) {
+                  output_grid->statistic_files[o][i]->close(
+                     output_grid->statistic_files[o][i]);
+               }
+               free(output_grid->statistic_files[o]);
+               free(out->statistic_outputs[v]);
+            }
+            free(out->data_outputs);
+            free(out->output_dtypes);
+            free(out->statistic_outputs);
+            free(out->number_statistic_outputs);
+         }
+         free(output_grid->output_files);
+         free(output_grid->statistic_files);
+         if (write_lats) {
+            output_grid->latitude_file->close(output_grid->latitude_file);
+         }
+         if (write_lons) {
+            output_grid->longitude_file->close(output_grid->longitude_file);
+         }
+         if (output_grid->nodes_visited_file != NULL) {
+            output_grid->nodes_visited_file->close(
+               output_grid->nodes_visited_file);
+         }
+         if (output_grid->leaves_tested_file != NULL) {
+            output_grid->leaves_tested_file->close(
+               output_grid->leaves_tested_file);
+         }
+         if (output_grid->hits_file != NULL) {
+            output_grid->hits_file->close(output_grid->hits_file);
+         }
+      }
+      free(outs);
+      if (weights_file != NULL) {
+         weights_file->close(weights_file);
       }
-      if (write_lats) {
-         latitude_output_file->close(latitude_output_file);
+      if (qa_file != NULL) {
+         qa_file->close(qa_file);
       }
-      if (write_lons) {
-         longitude_output_file->close(longitude_output_file);
+      if (in.valid != NULL) {
+         in.valid->free(in.valid);
       }
    }
 
+   // Record the run for the job scheduler
+   if (metrics_filename != NULL) {
+      metrics.phase_nanoseconds[phase_total] =
+         monotonic_nanoseconds() - run_start_time;
+      metrics.observations = data_index->num_observations;
+      metrics.threads = omp_get_max_threads();
+      FILE *metrics_file = fopen(metrics_filename, "w");
+      if (metrics_file == NULL) {
+         fprintf(stderr, "Could not open metrics file %s (%s)\n",
+                 metrics_filename, strerror(errno));
+         return EXIT_FAILURE;
+      }
+      run_metrics_write(&metrics, metrics_file);
+      fclose(metrics_file);
+   }
+
    // Free option strings and working data
-   free(input_data_filename);
+   for (int v=0; v<number_variables; v++) {
+      free(variables[v].input_filename);
+      free(variables[v].output_filename);
+      for (int i=0; i<variables[v].number_statistics; i++) {
+         free(variables[v].statistic_filenames[i]);
+      }
+      free(variables[v].statistic_filenames);
+      free(variables[v].statistics);
+   }
+   free(variables);
+   for (int g=0; g<number_grids; g++) {
+      free(grids[g].suffix);
+      free(grids[g].projection_string);
+   }
+   free(grids);
    free(input_index_filename);
    free(input_lat_filename);
    free(input_lon_filename);
    free(input_time_filename);
-   free(output_data_filename);
+   free(input_weights_filename);
+   free(input_qa_filename);
    free(output_index_filename);
    free(output_lat_filename);
    free(output_lon_filename);
+   free(coordinate_cache_directory);
+   free(diag_visited_filename);
+   free(diag_leaves_filename);
+   free(diag_hits_filename);
+   free(metrics_filename);
    if (!using_default_projection_string) free(projection_string);
    data_index->free(data_index);
 
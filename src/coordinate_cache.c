@@ -0,0 +1,181 @@
+/**
+  * @file
+  *
+  * Implements a cache of the latitude and longitude rasters of output grids.
+  *
+  * Each raster is stored as a raw float32 file in the cache directory, named
+  *after a hash of everything which determines it: the size, resolution,
+  *sampling offsets and centre of the grid, and the serialised projector.
+  */
+
+// Define posix source macro to enable open_memstream
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "coordinate_cache.h"
+
+/** The initial value of a 64-bit FNV-1a hash. */
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+
+/** The multiplier of a 64-bit FNV-1a hash. */
+#define FNV_PRIME 1099511628211ULL
+
+/**
+  * Add some bytes to a 64-bit FNV-1a hash.
+  *
+  * @param hash The hash so far.
+  * @param data The bytes to add.
+  * @param length The number of bytes to add.
+  * @return The updated hash.
+  */
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+   const unsigned char *bytes = data;
+   for (size_t i=0; i<length; i++) {
+      hash ^= bytes[i];
+      hash *= FNV_PRIME;
+   }
+   return hash;
+}
+
+/**
+  * Generate the path of a cached raster.
+  *
+  * @param cache_directory The cache directory.
+  * @param grid_spec The grid.
+  * @param name The name of the raster (e.g. "lats").
+  * @return The path (to be freed by the caller).
+  */
+static char *cached_coordinates_path(char *cache_directory, grid *grid_spec,
+                                     char *name) {
+   // Hash each field separately, so that padding is never included
+   uint64_t hash = FNV_OFFSET_BASIS;
+   #define hash_field(field) \
+   hash = hash_bytes(hash, &grid_spec->field, sizeof(grid_spec->field))
+   hash_field(width);
+   hash_field(height);
+   hash_field(vertical_resolution);
+   hash_field(horizontal_resolution);
+   hash_field(vertical_sampling_offset);
+   hash_field(horizontal_sampling_offset);
+   hash_field(central_x);
+   hash_field(central_y);
+   #undef hash_field
+
+   // The serialised projector identifies the projection
+   char *projector_bytes = NULL;
+   size_t projector_length = 0;
+   FILE *projector_stream = open_memstream(&projector_bytes,
+                                           &projector_length);
+   if (projector_stream == NULL) {
+      fprintf(stderr, "Could not open a stream to serialise the projector\n");
+      exit(EXIT_FAILURE);
+   }
+   grid_spec->input_projector->serialize_to_file(grid_spec->input_projector,
+                                                 projector_stream);
+   fclose(projector_stream);
+   hash = hash_bytes(hash, projector_bytes, projector_length);
+   free(projector_bytes);
+
+   size_t path_length = strlen(cache_directory) + strlen(name) + 32;
+   char *path = malloc(path_length);
+   if (path == NULL) {
+      fprintf(stderr, "Could not allocate space for a cache path\n");
+      exit(EXIT_FAILURE);
+   }
+   snprintf(path, path_length, "%s/grid-%016" PRIx64 ".%s", cache_directory,
+            hash, name);
+   return path;
+}
+
+/**
+  * Fill a latitude or longitude output from the cache, if it holds a raster
+  *for the grid. As the cache is optional, a raster which cannot be read (or
+  *is not of the right size) is treated as missing, rather than as an error.
+  *
+  * @param cache_directory The cache directory.
+  * @param grid_spec The grid.
+  * @param name The name of the raster (e.g. "lats").
+  * @param output The output to fill (width * height values).
+  * @return 1 if the output was filled from the cache, 0 otherwise.
+  */
+int load_cached_coordinates(char *cache_directory, grid *grid_spec,
+                            char *name, float32_t *output) {
+   char *path = cached_coordinates_path(cache_directory, grid_spec, name);
+   size_t number_bytes = (size_t) grid_spec->width * grid_spec->height *
+                         sizeof(float32_t);
+
+   int cache_file = open(path, O_RDONLY);
+   free(path);
+   if (cache_file == -1) {
+      return 0;
+   }
+
+   // Only use a cached raster of exactly the right size (checking the file
+   // which was opened, which may have been replaced since it was named)
+   struct stat cached_stat;
+   if (fstat(cache_file, &cached_stat) != 0 ||
+       (size_t) cached_stat.st_size != number_bytes) {
+      close(cache_file);
+      return 0;
+   }
+
+   void *cached = mmap(0, number_bytes, PROT_READ, MAP_SHARED, cache_file, 0);
+   close(cache_file);
+   if (cached == MAP_FAILED) {
+      return 0;
+   }
+   memcpy(output, cached, number_bytes);
+   munmap(cached, number_bytes);
+   return 1;
+}
+
+/**
+  * Store a latitude or longitude raster in the cache. The raster is written to
+  *a temporary file which is then renamed, so that concurrent runs never see a
+  *partial raster. Failing to write to the cache is not fatal.
+  *
+  * @param cache_directory The cache directory.
+  * @param grid_spec The grid.
+  * @param name The name of the raster (e.g. "lats").
+  * @param coordinates The raster (width * height values).
+  */
+void save_cached_coordinates(char *cache_directory, grid *grid_spec,
+                             char *name, float32_t *coordinates) {
+   char *path = cached_coordinates_path(cache_directory, grid_spec, name);
+   size_t number_values = (size_t) grid_spec->width * grid_spec->height;
+
+   size_t temporary_length = strlen(path) + 32;
+   char *temporary_path = malloc(temporary_length);
+   if (temporary_path == NULL) {
+      fprintf(stderr, "Could not allocate space for a cache path\n");
+      exit(EXIT_FAILURE);
+   }
+   snprintf(temporary_path, temporary_length, "%s.%ld", path,
+            (long) getpid());
+
+   FILE *cache_file = fopen(temporary_path, "wb");
+   int written = 0;
+   if (cache_file != NULL) {
+      written = (fwrite(coordinates, sizeof(float32_t), number_values,
+                        cache_file) == number_values);
+      written = (fclose(cache_file) == 0) && written;
+   }
+   if (!written || rename(temporary_path, path) != 0) {
+      fprintf(stderr, "Could not cache %s in %s (%s)\n", name, path,
+              strerror(errno));
+      unlink(temporary_path);
+   }
+
+   free(temporary_path);
+   free(path);
+}
@@ -0,0 +1,19 @@
+/**
+  * @file
+  *
+  * Defines a cache of the latitude and longitude rasters of output grids, so
+  *that repeated runs on the same grid need not inverse project every cell.
+  */
+#ifndef HEADER_COORDINATE_CACHE
+#define HEADER_COORDINATE_CACHE
+
+#include "data_handling.h"
+#include "grid.h"
+
+// Function prototypes - implementations in coordinate_cache.c
+int load_cached_coordinates(char *cache_directory, grid *grid_spec,
+                            char *name, float32_t *output);
+void save_cached_coordinates(char *cache_directory, grid *grid_spec,
+                             char *name, float32_t *coordinates);
+
+#endif
@@ -6,6 +6,8 @@
 #ifndef  HEADER_COORDINATE_READER
 #define HEADER_COORDINATE_READER
 
+#include <stddef.h>
+
 #include "projector.h"
 
 /**
@@ -23,7 +25,7 @@ typedef struct coordinate_reader_s {
    void *internals;
 
    /** The total number of records available from this coordinate reader.*/
-   unsigned int num_records;
+   size_t num_records;
 
    /** The projector which this coordinate reader should use to project
     *spherical coordinates into X/Y space.*/
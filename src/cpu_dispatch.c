@@ -0,0 +1,44 @@
+/**
+  * @file
+  *
+  * Implements detection of the instruction set level of the running CPU.
+  */
+#include "cpu_dispatch.h"
+
+/**
+  * Determine the highest instruction set level supported by the running CPU,
+  *out of those which kernels are compiled for.
+  *
+  * This is cheap enough to call whenever a kernel is dispatched (the CPU
+  *features are detected once, when the program is loaded).
+  *
+  * @return The instruction set level selected for the multiversioned kernels.
+  */
+cpu_level cpu_dispatch_level(void) {
+   #ifdef CPU_DISPATCH
+   if (__builtin_cpu_supports("avx512f")) return cpu_level_avx512;
+   if (__builtin_cpu_supports("avx2")) return cpu_level_avx2;
+   return cpu_level_sse2;
+   #else
+   return cpu_level_generic;
+   #endif
+}
+
+/**
+  * Get the name of an instruction set level, for reporting.
+  *
+  * @param level The instruction set level.
+  * @return The name of the level (e.g. "avx2").
+  */
+char *cpu_level_name(cpu_level level) {
+   switch (level) {
+   case cpu_level_sse2:
+      return "sse2";
+   case cpu_level_avx2:
+      return "avx2";
+   case cpu_level_avx512:
+      return "avx512";
+   default:
+      return "generic";
+   }
+}
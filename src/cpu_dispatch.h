@@ -0,0 +1,45 @@
+/**
+  * @file
+  *
+  * Runtime selection of instruction set specific versions of the hot kernels.
+  *
+  * Caspian is compiled for a generic target, so that a single binary runs on
+  *every machine of a cluster. Kernels which benefit from wider vectors are
+  *marked with #MULTIVERSIONED, which compiles a copy of the kernel for each
+  *supported instruction set level; the copy matching the running CPU is chosen
+  *by the dynamic loader, using cpuid. Hand-written intrinsic paths are marked
+  *with the appropriate TARGET_ attribute and selected with cpu_dispatch_level.
+  */
+#ifndef HEADER_CPU_DISPATCH
+#define HEADER_CPU_DISPATCH
+
+/**
+  * Enumeration of the instruction set levels which kernels may be compiled
+  *for, in increasing order of capability.
+  */
+typedef enum {cpu_level_generic, cpu_level_sse2, cpu_level_avx2,
+              cpu_level_avx512} cpu_level;
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) &&\
+   defined(__linux__)
+/** Runtime dispatch is available (GCC function multiversioning on x86-64
+ *Linux). */
+#define CPU_DISPATCH
+
+/** Compile a function for each of AVX-512, AVX2 and the baseline (SSE2), with
+ *the version used chosen when the program is loaded. */
+#define MULTIVERSIONED \
+   __attribute__((target_clones("avx512f", "avx2", "default")))
+
+/** Compile a function for AVX2 (it must only be called when
+ *cpu_dispatch_level() >= cpu_level_avx2). */
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MULTIVERSIONED
+#endif
+
+// Function prototypes - implementation in cpu_dispatch.c
+cpu_level cpu_dispatch_level(void);
+char *cpu_level_name(cpu_level level);
+
+#endif
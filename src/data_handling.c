@@ -8,8 +8,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "cpu_dispatch.h"
 #include "data_handling.h"
 
+// Use AVX2 gathers for the bulk retrieval functions when the running CPU
+// supports them (and the working type is a double)
+#if defined(CPU_DISPATCH) && defined(SIXTYFOURBIT)
+#include <immintrin.h>
+#define GATHER_AVX2
+#endif
+
 /**
   * Get a single number from an array, formatted as the current working numeric
   *type
@@ -19,7 +27,7 @@
   * @return The number from the array, formatted according to
   *NUMERIC_WORKING_TYPE (normally a float or double)
   */
-NUMERIC_WORKING_TYPE numeric_get(void *data, dtype input_dtype, int index) {
+NUMERIC_WORKING_TYPE numeric_get(void *data, dtype input_dtype, size_t index) {
    switch (input_dtype.specifier) {
    case uint8:
       return (NUMERIC_WORKING_TYPE) ((uint8_t *) data)[index];
@@ -59,7 +67,7 @@ NUMERIC_WORKING_TYPE numeric_get(void *data, dtype input_dtype, int index) {
   * @param index Index of the desired storage position
   * @param data_item The number to be stored
   */
-void numeric_put(void *data, dtype output_dtype, int index,
+void numeric_put(void *data, dtype output_dtype, size_t index,
                  NUMERIC_WORKING_TYPE data_item) {
 
    // Shortcut macro - cast the data to the appropriate type and
@@ -110,6 +118,324 @@ void numeric_put(void *data, dtype output_dtype, int index,
    }
 }
 
+/**
+  * Store a contiguous span of numbers into an array (equivalent to calling
+  *numeric_put for each number, but with the dtype dispatch hoisted out of the
+  *loop so that the conversion can be vectorised).
+  * @param data Pointer to the memory array
+  * @param output_dtype The type of the memory array
+  * @param index Index of the storage position of the first number
+  * @param length The number of numbers to store
+  * @param data_items The numbers to be stored
+  */
+MULTIVERSIONED
+void numeric_put_span(void *data, dtype output_dtype, size_t index,
+                      unsigned int length, NUMERIC_WORKING_TYPE *data_items) {
+
+   // Shortcut macro - convert and store each number in an appropriately-cast
+   // array
+   #define put_span(type) \
+   for (unsigned int i = 0; i < length; i++) { \
+      ((type *) data)[index + i] = (type) data_items[i]; \
+   }
+
+   switch (output_dtype.specifier) {
+   case uint8:
+      put_span(uint8_t);
+      break;
+   case uint16:
+      put_span(uint16_t);
+      break;
+   case uint32:
+      put_span(uint32_t);
+      break;
+      #ifdef SIXTYFOURBIT
+   case uint64:
+      put_span(uint64_t);
+      break;
+      #endif
+   case int8:
+      put_span(int8_t);
+      break;
+   case int16:
+      put_span(int16_t);
+      break;
+   case int32:
+      put_span(int32_t);
+      break;
+      #ifdef SIXTYFOURBIT
+   case int64:
+      put_span(int64_t);
+      break;
+      #endif
+   case float32:
+      put_span(float32_t);
+      break;
+   case float64:
+      put_span(float64_t);
+      break;
+   default:
+      fprintf(stderr,
+              "Unknown dtype '%s' (this is probably a bug in Caspian).\n",
+              output_dtype.string);
+      exit(EXIT_FAILURE);
+   }
+}
+
+#ifdef GATHER_AVX2
+/**
+  * Permutations (in 32-bit lanes) which move the selected doubles of a 4-double
+  *vector to the front of the vector, indexed by the 4-bit selection mask.
+  */
+static const int left_pack_table[16][8] = {
+   {0, 0, 0, 0, 0, 0, 0, 0},
+   {0, 1, 0, 0, 0, 0, 0, 0},
+   {2, 3, 0, 0, 0, 0, 0, 0},
+   {0, 1, 2, 3, 0, 0, 0, 0},
+   {4, 5, 0, 0, 0, 0, 0, 0},
+   {0, 1, 4, 5, 0, 0, 0, 0},
+   {2, 3, 4, 5, 0, 0, 0, 0},
+   {0, 1, 2, 3, 4, 5, 0, 0},
+   {6, 7, 0, 0, 0, 0, 0, 0},
+   {0, 1, 6, 7, 0, 0, 0, 0},
+   {2, 3, 6, 7, 0, 0, 0, 0},
+   {0, 1, 2, 3, 6, 7, 0, 0},
+   {4, 5, 6, 7, 0, 0, 0, 0},
+   {0, 1, 4, 5, 6, 7, 0, 0},
+   {2, 3, 4, 5, 6, 7, 0, 0},
+   {0, 1, 2, 3, 4, 5, 6, 7}
+};
+
+/**
+  * Store 4 converted values, masking out fill values.
+  *
+  * If valid is NULL, the non-fill values are packed together and stored at
+  *output[position]; otherwise all 4 values are stored at output[position] and
+  *the validity of each is recorded in valid[position].
+  *
+  * @param values The 4 converted values.
+  * @param fill The fill value, broadcast to all 4 lanes.
+  * @param output The output array.
+  * @param valid The validity array (may be NULL).
+  * @param position The index in the output array to store at.
+  * @return The number of non-fill values.
+  */
+TARGET_AVX2
+static inline unsigned int store_four(__m256d values, __m256d fill,
+                                      NUMERIC_WORKING_TYPE *output,
+                                      char *valid, unsigned int position) {
+   // Unordered comparison, so that NaNs are kept as in numeric_get
+   int mask = _mm256_movemask_pd(_mm256_cmp_pd(values, fill, _CMP_NEQ_UQ));
+
+   if (valid == NULL) {
+      __m256i permutation =
+         _mm256_loadu_si256((__m256i *) left_pack_table[mask]);
+      values = _mm256_castps_pd(_mm256_permutevar8x32_ps(
+                                   _mm256_castpd_ps(values), permutation));
+      _mm256_storeu_pd(&output[position], values);
+   } else {
+      _mm256_storeu_pd(&output[position], values);
+      for (int k=0; k<4; k++) {
+         valid[position + k] = (mask >> k) & 1;
+      }
+   }
+   return __builtin_popcount(mask);
+}
+
+/**
+  * Vectorised bulk of gather, for the 32 and 64-bit types that can be gathered
+  *directly. Narrower types (and any remainder) are left for the scalar loops
+  *of gather.
+  *
+  * @param data Pointer to the memory array
+  * @param input_dtype The type of the memory array
+  * @param indices Indices of the desired numbers
+  * @param length The number of indices
+  * @param fill_value Numbers equal to this value are treated as missing
+  * @param output Array of at least length items to store the numbers in
+  * @param valid Array of at least length items to store the validity of each
+  *number in, or NULL to pack the non-fill numbers at the start of output
+  * @param written Incremented by the number of non-fill numbers gathered
+  * @return The number of indices processed
+  */
+TARGET_AVX2
+static unsigned int gather_avx2(void *data, dtype input_dtype, size_t *indices,
+                                unsigned int length,
+                                NUMERIC_WORKING_TYPE fill_value,
+                                NUMERIC_WORKING_TYPE *output, char *valid,
+                                unsigned int *written) {
+   unsigned int i = 0;
+
+   #define position(offset) ((valid == NULL) ? *written : i + offset)
+   __m256d fill = _mm256_set1_pd(fill_value);
+   switch (input_dtype.specifier) {
+   case float32:
+      for (; i + 4 <= length; i += 4) {
+         __m256i vindex = _mm256_loadu_si256((__m256i *) &indices[i]);
+         *written += store_four(
+            _mm256_cvtps_pd(_mm256_i64gather_ps((float32_t *) data, vindex, 4)),
+            fill, output, valid, position(0));
+      }
+      break;
+   case int32:
+      for (; i + 4 <= length; i += 4) {
+         __m256i vindex = _mm256_loadu_si256((__m256i *) &indices[i]);
+         *written += store_four(
+            _mm256_cvtepi32_pd(_mm256_i64gather_epi32((int *) data, vindex, 4)),
+            fill, output, valid, position(0));
+      }
+      break;
+   case float64:
+      for (; i + 4 <= length; i += 4) {
+         __m256i vindex = _mm256_loadu_si256((__m256i *) &indices[i]);
+         *written += store_four(
+            _mm256_i64gather_pd((float64_t *) data, vindex, 8), fill, output,
+            valid, position(0));
+      }
+      break;
+   default:
+      break;
+   }
+   #undef position
+   return i;
+}
+#endif
+
+/**
+  * Implementation of numeric_gather and numeric_gather_masked.
+  *
+  * @param data Pointer to the memory array
+  * @param input_dtype The type of the memory array
+  * @param indices Indices of the desired numbers
+  * @param length The number of indices
+  * @param fill_value Numbers equal to this value are treated as missing
+  * @param output Array of at least length items to store the numbers in
+  * @param valid Array of at least length items to store the validity of each
+  *number in, or NULL to pack the non-fill numbers at the start of output
+  * @return The number of non-fill numbers
+  */
+MULTIVERSIONED
+static unsigned int gather(void *data, dtype input_dtype, size_t *indices,
+                           unsigned int length,
+                           NUMERIC_WORKING_TYPE fill_value,
+                           NUMERIC_WORKING_TYPE *output, char *valid) {
+   unsigned int i = 0;
+   unsigned int written = 0;
+   register NUMERIC_WORKING_TYPE value;
+
+   #ifdef GATHER_AVX2
+   if (cpu_dispatch_level() >= cpu_level_avx2) {
+      i = gather_avx2(data, input_dtype, indices, length, fill_value, output,
+                      valid, &written);
+   }
+   #endif
+
+   // Shortcut macro - convert the remaining numbers one by one, with the
+   // dtype switch hoisted out of the loop
+   #define gather_loop(type) \
+   for (; i < length; i++) { \
+      value = (NUMERIC_WORKING_TYPE) ((type *) data)[indices[i]]; \
+      if (valid != NULL) { \
+         output[i] = value; \
+         valid[i] = (value != fill_value); \
+         written += valid[i]; \
+      } else if (value != fill_value) { \
+         output[written++] = value; \
+      } \
+   }
+
+   switch (input_dtype.specifier) {
+   case uint8:
+      gather_loop(uint8_t);
+      break;
+   case uint16:
+      gather_loop(uint16_t);
+      break;
+   case uint32:
+      gather_loop(uint32_t);
+      break;
+      #ifdef SIXTYFOURBIT
+   case uint64:
+      gather_loop(uint64_t);
+      break;
+      #endif
+   case int8:
+      gather_loop(int8_t);
+      break;
+   case int16:
+      gather_loop(int16_t);
+      break;
+   case int32:
+      gather_loop(int32_t);
+      break;
+      #ifdef SIXTYFOURBIT
+   case int64:
+      gather_loop(int64_t);
+      break;
+      #endif
+   case float32:
+      gather_loop(float32_t);
+      break;
+   case float64:
+      gather_loop(float64_t);
+      break;
+   default:
+      fprintf(stderr,
+              "numeric_gather received an invalid dtype (%d), quitting.\n",
+              input_dtype.specifier);
+      exit(EXIT_FAILURE);
+   }
+   return written;
+}
+
+/**
+  * Get many numbers from an array, formatted as the current working numeric
+  *type, discarding any fill values.
+  *
+  * This is equivalent to calling numeric_get for each index and keeping the
+  *results which are not equal to fill_value, but converts the numbers in bulk
+  *(using vector gathers where available).
+  *
+  * @param data Pointer to the memory array
+  * @param input_dtype The type of the memory array
+  * @param indices Indices of the desired numbers
+  * @param length The number of indices
+  * @param fill_value Numbers equal to this value are discarded
+  * @param output Array of at least length items; the non-fill numbers are
+  *stored contiguously at the start of this array, in the order of indices
+  * @return The number of non-fill numbers stored in output
+  */
+unsigned int numeric_gather(void *data, dtype input_dtype, size_t *indices,
+                            unsigned int length,
+                            NUMERIC_WORKING_TYPE fill_value,
+                            NUMERIC_WORKING_TYPE *output) {
+   return gather(data, input_dtype, indices, length, fill_value, output, NULL);
+}
+
+/**
+  * Get many numbers from an array, formatted as the current working numeric
+  *type, marking any fill values.
+  *
+  * Unlike numeric_gather, output[i] always corresponds to indices[i]; valid[i]
+  *is set to 0 where that number is equal to fill_value, and 1 otherwise.
+  *
+  * @param data Pointer to the memory array
+  * @param input_dtype The type of the memory array
+  * @param indices Indices of the desired numbers
+  * @param length The number of indices
+  * @param fill_value Numbers equal to this value are marked as invalid
+  * @param output Array of at least length items to store the numbers in
+  * @param valid Array of at least length items to store the validity flags in
+  * @return The number of non-fill numbers
+  */
+unsigned int numeric_gather_masked(void *data, dtype input_dtype,
+                                   size_t *indices, unsigned int length,
+                                   NUMERIC_WORKING_TYPE fill_value,
+                                   NUMERIC_WORKING_TYPE *output,
+                                   char *valid) {
+   return gather(data, input_dtype, indices, length, fill_value, output, valid);
+}
+
 /**
   * Get a single piece of coded data from an array.
   * @param data Pointer to the memory array.
@@ -117,7 +443,7 @@ void numeric_put(void *data, dtype output_dtype, int index,
   * @param index Index of the desired number.
   * @param output Pointer to where the retrieved data should be stored
   */
-void coded_get(void *data, dtype input_dtype, int index, void *output) {
+void coded_get(void *data, dtype input_dtype, size_t index, void *output) {
    // Cast the data to char (so that bytes can be indexed), calculate
    // the correct offset, then copy the data from that offset to the
    // specified memory address
@@ -131,7 +457,7 @@ void coded_get(void *data, dtype input_dtype, int index, void *output) {
   * @param index Index of the desired storage position
   * @param input The coded data to be stored
   */
-void coded_put(void *data, dtype output_dtype, int index, void *input) {
+void coded_put(void *data, dtype output_dtype, size_t index, void *input) {
    memcpy(&((char *) data)[index*output_dtype.size], input, output_dtype.size);
 }
 
@@ -6,6 +6,7 @@
   */
 #ifndef HEADER_DATA_HANDLING
 #define HEADER_DATA_HANDLING
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -85,11 +86,22 @@ typedef struct dtype_s {
 typedef float *dimension_bounds;
 
 // Function prototypes - implemented in data_handling.c
-NUMERIC_WORKING_TYPE numeric_get(void *data, dtype input_dtype, int index);
-void coded_get(void *data, dtype input_dtype, int index, void *output);
-void coded_put(void *data, dtype output_dtype, int index, void *input);
-void numeric_put(void *data, dtype output_dtype, int index,
+NUMERIC_WORKING_TYPE numeric_get(void *data, dtype input_dtype, size_t index);
+void coded_get(void *data, dtype input_dtype, size_t index, void *output);
+void coded_put(void *data, dtype output_dtype, size_t index, void *input);
+void numeric_put(void *data, dtype output_dtype, size_t index,
                  NUMERIC_WORKING_TYPE data_item);
+void numeric_put_span(void *data, dtype output_dtype, size_t index,
+                      unsigned int length, NUMERIC_WORKING_TYPE *data_items);
+unsigned int numeric_gather(void *data, dtype input_dtype, size_t *indices,
+                            unsigned int length,
+                            NUMERIC_WORKING_TYPE fill_value,
+                            NUMERIC_WORKING_TYPE *output);
+unsigned int numeric_gather_masked(void *data, dtype input_dtype,
+                                   size_t *indices, unsigned int length,
+                                   NUMERIC_WORKING_TYPE fill_value,
+                                   NUMERIC_WORKING_TYPE *output,
+                                   char *valid);
 dtype dtype_string_parse(char *dtype_string);
 
 #endif
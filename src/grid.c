@@ -75,6 +75,38 @@ grid *initialise_grid(int width, int height, float vertical_resolution,
    return result;
 }
 
+/**
+  * Initialise an overview of a grid, each of whose cells covers a square block
+  *of cells of the grid (2 by 2 at level 1, 4 by 4 at level 2, and so on). The
+  *overview shares the top left corner of the grid, and its last row and column
+  *are partial blocks where the grid does not divide evenly. The sampling sizes
+  *and time constraints of the grid are scaled and copied respectively.
+  *
+  * @param base The grid to make an overview of.
+  * @param level The level of the overview (at least 1).
+  * @return A pointer to the initialised overview grid.
+  */
+grid *initialise_overview_grid(grid *base, int level) {
+   int factor = 1 << level;
+   int width = (base->width + factor - 1) / factor;
+   int height = (base->height + factor - 1) / factor;
+   float vertical_resolution = base->vertical_resolution * factor;
+   float horizontal_resolution = base->horizontal_resolution * factor;
+
+   // Keep the top left corner of the grid in place
+   float left = base->central_x -
+                (base->width / 2.0) * base->horizontal_resolution;
+   float top = base->central_y +
+               (base->height / 2.0) * base->vertical_resolution;
+   grid *result = initialise_grid(
+      width, height, vertical_resolution, horizontal_resolution,
+      base->vsample * factor, base->hsample * factor,
+      left + (width / 2.0) * horizontal_resolution,
+      top - (height / 2.0) * vertical_resolution, base->input_projector);
+   set_time_constraints(result, base->time_min, base->time_max);
+   return result;
+}
+
 /**
   * Set time constraints on the grid.
   *
@@ -74,6 +74,7 @@ grid *initialise_grid(int width, int height, float vertical_resolution,
                       float central_x,
                       float central_y,
                       projector *input_projector);
+grid *initialise_overview_grid(grid *base, int level);
 void set_time_constraints(grid *output_grid, float min, float max);
 
 #endif
@@ -1,18 +1,2218 @@
 /**
   * @file
   *
-  * Implements the standard gridding algorithm
+  * Implements the standard gridding algorithm, a scatter gridding algorithm
+  *for reductions which can be accumulated one observation at a time, and a
+  *running sum algorithm for linear reductions over large sampling boxes.
   */
-#include <time.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <omp.h>
 
+#include "cpu_dispatch.h"
 #include "gridding.h"
+#include "hit_list.h"
+#include "io_helper.h"
 #include "io_spec.h"
+#include "quantile_sketch.h"
 #include "result_set.h"
+#include "run_metrics.h"
+
+/** The width and height (in cells) of the tiles that the grid is divided into
+ *for scheduling between threads. */
+#define TILE_SIZE 64
+
+/** The number of points along each edge of the sampling box of a cell which
+ *are re-projected to find the region of the index it covers (see
+ *reproject_bounds).*/
+#define CELL_REPROJECTION_SAMPLES 3
+
+/** The number of points along each edge of a tile which are re-projected to
+ *find the region of the index it covers. Tiles are larger than cells, so more
+ *points are needed to follow the curvature of their edges.*/
+#define TILE_REPROJECTION_SAMPLES 9
+
+/** The number of observations visited at once by each thread of
+ *perform_scatter_gridding (and of perform_incremental_gridding). */
+#define SCATTER_CHUNK_SIZE 4096
+
+/**
+  * A rectangular block of cells of the output grid, gridded by one thread.
+  */
+typedef struct {
+   /** The band of rows that the tile belongs to (see grid_bands).*/
+   int band;
+
+   /** The column of the first cell of the tile.*/
+   int first_u;
+
+   /** The row of the first cell of the tile.*/
+   int first_v;
+
+   /** The number of columns in the tile.*/
+   int width;
+
+   /** The number of rows in the tile.*/
+   int height;
+
+   /** The estimated cost of gridding the tile.*/
+   float cost;
+
+   /** Whether the index holds no observations within the sampling boxes of
+    *the tile's cells (so that every cell takes the value of an empty cell).*/
+   int empty;
+} tile;
+
+/**
+  * Compare two tiles by their estimated cost, for sorting the most expensive
+  *first.
+  *
+  * @param a Pointer to the first tile.
+  * @param b Pointer to the second tile.
+  * @return Negative if a is more expensive than b, positive if it is cheaper,
+  *0 if they are equal.
+  */
+static int compare_tile_costs(const void *a, const void *b) {
+   float cost_a = ((const tile *) a)->cost;
+   float cost_b = ((const tile *) b)->cost;
+   return (cost_a < cost_b) - (cost_a > cost_b);
+}
+
+/**
+  * Determine whether an observation passes a QA filter. Where the filter has a
+  *reject_mask, a QA value which is not a number, or which is beyond the range
+  *of a 64-bit integer, has no bits to test and so fails the filter.
+  *
+  * @param filter The QA filter.
+  * @param record_index The index of the observation.
+  * @return 1 if the observation passes the filter, 0 otherwise.
+  */
+int qa_filter_accepts(qa_filter *filter, size_t record_index) {
+   NUMERIC_WORKING_TYPE qa_value = numeric_get(filter->qa_data,
+                                               filter->qa_dtype, record_index);
+   if (filter->reject_mask != 0) {
+      if (!(qa_value >= -0x1p63 && qa_value < 0x1p63)) {
+         return 0;
+      }
+      if (((uint64_t) (int64_t) qa_value & filter->reject_mask) != 0) {
+         return 0;
+      }
+   }
+   return qa_value >= filter->minimum;
+}
+
+/**
+  * Determine whether an observation should be used for gridding, i.e. it is
+  *marked as valid in the validity mask, and passes the QA filter, of an
+  *input_spec (see spatial_index::filter).
+  *
+  * @param context The input_spec.
+  * @param record_index The index of the observation.
+  * @return 1 if the observation should be kept, 0 otherwise.
+  */
+static int observation_accepted(void *context, size_t record_index) {
+   input_spec *inspec = (input_spec *) context;
+   if (inspec->valid != NULL &&
+       !validity_mask_is_valid(inspec->valid, record_index)) {
+      return 0;
+   }
+   return inspec->qa == NULL || qa_filter_accepts(inspec->qa, record_index);
+}
+
+/**
+  * Calculate the position of the centre of a cell, along one dimension.
+  *
+  * @param origin The position of the edge of the first cell.
+  * @param resolution The size of each cell.
+  * @param cell The number of the cell.
+  * @return The position of the centre of the cell.
+  */
+static inline float32_t cell_centre(float32_t origin, float resolution,
+                                    int cell) {
+   float32_t centre = origin + ((float) cell + 0.5) * resolution;
+   return centre;
+}
+
+/**
+  * Store the latitude and longitude of every cell of a band of rows of the
+  *grid in the latitude and longitude outputs (where they are required). The
+  *centres of the cells are inverse projected a row at a time; where the
+  *projection is separable, only one row and one column are inverse projected,
+  *and every other cell is filled from them.
+  *
+  * @param outspec Specification of the output grid, whose outputs hold just
+  *the rows of the band (the topmost row first).
+  * @param x_0 The x-coordinate of the left edge of the grid.
+  * @param y_0 The y-coordinate of the bottom edge of the grid.
+  * @param first_v The lowest row of the band.
+  * @param number_rows The number of rows in the band.
+  */
+static void store_grid_coordinates(output_spec *outspec, float32_t x_0,
+                                   float32_t y_0, int first_v,
+                                   int number_rows) {
+   if (outspec->lats_output == NULL && outspec->lons_output == NULL) {
+      return;
+   }
+
+   grid *grid_spec = outspec->grid_spec;
+   projector *input_projector = grid_spec->input_projector;
+   int grid_width = grid_spec->width;
+
+   // Find the centres of the sampling boxes of each column and row, as
+   // perform_gridding finds them
+   float32_t *centres_x = malloc(sizeof(float32_t) * grid_width);
+   float32_t *centres_y = malloc(sizeof(float32_t) * number_rows);
+   if (centres_x == NULL || centres_y == NULL) {
+      fprintf(stderr, "Could not allocate space for the cell centres\n");
+      exit(EXIT_FAILURE);
+   }
+   for (int u=0; u<grid_width; u++) {
+      float32_t cr_x = cell_centre(x_0, grid_spec->horizontal_resolution, u);
+      float32_t bl_x = cr_x - grid_spec->horizontal_sampling_offset;
+      float32_t tr_x = cr_x + grid_spec->horizontal_sampling_offset;
+      centres_x[u] = (tr_x + bl_x) / 2.0;
+   }
+   for (int row=0; row<number_rows; row++) {
+      float32_t cr_y = cell_centre(y_0, grid_spec->vertical_resolution,
+                                   first_v + row);
+      float32_t bl_y = cr_y - grid_spec->vertical_sampling_offset;
+      float32_t tr_y = cr_y + grid_spec->vertical_sampling_offset;
+      centres_y[row] = (tr_y + bl_y) / 2.0;
+   }
+
+   if (input_projector->separable) {
+      // Inverse project the centre of each column along the middle of the
+      // grid, and the centre of each row along the middle of the grid
+      int longest = (grid_width > number_rows) ? grid_width : number_rows;
+      float32_t *middle = malloc(sizeof(float32_t) * longest);
+      spherical_coordinates *column_coords =
+         malloc(sizeof(spherical_coordinates) * grid_width);
+      spherical_coordinates *row_coords =
+         malloc(sizeof(spherical_coordinates) * number_rows);
+      if (middle == NULL || column_coords == NULL || row_coords == NULL) {
+         fprintf(stderr, "Could not allocate space for the cell centres\n");
+         exit(EXIT_FAILURE);
+      }
+      for (int i=0; i<longest; i++) {
+         middle[i] = grid_spec->central_y;
+      }
+      input_projector->inverse_project_many(input_projector, grid_width,
+                                            middle, centres_x, column_coords);
+      for (int i=0; i<longest; i++) {
+         middle[i] = grid_spec->central_x;
+      }
+      input_projector->inverse_project_many(input_projector, number_rows,
+                                            centres_y, middle, row_coords);
+
+      #pragma omp parallel for
+      for (size_t index=0; index<(size_t) grid_width * number_rows; index++) {
+         int u = index % grid_width;
+         int row = number_rows - 1 - index / grid_width;
+         if (outspec->lats_output != NULL) {
+            outspec->lats_output[index] = row_coords[row].latitude;
+         }
+         if (outspec->lons_output != NULL) {
+            outspec->lons_output[index] = column_coords[u].longitude;
+         }
+      }
+      free(middle);
+      free(column_coords);
+      free(row_coords);
+   } else {
+      #pragma omp parallel
+      {
+      float32_t *row_y = malloc(sizeof(float32_t) * grid_width);
+      spherical_coordinates *coords =
+         malloc(sizeof(spherical_coordinates) * grid_width);
+      if (row_y == NULL || coords == NULL) {
+         fprintf(stderr, "Could not allocate space for the cell centres\n");
+         exit(EXIT_FAILURE);
+      }
+
+      #pragma omp for schedule(dynamic)
+      for (int row=0; row<number_rows; row++) {
+         for (int u=0; u<grid_width; u++) {
+            row_y[u] = centres_y[row];
+         }
+         input_projector->inverse_project_many(input_projector, grid_width,
+                                               row_y, centres_x, coords);
+         size_t first_index = (size_t) (number_rows - row - 1) * grid_width;
+         for (int u=0; u<grid_width; u++) {
+            if (outspec->lats_output != NULL) {
+               outspec->lats_output[first_index + u] = coords[u].latitude;
+            }
+            if (outspec->lons_output != NULL) {
+               outspec->lons_output[first_index + u] = coords[u].longitude;
+            }
+         }
+      }
+
+      free(row_y);
+      free(coords);
+      }
+   }
+
+   free(centres_x);
+   free(centres_y);
+}
+
+/**
+  * Reduce an empty set of observations into a one-cell copy of each output of
+  *a gridding job, to find the value taken by every cell without observations
+  *(e.g. the fill value, or a count of 0).
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @return A copy of @a outspec whose outputs hold a single cell (to be freed
+  *with empty_cell_free).
+  */
+static output_spec empty_cell_init(input_spec *inspec, output_spec *outspec,
+                                   reduction_function reduce_func,
+                                   reduction_attrs *attrs) {
+   output_spec empty = *outspec;
+   empty.lats_output = NULL;
+   empty.lons_output = NULL;
+   empty.nodes_visited_output = NULL;
+   empty.leaves_tested_output = NULL;
+   empty.hits_output = NULL;
+   empty.data_outputs = calloc(inspec->number_data_inputs, sizeof(char *));
+   empty.statistic_outputs = calloc(inspec->number_data_inputs,
+                                    sizeof(statistic_output *));
+   if (empty.data_outputs == NULL || empty.statistic_outputs == NULL) {
+      fprintf(stderr, "Could not allocate space for an empty cell\n");
+      exit(EXIT_FAILURE);
+   }
+
+   float32_t no_bounds[] = {0.0, 0.0, 0.0, 0.0, outspec->grid_spec->time_min,
+                            outspec->grid_spec->time_max};
+   result_set *no_observations = result_set_init();
+   for (int var=0; var<inspec->number_data_inputs; var++) {
+      size_t size = outspec->output_dtypes[var].size;
+      if (outspec->data_outputs[var] != NULL) {
+         empty.data_outputs[var] = malloc(size);
+         if (empty.data_outputs[var] == NULL) {
+            fprintf(stderr, "Could not allocate space for an empty cell\n");
+            exit(EXIT_FAILURE);
+         }
+         reduce_func.call(no_observations, attrs, no_bounds,
+                          inspec->data_inputs[var], empty.data_outputs[var],
+                          0, inspec->input_dtypes[var],
+                          outspec->output_dtypes[var]);
+      }
+      int number_statistics = outspec->number_statistic_outputs[var];
+      if (number_statistics > 0) {
+         empty.statistic_outputs[var] = malloc(sizeof(statistic_output) *
+                                               number_statistics);
+         if (empty.statistic_outputs[var] == NULL) {
+            fprintf(stderr, "Could not allocate space for an empty cell\n");
+            exit(EXIT_FAILURE);
+         }
+         for (int i=0; i<number_statistics; i++) {
+            empty.statistic_outputs[var][i] =
+               outspec->statistic_outputs[var][i];
+            empty.statistic_outputs[var][i].data_output = malloc(size);
+            if (empty.statistic_outputs[var][i].data_output == NULL) {
+               fprintf(stderr, "Could not allocate space for an empty cell\n");
+               exit(EXIT_FAILURE);
+            }
+         }
+         reduce_numeric_statistics(no_observations, attrs,
+                                   inspec->data_inputs[var],
+                                   inspec->input_dtypes[var],
+                                   empty.statistic_outputs[var],
+                                   number_statistics, 0);
+      }
+   }
+   no_observations->free(no_observations);
+   return empty;
+}
+
+/**
+  * Free the outputs of an empty cell.
+  *
+  * @param inspec Specification of the input data.
+  * @param empty The empty cell returned by empty_cell_init.
+  */
+static void empty_cell_free(input_spec *inspec, output_spec *empty) {
+   for (int var=0; var<inspec->number_data_inputs; var++) {
+      free(empty->data_outputs[var]);
+      for (int i=0; i<empty->number_statistic_outputs[var]; i++) {
+         free(empty->statistic_outputs[var][i].data_output);
+      }
+      free(empty->statistic_outputs[var]);
+   }
+   free(empty->data_outputs);
+   free(empty->statistic_outputs);
+}
+
+/**
+  * Fill every cell of a tile of an output with the same value, copying the
+  *first row of the tile to each of the others.
+  *
+  * @param output The output.
+  * @param size The size of each value of the output.
+  * @param value The value to store.
+  * @param current_tile The tile.
+  * @param last_v The row above the last row held by the output.
+  * @param grid_width The width of the grid.
+  */
+static void fill_tile(char *output, size_t size, char *value,
+                      tile *current_tile, int last_v, int grid_width) {
+   int top_v = current_tile->first_v + current_tile->height - 1;
+   char *first_row = output +
+                     ((size_t) (last_v - top_v - 1) * grid_width +
+                      current_tile->first_u) * size;
+   for (int u=0; u<current_tile->width; u++) {
+      memcpy(first_row + u * size, value, size);
+   }
+   for (int row=1; row<current_tile->height; row++) {
+      memcpy(first_row + (size_t) row * grid_width * size, first_row,
+             current_tile->width * size);
+   }
+}
+
+/**
+  * Fill every cell of a tile of each output with the value of an empty cell.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid.
+  * @param empty The empty cell (see empty_cell_init).
+  * @param current_tile The tile.
+  * @param last_v The row above the last row held by the outputs.
+  */
+static void fill_empty_tile(input_spec *inspec, output_spec *outspec,
+                            output_spec *empty, tile *current_tile,
+                            int last_v) {
+   int grid_width = outspec->grid_spec->width;
+   for (int var=0; var<inspec->number_data_inputs; var++) {
+      size_t size = outspec->output_dtypes[var].size;
+      if (outspec->data_outputs[var] != NULL) {
+         fill_tile(outspec->data_outputs[var], size, empty->data_outputs[var],
+                   current_tile, last_v, grid_width);
+      }
+      for (int i=0; i<outspec->number_statistic_outputs[var]; i++) {
+         fill_tile(outspec->statistic_outputs[var][i].data_output, size,
+                   empty->statistic_outputs[var][i].data_output,
+                   current_tile, last_v, grid_width);
+      }
+   }
+}
+
+/**
+  * Store zero in every cell of a tile of each query diagnostic output, as the
+  *index is not queried for the cells of an empty tile.
+  *
+  * @param outspec Specification of the output grid.
+  * @param current_tile The tile.
+  * @param last_v The row above the last row held by the outputs.
+  */
+static void fill_empty_tile_diagnostics(output_spec *outspec,
+                                        tile *current_tile, int last_v) {
+   int grid_width = outspec->grid_spec->width;
+   uint32_t zero = 0;
+   uint32_t *outputs[] = {outspec->nodes_visited_output,
+                          outspec->leaves_tested_output,
+                          outspec->hits_output};
+   for (int i=0; i<3; i++) {
+      if (outputs[i] != NULL) {
+         fill_tile((char *) outputs[i], sizeof(uint32_t), (char *) &zero,
+                   current_tile, last_v, grid_width);
+      }
+   }
+}
+
+/**
+  * A band of rows of one output grid, to be gridded by grid_bands.
+  */
+typedef struct {
+   /** Specification of the output grid, whose outputs hold just the rows of
+    *the band (the topmost row first). Where the grid is divided into time
+    *bins, this is the first of number_time_bins specifications, one for each
+    *bin in turn.*/
+   output_spec *outspec;
+
+   /** The number of time bins that the observations of each cell are divided
+    *between (1 where the grid is not divided).*/
+   int number_time_bins;
+
+   /** The length of each time bin, the first starting at the earliest time of
+    *the grid (0 where the grid is not divided).*/
+   float32_t time_step;
+
+   /** The x-coordinate of the left edge of the grid.*/
+   float32_t x_0;
+
+   /** The y-coordinate of the bottom edge of the grid.*/
+   float32_t y_0;
+
+   /** The lowest row of the band.*/
+   int first_v;
+
+   /** The number of rows in the band.*/
+   int number_rows;
+
+   /** Whether the grid is in a different projection from the index, so that
+    *the sampling boxes of its cells must be re-projected to query the
+    *index.*/
+   int reprojected;
+
+   /** Whether the cells are reduced a row at a time (see
+    *reduction_function::call_row).*/
+   int reduce_rows;
+
+   /** The value of an empty cell of each output (see empty_cell_init).*/
+   output_spec empty_cell;
+
+   /** Whether the query of each cell counts the work done by the index, for
+    *the query diagnostic outputs (see spatial_index::query_counted).*/
+   int diagnosing;
+
+   /** A flag for each cell of the grid (row by row, from the bottom), marking
+    *the cells to be gridded, or NULL to grid every cell. Tiles without any
+    *marked cells are skipped (see perform_incremental_gridding).*/
+   unsigned char *dirty;
+} grid_band;
+
+/**
+  * Find the region of one projection covered by a box in another, from the
+  *bounding box of a lattice of points spanning the box. The region is padded
+  *by the spacing of the lattice, as the edges of the box may curve between the
+  *points, and extended to a pole where the box contains one. Where any point
+  *cannot be projected, the region is unbounded.
+  *
+  * @param from The projection of the box.
+  * @param to The projection of the region.
+  * @param bounds The box (lower X, upper X, lower Y, upper Y, lower T, upper
+  *T).
+  * @param samples The number of points of the lattice along each edge (at
+  *least 2).
+  * @param output The region (in the same form as @a bounds, with the same
+  *times) is stored here.
+  */
+static void reproject_bounds(projector *from, projector *to,
+                             dimension_bounds bounds, int samples,
+                             float32_t *output) {
+   float32_t lower_x = INFINITY, upper_x = -INFINITY;
+   float32_t lower_y = INFINITY, upper_y = -INFINITY;
+   int bounded = 1;
+
+   for (int i=0; i<samples; i++) {
+      float32_t x = bounds[2*X + LOWER] + (bounds[2*X + UPPER] -
+                                           bounds[2*X + LOWER]) * i /
+                    (samples - 1);
+      for (int j=0; j<samples; j++) {
+         float32_t y = bounds[2*Y + LOWER] + (bounds[2*Y + UPPER] -
+                                              bounds[2*Y + LOWER]) * j /
+                       (samples - 1);
+         spherical_coordinates s = from->inverse_project(from, y, x);
+         projected_coordinates p = to->project(to, s.longitude, s.latitude);
+         if (!isfinite(p.x) || !isfinite(p.y)) {
+            bounded = 0;
+         } else {
+            lower_x = fminf(lower_x, p.x);
+            upper_x = fmaxf(upper_x, p.x);
+            lower_y = fminf(lower_y, p.y);
+            upper_y = fmaxf(upper_y, p.y);
+         }
+      }
+   }
+   float32_t pad_x = (upper_x - lower_x) / (samples - 1);
+   float32_t pad_y = (upper_y - lower_y) / (samples - 1);
+   lower_x -= pad_x;
+   upper_x += pad_x;
+   lower_y -= pad_y;
+   upper_y += pad_y;
+
+   // A pole within the box may lie beyond every point of the lattice (and
+   // may be a line rather than a point in the other projection)
+   for (float pole=-90.0; pole<=90.0; pole+=180.0) {
+      projected_coordinates in_box = from->project(from, 0.0, pole);
+      if (in_box.x >= bounds[2*X + LOWER] && in_box.x <= bounds[2*X + UPPER] &&
+          in_box.y >= bounds[2*Y + LOWER] && in_box.y <= bounds[2*Y + UPPER]) {
+         projected_coordinates in_region = to->project(to, 0.0, pole);
+         if (!isfinite(in_region.y)) {
+            bounded = 0;
+         }
+         lower_x = -INFINITY;
+         upper_x = INFINITY;
+         lower_y = fminf(lower_y, in_region.y);
+         upper_y = fmaxf(upper_y, in_region.y);
+      }
+   }
+
+   if (!bounded) {
+      lower_x = lower_y = -INFINITY;
+      upper_x = upper_y = INFINITY;
+   }
+   output[2*X + LOWER] = lower_x;
+   output[2*X + UPPER] = upper_x;
+   output[2*Y + LOWER] = lower_y;
+   output[2*Y + UPPER] = upper_y;
+   output[2*T + LOWER] = bounds[2*T + LOWER];
+   output[2*T + UPPER] = bounds[2*T + UPPER];
+}
+
+/**
+  * Query the index for the observations within the sampling box of a cell of
+  *a grid in a different projection. The index is queried for the region
+  *covering the box, and the observations found are re-projected into the
+  *grid, keeping those which lie within the box.
+  *
+  * @param coordinate_index The index to query.
+  * @param grid_projector The projection of the grid.
+  * @param bounds The sampling box, in the projection of the grid.
+  * @param counts The work done by the query of the index is stored here (or
+  *NULL to not count it, see spatial_index::query_counted).
+  * @return A result_set holding the observations within the box, with their
+  *coordinates in the projection of the grid.
+  */
+static result_set *query_reprojected(spatial_index *coordinate_index,
+                                     projector *grid_projector,
+                                     dimension_bounds bounds,
+                                     query_counts *counts) {
+   projector *index_projector = coordinate_index->input_projector;
+   float32_t index_bounds[6];
+   reproject_bounds(grid_projector, index_projector, bounds,
+                    CELL_REPROJECTION_SAMPLES, index_bounds);
+
+   result_set *found = (counts == NULL) ?
+                       coordinate_index->query(coordinate_index,
+                                               index_bounds) :
+                       coordinate_index->query_counted(coordinate_index,
+                                                       index_bounds, counts);
+   result_set *kept = result_set_init();
+   result_set_item *item;
+   while ((item = found->iterate(found)) != NULL) {
+      spherical_coordinates s = index_projector->inverse_project(
+         index_projector, item->y, item->x);
+      projected_coordinates p = grid_projector->project(
+         grid_projector, s.longitude, s.latitude);
+      if (p.x >= bounds[2*X + LOWER] && p.x <= bounds[2*X + UPPER] &&
+          p.y >= bounds[2*Y + LOWER] && p.y <= bounds[2*Y + UPPER]) {
+         kept->insert(kept, p.x, p.y, item->t, item->record_index);
+      }
+   }
+   found->free(found);
+   return kept;
+}
+
+/**
+  * Calculate the position of the bottom left corner of a grid.
+  *
+  * @param grid_spec The grid.
+  * @param x_0 The x-coordinate of the left edge is stored here.
+  * @param y_0 The y-coordinate of the bottom edge is stored here.
+  */
+static void grid_origin(grid *grid_spec, float32_t *x_0, float32_t *y_0) {
+   *x_0 = grid_spec->central_x -
+          (((float) grid_spec->width / 2.0) * grid_spec->horizontal_resolution);
+   *y_0 = grid_spec->central_y -
+          (((float) grid_spec->height / 2.0) * grid_spec->vertical_resolution);
+}
+
+/**
+  * Prepare a band of rows of an output grid to be gridded.
+  *
+  * @param band The band to initialise.
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid, whose outputs hold just
+  *the rows of the band.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param first_v The lowest row of the band.
+  * @param number_rows The number of rows in the band.
+  * @param number_time_bins The number of time bins (1 to not divide the
+  *observations by time).
+  * @param time_step The length of each time bin (0 to not divide the
+  *observations by time).
+  */
+static void grid_band_init(grid_band *band, input_spec *inspec,
+                           output_spec *outspec,
+                           reduction_function reduce_func,
+                           reduction_attrs *attrs, int first_v,
+                           int number_rows, int number_time_bins,
+                           float32_t time_step) {
+   band->outspec = outspec;
+   band->number_time_bins = number_time_bins;
+   band->time_step = time_step;
+   band->dirty = NULL;
+   grid_origin(outspec->grid_spec, &band->x_0, &band->y_0);
+   band->first_v = first_v;
+   band->number_rows = number_rows;
+   band->reprojected = (outspec->grid_spec->input_projector !=
+                        inspec->coordinate_index->input_projector);
+
+   // The work done by the query of each cell is counted for the query
+   // diagnostic outputs, which requires an index able to count it
+   band->diagnosing = (outspec->nodes_visited_output != NULL ||
+                       outspec->leaves_tested_output != NULL ||
+                       outspec->hits_output != NULL);
+   if (band->diagnosing &&
+       inspec->coordinate_index->query_counted == NULL) {
+      fprintf(stderr, "The index cannot count the work done by its queries\n");
+      exit(EXIT_FAILURE);
+   }
+
+   // Reductions which can reduce a whole row of cells at once do so from a
+   // single per-thread hit_list (statistics outputs are always reduced per
+   // cell, and the observations of a re-projected or time binned grid are
+   // divided per cell, as are those of a diagnosed grid, whose queries are
+   // counted per cell, so a row reduction is only used when none apply)
+   band->reduce_rows = (reduce_func.call_row != NULL &&
+                        inspec->number_data_inputs > 0 &&
+                        !band->reprojected && time_step == 0.0 &&
+                        !band->diagnosing);
+   for (int var=0; var<inspec->number_data_inputs; var++) {
+      if (outspec->number_statistic_outputs[var] > 0) {
+         band->reduce_rows = 0;
+      }
+   }
+
+   // Tiles without observations are filled with the value of an empty cell,
+   // without querying the index
+   band->empty_cell = empty_cell_init(inspec, outspec, reduce_func, attrs);
+}
+
+/**
+  * Store the work done by the query of a cell in the query diagnostic outputs
+  *of a grid.
+  *
+  * @param outspec Specification of the output grid.
+  * @param counts The work done by the query (see spatial_index::query_counted).
+  * @param index The index of the cell in the outputs.
+  */
+static void store_query_counts(output_spec *outspec, query_counts *counts,
+                               size_t index) {
+   if (outspec->nodes_visited_output != NULL) {
+      outspec->nodes_visited_output[index] = counts->nodes_visited;
+   }
+   if (outspec->leaves_tested_output != NULL) {
+      outspec->leaves_tested_output[index] = counts->leaves_tested;
+   }
+   if (outspec->hits_output != NULL) {
+      outspec->hits_output[index] = counts->hits;
+   }
+}
+
+/**
+  * Determine whether any cell of a tile is marked to be gridded.
+  *
+  * @param dirty The flag of each cell of the grid (see grid_band::dirty).
+  * @param current_tile The tile.
+  * @param grid_width The width of the grid.
+  * @return 1 if any cell of the tile is marked, 0 otherwise.
+  */
+static int tile_is_dirty(unsigned char *dirty, tile *current_tile,
+                         int grid_width) {
+   for (int v=current_tile->first_v;
+        v<current_tile->first_v + current_tile->height; v++) {
+      unsigned char *row = dirty + (size_t) v * grid_width;
+      for (int u=current_tile->first_u;
+           u<current_tile->first_u + current_tile->width; u++) {
+         if (row[u]) {
+            return 1;
+         }
+      }
+   }
+   return 0;
+}
+
+/**
+  * Reduce the observations of a cell into each output of each variable.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid.
+  * @param cell_set The observations within the sampling box of the cell.
+  * @param bounds The sampling box of the cell.
+  * @param index The index of the cell within the outputs.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  */
+static void reduce_cell(input_spec *inspec, output_spec *outspec,
+                        result_set *cell_set, dimension_bounds bounds,
+                        size_t index, reduction_function reduce_func,
+                        reduction_attrs *attrs) {
+   for (int var=0; var<inspec->number_data_inputs; var++) {
+      if (outspec->data_outputs[var] != NULL) {
+         reduce_func.call(cell_set, attrs, bounds, inspec->data_inputs[var],
+                          outspec->data_outputs[var], index,
+                          inspec->input_dtypes[var],
+                          outspec->output_dtypes[var]);
+         cell_set->rewind(cell_set);
+      }
+      if (outspec->number_statistic_outputs[var] > 0) {
+         reduce_numeric_statistics(cell_set, attrs, inspec->data_inputs[var],
+                                   inspec->input_dtypes[var],
+                                   outspec->statistic_outputs[var],
+                                   outspec->number_statistic_outputs[var],
+                                   index);
+         cell_set->rewind(cell_set);
+      }
+   }
+}
+
+/**
+  * Per-thread storage for dividing the observations of a cell between time
+  *bins (see reduce_time_bins), reused from one cell to the next.
+  */
+typedef struct {
+   /** The observations of the cell, ordered by time bin.*/
+   result_set_item **items;
+
+   /** The number of observations that @a items can hold.*/
+   unsigned int capacity;
+
+   /** The position in @a items of the first observation of each bin, followed
+    *by the observations outside every bin, and the end of the list.*/
+   unsigned int *offsets;
+} time_bin_buffer;
+
+/**
+  * Find the time bin of a band holding an observation.
+  *
+  * @param band The band.
+  * @param bounds The sampling box of the cell, across the times of every bin.
+  * @param t The time of the observation.
+  * @return The bin holding the observation, or number_time_bins if it lies
+  *outside every bin.
+  */
+static inline int time_bin(grid_band *band, dimension_bounds bounds,
+                           float32_t t) {
+   int number_bins = band->number_time_bins;
+   int b = (int) floorf((t - bounds[2*T + LOWER]) / band->time_step);
+
+   // The last bin also holds the observations at the end time of the grid
+   if (b == number_bins && t <= bounds[2*T + UPPER]) {
+      b = number_bins - 1;
+   }
+   return (b < 0 || b > number_bins) ? number_bins : b;
+}
+
+/**
+  * Divide the observations of a cell between the time bins of a band, and
+  *reduce each bin into its own outputs. Each bin holds the observations from
+  *its start time up to (but not including) the start of the next bin, except
+  *the last, which also holds those at its end time (the upper time bound of
+  *the grid). The observations are sorted into their bins by relinking the
+  *items of @a cell_set in place, so no memory is allocated per cell; on
+  *return, @a cell_set holds every one of its items again.
+  *
+  * @param inspec Specification of the input data.
+  * @param band The band that the cell belongs to.
+  * @param cell_set The observations within the sampling box of the cell,
+  *across the times of every bin.
+  * @param bounds The sampling box of the cell, across the times of every bin.
+  * @param index The index of the cell within the outputs.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param buffer The calling thread's storage for sorting the observations
+  *(which must have space for number_time_bins + 2 offsets).
+  */
+static void reduce_time_bins(input_spec *inspec, grid_band *band,
+                             result_set *cell_set, dimension_bounds bounds,
+                             size_t index, reduction_function reduce_func,
+                             reduction_attrs *attrs,
+                             time_bin_buffer *buffer) {
+   int number_bins = band->number_time_bins;
+   float32_t first_time = bounds[2*T + LOWER];
+   unsigned int number_items = cell_set->length;
+   if (number_items > buffer->capacity) {
+      free(buffer->items);
+      buffer->capacity = (number_items > 2 * buffer->capacity) ?
+                         number_items : 2 * buffer->capacity;
+      buffer->items = malloc(sizeof(result_set_item *) * buffer->capacity);
+      if (buffer->items == NULL) {
+         fprintf(stderr, "Could not allocate space for %u observations\n",
+                 buffer->capacity);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   // Count the observations of each bin (observations outside every bin are
+   // counted after the last), and sort them into their bins
+   unsigned int *offsets = buffer->offsets;
+   memset(offsets, 0, sizeof(unsigned int) * (number_bins + 2));
+   result_set_item *item;
+   for (item = cell_set->head; item != NULL; item = item->next) {
+      int b = time_bin(band, bounds, item->t);
+      offsets[b + 1]++;
+   }
+   for (int b=0; b<=number_bins; b++) {
+      offsets[b + 1] += offsets[b];
+   }
+   for (item = cell_set->head; item != NULL; item = item->next) {
+      int b = time_bin(band, bounds, item->t);
+      buffer->items[offsets[b]++] = item;
+   }
+   for (int b=number_bins; b>0; b--) {
+      offsets[b] = offsets[b - 1];
+   }
+   offsets[0] = 0;
+
+   // Reduce each bin from its own run of the sorted items
+   for (int b=0; b<number_bins; b++) {
+      unsigned int first = offsets[b], last = offsets[b + 1];
+      for (unsigned int i=first; i<last; i++) {
+         buffer->items[i]->next = (i + 1 < last) ? buffer->items[i + 1] : NULL;
+      }
+      cell_set->head = (last > first) ? buffer->items[first] : NULL;
+      cell_set->tail = (last > first) ? buffer->items[last - 1] : NULL;
+      cell_set->current = cell_set->head;
+      cell_set->length = last - first;
+
+      float32_t bin_bounds[] = {
+         bounds[2*X + LOWER], bounds[2*X + UPPER],
+         bounds[2*Y + LOWER], bounds[2*Y + UPPER],
+         first_time + b * band->time_step,
+         first_time + (b + 1) * band->time_step
+      };
+      reduce_cell(inspec, &band->outspec[b], cell_set, bin_bounds, index,
+                  reduce_func, attrs);
+   }
+
+   // Link every item back into the set, so that it can be freed
+   for (unsigned int i=0; i<number_items; i++) {
+      buffer->items[i]->next = (i + 1 < number_items) ?
+                               buffer->items[i + 1] : NULL;
+   }
+   cell_set->head = (number_items > 0) ? buffer->items[0] : NULL;
+   cell_set->tail = (number_items > 0) ? buffer->items[number_items - 1] :
+                    NULL;
+   cell_set->current = cell_set->head;
+   cell_set->length = number_items;
+}
+
+/**
+  * Grid bands of rows of one or more output grids, dividing them into tiles
+  *which are shared dynamically between threads.
+  *
+  * @param inspec Specification of the input data.
+  * @param bands The bands to grid.
+  * @param number_bands The number of bands.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+static void grid_bands(input_spec *inspec, grid_band *bands, int number_bands,
+                       reduction_function reduce_func, reduction_attrs *attrs,
+                       int verbosity) {
+
+   // Divide the bands into tiles
+   int number_tiles = 0;
+   int any_reduce_rows = 0;
+   int most_time_bins = 0;
+   for (int b=0; b<number_bands; b++) {
+      int tiles_across = (bands[b].outspec->grid_spec->width + TILE_SIZE - 1) /
+                         TILE_SIZE;
+      int tiles_down = (bands[b].number_rows + TILE_SIZE - 1) / TILE_SIZE;
+      number_tiles += tiles_across * tiles_down;
+      any_reduce_rows |= bands[b].reduce_rows;
+      if (bands[b].time_step > 0.0 &&
+          bands[b].number_time_bins > most_time_bins) {
+         most_time_bins = bands[b].number_time_bins;
+      }
+   }
+   if (any_reduce_rows && verbosity > 1) {
+      printf("Reducing a row of cells at a time\n");
+   }
+   tile *tiles = malloc(sizeof(tile) * number_tiles);
+   if (tiles == NULL) {
+      fprintf(stderr, "Could not allocate space for %d tiles\n", number_tiles);
+      exit(EXIT_FAILURE);
+   }
+   int next_tile = 0;
+   for (int b=0; b<number_bands; b++) {
+      int grid_width = bands[b].outspec->grid_spec->width;
+      int last_v = bands[b].first_v + bands[b].number_rows;
+      for (int first_v=bands[b].first_v; first_v<last_v; first_v+=TILE_SIZE) {
+         for (int first_u=0; first_u<grid_width; first_u+=TILE_SIZE) {
+            tile *current_tile = &tiles[next_tile];
+            current_tile->band = b;
+            current_tile->first_u = first_u;
+            current_tile->first_v = first_v;
+            current_tile->width = grid_width - first_u;
+            if (current_tile->width > TILE_SIZE) {
+               current_tile->width = TILE_SIZE;
+            }
+            current_tile->height = last_v - first_v;
+            if (current_tile->height > TILE_SIZE) {
+               current_tile->height = TILE_SIZE;
+            }
+            if (bands[b].dirty == NULL ||
+                tile_is_dirty(bands[b].dirty, current_tile, grid_width)) {
+               next_tile++;
+            }
+         }
+      }
+   }
+   number_tiles = next_tile;
+
+   // Estimate the cost of each tile from the number of observations the index
+   // holds within it (plus a cost per cell)
+   #pragma omp parallel for schedule(dynamic)
+   for (int t=0; t<number_tiles; t++) {
+      tile *current_tile = &tiles[t];
+      grid_band *band = &bands[current_tile->band];
+      grid *grid_spec = band->outspec->grid_spec;
+
+      float32_t tile_bounds[] = {
+         band->x_0 + current_tile->first_u *
+         grid_spec->horizontal_resolution -
+         grid_spec->horizontal_sampling_offset,
+         band->x_0 + (current_tile->first_u + current_tile->width) *
+         grid_spec->horizontal_resolution +
+         grid_spec->horizontal_sampling_offset,
+         band->y_0 + current_tile->first_v *
+         grid_spec->vertical_resolution -
+         grid_spec->vertical_sampling_offset,
+         band->y_0 + (current_tile->first_v + current_tile->height) *
+         grid_spec->vertical_resolution +
+         grid_spec->vertical_sampling_offset,
+         grid_spec->time_min, grid_spec->time_max
+      };
+      if (band->reprojected) {
+         reproject_bounds(grid_spec->input_projector,
+                          inspec->coordinate_index->input_projector,
+                          tile_bounds, TILE_REPROJECTION_SAMPLES,
+                          tile_bounds);
+      }
+      current_tile->cost = (float) (current_tile->width *
+                                    current_tile->height);
+      current_tile->empty = 0;
+      if (inspec->number_data_inputs > 0) {
+         current_tile->empty = !inspec->coordinate_index->occupied(
+            inspec->coordinate_index, tile_bounds);
+         if (!current_tile->empty) {
+            current_tile->cost += inspec->coordinate_index->estimate_count(
+               inspec->coordinate_index, tile_bounds);
+         }
+      }
+   }
+
+   // Start the most expensive tiles first, so that the cheap tiles left at the
+   // end fill in the gaps between threads
+   qsort(tiles, number_tiles, sizeof(tile), &compare_tile_costs);
+   if (verbosity > 1) {
+      int number_empty = 0;
+      for (int t=0; t<number_tiles; t++) {
+         number_empty += tiles[t].empty;
+      }
+      printf("Gridding %d tiles of up to %dx%d cells (%d empty)\n",
+             number_tiles, TILE_SIZE, TILE_SIZE, number_empty);
+   }
+
+   #pragma omp parallel
+   {
+   // Each thread times its own queries and reductions, and adds them to the
+   // metrics of the run at the end
+   run_metrics *metrics = inspec->metrics;
+   run_metrics thread_metrics;
+   run_metrics_init(&thread_metrics);
+   uint64_t started = 0, queried = 0;
+
+   hit_list *row_hits = NULL;
+   unsigned int *row_offsets = NULL;
+   float32_t *row_centres_x = NULL;
+   time_bin_buffer bin_buffer = {NULL, 0, NULL};
+   if (most_time_bins > 0) {
+      bin_buffer.offsets = malloc(sizeof(unsigned int) *
+                                  (most_time_bins + 2));
+      if (bin_buffer.offsets == NULL) {
+         fprintf(stderr, "Could not allocate space for %d time bins\n",
+                 most_time_bins);
+         exit(EXIT_FAILURE);
+      }
+   }
+   if (any_reduce_rows) {
+      row_hits = hit_list_init();
+      row_offsets = malloc(sizeof(unsigned int) * (TILE_SIZE + 1));
+      row_centres_x = malloc(sizeof(float32_t) * TILE_SIZE);
+      if (row_offsets == NULL || row_centres_x == NULL) {
+         fprintf(stderr, "Could not allocate space for a row of cells\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   // Each idle thread takes the next tile from the list
+   #pragma omp for schedule(dynamic, 1)
+   for (int t=0; t<number_tiles; t++) {
+      grid_band *band = &bands[tiles[t].band];
+      output_spec *outspec = band->outspec;
+      grid *grid_spec = outspec->grid_spec;
+      int grid_width = grid_spec->width;
+      int last_v = band->first_v + band->number_rows;
+      if (tiles[t].empty) {
+         for (int b=0; b<band->number_time_bins; b++) {
+            fill_empty_tile(inspec, &outspec[b], &band->empty_cell, &tiles[t],
+                            last_v);
+         }
+         if (band->diagnosing) {
+            fill_empty_tile_diagnostics(outspec, &tiles[t], last_v);
+         }
+         thread_metrics.cells += (uint64_t) tiles[t].width * tiles[t].height;
+         continue;
+      }
+      int first_u = tiles[t].first_u;
+      int last_u = first_u + tiles[t].width;
+      int tile_width = tiles[t].width;
+      for (int v=tiles[t].first_v; v<tiles[t].first_v + tiles[t].height; v++) {
+         if (band->reduce_rows) {
+            row_hits->clear(row_hits);
+         }
+         for (int u=first_u; u<last_u; u++) {
+            if (band->dirty != NULL &&
+                !band->dirty[(size_t) v * grid_width + u]) {
+               continue;
+            }
+            size_t index = (size_t) (last_v-v-1) * grid_width + u;
+            thread_metrics.cells++;
+
+            float32_t cr_x = band->x_0 +
+                             ((float) u +
+                              0.5) * grid_spec->horizontal_resolution;
+            float32_t cr_y = band->y_0 +
+                             ((float) v +
+                              0.5) * grid_spec->vertical_resolution;
+
+            float32_t bl_x = cr_x - grid_spec->horizontal_sampling_offset;
+            float32_t bl_y = cr_y - grid_spec->vertical_sampling_offset;
+
+            float32_t tr_x = cr_x + grid_spec->horizontal_sampling_offset;
+            float32_t tr_y = cr_y + grid_spec->vertical_sampling_offset;
+
+            // Perform gridding of data - the index is queried once, and the
+            // result set is reduced for each of the outputs of each variable
+            if (band->reduce_rows) {
+               // Collect the hits for this cell, to be reduced with the row
+               float32_t query_dimensions[] =
+               {bl_x, tr_x, bl_y, tr_y, grid_spec->time_min,
+                grid_spec->time_max};
+               row_offsets[u - first_u] = row_hits->length;
+               row_centres_x[u - first_u] = (bl_x + tr_x) / 2.0;
+               if (metrics != NULL) started = monotonic_nanoseconds();
+               inspec->coordinate_index->query_append(
+                  inspec->coordinate_index, query_dimensions, row_hits);
+               if (metrics != NULL) {
+                  thread_metrics.phase_nanoseconds[phase_query] +=
+                     monotonic_nanoseconds() - started;
+                  run_metrics_count_query(
+                     &thread_metrics,
+                     row_hits->length - row_offsets[u - first_u]);
+               }
+            } else if (inspec->number_data_inputs > 0 || band->diagnosing) {
+               float32_t query_dimensions[] =
+               {bl_x, tr_x, bl_y, tr_y, grid_spec->time_min,
+                grid_spec->time_max};
+
+               // The query is counted for the diagnostic outputs, if any
+               query_counts counts;
+               query_counts *cell_counts = band->diagnosing ? &counts : NULL;
+               result_set *current_result_set;
+               if (metrics != NULL) started = monotonic_nanoseconds();
+               if (band->reprojected) {
+                  current_result_set = query_reprojected(
+                     inspec->coordinate_index, grid_spec->input_projector,
+                     query_dimensions, cell_counts);
+               } else if (cell_counts != NULL) {
+                  current_result_set = inspec->coordinate_index->query_counted(
+                     inspec->coordinate_index, query_dimensions, cell_counts);
+               } else {
+                  current_result_set = inspec->coordinate_index->query(
+                     inspec->coordinate_index, query_dimensions);
+               }
+               if (metrics != NULL) {
+                  queried = monotonic_nanoseconds();
+                  thread_metrics.phase_nanoseconds[phase_query] +=
+                     queried - started;
+                  run_metrics_count_query(&thread_metrics,
+                                          current_result_set->length);
+               }
+               if (band->time_step > 0.0) {
+                  reduce_time_bins(inspec, band, current_result_set,
+                                   query_dimensions, index, reduce_func,
+                                   attrs, &bin_buffer);
+               } else {
+                  reduce_cell(inspec, outspec, current_result_set,
+                              query_dimensions, index, reduce_func, attrs);
+               }
+               if (metrics != NULL) {
+                  thread_metrics.phase_nanoseconds[phase_reduction] +=
+                     monotonic_nanoseconds() - queried;
+               }
+               if (cell_counts != NULL) {
+                  store_query_counts(outspec, cell_counts, index);
+               }
+               current_result_set->free(current_result_set);
+            }
+         }
+
+         if (band->reduce_rows) {
+            // Reduce the tile's row of cells for each variable, storing the
+            // values contiguously from the first cell of the row
+            row_offsets[tile_width] = row_hits->length;
+            float32_t centre_y = cell_centre(
+               band->y_0, grid_spec->vertical_resolution, v);
+            float32_t row_bl_y = centre_y - grid_spec->vertical_sampling_offset;
+            float32_t row_tr_y = centre_y + grid_spec->vertical_sampling_offset;
+            size_t first_index = (size_t) (last_v-v-1) * grid_width + first_u;
+            if (metrics != NULL) queried = monotonic_nanoseconds();
+            for (int var=0; var<inspec->number_data_inputs; var++) {
+               if (outspec->data_outputs[var] != NULL) {
+                  reduce_func.call_row(row_hits, row_offsets,
+                                       tile_width, row_centres_x,
+                                       (row_bl_y + row_tr_y) / 2.0, attrs,
+                                       inspec->data_inputs[var],
+                                       outspec->data_outputs[var], first_index,
+                                       inspec->input_dtypes[var],
+                                       outspec->output_dtypes[var]);
+               }
+            }
+            if (metrics != NULL) {
+               thread_metrics.phase_nanoseconds[phase_reduction] +=
+                  monotonic_nanoseconds() - queried;
+            }
+         }
+      }
+   }
+
+   if (any_reduce_rows) {
+      row_hits->free(row_hits);
+      free(row_offsets);
+      free(row_centres_x);
+   }
+   free(bin_buffer.items);
+   free(bin_buffer.offsets);
+
+   // The storage kept between cells by the reduction functions belongs to
+   // the threads of this team (the master thread's also holding that used for
+   // the empty cells, see empty_cell_init), so each frees its own here
+   reduction_thread_storage_free();
+   if (metrics != NULL) {
+      #pragma omp critical
+      run_metrics_merge(metrics, &thread_metrics);
+   }
+   }
+   free(tiles);
+}
+
+/**
+  * Perform gridding based on input and output specifications, using the
+  *specified reduction function and data source.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+void perform_gridding(input_spec inspec, output_spec outspec,
+                      reduction_function reduce_func, reduction_attrs *attrs,
+                      int verbosity) {
+   perform_multiple_gridding(inspec, &outspec, 1, reduce_func, attrs,
+                             verbosity);
+}
+
+/**
+  * Perform gridding onto several output grids at once, sharing the index
+  *between them. The tiles of every grid are scheduled together, so that
+  *threads are kept busy until every grid is complete. A grid may be in a
+  *different projection from the index (see grid::input_projector), in which
+  *case the sampling box of each of its cells is re-projected to query the
+  *index, and the observations found are re-projected into the grid.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspecs Specification of each output grid.
+  * @param number_grids The number of output grids.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+void perform_multiple_gridding(input_spec inspec, output_spec *outspecs,
+                               int number_grids,
+                               reduction_function reduce_func,
+                               reduction_attrs *attrs, int verbosity) {
+   perform_time_binned_gridding(inspec, outspecs, number_grids, 1, 0.0,
+                                reduce_func, attrs, verbosity);
+}
+
+/**
+  * Perform gridding onto several output grids at once, dividing the
+  *observations of each cell between a number of consecutive time bins, each
+  *with its own outputs. The index is queried once for each cell across the
+  *times of every bin, rather than once for each bin. The first bin starts at
+  *the earliest time of the grid (see grid::time_min), and each bin holds the
+  *observations from its start up to (but not including) the start of the
+  *next (the last bin also holds the observations at the latest time of the
+  *grid).
+  *
+  * @param inspec Specification of the input data.
+  * @param outspecs Specification of each time bin of each output grid (the
+  *bins of the first grid, then the bins of the second, and so on). The bins of
+  *a grid share its grid::grid_spec, and only the latitude and longitude
+  *outputs of its first bin are used.
+  * @param number_grids The number of output grids.
+  * @param number_time_bins The number of time bins of each grid.
+  * @param time_step The length of each time bin (0 for a single bin holding
+  *every time of the grid, as perform_multiple_gridding).
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+void perform_time_binned_gridding(input_spec inspec, output_spec *outspecs,
+                                  int number_grids, int number_time_bins,
+                                  float32_t time_step,
+                                  reduction_function reduce_func,
+                                  reduction_attrs *attrs, int verbosity) {
+
+   if (verbosity > 0) printf("Building output image\n");
+   if (verbosity > 0) {
+      printf("Using %s kernels\n", cpu_level_name(cpu_dispatch_level()));
+   }
+   uint64_t start_time = monotonic_nanoseconds();
+
+   // Skip invalid and rejected observations as the index is searched, so
+   // that they are never stored or gathered
+   if (inspec.valid != NULL || inspec.qa != NULL) {
+      inspec.coordinate_index->filter = &observation_accepted;
+      inspec.coordinate_index->filter_context = &inspec;
+   }
+
+   grid_band *bands = malloc(sizeof(grid_band) * number_grids);
+   if (bands == NULL) {
+      fprintf(stderr, "Could not allocate space for %d grids\n", number_grids);
+      exit(EXIT_FAILURE);
+   }
+   for (int g=0; g<number_grids; g++) {
+      output_spec *first_bin = &outspecs[g * number_time_bins];
+      grid_band_init(&bands[g], &inspec, first_bin, reduce_func, attrs, 0,
+                     first_bin->grid_spec->height, number_time_bins,
+                     time_step);
+      if (verbosity > 0 && bands[g].reprojected) {
+         printf("Re-projecting grid %d into the projection of the index\n",
+                g + 1);
+      }
+   }
+   if (verbosity > 0 && time_step > 0.0) {
+      printf("Dividing each cell between %d time bins\n", number_time_bins);
+   }
+   grid_bands(&inspec, bands, number_grids, reduce_func, attrs, verbosity);
+   for (int g=0; g<number_grids; g++) {
+      store_grid_coordinates(bands[g].outspec, bands[g].x_0, bands[g].y_0, 0,
+                             bands[g].outspec->grid_spec->height);
+      empty_cell_free(&inspec, &bands[g].empty_cell);
+   }
+   free(bands);
+   inspec.coordinate_index->filter = NULL;
+   inspec.coordinate_index->filter_context = NULL;
+
+   uint64_t end_time = monotonic_nanoseconds();
+   if (verbosity > 0) {
+      printf("Output image built.\n");
+      printf("Building image took %.3f seconds\n",
+             (end_time - start_time) / 1e9);
+   }
+}
+
+/**
+  * Perform gridding one band of rows at a time, writing each finished band to
+  *the output files before starting the next, so that the memory used for the
+  *outputs is bounded by a budget rather than by the size of the grid. The
+  *bands are gridded from the top of the grid down, so that every output file
+  *is written sequentially.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid. Its output pointers are
+  *ignored, as the outputs are buffered a band at a time and written to @a
+  *files.
+  * @param files The files that the outputs are written to.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param memory_budget The number of bytes that the buffered outputs of a
+  *band may occupy (at least one row is always buffered).
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+void perform_tiled_gridding(input_spec inspec, output_spec outspec,
+                            output_files files,
+                            reduction_function reduce_func,
+                            reduction_attrs *attrs, size_t memory_budget,
+                            int verbosity) {
+
+   if (verbosity > 0) printf("Building output image\n");
+   if (verbosity > 0) {
+      printf("Using %s kernels\n", cpu_level_name(cpu_dispatch_level()));
+   }
+   uint64_t start_time = monotonic_nanoseconds();
+
+   grid *grid_spec = outspec.grid_spec;
+
+   if (inspec.valid != NULL || inspec.qa != NULL) {
+      inspec.coordinate_index->filter = &observation_accepted;
+      inspec.coordinate_index->filter_context = &inspec;
+   }
+
+   // Size the bands to the budget, rounding down to a whole number of tiles
+   // where the budget allows more than one tile of rows
+   size_t row_bytes = 0;
+   for (int var=0; var<inspec.number_data_inputs; var++) {
+      if (files.data_outputs[var] != -1) {
+         row_bytes += outspec.output_dtypes[var].size;
+      }
+      row_bytes += outspec.number_statistic_outputs[var] *
+                   outspec.output_dtypes[var].size;
+   }
+   if (files.lats_output != -1) row_bytes += sizeof(float32_t);
+   if (files.lons_output != -1) row_bytes += sizeof(float32_t);
+   row_bytes *= grid_spec->width;
+   size_t budget_rows = (row_bytes > 0) ? memory_budget / row_bytes : 0;
+   int band_rows = grid_spec->height;
+   if (row_bytes > 0 && budget_rows < (size_t) band_rows) {
+      band_rows = (budget_rows >= TILE_SIZE) ?
+                  (int) (budget_rows - budget_rows % TILE_SIZE) :
+                  (int) budget_rows;
+      if (band_rows < 1) band_rows = 1;
+   }
+   int number_bands = (grid_spec->height + band_rows - 1) / band_rows;
+   if (verbosity > 0) {
+      printf("Gridding %d bands of up to %d rows\n", number_bands, band_rows);
+   }
+
+   // Allocate a buffer for each output, holding one band
+   size_t band_cells = (size_t) band_rows * grid_spec->width;
+   output_spec buffers = outspec;
+   buffers.data_outputs = calloc(inspec.number_data_inputs, sizeof(char *));
+   buffers.statistic_outputs = calloc(inspec.number_data_inputs,
+                                   sizeof(statistic_output *));
+   if (buffers.data_outputs == NULL || buffers.statistic_outputs == NULL) {
+      fprintf(stderr, "Could not allocate space for the band outputs\n");
+      exit(EXIT_FAILURE);
+   }
+   for (int var=0; var<inspec.number_data_inputs; var++) {
+      size_t buffer_bytes = band_cells * outspec.output_dtypes[var].size;
+      if (files.data_outputs[var] != -1) {
+         buffers.data_outputs[var] = malloc(buffer_bytes);
+         if (buffers.data_outputs[var] == NULL) {
+            fprintf(stderr, "Could not allocate %zu bytes for a band\n",
+                    buffer_bytes);
+            exit(EXIT_FAILURE);
+         }
+      }
+      int number_statistics = outspec.number_statistic_outputs[var];
+      if (number_statistics > 0) {
+         buffers.statistic_outputs[var] = malloc(sizeof(statistic_output) *
+                                              number_statistics);
+         if (buffers.statistic_outputs[var] == NULL) {
+            fprintf(stderr, "Could not allocate space for the band outputs\n");
+            exit(EXIT_FAILURE);
+         }
+      }
+      for (int i=0; i<number_statistics; i++) {
+         buffers.statistic_outputs[var][i] = outspec.statistic_outputs[var][i];
+         buffers.statistic_outputs[var][i].data_output = malloc(buffer_bytes);
+         if (buffers.statistic_outputs[var][i].data_output == NULL) {
+            fprintf(stderr, "Could not allocate %zu bytes for a band\n",
+                    buffer_bytes);
+            exit(EXIT_FAILURE);
+         }
+      }
+   }
+   buffers.lats_output = NULL;
+   buffers.lons_output = NULL;
+   buffers.nodes_visited_output = NULL;
+   buffers.leaves_tested_output = NULL;
+   buffers.hits_output = NULL;
+   if (files.lats_output != -1) {
+      buffers.lats_output = malloc(sizeof(float32_t) * band_cells);
+   }
+   if (files.lons_output != -1) {
+      buffers.lons_output = malloc(sizeof(float32_t) * band_cells);
+   }
+   if ((files.lats_output != -1 && buffers.lats_output == NULL) ||
+       (files.lons_output != -1 && buffers.lons_output == NULL)) {
+      fprintf(stderr, "Could not allocate space for the band coordinates\n");
+      exit(EXIT_FAILURE);
+   }
+
+   for (int b=0; b<number_bands; b++) {
+      // Bands are numbered from the top of the grid, as the output is stored
+      int first_row = b * band_rows;
+      int number_rows = grid_spec->height - first_row;
+      if (number_rows > band_rows) number_rows = band_rows;
+      int first_v = grid_spec->height - first_row - number_rows;
+
+      grid_band band;
+      grid_band_init(&band, &inspec, &buffers, reduce_func, attrs, first_v,
+                     number_rows, 1, 0.0);
+      grid_bands(&inspec, &band, 1, reduce_func, attrs, verbosity);
+      store_grid_coordinates(&buffers, band.x_0, band.y_0, first_v,
+                             number_rows);
+      empty_cell_free(&inspec, &band.empty_cell);
+
+      // Flush the finished band to each output file
+      size_t number_cells = (size_t) number_rows * grid_spec->width;
+      size_t first_cell = (size_t) first_row * grid_spec->width;
+      for (int var=0; var<inspec.number_data_inputs; var++) {
+         size_t size = outspec.output_dtypes[var].size;
+         if (files.data_outputs[var] != -1) {
+            write_file_range(files.data_outputs[var], buffers.data_outputs[var],
+                             number_cells * size, first_cell * size);
+         }
+         for (int i=0; i<outspec.number_statistic_outputs[var]; i++) {
+            write_file_range(files.statistic_outputs[var][i],
+                             buffers.statistic_outputs[var][i].data_output,
+                             number_cells * size, first_cell * size);
+         }
+      }
+      if (files.lats_output != -1) {
+         write_file_range(files.lats_output, buffers.lats_output,
+                          number_cells * sizeof(float32_t),
+                          first_cell * sizeof(float32_t));
+      }
+      if (files.lons_output != -1) {
+         write_file_range(files.lons_output, buffers.lons_output,
+                          number_cells * sizeof(float32_t),
+                          first_cell * sizeof(float32_t));
+      }
+      if (verbosity > 1) {
+         printf("Band %d of %d written\n", b + 1, number_bands);
+      }
+   }
+
+   for (int var=0; var<inspec.number_data_inputs; var++) {
+      free(buffers.data_outputs[var]);
+      for (int i=0; i<outspec.number_statistic_outputs[var]; i++) {
+         free(buffers.statistic_outputs[var][i].data_output);
+      }
+      free(buffers.statistic_outputs[var]);
+   }
+   free(buffers.data_outputs);
+   free(buffers.statistic_outputs);
+   free(buffers.lats_output);
+   free(buffers.lons_output);
+   inspec.coordinate_index->filter = NULL;
+   inspec.coordinate_index->filter_context = NULL;
+
+   uint64_t end_time = monotonic_nanoseconds();
+   if (verbosity > 0) {
+      printf("Output image built.\n");
+      printf("Building image took %.3f seconds\n",
+             (end_time - start_time) / 1e9);
+   }
+}
+
+/**
+  * Update existing outputs in place after observations have been appended to
+  *the input, regridding only the cells whose sampling boxes may contain a new
+  *observation. The outputs must hold the result of gridding the observations
+  *before @a first_new_observation with the same options, and the index must
+  *hold every observation. The latitude and longitude outputs are not written,
+  *as they do not change.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid, whose outputs hold the
+  *existing grid.
+  * @param first_new_observation The record index of the first new observation
+  *(every observation from this index onwards is new).
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+void perform_incremental_gridding(input_spec inspec, output_spec outspec,
+                                  size_t first_new_observation,
+                                  reduction_function reduce_func,
+                                  reduction_attrs *attrs, int verbosity) {
+
+   if (verbosity > 0) {
+      printf("Updating output image with observations from record %zu\n",
+             first_new_observation);
+   }
+   uint64_t start_time = monotonic_nanoseconds();
+
+   grid *grid_spec = outspec.grid_spec;
+   int grid_width = grid_spec->width;
+   int grid_height = grid_spec->height;
+   size_t number_cells = (size_t) grid_width * grid_height;
+   unsigned char *dirty = calloc(number_cells, sizeof(unsigned char));
+   if (dirty == NULL) {
+      fprintf(stderr, "Could not allocate space to mark %zu cells\n",
+              number_cells);
+      exit(EXIT_FAILURE);
+   }
+
+   // Skip invalid and rejected observations as the index is scanned and
+   // searched, as they cannot change any cell
+   if (inspec.valid != NULL || inspec.qa != NULL) {
+      inspec.coordinate_index->filter = &observation_accepted;
+      inspec.coordinate_index->filter_context = &inspec;
+   }
+
+   grid_band band;
+   grid_band_init(&band, &inspec, &outspec, reduce_func, attrs, 0,
+                  grid_height, 1, 0.0);
+   projector *index_projector = inspec.coordinate_index->input_projector;
+
+   // The number of cells either side of the cell containing an observation
+   // whose sampling boxes may also contain it
+   int reach_u = (int) ceilf(grid_spec->horizontal_sampling_offset /
+                             grid_spec->horizontal_resolution) + 1;
+   int reach_v = (int) ceilf(grid_spec->vertical_sampling_offset /
+                             grid_spec->vertical_resolution) + 1;
+
+   // Mark every cell near each new observation
+   size_t number_observations = inspec.coordinate_index->num_observations;
+   size_t number_chunks = (number_observations + SCATTER_CHUNK_SIZE - 1) /
+                          SCATTER_CHUNK_SIZE;
+   size_t number_new = 0;
+   #pragma omp parallel reduction(+:number_new)
+   {
+   hit_list *hits = hit_list_init();
+
+   #pragma omp for schedule(dynamic)
+   for (size_t chunk=0; chunk<number_chunks; chunk++) {
+      size_t first = chunk * SCATTER_CHUNK_SIZE;
+      size_t count = number_observations - first;
+      if (count > SCATTER_CHUNK_SIZE) count = SCATTER_CHUNK_SIZE;
+
+      hits->clear(hits);
+      inspec.coordinate_index->scan(inspec.coordinate_index, first, count,
+                                    hits);
+      for (unsigned int h=0; h<hits->length; h++) {
+         float32_t t = hits->t[h];
+         if (hits->record_indices[h] < first_new_observation ||
+             !(t >= grid_spec->time_min && t <= grid_spec->time_max)) {
+            continue;
+         }
+         number_new++;
+
+         float32_t x = hits->x[h];
+         float32_t y = hits->y[h];
+         if (band.reprojected) {
+            spherical_coordinates s = index_projector->inverse_project(
+               index_projector, y, x);
+            projected_coordinates p = grid_spec->input_projector->project(
+               grid_spec->input_projector, s.longitude, s.latitude);
+            x = p.x;
+            y = p.y;
+         }
+
+         // Find the range of cells which may contain the observation (this
+         // also rejects observations far outside the grid, and NaNs)
+         float32_t u_position = (x - band.x_0) /
+                                grid_spec->horizontal_resolution;
+         float32_t v_position = (y - band.y_0) /
+                                grid_spec->vertical_resolution;
+         if (!(u_position > -reach_u && u_position < grid_width + reach_u &&
+               v_position > -reach_v && v_position < grid_height + reach_v)) {
+            continue;
+         }
+         int first_u = (int) floorf(u_position) - reach_u;
+         int last_u = (int) floorf(u_position) + reach_u;
+         int first_v = (int) floorf(v_position) - reach_v;
+         int last_v = (int) floorf(v_position) + reach_v;
+         if (first_u < 0) first_u = 0;
+         if (last_u > grid_width - 1) last_u = grid_width - 1;
+         if (first_v < 0) first_v = 0;
+         if (last_v > grid_height - 1) last_v = grid_height - 1;
+
+         for (int v=first_v; v<=last_v; v++) {
+            for (int u=first_u; u<=last_u; u++) {
+               #pragma omp atomic write
+               dirty[(size_t) v * grid_width + u] = 1;
+            }
+         }
+      }
+   }
+   hits->free(hits);
+   }
+
+   size_t number_dirty = 0;
+   for (size_t cell=0; cell<number_cells; cell++) {
+      number_dirty += dirty[cell];
+   }
+   if (verbosity > 0) {
+      printf("%zu new observations touch %zu of %zu cells\n", number_new,
+             number_dirty, number_cells);
+   }
+
+   // Regrid just the marked cells, one at a time (reducing a whole row would
+   // also overwrite the unmarked cells of the row)
+   band.dirty = dirty;
+   band.reduce_rows = 0;
+   grid_bands(&inspec, &band, 1, reduce_func, attrs, verbosity);
+   empty_cell_free(&inspec, &band.empty_cell);
+   free(dirty);
+   inspec.coordinate_index->filter = NULL;
+   inspec.coordinate_index->filter_context = NULL;
+
+   uint64_t end_time = monotonic_nanoseconds();
+   if (verbosity > 0) {
+      printf("Output image updated.\n");
+      printf("Updating image took %.3f seconds\n",
+             (end_time - start_time) / 1e9);
+   }
+}
+
+/**
+  * The accumulated state of every cell of the grid, for one variable, as
+  *gathered by one thread of perform_scatter_gridding. Only the arrays needed
+  *for the requested outputs are allocated (the others are NULL).
+  */
+typedef struct {
+   /** The number of (non-fill) values of each cell.*/
+   unsigned int *count;
+
+   /** The sum of the values of each cell.*/
+   NUMERIC_WORKING_TYPE *sum;
+
+   /** The smallest value of each cell.*/
+   NUMERIC_WORKING_TYPE *minimum;
+
+   /** The largest value of each cell.*/
+   NUMERIC_WORKING_TYPE *maximum;
+
+   /** The value of the newest observation of each cell.*/
+   NUMERIC_WORKING_TYPE *newest_value;
+
+   /** The time of the newest observation of each cell.*/
+   float *newest_time;
+
+   /** The record index of the newest observation of each cell, to break ties
+    *between equally new observations as reduce_numeric_newest does.*/
+   size_t *newest_record;
+
+   /** The sum of the values of each cell, each multiplied by its (positive)
+    *input weight.*/
+   NUMERIC_WORKING_TYPE *weighted_sum;
+
+   /** The sum of the (positive) input weights of each cell.*/
+   NUMERIC_WORKING_TYPE *total_weight;
+
+   /** A quantile sketch of the values of each cell (NULL until the cell
+    *receives its first value).*/
+   quantile_sketch **sketch;
+
+   /** The rank error of the quantile sketches.*/
+   float sketch_rank_error;
+
+   /** The number of cells of the grid.*/
+   size_t number_cells;
+} cell_accumulator;
+
+/**
+  * Allocate one of the arrays of a cell_accumulator, zeroed.
+  *
+  * @param number_cells The number of cells of the grid.
+  * @param item_size The size of each item of the array.
+  * @return Pointer to the array.
+  */
+static void *allocate_accumulator_array(size_t number_cells,
+                                        size_t item_size) {
+   void *array = calloc(number_cells, item_size);
+   if (array == NULL) {
+      fprintf(stderr, "Could not allocate space to accumulate %zu cells\n",
+              number_cells);
+      exit(EXIT_FAILURE);
+   }
+   return array;
+}
+
+/**
+  * Determine whether a reduction function can be accumulated by
+  *perform_scatter_gridding (mean and newest can be).
+  *
+  * @param reduce_func The reduction function.
+  * @return 1 if the reduction function is supported, 0 otherwise.
+  */
+int scatter_reduction_supported(reduction_function reduce_func) {
+   return strcmp(reduce_func.name, "mean") == 0 ||
+          strcmp(reduce_func.name, "newest") == 0;
+}
+
+/**
+  * Determine whether a statistic can be accumulated by
+  *perform_scatter_gridding (count, sum, mean, min and max can be).
+  *
+  * @param stat The statistic.
+  * @return 1 if the statistic is supported, 0 otherwise.
+  */
+int scatter_statistic_supported(statistic stat) {
+   return stat == statistic_count || stat == statistic_sum ||
+          stat == statistic_mean || stat == statistic_min ||
+          stat == statistic_max;
+}
+
+/**
+  * Allocate the arrays of a cell_accumulator needed for the outputs of a
+  *variable.
+  *
+  * @param accumulator The cell_accumulator to initialise.
+  * @param number_cells The number of cells of the grid.
+  * @param reduce_func The selected reduction function.
+  * @param outspec Specification of the output grid.
+  * @param var The number of the variable.
+  * @param attrs Attributes of the reduction (providing the rank error of the
+  *percentile reduction function).
+  */
+static void cell_accumulator_init(cell_accumulator *accumulator,
+                                  size_t number_cells,
+                                  reduction_function reduce_func,
+                                  output_spec *outspec, int var,
+                                  reduction_attrs *attrs) {
+   int need_sum = 0, need_minimum = 0, need_maximum = 0, need_newest = 0;
+   int need_weights = 0, need_sketch = 0;
+   if (outspec->data_outputs[var] != NULL) {
+      need_sum = (strcmp(reduce_func.name, "mean") == 0);
+      need_newest = (strcmp(reduce_func.name, "newest") == 0);
+      need_weights = (strcmp(reduce_func.name, "input_weighted_mean") == 0);
+      need_sketch = (strcmp(reduce_func.name, "percentile") == 0);
+   }
+   for (int o=0; o<outspec->number_statistic_outputs[var]; o++) {
+      switch (outspec->statistic_outputs[var][o].stat) {
+      case statistic_sum:
+      case statistic_mean:
+         need_sum = 1;
+         break;
+      case statistic_min:
+         need_minimum = 1;
+         break;
+      case statistic_max:
+         need_maximum = 1;
+         break;
+      default:
+         break;
+      }
+   }
+
+   #define allocate_if(needed, array) \
+   accumulator->array = (needed) ? allocate_accumulator_array( \
+      number_cells, sizeof(*accumulator->array)) : NULL
+   allocate_if(1, count);
+   allocate_if(need_sum, sum);
+   allocate_if(need_minimum, minimum);
+   allocate_if(need_maximum, maximum);
+   allocate_if(need_newest, newest_value);
+   allocate_if(need_newest, newest_time);
+   allocate_if(need_newest, newest_record);
+   allocate_if(need_weights, weighted_sum);
+   allocate_if(need_weights, total_weight);
+   allocate_if(need_sketch, sketch);
+   #undef allocate_if
+   accumulator->sketch_rank_error = attrs->percentile_rank_error;
+   accumulator->number_cells = number_cells;
+}
+
+/**
+  * Free the arrays of a cell_accumulator.
+  *
+  * @param accumulator The cell_accumulator.
+  */
+static void cell_accumulator_free(cell_accumulator *accumulator) {
+   free(accumulator->count);
+   free(accumulator->sum);
+   free(accumulator->minimum);
+   free(accumulator->maximum);
+   free(accumulator->newest_value);
+   free(accumulator->newest_time);
+   free(accumulator->newest_record);
+   free(accumulator->weighted_sum);
+   free(accumulator->total_weight);
+   if (accumulator->sketch != NULL) {
+      for (size_t cell=0; cell<accumulator->number_cells; cell++) {
+         if (accumulator->sketch[cell] != NULL) {
+            accumulator->sketch[cell]->free(accumulator->sketch[cell]);
+         }
+      }
+      free(accumulator->sketch);
+   }
+}
+
+/**
+  * Add a single value to a cell of a cell_accumulator.
+  *
+  * @param accumulator The cell_accumulator.
+  * @param cell The index of the cell.
+  * @param value The value.
+  * @param t The time of the observation.
+  * @param record_index The record index of the observation.
+  */
+static inline void cell_accumulator_add(cell_accumulator *accumulator,
+                                        size_t cell, NUMERIC_WORKING_TYPE value,
+                                        float t, size_t record_index) {
+   unsigned int count = accumulator->count[cell]++;
+   if (accumulator->sum != NULL) {
+      accumulator->sum[cell] += value;
+   }
+   if (accumulator->minimum != NULL &&
+       (count == 0 || value < accumulator->minimum[cell])) {
+      accumulator->minimum[cell] = value;
+   }
+   if (accumulator->maximum != NULL &&
+       (count == 0 || value > accumulator->maximum[cell])) {
+      accumulator->maximum[cell] = value;
+   }
+   if (accumulator->newest_value != NULL &&
+       (count == 0 || t > accumulator->newest_time[cell] ||
+        (t == accumulator->newest_time[cell] &&
+         record_index < accumulator->newest_record[cell]))) {
+      accumulator->newest_value[cell] = value;
+      accumulator->newest_time[cell] = t;
+      accumulator->newest_record[cell] = record_index;
+   }
+   if (accumulator->sketch != NULL) {
+      if (count == 0) {
+         accumulator->sketch[cell] =
+            quantile_sketch_init(accumulator->sketch_rank_error);
+      }
+      accumulator->sketch[cell]->update(accumulator->sketch[cell], value);
+   }
+}
+
+/**
+  * Merge a cell of one cell_accumulator into a cell of another.
+  *
+  * @param total The cell_accumulator to merge into.
+  * @param total_cell The index of the cell to merge into.
+  * @param part The cell_accumulator to merge from.
+  * @param part_cell The index of the cell to merge from.
+  */
+static inline void cell_accumulator_merge(cell_accumulator *total,
+                                          size_t total_cell,
+                                          cell_accumulator *part,
+                                          size_t part_cell) {
+   if (part->count[part_cell] == 0) {
+      return;
+   }
+   int total_empty = (total->count[total_cell] == 0);
+   total->count[total_cell] += part->count[part_cell];
+   if (total->sum != NULL) {
+      total->sum[total_cell] += part->sum[part_cell];
+   }
+   if (total->minimum != NULL &&
+       (total_empty || part->minimum[part_cell] < total->minimum[total_cell])) {
+      total->minimum[total_cell] = part->minimum[part_cell];
+   }
+   if (total->maximum != NULL &&
+       (total_empty || part->maximum[part_cell] > total->maximum[total_cell])) {
+      total->maximum[total_cell] = part->maximum[part_cell];
+   }
+   if (total->newest_value != NULL &&
+       (total_empty ||
+        part->newest_time[part_cell] > total->newest_time[total_cell] ||
+        (part->newest_time[part_cell] == total->newest_time[total_cell] &&
+         part->newest_record[part_cell] < total->newest_record[total_cell]))) {
+      total->newest_value[total_cell] = part->newest_value[part_cell];
+      total->newest_time[total_cell] = part->newest_time[part_cell];
+      total->newest_record[total_cell] = part->newest_record[part_cell];
+   }
+   if (total->sketch != NULL) {
+      if (total_empty) {
+         total->sketch[total_cell] =
+            quantile_sketch_init(total->sketch_rank_error);
+      }
+      total->sketch[total_cell]->merge(total->sketch[total_cell],
+                                       part->sketch[part_cell]);
+   }
+}
 
 /**
-  * Perform gridding based on input and output specifications, using the
-  *specified reduction function and data source.
+  * Store the outputs of a variable for a single cell from its accumulated
+  *state.
+  *
+  * @param accumulator The cell_accumulator of the variable.
+  * @param cell The index of the cell.
+  * @param outspec Specification of the output grid.
+  * @param var The number of the variable.
+  * @param attrs Attributes of the reduction (providing the output fill value).
+  */
+static void cell_accumulator_store(cell_accumulator *accumulator, size_t cell,
+                                   output_spec *outspec, int var,
+                                   reduction_attrs *attrs) {
+   unsigned int count = accumulator->count[cell];
+   NUMERIC_WORKING_TYPE fill = attrs->output_fill_value;
+   NUMERIC_WORKING_TYPE output_value;
+
+   if (outspec->data_outputs[var] != NULL) {
+      if (accumulator->weighted_sum != NULL) {
+         output_value = (accumulator->total_weight[cell] == 0.0) ? fill :
+                        accumulator->weighted_sum[cell] /
+                        accumulator->total_weight[cell];
+      } else if (count == 0) {
+         output_value = fill;
+      } else if (accumulator->newest_value != NULL) {
+         output_value = accumulator->newest_value[cell];
+      } else if (accumulator->sketch != NULL) {
+         output_value = accumulator->sketch[cell]->query(
+            accumulator->sketch[cell], attrs->percentile);
+      } else {
+         output_value = accumulator->sum[cell] / (NUMERIC_WORKING_TYPE) count;
+      }
+      numeric_put(outspec->data_outputs[var], outspec->output_dtypes[var],
+                  cell, output_value);
+   }
+
+   for (int o=0; o<outspec->number_statistic_outputs[var]; o++) {
+      statistic_output *output = &outspec->statistic_outputs[var][o];
+      switch (output->stat) {
+      case statistic_count:
+         output_value = (NUMERIC_WORKING_TYPE) count;
+         break;
+      case statistic_sum:
+         output_value = accumulator->sum[cell];
+         break;
+      case statistic_mean:
+         output_value = (count == 0) ? fill :
+                        accumulator->sum[cell] / (NUMERIC_WORKING_TYPE) count;
+         break;
+      case statistic_min:
+         output_value = (count == 0) ? fill : accumulator->minimum[cell];
+         break;
+      case statistic_max:
+         output_value = (count == 0) ? fill : accumulator->maximum[cell];
+         break;
+      default:
+         fprintf(stderr,
+                 "Unsupported statistic (%d) - this is probably a bug in "\
+                 "Caspian\n", output->stat);
+         exit(EXIT_FAILURE);
+      }
+      numeric_put(output->data_output, output->output_dtype, cell,
+                  output_value);
+   }
+}
+
+/**
+  * Accumulate every observation of the index into the cells whose sampling
+  *box contains it. Each thread accumulates the observations it visits over the
+  *whole grid, and the threads' accumulations are merged at the end, so the
+  *memory required grows with the number of threads.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param half_open 0 to test the sampling boxes as perform_gridding queries
+  *them (closed, so an observation on the edge of two boxes is added to both),
+  *or 1 to add each observation to the single cell containing it, where each
+  *cell includes its left and top edges but not its right and bottom edges
+  *(the sampling boxes must be the cells).
+  * @return The accumulated state of every cell, one cell_accumulator per
+  *variable (free each with cell_accumulator_free, then free the array).
+  */
+static cell_accumulator *scatter_observations(input_spec inspec,
+                                              output_spec *outspec,
+                                              reduction_function reduce_func,
+                                              reduction_attrs *attrs,
+                                              int half_open) {
+   grid *grid_spec = outspec->grid_spec;
+   int grid_width = grid_spec->width;
+   int grid_height = grid_spec->height;
+   size_t number_cells = (size_t) grid_width * grid_height;
+   int number_variables = inspec.number_data_inputs;
+
+   float32_t x_0, y_0;
+   grid_origin(grid_spec, &x_0, &y_0);
+
+   // The number of cells either side of the cell containing an observation
+   // whose sampling boxes may also contain it
+   int reach_u = (int) ceilf(grid_spec->horizontal_sampling_offset /
+                             grid_spec->horizontal_resolution) + 1;
+   int reach_v = (int) ceilf(grid_spec->vertical_sampling_offset /
+                             grid_spec->vertical_resolution) + 1;
+
+   // Skip invalid and rejected observations as the index is scanned
+   if (inspec.valid != NULL || inspec.qa != NULL) {
+      inspec.coordinate_index->filter = &observation_accepted;
+      inspec.coordinate_index->filter_context = &inspec;
+   }
+
+   // Allocate the accumulators of every thread before any are used, so that
+   // they can be merged regardless of how many threads take part
+   int number_threads = omp_get_max_threads();
+   cell_accumulator *accumulators = malloc(
+      sizeof(cell_accumulator) * number_threads * number_variables);
+   if (accumulators == NULL) {
+      fprintf(stderr, "Could not allocate space for the accumulators\n");
+      exit(EXIT_FAILURE);
+   }
+   for (int a=0; a<number_threads * number_variables; a++) {
+      cell_accumulator_init(&accumulators[a], number_cells, reduce_func,
+                            outspec, a % number_variables, attrs);
+   }
+
+   size_t number_observations = inspec.coordinate_index->num_observations;
+   size_t number_chunks = (number_observations + SCATTER_CHUNK_SIZE - 1) /
+                          SCATTER_CHUNK_SIZE;
+
+   #pragma omp parallel
+   {
+   cell_accumulator *thread_accumulators =
+      &accumulators[omp_get_thread_num() * number_variables];
+   hit_list *hits = hit_list_init();
+   NUMERIC_WORKING_TYPE *values = malloc(sizeof(NUMERIC_WORKING_TYPE) *
+                                         SCATTER_CHUNK_SIZE * number_variables);
+   char *valid = malloc(SCATTER_CHUNK_SIZE * number_variables);
+   if (values == NULL || valid == NULL) {
+      fprintf(stderr, "Could not allocate space for a chunk of observations\n");
+      exit(EXIT_FAILURE);
+   }
+
+   #pragma omp for schedule(dynamic)
+   for (size_t chunk=0; chunk<number_chunks; chunk++) {
+      size_t first = chunk * SCATTER_CHUNK_SIZE;
+      size_t count = number_observations - first;
+      if (count > SCATTER_CHUNK_SIZE) count = SCATTER_CHUNK_SIZE;
+
+      hits->clear(hits);
+      inspec.coordinate_index->scan(inspec.coordinate_index, first, count,
+                                    hits);
+      for (int var=0; var<number_variables; var++) {
+         numeric_gather_masked(inspec.data_inputs[var],
+                               inspec.input_dtypes[var], hits->record_indices,
+                               hits->length, attrs->input_fill_value,
+                               &values[var * SCATTER_CHUNK_SIZE],
+                               &valid[var * SCATTER_CHUNK_SIZE]);
+      }
+
+      for (unsigned int h=0; h<hits->length; h++) {
+         float32_t x = hits->x[h];
+         float32_t y = hits->y[h];
+         float32_t t = hits->t[h];
+         if (!(t >= grid_spec->time_min && t <= grid_spec->time_max)) {
+            continue;
+         }
+
+         // Find the range of cells which may contain the observation (this
+         // also rejects observations far outside the grid, and NaNs)
+         float32_t u_position = (x - x_0) / grid_spec->horizontal_resolution;
+         float32_t v_position = (y - y_0) / grid_spec->vertical_resolution;
+         if (!(u_position > -reach_u && u_position < grid_width + reach_u &&
+               v_position > -reach_v && v_position < grid_height + reach_v)) {
+            continue;
+         }
+         int first_u = (int) floorf(u_position) - reach_u;
+         int last_u = (int) floorf(u_position) + reach_u;
+         int first_v = (int) floorf(v_position) - reach_v;
+         int last_v = (int) floorf(v_position) + reach_v;
+         if (half_open) {
+            // Only the cell holding the observation, which belongs to the
+            // cell to its right, or below, where it lies on an edge
+            first_u = last_u = (int) floorf(u_position);
+            first_v = last_v = (int) ceilf(v_position) - 1;
+            if (first_u < 0 || first_u >= grid_width ||
+                first_v < 0 || first_v >= grid_height) {
+               continue;
+            }
+         }
+         if (first_u < 0) first_u = 0;
+         if (last_u > grid_width - 1) last_u = grid_width - 1;
+         if (first_v < 0) first_v = 0;
+         if (last_v > grid_height - 1) last_v = grid_height - 1;
+
+         // Add the observation to each cell whose sampling box contains it,
+         // testing the box exactly as perform_gridding queries it
+         for (int v=first_v; v<=last_v; v++) {
+            float32_t cr_y = cell_centre(y_0, grid_spec->vertical_resolution,
+                                         v);
+            float32_t bl_y = cr_y - grid_spec->vertical_sampling_offset;
+            float32_t tr_y = cr_y + grid_spec->vertical_sampling_offset;
+            if (!half_open && (y < bl_y || y > tr_y)) {
+               continue;
+            }
+            for (int u=first_u; u<=last_u; u++) {
+               float32_t cr_x = cell_centre(
+                  x_0, grid_spec->horizontal_resolution, u);
+               float32_t bl_x = cr_x - grid_spec->horizontal_sampling_offset;
+               float32_t tr_x = cr_x + grid_spec->horizontal_sampling_offset;
+               if (!half_open && (x < bl_x || x > tr_x)) {
+                  continue;
+               }
+               size_t index = (size_t) (grid_height-v-1)*grid_width + u;
+               for (int var=0; var<number_variables; var++) {
+                  if (valid[var * SCATTER_CHUNK_SIZE + h]) {
+                     cell_accumulator_add(
+                        &thread_accumulators[var], index,
+                        values[var * SCATTER_CHUNK_SIZE + h], t,
+                        hits->record_indices[h]);
+                  }
+               }
+            }
+         }
+      }
+   }
+
+   hits->free(hits);
+   free(values);
+   free(valid);
+   }
+
+   // Merge the accumulations of every thread into the first
+   #pragma omp parallel for
+   for (size_t index=0; index<number_cells; index++) {
+      for (int var=0; var<number_variables; var++) {
+         for (int thread=1; thread<number_threads; thread++) {
+            cell_accumulator_merge(
+               &accumulators[var], index,
+               &accumulators[thread * number_variables + var], index);
+         }
+      }
+   }
+
+   for (int a=number_variables; a<number_threads * number_variables; a++) {
+      cell_accumulator_free(&accumulators[a]);
+   }
+   inspec.coordinate_index->filter = NULL;
+   inspec.coordinate_index->filter_context = NULL;
+   return accumulators;
+}
+
+/**
+  * Store the outputs of every cell of a grid from their accumulated states,
+  *and the latitudes and longitudes of the grid.
+  *
+  * @param accumulators The accumulated state of every cell, one
+  *cell_accumulator per variable.
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid.
+  * @param attrs Attributes of the reduction (providing the output fill value).
+  */
+static void store_accumulated_grid(cell_accumulator *accumulators,
+                                   input_spec *inspec, output_spec *outspec,
+                                   reduction_attrs *attrs) {
+   grid *grid_spec = outspec->grid_spec;
+   size_t number_cells = (size_t) grid_spec->width * grid_spec->height;
+   int number_variables = inspec->number_data_inputs;
+
+   #pragma omp parallel for
+   for (size_t index=0; index<number_cells; index++) {
+      for (int var=0; var<number_variables; var++) {
+         cell_accumulator_store(&accumulators[var], index, outspec, var,
+                                attrs);
+      }
+   }
+
+   float32_t x_0, y_0;
+   grid_origin(grid_spec, &x_0, &y_0);
+   store_grid_coordinates(outspec, x_0, y_0, 0, grid_spec->height);
+   if (inspec->metrics != NULL) {
+      inspec->metrics->cells += number_cells;
+   }
+}
+
+/**
+  * Perform gridding by visiting each observation once, and adding it to the
+  *cells whose sampling box contains it (rather than querying the index for
+  *each cell). Each thread accumulates the observations it visits over the
+  *whole grid, and the threads' accumulations are merged at the end, so the
+  *memory required grows with the number of threads.
+  *
+  * Only the reduction functions and statistics accepted by
+  *scatter_reduction_supported and scatter_statistic_supported can be used. The
+  *observations are streamed from the index using spatial_index::scan, so the
+  *index need not support efficient queries (see observation_list.h).
   *
   * @param inspec Specification of the input data.
   * @param outspec Specification of the output grid.
@@ -20,70 +2220,659 @@
   * @param attrs Attributes to be used by the reduction function.
   * @param verbosity Set as >=1 for verbose output, 0 for silence.
   */
-void perform_gridding(input_spec inspec, output_spec outspec,
-                      reduction_function reduce_func, reduction_attrs *attrs,
-                      int verbosity) {
+void perform_scatter_gridding(input_spec inspec, output_spec outspec,
+                              reduction_function reduce_func,
+                              reduction_attrs *attrs, int verbosity) {
 
-   if (verbosity > 0) printf("Building output image\n");
-   time_t start_time = time(NULL);
+   if (verbosity > 0) {
+      printf("Building output image from each observation in turn\n");
+   }
+   uint64_t start_time = monotonic_nanoseconds();
+
+   int number_variables = inspec.number_data_inputs;
+   cell_accumulator *accumulators = scatter_observations(
+      inspec, &outspec, reduce_func, attrs, 0);
+   store_accumulated_grid(accumulators, &inspec, &outspec, attrs);
+
+   for (int var=0; var<number_variables; var++) {
+      cell_accumulator_free(&accumulators[var]);
+   }
+   free(accumulators);
+
+   uint64_t end_time = monotonic_nanoseconds();
+   if (verbosity > 0) {
+      printf("Output image built.\n");
+      printf("Building image took %.3f seconds\n",
+             (end_time - start_time) / 1e9);
+   }
+}
+
+/**
+  * Determine whether the levels of a pyramid can be built by merging the
+  *accumulated cells of each finer level, rather than by querying the index
+  *for each cell of every level. This is the case when the reduction function
+  *and statistics can be accumulated (see scatter_reduction_supported and
+  *scatter_statistic_supported, and the percentile reduction function, whose
+  *cells are accumulated as quantile sketches), and the sampling boxes of the
+  *full resolution grid tile it exactly (the sampling resolution is the
+  *resolution).
+  *
+  * @param inspec Specification of the input data.
+  * @param levels Specification of each level of the pyramid.
+  * @param reduce_func The selected reduction function.
+  * @return 1 if the levels can be merged, 0 otherwise.
+  */
+static int pyramid_can_be_merged(input_spec *inspec, output_spec *levels,
+                                 reduction_function reduce_func) {
+   grid *grid_spec = levels[0].grid_spec;
+   if (grid_spec->horizontal_sampling_offset !=
+       grid_spec->horizontal_resolution / 2.0 ||
+       grid_spec->vertical_sampling_offset !=
+       grid_spec->vertical_resolution / 2.0) {
+      return 0;
+   }
+   for (int var=0; var<inspec->number_data_inputs; var++) {
+      if (levels[0].data_outputs[var] != NULL &&
+          !scatter_reduction_supported(reduce_func) &&
+          strcmp(reduce_func.name, "percentile") != 0) {
+         return 0;
+      }
+      for (int o=0; o<levels[0].number_statistic_outputs[var]; o++) {
+         if (!scatter_statistic_supported(
+                levels[0].statistic_outputs[var][o].stat)) {
+            return 0;
+         }
+      }
+   }
+   return 1;
+}
+
+/**
+  * Perform gridding onto a pyramid of levels, each of which is an overview of
+  *the full resolution grid (see initialise_overview_grid): level k must be the
+  *overview of level 0 at level k, and every level must have the same outputs.
+  *
+  * The full resolution grid is always gridded by querying the index for each
+  *of its cells (as by perform_gridding), so it is the same as if it were
+  *gridded without the pyramid. Where pyramid_can_be_merged allows it, the
+  *observations are then accumulated once onto the full resolution grid (as by
+  *perform_scatter_gridding), and each coarser level is accumulated by merging
+  *the 2 by 2 blocks of cells of the level before it, so the index is only
+  *visited once more. So that each observation is counted once by every
+  *coarser level, these accumulations are over half-open cells (including
+  *their left and top edges, but not their right and bottom edges): an
+  *observation lying exactly on the edge of two cells of a coarser level is
+  *counted by one of them only, where querying the index would count it in
+  *both. Percentiles of the coarser levels are estimated from merged quantile
+  *sketches, within the rank error of reduction_attrs::percentile_rank_error.
+  *
+  * Otherwise, every level is gridded by querying the index for each of its
+  *cells, with one pool of threads shared by every level (see
+  *perform_multiple_gridding).
+  *
+  * @param inspec Specification of the input data.
+  * @param levels Specification of each level of the pyramid, finest first.
+  * @param number_levels The number of levels.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+void perform_pyramid_gridding(input_spec inspec, output_spec *levels,
+                              int number_levels,
+                              reduction_function reduce_func,
+                              reduction_attrs *attrs, int verbosity) {
+   if (!pyramid_can_be_merged(&inspec, levels, reduce_func)) {
+      if (verbosity > 0) {
+         printf("Querying the index for each level of the pyramid\n");
+      }
+      perform_multiple_gridding(inspec, levels, number_levels, reduce_func,
+                                attrs, verbosity);
+      return;
+   }
+
+   perform_gridding(inspec, levels[0], reduce_func, attrs, verbosity);
+
+   if (verbosity > 0) {
+      printf("Building the overviews from each observation in turn\n");
+   }
+   uint64_t start_time = monotonic_nanoseconds();
+
+   // The full resolution cells are only accumulated to be merged into the
+   // first overview, and are not stored
+   int number_variables = inspec.number_data_inputs;
+   cell_accumulator *finer = scatter_observations(inspec, &levels[0],
+                                                  reduce_func, attrs, 1);
+
+   for (int level=1; level<number_levels; level++) {
+      grid *fine_grid = levels[level - 1].grid_spec;
+      grid *coarse_grid = levels[level].grid_spec;
+      int coarse_width = coarse_grid->width;
+      size_t number_cells = (size_t) coarse_width * coarse_grid->height;
+
+      cell_accumulator *coarser = malloc(sizeof(cell_accumulator) *
+                                         number_variables);
+      if (coarser == NULL) {
+         fprintf(stderr, "Could not allocate space for the accumulators\n");
+         exit(EXIT_FAILURE);
+      }
+      for (int var=0; var<number_variables; var++) {
+         cell_accumulator_init(&coarser[var], number_cells, reduce_func,
+                               &levels[level], var, attrs);
+      }
+
+      // Both levels share their top left corner, and their cells are stored
+      // from the top row down, so each coarse cell merges the fine cells
+      // from twice its row and column (those beyond the edge of the finer
+      // level are missing from the last row and column)
+      #pragma omp parallel for
+      for (size_t index=0; index<number_cells; index++) {
+         int row = index / coarse_width;
+         int column = index % coarse_width;
+         for (int fine_row=2*row;
+              fine_row<2*row+2 && fine_row<fine_grid->height; fine_row++) {
+            for (int fine_column=2*column;
+                 fine_column<2*column+2 && fine_column<fine_grid->width;
+                 fine_column++) {
+               size_t fine_index = (size_t) fine_row * fine_grid->width +
+                                   fine_column;
+               for (int var=0; var<number_variables; var++) {
+                  cell_accumulator_merge(&coarser[var], index, &finer[var],
+                                         fine_index);
+               }
+            }
+         }
+      }
+      store_accumulated_grid(coarser, &inspec, &levels[level], attrs);
+
+      for (int var=0; var<number_variables; var++) {
+         cell_accumulator_free(&finer[var]);
+      }
+      free(finer);
+      finer = coarser;
+      if (verbosity > 0) {
+         printf("Level %d of the pyramid built.\n", level);
+      }
+   }
+
+   for (int var=0; var<number_variables; var++) {
+      cell_accumulator_free(&finer[var]);
+   }
+   free(finer);
+
+   uint64_t end_time = monotonic_nanoseconds();
+   if (verbosity > 0) {
+      printf("Overviews built.\n");
+      printf("Building overviews took %.3f seconds\n",
+             (end_time - start_time) / 1e9);
+   }
+}
+
+/**
+  * Determine whether a reduction function can be calculated by
+  *perform_running_sum_gridding (mean and input_weighted_mean can be).
+  *
+  * @param reduce_func The reduction function.
+  * @return 1 if the reduction function is supported, 0 otherwise.
+  */
+int running_sum_reduction_supported(reduction_function reduce_func) {
+   return strcmp(reduce_func.name, "mean") == 0 ||
+          strcmp(reduce_func.name, "input_weighted_mean") == 0;
+}
+
+/**
+  * Determine whether a statistic can be calculated by
+  *perform_running_sum_gridding (count, sum and mean can be).
+  *
+  * @param stat The statistic.
+  * @return 1 if the statistic is supported, 0 otherwise.
+  */
+int running_sum_statistic_supported(statistic stat) {
+   return stat == statistic_count || stat == statistic_sum ||
+          stat == statistic_mean;
+}
+
+/**
+  * The corners of the ranges of cells whose sampling boxes contain each
+  *observation, marked with the observation's contributions (positively at the
+  *first and beyond the last corner, negatively at the other two). Running sums
+  *along each row and then each column turn these into the total contribution
+  *to each cell.
+  *
+  * Each array has (width + 1) * (height + 1) elements, and only those needed
+  *for the outputs of the variable are allocated.
+  */
+typedef struct {
+   /** The number of valid values.*/
+   NUMERIC_WORKING_TYPE *count;
+
+   /** The sum of the valid values.*/
+   NUMERIC_WORKING_TYPE *sum;
+
+   /** The sum of the valid values multiplied by their (positive) weights.*/
+   NUMERIC_WORKING_TYPE *weighted_sum;
+
+   /** The sum of the (positive) weights of the valid values.*/
+   NUMERIC_WORKING_TYPE *total_weight;
+
+   /** The number of valid values with positive weights.*/
+   NUMERIC_WORKING_TYPE *weight_count;
+} box_corners;
+
+/**
+  * Allocate the arrays of a box_corners which are needed to fill a
+  *cell_accumulator.
+  *
+  * @param corners The box_corners to initialise.
+  * @param number_corners The number of corners, (width + 1) * (height + 1).
+  * @param accumulator The cell_accumulator which will receive the totals.
+  */
+static void box_corners_init(box_corners *corners, size_t number_corners,
+                             cell_accumulator *accumulator) {
+   #define allocate_if(needed, array) \
+   corners->array = (needed) ? allocate_accumulator_array( \
+      number_corners, sizeof(*corners->array)) : NULL
+   allocate_if(1, count);
+   allocate_if(accumulator->sum != NULL, sum);
+   allocate_if(accumulator->weighted_sum != NULL, weighted_sum);
+   allocate_if(accumulator->weighted_sum != NULL, total_weight);
+   allocate_if(accumulator->weighted_sum != NULL, weight_count);
+   #undef allocate_if
+}
+
+/**
+  * Free the arrays of a box_corners.
+  *
+  * @param corners The box_corners.
+  */
+static void box_corners_free(box_corners *corners) {
+   free(corners->count);
+   free(corners->sum);
+   free(corners->weighted_sum);
+   free(corners->total_weight);
+   free(corners->weight_count);
+}
+
+/**
+  * Mark the contribution of a value to a rectangle of corners.
+  *
+  * @param corners The array of corners.
+  * @param stride The number of corners in each row (width + 1).
+  * @param first_u The first column of cells receiving the value.
+  * @param last_u The last column of cells receiving the value.
+  * @param first_v The first row of cells receiving the value.
+  * @param last_v The last row of cells receiving the value.
+  * @param value The value.
+  */
+void mark_box(NUMERIC_WORKING_TYPE *corners, size_t stride, int first_u,
+              int last_u, int first_v, int last_v,
+              NUMERIC_WORKING_TYPE value) {
+   corners[first_v * stride + first_u] += value;
+   corners[first_v * stride + last_u + 1] -= value;
+   corners[(last_v + 1) * stride + first_u] -= value;
+   corners[(last_v + 1) * stride + last_u + 1] += value;
+}
+
+/**
+  * Replace each corner by the running sum of the corners up to and including
+  *it along its row and then along its column.
+  *
+  * @param corners The array of corners.
+  * @param width The number of cells in each row (the array holds width + 1).
+  * @param height The number of rows of cells (the array holds height + 1).
+  */
+void running_sums(NUMERIC_WORKING_TYPE *corners, int width, int height) {
+   size_t stride = (size_t) width + 1;
+
+   #pragma omp parallel for
+   for (int v=0; v<height; v++) {
+      NUMERIC_WORKING_TYPE *row = &corners[v * stride];
+      for (int u=1; u<width; u++) {
+         row[u] += row[u - 1];
+      }
+   }
+
+   // Accumulate the columns a block at a time, so that each thread reads
+   // along rows
+   #pragma omp parallel for
+   for (int first_u=0; first_u<width; first_u+=TILE_SIZE) {
+      int last_u = first_u + TILE_SIZE;
+      if (last_u > width) last_u = width;
+      for (int v=1; v<height; v++) {
+         for (int u=first_u; u<last_u; u++) {
+            corners[v * stride + u] += corners[(v - 1) * stride + u];
+         }
+      }
+   }
+}
+
+/**
+  * Find the first cell whose sampling box ends at or after a position.
+  *
+  * @param upper The (non-decreasing) upper bounds of the sampling boxes.
+  * @param number_cells The number of cells.
+  * @param position The position.
+  * @return The number of the cell, or number_cells if there is none.
+  */
+static inline int first_box_ending_after(float32_t *upper, int number_cells,
+                                         float32_t position) {
+   int low = 0, high = number_cells;
+   while (low < high) {
+      int middle = low + (high - low) / 2;
+      if (upper[middle] >= position) {
+         high = middle;
+      } else {
+         low = middle + 1;
+      }
+   }
+   return low;
+}
+
+/**
+  * Find the last cell whose sampling box starts at or before a position.
+  *
+  * @param lower The (non-decreasing) lower bounds of the sampling boxes.
+  * @param number_cells The number of cells.
+  * @param position The position.
+  * @return The number of the cell, or -1 if there is none.
+  */
+static inline int last_box_starting_before(float32_t *lower, int number_cells,
+                                           float32_t position) {
+   int low = 0, high = number_cells;
+   while (low < high) {
+      int middle = low + (high - low) / 2;
+      if (lower[middle] <= position) {
+         low = middle + 1;
+      } else {
+         high = middle;
+      }
+   }
+   return low - 1;
+}
+
+/**
+  * Calculate the lower and upper bounds of the sampling boxes of a row or
+  *column of cells, exactly as perform_gridding calculates them.
+  *
+  * @param origin The position of the first edge of the grid.
+  * @param resolution The size of each cell.
+  * @param sampling_offset The distance from the centre of each cell to the
+  *edges of its sampling box.
+  * @param number_cells The number of cells.
+  * @param lower Array to receive the lower bound of each box.
+  * @param upper Array to receive the upper bound of each box.
+  */
+static void sampling_box_bounds(float32_t origin, float resolution,
+                                float sampling_offset, int number_cells,
+                                float32_t *lower, float32_t *upper) {
+   for (int cell=0; cell<number_cells; cell++) {
+      float32_t centre = cell_centre(origin, resolution, cell);
+      lower[cell] = centre - sampling_offset;
+      upper[cell] = centre + sampling_offset;
+   }
+}
+
+/**
+  * Perform gridding of linear reductions (sums, counts and the means formed
+  *from them) in a time independent of the size of the sampling boxes. Each
+  *observation is visited once; the range of cells whose sampling boxes contain
+  *it is found from the box bounds, and its contribution is marked at the four
+  *corners of that range. Running sums along the rows and columns of the grid
+  *then give the totals of every cell at once, so oversampled grids cost no
+  *more than grids sampled at their native resolution.
+  *
+  * Only the reduction functions and statistics accepted by
+  *running_sum_reduction_supported and running_sum_statistic_supported can be
+  *used. The observations are streamed from the index using
+  *spatial_index::scan, so the index need not support efficient queries (see
+  *observation_list.h). Each thread marks the observations it visits over the
+  *whole grid, so the memory required grows with the number of threads.
+  *
+  * @param inspec Specification of the input data.
+  * @param outspec Specification of the output grid.
+  * @param reduce_func Selection reduction function.
+  * @param attrs Attributes to be used by the reduction function.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  */
+void perform_running_sum_gridding(input_spec inspec, output_spec outspec,
+                                  reduction_function reduce_func,
+                                  reduction_attrs *attrs, int verbosity) {
+
+   if (verbosity > 0) {
+      printf("Building output image from running sums\n");
+   }
+   uint64_t start_time = monotonic_nanoseconds();
+
+   grid *grid_spec = outspec.grid_spec;
+   int grid_width = grid_spec->width;
+   int grid_height = grid_spec->height;
+   size_t number_cells = (size_t) grid_width * grid_height;
+   size_t number_corners = (size_t) (grid_width + 1) * (grid_height + 1);
+   int number_variables = inspec.number_data_inputs;
+   int weighted = (strcmp(reduce_func.name, "input_weighted_mean") == 0);
+
+   float32_t x_0, y_0;
+   grid_origin(grid_spec, &x_0, &y_0);
+
+   float32_t *lower_x = malloc(sizeof(float32_t) * grid_width);
+   float32_t *upper_x = malloc(sizeof(float32_t) * grid_width);
+   float32_t *lower_y = malloc(sizeof(float32_t) * grid_height);
+   float32_t *upper_y = malloc(sizeof(float32_t) * grid_height);
+   if (lower_x == NULL || upper_x == NULL || lower_y == NULL ||
+       upper_y == NULL) {
+      fprintf(stderr, "Could not allocate space for the sampling boxes\n");
+      exit(EXIT_FAILURE);
+   }
+   sampling_box_bounds(x_0, grid_spec->horizontal_resolution,
+                       grid_spec->horizontal_sampling_offset, grid_width,
+                       lower_x, upper_x);
+   sampling_box_bounds(y_0, grid_spec->vertical_resolution,
+                       grid_spec->vertical_sampling_offset, grid_height,
+                       lower_y, upper_y);
+
+   // Skip invalid and rejected observations as the index is scanned
+   if (inspec.valid != NULL || inspec.qa != NULL) {
+      inspec.coordinate_index->filter = &observation_accepted;
+      inspec.coordinate_index->filter_context = &inspec;
+   }
+
+   // The totals of each variable are gathered into a cell_accumulator, which
+   // also decides which totals are needed
+   cell_accumulator *totals = malloc(sizeof(cell_accumulator) *
+                                     number_variables);
+   int number_threads = omp_get_max_threads();
+   box_corners *corners = malloc(sizeof(box_corners) * number_threads *
+                                 number_variables);
+   if (totals == NULL || corners == NULL) {
+      fprintf(stderr, "Could not allocate space for the running sums\n");
+      exit(EXIT_FAILURE);
+   }
+   for (int var=0; var<number_variables; var++) {
+      cell_accumulator_init(&totals[var], number_cells, reduce_func, &outspec,
+                            var, attrs);
+   }
+   for (int c=0; c<number_threads * number_variables; c++) {
+      box_corners_init(&corners[c], number_corners,
+                       &totals[c % number_variables]);
+   }
+
+   size_t number_observations = inspec.coordinate_index->num_observations;
+   size_t number_chunks = (number_observations + SCATTER_CHUNK_SIZE - 1) /
+                          SCATTER_CHUNK_SIZE;
 
-   float32_t x_0 = outspec.grid_spec->central_x -
-                   (((float) outspec.grid_spec->width /
-                     2.0) * outspec.grid_spec->horizontal_resolution);
-   float32_t y_0 = outspec.grid_spec->central_y -
-                   (((float) outspec.grid_spec->height /
-                     2.0) * outspec.grid_spec->vertical_resolution);
+   #pragma omp parallel
+   {
+   box_corners *thread_corners =
+      &corners[omp_get_thread_num() * number_variables];
+   hit_list *hits = hit_list_init();
+   NUMERIC_WORKING_TYPE *values = malloc(sizeof(NUMERIC_WORKING_TYPE) *
+                                         SCATTER_CHUNK_SIZE * number_variables);
+   char *valid = malloc(SCATTER_CHUNK_SIZE * number_variables);
+   NUMERIC_WORKING_TYPE *weights = malloc(sizeof(NUMERIC_WORKING_TYPE) *
+                                          SCATTER_CHUNK_SIZE);
+   char *weight_valid = malloc(SCATTER_CHUNK_SIZE);
+   if (values == NULL || valid == NULL || weights == NULL ||
+       weight_valid == NULL) {
+      fprintf(stderr, "Could not allocate space for a chunk of observations\n");
+      exit(EXIT_FAILURE);
+   }
+
+   #pragma omp for schedule(dynamic)
+   for (size_t chunk=0; chunk<number_chunks; chunk++) {
+      size_t first = chunk * SCATTER_CHUNK_SIZE;
+      size_t count = number_observations - first;
+      if (count > SCATTER_CHUNK_SIZE) count = SCATTER_CHUNK_SIZE;
+
+      hits->clear(hits);
+      inspec.coordinate_index->scan(inspec.coordinate_index, first, count,
+                                    hits);
+      for (int var=0; var<number_variables; var++) {
+         numeric_gather_masked(inspec.data_inputs[var],
+                               inspec.input_dtypes[var], hits->record_indices,
+                               hits->length, attrs->input_fill_value,
+                               &values[var * SCATTER_CHUNK_SIZE],
+                               &valid[var * SCATTER_CHUNK_SIZE]);
+      }
+      if (weighted) {
+         // Weights have no fill value, so NAN is used, which never compares
+         // equal
+         numeric_gather_masked(attrs->input_weights,
+                               attrs->input_weights_dtype,
+                               hits->record_indices, hits->length, NAN,
+                               weights, weight_valid);
+      }
+
+      for (unsigned int h=0; h<hits->length; h++) {
+         float32_t x = hits->x[h];
+         float32_t y = hits->y[h];
+         float32_t t = hits->t[h];
+         if (!(t >= grid_spec->time_min && t <= grid_spec->time_max)) {
+            continue;
+         }
+
+         // Find the range of cells whose sampling boxes contain the
+         // observation (this also rejects observations outside every box, and
+         // NaNs)
+         if (!(x >= lower_x[0] && x <= upper_x[grid_width - 1] &&
+               y >= lower_y[0] && y <= upper_y[grid_height - 1])) {
+            continue;
+         }
+         int first_u = first_box_ending_after(upper_x, grid_width, x);
+         int last_u = last_box_starting_before(lower_x, grid_width, x);
+         int first_v = first_box_ending_after(upper_y, grid_height, y);
+         int last_v = last_box_starting_before(lower_y, grid_height, y);
+         if (first_u > last_u || first_v > last_v) {
+            continue;
+         }
+
+         for (int var=0; var<number_variables; var++) {
+            if (!valid[var * SCATTER_CHUNK_SIZE + h]) {
+               continue;
+            }
+            NUMERIC_WORKING_TYPE value = values[var * SCATTER_CHUNK_SIZE + h];
+            box_corners *marks = &thread_corners[var];
+            mark_box(marks->count, grid_width + 1, first_u, last_u, first_v,
+                     last_v, 1.0);
+            if (marks->sum != NULL) {
+               mark_box(marks->sum, grid_width + 1, first_u, last_u, first_v,
+                        last_v, value);
+            }
+            if (marks->weighted_sum != NULL && weights[h] > 0.0) {
+               mark_box(marks->weighted_sum, grid_width + 1, first_u, last_u,
+                        first_v, last_v, value * weights[h]);
+               mark_box(marks->total_weight, grid_width + 1, first_u, last_u,
+                        first_v, last_v, weights[h]);
+               mark_box(marks->weight_count, grid_width + 1, first_u, last_u,
+                        first_v, last_v, 1.0);
+            }
+         }
+      }
+   }
+
+   hits->free(hits);
+   free(values);
+   free(valid);
+   free(weights);
+   free(weight_valid);
+   }
 
+   // Merge the marks of every thread into the first
    #pragma omp parallel for
-   for (int v=0; v<outspec.grid_spec->height; v++) {
-      for (int u=0; u<outspec.grid_spec->width; u++) {
-         int index =
-            (outspec.grid_spec->height-v-1)*outspec.grid_spec->width + u;
-
-         float32_t cr_x = x_0 +
-                          ((float) u +
-                           0.5) * outspec.grid_spec->horizontal_resolution;
-         float32_t cr_y = y_0 +
-                          ((float) v +
-                           0.5) * outspec.grid_spec->vertical_resolution;
-
-         float32_t bl_x = cr_x - outspec.grid_spec->horizontal_sampling_offset;
-         float32_t bl_y = cr_y - outspec.grid_spec->vertical_sampling_offset;
-
-         float32_t tr_x = cr_x + outspec.grid_spec->horizontal_sampling_offset;
-         float32_t tr_y = cr_y + outspec.grid_spec->vertical_sampling_offset;
-
-         // Perform gridding of data
-         if (outspec.data_output != NULL) {
-            float32_t query_dimensions[] =
-            {bl_x, tr_x, bl_y, tr_y, outspec.grid_spec->time_min,
-             outspec.grid_spec->time_max};
-
-            result_set *current_result_set = inspec.coordinate_index->query(
-               inspec.coordinate_index, query_dimensions);
-            reduce_func.call(current_result_set, attrs, query_dimensions,
-                             inspec.data_input, outspec.data_output, index,
-                             inspec.input_dtype,
-                             outspec.output_dtype);
-            current_result_set->free(current_result_set);
-         }
-
-         if (outspec.lats_output != NULL || outspec.lons_output != NULL) {
-            // Get the central latitude and longitude for this cell, and store
-            spherical_coordinates coords =
-               inspec.coordinate_index->input_projector->inverse_project(
-                  inspec.coordinate_index->input_projector, (tr_y + bl_y) / 2.0,
-                  (tr_x + bl_x) / 2.0);
-            if (outspec.lats_output != NULL) outspec.lats_output[index] =
-                  coords.latitude;
-            if (outspec.lons_output != NULL) outspec.lons_output[index] =
-                  coords.longitude;
-         }
-      }
-   }
-   time_t end_time = time(NULL);
+   for (size_t corner=0; corner<number_corners; corner++) {
+      for (int var=0; var<number_variables; var++) {
+         box_corners *total = &corners[var];
+         for (int thread=1; thread<number_threads; thread++) {
+            box_corners *part = &corners[thread * number_variables + var];
+            total->count[corner] += part->count[corner];
+            if (total->sum != NULL) {
+               total->sum[corner] += part->sum[corner];
+            }
+            if (total->weighted_sum != NULL) {
+               total->weighted_sum[corner] += part->weighted_sum[corner];
+               total->total_weight[corner] += part->total_weight[corner];
+               total->weight_count[corner] += part->weight_count[corner];
+            }
+         }
+      }
+   }
+
+   // Turn the marks into the totals of each cell, and store the outputs
+   for (int var=0; var<number_variables; var++) {
+      box_corners *total = &corners[var];
+      running_sums(total->count, grid_width, grid_height);
+      if (total->sum != NULL) {
+         running_sums(total->sum, grid_width, grid_height);
+      }
+      if (total->weighted_sum != NULL) {
+         running_sums(total->weighted_sum, grid_width, grid_height);
+         running_sums(total->total_weight, grid_width, grid_height);
+         running_sums(total->weight_count, grid_width, grid_height);
+      }
+
+      #pragma omp parallel for
+      for (size_t index=0; index<number_cells; index++) {
+         int u = index % grid_width;
+         int v = grid_height - 1 - index / grid_width;
+         size_t corner = (size_t) v * (grid_width + 1) + u;
+         // The counts are exact, but the sums of empty cells may be left
+         // with rounding errors where marks cancelled, so they are cleared
+         totals[var].count[index] = (unsigned int) total->count[corner];
+         if (total->sum != NULL) {
+            totals[var].sum[index] = (total->count[corner] == 0.0) ? 0.0 :
+                                     total->sum[corner];
+         }
+         if (total->weighted_sum != NULL &&
+             total->weight_count[corner] > 0.0) {
+            totals[var].weighted_sum[index] = total->weighted_sum[corner];
+            totals[var].total_weight[index] = total->total_weight[corner];
+         }
+         cell_accumulator_store(&totals[var], index, &outspec, var, attrs);
+      }
+   }
+   store_grid_coordinates(&outspec, x_0, y_0, 0,
+                          outspec.grid_spec->height);
+   if (inspec.metrics != NULL) {
+      inspec.metrics->cells += number_cells;
+   }
+
+   for (int c=0; c<number_threads * number_variables; c++) {
+      box_corners_free(&corners[c]);
+   }
+   for (int var=0; var<number_variables; var++) {
+      cell_accumulator_free(&totals[var]);
+   }
+   free(corners);
+   free(totals);
+   free(lower_x);
+   free(upper_x);
+   free(lower_y);
+   free(upper_y);
+   inspec.coordinate_index->filter = NULL;
+   inspec.coordinate_index->filter_context = NULL;
+
+   uint64_t end_time = monotonic_nanoseconds();
    if (verbosity > 0) {
       printf("Output image built.\n");
-      printf("Building image took %d seconds\n", (int) (end_time - start_time));
+      printf("Building image took %.3f seconds\n",
+             (end_time - start_time) / 1e9);
    }
 }
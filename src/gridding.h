@@ -7,9 +7,46 @@
 #include "io_spec.h"
 #include "reduction_functions.h"
 
-// Function prototype - implementation in gridding.c
+// Function prototypes - implementation in gridding.c
+int qa_filter_accepts(qa_filter *filter, size_t record_index);
 void perform_gridding(input_spec inspec, output_spec outspec,
                       reduction_function reduce_func, reduction_attrs *attrs,
                       int verbosity);
+void perform_multiple_gridding(input_spec inspec, output_spec *outspecs,
+                               int number_grids,
+                               reduction_function reduce_func,
+                               reduction_attrs *attrs, int verbosity);
+void perform_time_binned_gridding(input_spec inspec, output_spec *outspecs,
+                                  int number_grids, int number_time_bins,
+                                  float32_t time_step,
+                                  reduction_function reduce_func,
+                                  reduction_attrs *attrs, int verbosity);
+void perform_tiled_gridding(input_spec inspec, output_spec outspec,
+                            output_files files,
+                            reduction_function reduce_func,
+                            reduction_attrs *attrs, size_t memory_budget,
+                            int verbosity);
+void perform_incremental_gridding(input_spec inspec, output_spec outspec,
+                                  size_t first_new_observation,
+                                  reduction_function reduce_func,
+                                  reduction_attrs *attrs, int verbosity);
+int scatter_reduction_supported(reduction_function reduce_func);
+int scatter_statistic_supported(statistic stat);
+void perform_scatter_gridding(input_spec inspec, output_spec outspec,
+                              reduction_function reduce_func,
+                              reduction_attrs *attrs, int verbosity);
+void perform_pyramid_gridding(input_spec inspec, output_spec *levels,
+                              int number_levels,
+                              reduction_function reduce_func,
+                              reduction_attrs *attrs, int verbosity);
+int running_sum_reduction_supported(reduction_function reduce_func);
+int running_sum_statistic_supported(statistic stat);
+void perform_running_sum_gridding(input_spec inspec, output_spec outspec,
+                                  reduction_function reduce_func,
+                                  reduction_attrs *attrs, int verbosity);
+void mark_box(NUMERIC_WORKING_TYPE *corners, size_t stride, int first_u,
+              int last_u, int first_v, int last_v,
+              NUMERIC_WORKING_TYPE value);
+void running_sums(NUMERIC_WORKING_TYPE *corners, int width, int height);
 
 #endif
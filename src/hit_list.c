@@ -0,0 +1,96 @@
+/**
+  * @file
+  *
+  * Implementation of hit_list
+  */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hit_list.h"
+
+/** The initial number of hits allocated for a hit_list */
+#define INITIAL_HIT_LIST_ALLOCATION 256
+
+/**
+  * Grow the storage of a hit_list to the given number of hits.
+  *
+  * @param hits The hit_list to grow.
+  * @param allocation The new number of hits to allocate.
+  */
+static void hit_list_reserve(hit_list *hits, unsigned int allocation) {
+   hits->x = realloc(hits->x, sizeof(float) * allocation);
+   hits->y = realloc(hits->y, sizeof(float) * allocation);
+   hits->t = realloc(hits->t, sizeof(float) * allocation);
+   hits->record_indices = realloc(hits->record_indices,
+                                  sizeof(size_t) * allocation);
+   if (hits->x == NULL || hits->y == NULL || hits->t == NULL ||
+       hits->record_indices == NULL) {
+      fprintf(stderr, "Could not allocate space for %u hits\n", allocation);
+      exit(EXIT_FAILURE);
+   }
+   hits->allocated = allocation;
+}
+
+/**
+  * Append a single hit to a hit_list.
+  *
+  * @see hit_list::append
+  */
+void hit_list_append(hit_list *hits, float x, float y, float t,
+                     size_t record_index) {
+   if (hits->length == hits->allocated) {
+      hit_list_reserve(hits, hits->allocated * 2);
+   }
+   hits->x[hits->length] = x;
+   hits->y[hits->length] = y;
+   hits->t[hits->length] = t;
+   hits->record_indices[hits->length] = record_index;
+   hits->length++;
+}
+
+/**
+  * Remove all hits from a hit_list, retaining its storage.
+  *
+  * @see hit_list::clear
+  */
+void hit_list_clear(hit_list *hits) {
+   hits->length = 0;
+}
+
+/**
+  * Free a hit_list.
+  *
+  * @see hit_list::free
+  */
+void hit_list_free(hit_list *tofree) {
+   free(tofree->x);
+   free(tofree->y);
+   free(tofree->t);
+   free(tofree->record_indices);
+   free(tofree);
+}
+
+/**
+  * Initialise an empty hit_list.
+  *
+  * @return A pointer to an initialised hit_list.
+  */
+hit_list *hit_list_init() {
+   hit_list *hits = malloc(sizeof(hit_list));
+   if (hits == NULL) {
+      fprintf(stderr, "Could not allocate space for a hit_list struct\n");
+      exit(EXIT_FAILURE);
+   }
+   hits->x = NULL;
+   hits->y = NULL;
+   hits->t = NULL;
+   hits->record_indices = NULL;
+   hits->length = 0;
+   hit_list_reserve(hits, INITIAL_HIT_LIST_ALLOCATION);
+
+   // Set up function pointers
+   hits->append = &hit_list_append;
+   hits->clear = &hit_list_clear;
+   hits->free = &hit_list_free;
+   return hits;
+}
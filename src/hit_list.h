@@ -0,0 +1,65 @@
+/**
+  * @file
+  *
+  * Defines a flat, reusable list of query results, used to reduce a whole row
+  *of cells at once.
+  */
+#ifndef HEADER_HIT_LIST
+#define HEADER_HIT_LIST
+#include <stddef.h>
+
+/**
+  * A growable list of query results (hits), stored as separate arrays of each
+  *attribute. Unlike a result_set, the storage is retained when the list is
+  *cleared, so a single hit_list can be reused for many queries without
+  *allocating memory for each hit.
+  */
+typedef struct hit_list_s {
+   /** The x-value of each hit.*/
+   float *x;
+
+   /** The y-value of each hit.*/
+   float *y;
+
+   /** The time value of each hit.*/
+   float *t;
+
+   /** The record index of each hit.*/
+   size_t *record_indices;
+
+   /** The number of hits stored.*/
+   unsigned int length;
+
+   /** The number of hits which can be stored without reallocating.*/
+   unsigned int allocated;
+
+   /**
+     * Append a single hit to a hit_list.
+     *
+     * @param hits The hit_list to append to.
+     * @param x The x-value of the hit.
+     * @param y The y-value of the hit.
+     * @param t The time value of the hit.
+     * @param record_index The record index of the hit.
+     */
+   void (*append)(struct hit_list_s *hits, float x, float y, float t,
+                  size_t record_index);
+
+   /**
+     * Remove all hits from a hit_list, retaining its storage.
+     *
+     * @param hits The hit_list to clear.
+     */
+   void (*clear)(struct hit_list_s *hits);
+
+   /**
+     * Free a hit_list.
+     *
+     * @param tofree The hit_list to free.
+     */
+   void (*free)(struct hit_list_s *tofree);
+} hit_list;
+
+// Function prototypes - implemented in hit_list.c
+hit_list *hit_list_init();
+#endif
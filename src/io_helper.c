@@ -7,19 +7,26 @@
 // Define xopen source macro to enable posix_fallocate
 #define _XOPEN_SOURCE 600
 
+// Use 64-bit file offsets, so that files beyond 4 GiB can be mapped on 32-bit
+// systems too
+#define _FILE_OFFSET_BITS 64
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "io_helper.h"
 
 void _close(memory_mapped_file *toclose) {
-   // Unmap the data from memory
-   munmap(toclose->memory_mapped_data, toclose->mapped_bytes);
+   // Unmap the data from memory (unless the file was opened without mapping)
+   if (toclose->memory_mapped_data != NULL) {
+      munmap(toclose->memory_mapped_data, toclose->mapped_bytes);
+   }
 
    // Close the backing file
    close(toclose->file_descriptor);
@@ -36,7 +43,7 @@ void _close(memory_mapped_file *toclose) {
   * @return An instance of memory_mapped_file, or NULL on failure.
   */
 memory_mapped_file *open_memory_mapped_input_file(char *filename,
-                                                  unsigned int number_bytes) {
+                                                  size_t number_bytes) {
    // Allocate space for the memory_mapped_file struct
    memory_mapped_file *f = malloc(sizeof(memory_mapped_file));
    if (f == NULL) {
@@ -69,14 +76,14 @@ memory_mapped_file *open_memory_mapped_input_file(char *filename,
 }
 
 /**
-  * Open and memory map an output file.
+  * Create an output file, and allocate space for it in the file system.
   *
-  * @param filename The file path to open.
-  * @param number_bytes The number of bytes to map into memory
-  * @return An instance of memory_mapped_file, or NULL on failure.
+  * @param filename The file path to create.
+  * @param number_bytes The size of the file.
+  * @return An instance of memory_mapped_file, with no data mapped.
   */
-memory_mapped_file *open_memory_mapped_output_file(char *filename,
-                                                   unsigned int number_bytes) {
+static memory_mapped_file *create_output_file(char *filename,
+                                              size_t number_bytes) {
    // Allocate space for the memory_mapped_file struct
    memory_mapped_file *f = malloc(sizeof(memory_mapped_file));
    if (f == NULL) {
@@ -98,9 +105,10 @@ memory_mapped_file *open_memory_mapped_output_file(char *filename,
    }
 
    // Allocate space in the file system for the requested number of bytes
-   int fallocate_result = posix_fallocate(f->file_descriptor, 0, number_bytes);
+   int fallocate_result = posix_fallocate(f->file_descriptor, 0,
+                                          (off_t) number_bytes);
    if(fallocate_result != 0) {
-      fprintf(stderr, "Could not allocate %d bytes of space in file sytem (",
+      fprintf(stderr, "Could not allocate %zu bytes of space in file sytem (",
               number_bytes);
       switch (fallocate_result) {
       case EBADF:
@@ -127,6 +135,23 @@ memory_mapped_file *open_memory_mapped_output_file(char *filename,
       exit(EXIT_FAILURE);
    }
 
+   f->memory_mapped_data = NULL;
+   f->mapped_bytes = 0;
+   f->close = &_close;
+   return f;
+}
+
+/**
+  * Open and memory map an output file.
+  *
+  * @param filename The file path to open.
+  * @param number_bytes The number of bytes to map into memory
+  * @return An instance of memory_mapped_file, or NULL on failure.
+  */
+memory_mapped_file *open_memory_mapped_output_file(char *filename,
+                                                   size_t number_bytes) {
+   memory_mapped_file *f = create_output_file(filename, number_bytes);
+
    // Map the output data into memory
    f->memory_mapped_data =
       mmap(0, number_bytes, PROT_WRITE, MAP_SHARED, f->file_descriptor,
@@ -142,3 +167,95 @@ memory_mapped_file *open_memory_mapped_output_file(char *filename,
 
    return f;
 }
+
+/**
+  * Open and memory map an existing output file, so that its contents can be
+  *updated in place.
+  *
+  * @param filename The file path to open.
+  * @param number_bytes The number of bytes to map into memory (the file must be
+  *at least this large).
+  * @return An instance of memory_mapped_file.
+  */
+memory_mapped_file *open_memory_mapped_existing_output_file(
+   char *filename, size_t number_bytes) {
+   // Allocate space for the memory_mapped_file struct
+   memory_mapped_file *f = malloc(sizeof(memory_mapped_file));
+   if (f == NULL) {
+      fprintf(stderr,
+              "Could not allocate space for a memory_mapped_file struct (!)\n");
+      exit(EXIT_FAILURE);
+   }
+
+   // Open the actual file, which must already hold the whole output
+   f->file_descriptor = open(filename, O_RDWR);
+   if (f->file_descriptor == -1) {
+      fprintf(stderr, "Failed to open existing output file %s (%s)\n",
+              filename, strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+   struct stat file_status;
+   if (fstat(f->file_descriptor, &file_status) == -1 ||
+       (size_t) file_status.st_size < number_bytes) {
+      fprintf(stderr,
+              "Existing output file %s is smaller than the output (%zu "\
+              "bytes)\n", filename, number_bytes);
+      exit(EXIT_FAILURE);
+   }
+
+   // Map the output data into memory
+   f->memory_mapped_data =
+      mmap(0, number_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+           f->file_descriptor, 0);
+   if (f->memory_mapped_data == MAP_FAILED) {
+      fprintf(stderr, "Failed to map output into memory (%s)\n",
+              strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+
+   // Finish off the memory_mapped_file struct and return
+   f->mapped_bytes = number_bytes;
+   f->close = &_close;
+   return f;
+}
+
+/**
+  * Open an output file without mapping it into memory, for outputs too large
+  *to map which are instead written a range at a time (see write_file_range).
+  *
+  * @param filename The file path to open.
+  * @param number_bytes The size of the file.
+  * @return An instance of memory_mapped_file, whose memory_mapped_data is NULL.
+  */
+memory_mapped_file *open_unmapped_output_file(char *filename,
+                                              size_t number_bytes) {
+   return create_output_file(filename, number_bytes);
+}
+
+/**
+  * Write a range of bytes to a file, at the given offset.
+  *
+  * @param file_descriptor The file to write to.
+  * @param data The bytes to write.
+  * @param number_bytes The number of bytes to write.
+  * @param offset The position in the file of the first byte.
+  */
+void write_file_range(int file_descriptor, const void *data,
+                      size_t number_bytes, size_t offset) {
+   const char *remaining = data;
+   while (number_bytes > 0) {
+      ssize_t written = pwrite(file_descriptor, remaining, number_bytes,
+                               (off_t) offset);
+      if (written == -1) {
+         if (errno == EINTR) {
+            continue;
+         }
+         fprintf(stderr, "Failed to write to output file (%s)\n",
+                 strerror(errno));
+         exit(EXIT_FAILURE);
+      }
+      remaining += written;
+      number_bytes -= written;
+      offset += written;
+   }
+}
@@ -5,6 +5,7 @@
   */
 #ifndef HEADER_IO_HELPER
 #define HEADER_IO_HELPER
+#include <stddef.h>
 
 /**
   * Representation of a memory mapped file.
@@ -17,7 +18,7 @@ typedef struct memory_mapped_file_s {
    void *memory_mapped_data;
 
    /** The number of bytes mapped into memory.*/
-   unsigned int mapped_bytes;
+   size_t mapped_bytes;
 
    /**
      * Unmap and close the memory mapped file.
@@ -29,9 +30,15 @@ typedef struct memory_mapped_file_s {
 
 // Function prototypes - implementations in io_helper.c
 memory_mapped_file *open_memory_mapped_input_file(char *filename,
-                                                  unsigned int number_bytes);
+                                                  size_t number_bytes);
 memory_mapped_file *open_memory_mapped_output_file(char *filename,
-                                                   unsigned int number_bytes);
+                                                   size_t number_bytes);
+memory_mapped_file *open_memory_mapped_existing_output_file(
+   char *filename, size_t number_bytes);
+memory_mapped_file *open_unmapped_output_file(char *filename,
+                                              size_t number_bytes);
+void write_file_range(int file_descriptor, const void *data,
+                      size_t number_bytes, size_t offset);
 
 #endif
 
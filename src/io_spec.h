@@ -9,18 +9,32 @@
 
 #include "data_handling.h"
 #include "grid.h"
+#include "reduction_functions.h"
+#include "run_metrics.h"
 #include "spatial_index.h"
+#include "validity_mask.h"
 
 /**
   * Represents the output requirements of a gridding job. This struct should be
   *constructed manually.
   */
 typedef struct {
-   /** Pointer to memory where the gridded data should be stored.*/
-   char *data_output;
+   /** Pointers to memory where the gridded data of each input variable should
+    *be stored (one per input_spec::data_inputs; an item may be NULL if only
+    *statistics are required for that variable).*/
+   char **data_outputs;
 
-   /** The data type of the output @a data.*/
-   dtype output_dtype;
+   /** The data type of each of @a data_outputs (and of the corresponding
+    *statistic outputs).*/
+   dtype *output_dtypes;
+
+   /** For each input variable, statistics to be computed from the same
+    *observations, and stored in their own outputs (see
+    *reduce_numeric_statistics).*/
+   statistic_output **statistic_outputs;
+
+   /** The number of items in each of @a statistic_outputs (may be 0).*/
+   int *number_statistic_outputs;
 
    /** Pointer to memory of type float32_t where the generated latitudes should
     *be stored.*/
@@ -30,22 +44,98 @@ typedef struct {
     *be stored.*/
    float32_t *lons_output;
 
+   /** Pointer to memory of type uint32_t where the number of internal nodes of
+    *the index visited by the query of each cell should be stored (NULL if not
+    *required, see spatial_index::query_counted).*/
+   uint32_t *nodes_visited_output;
+
+   /** Pointer to memory of type uint32_t where the number of observations
+    *tested by the query of each cell should be stored (NULL if not
+    *required).*/
+   uint32_t *leaves_tested_output;
+
+   /** Pointer to memory of type uint32_t where the number of observations
+    *found by the query of each cell should be stored (NULL if not
+    *required).*/
+   uint32_t *hits_output;
+
    /** The grid specification of the output.*/
    grid *grid_spec;
 } output_spec;
 
 /**
-  * Represents a set of input data. This struct should be constructed manually.
+  * The files that the outputs of a tiled gridding job are written to (see
+  *perform_tiled_gridding), in place of the memory of an output_spec. This
+  *struct should be constructed manually.
+  */
+typedef struct {
+   /** The file descriptor of the file for each of output_spec::data_outputs
+    *(-1 where the gridded data of a variable is not required).*/
+   int *data_outputs;
+
+   /** The file descriptors of the files for each of
+    *output_spec::statistic_outputs.*/
+   int **statistic_outputs;
+
+   /** The file descriptor of the latitude output (-1 if not required).*/
+   int lats_output;
+
+   /** The file descriptor of the longitude output (-1 if not required).*/
+   int lons_output;
+} output_files;
+
+/**
+  * A predicate on a per-observation quality (QA) array, used to reject
+  *observations before they are reduced. This struct should be constructed
+  *manually.
   */
 typedef struct {
-   /** Pointer to memory where the input data is stored.*/
-   char *data_input;
+   /** Pointer to memory where the QA value of each observation is stored.*/
+   void *qa_data;
 
-   /** The type of the data */
-   dtype input_dtype;
+   /** The (numeric) type of the QA values.*/
+   dtype qa_dtype;
+
+   /** Observations whose QA value has any of these bits set are rejected (0
+    *to disable). While enabled, QA values which are not numbers, or are
+    *beyond the range of a 64-bit integer, are rejected too.*/
+   uint64_t reject_mask;
+
+   /** Observations whose QA value is less than this are rejected (-INFINITY
+    *to disable).*/
+   NUMERIC_WORKING_TYPE minimum;
+} qa_filter;
+
+/**
+  * Represents a set of input data variables. This struct should be constructed
+  *manually.
+  */
+typedef struct {
+   /** Pointers to memory where each input variable is stored. All variables
+    *share the observations (and hence geolocation) of the index.*/
+   char **data_inputs;
+
+   /** The type of each input variable */
+   dtype *input_dtypes;
+
+   /** The number of input variables */
+   int number_data_inputs;
 
    /** The spatial index for the input.*/
    spatial_index *coordinate_index;
+
+   /** Filter applied to the observations of every cell before reduction (NULL
+    *if all observations should be used).*/
+   qa_filter *qa;
+
+   /** Observations not marked as valid in this mask are skipped (NULL if all
+    *observations should be used). Where there are several variables, this
+    *should mark observations which are valid in any of them.*/
+   validity_mask *valid;
+
+   /** Timers and counters to record the gridding in (NULL if they are not
+    *required).*/
+   run_metrics *metrics;
 } input_spec;
 
 #endif
@@ -9,9 +9,11 @@
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "coordinate_reader.h"
 #include "data_handling.h"
+#include "hit_list.h"
 #include "spatial_index.h"
 #include "kd_tree.h"
 #include "projector.h"
@@ -33,7 +35,15 @@
 
 /** A format specifier for the on-disk binary file format. This should be
  *incremented whenever the on-disk format changes.*/
-#define KDTREE_FILE_FORMAT 2
+#define KDTREE_FILE_FORMAT 3
+
+/** The depth beyond which estimate_kdtree_count stops descending, and counts
+ *every observation of a subtree which overlaps the bounds.*/
+#define ESTIMATE_MAX_DEPTH 12
+
+/** The depth to which the bounding boxes of subtrees are stored, to find empty
+ *regions cheaply (see occupied_kdtree).*/
+#define OCCUPANCY_DEPTH 12
 
 /**
   * Create a kdtree for a given number of observations.. This includes
@@ -44,7 +54,7 @@
   *kdtree.
   * @return A pointer to an allocated (but unconstructed) kdtree.
   */
-kdtree *construct_tree(unsigned int num_observations) {
+kdtree *construct_tree(size_t num_observations) {
 
    // Keep track of total bytes allocated (for debug purposes)
    size_t total_allocation = 0;
@@ -59,18 +69,18 @@ kdtree *construct_tree(unsigned int num_observations) {
 
    // Compute the number of nodes needed - the number of leaf nodes
    // is essentially the number of observations rounded up to the nearest
-   // power of 2.`
-   float tree_number_of_leaf_nodes =
-      powf(2.0, ceilf(log2f((float) num_observations)));
+   // power of 2 (computed exactly, as a float cannot represent every count
+   // of observations).
+   size_t tree_number_of_leaf_nodes = 1;
+   while (tree_number_of_leaf_nodes < num_observations) {
+      tree_number_of_leaf_nodes *= 2;
+   }
    // The total number of nodes in the tree is calculated from the
-   // number of leaf nodes
-   float tree_number_of_nodes_f = (2 * tree_number_of_leaf_nodes) - 1;
-   // Make sure the tree always has at least 1 nodes in it
-   unsigned int tree_number_of_nodes = (unsigned int) fmax(
-      tree_number_of_nodes_f, 1.0);
+   // number of leaf nodes (this is always at least 1)
+   size_t tree_number_of_nodes = (2 * tree_number_of_leaf_nodes) - 1;
 
    #ifdef DEBUG_KDTREE
-   printf("Allocating a tree of size %d for %d leaf nodes\n",
+   printf("Allocating a tree of size %zu for %zu leaf nodes\n",
           tree_number_of_nodes,
           num_observations);
    #endif
@@ -84,12 +94,12 @@ kdtree *construct_tree(unsigned int num_observations) {
    output_tree->tree_nodes = malloc(kdtree_node_allocate_size);
    if (output_tree->tree_nodes == NULL) {
       fprintf(stderr,
-              "Could not allocate %Zd bytes to store the kdtree nodes\n",
+              "Could not allocate %zu bytes to store the kdtree nodes\n",
               kdtree_node_allocate_size);
       exit(EXIT_FAILURE);
    }
    total_allocation += kdtree_node_allocate_size;
-   for (unsigned int i=0; i<tree_number_of_nodes; i++) {
+   for (size_t i=0; i<tree_number_of_nodes; i++) {
       output_tree->tree_nodes[i].tag = UNINITIALISED;
    }
 
@@ -98,11 +108,12 @@ kdtree *construct_tree(unsigned int num_observations) {
    output_tree->observations = malloc(observation_allocate_size);
    if (output_tree->observations == NULL) {
       fprintf(stderr,
-              "Could not allocate %Zd bytes to store the kdtree observations\n",
+              "Could not allocate %zu bytes to store the kdtree observations\n",
               observation_allocate_size);
       exit(EXIT_FAILURE);
    }
    total_allocation += observation_allocate_size;
+   output_tree->occupancy_boxes = NULL;
 
    #ifdef DEBUG_KDTREE
    printf("construct_tree: Total allocation is %ld bytes\n",
@@ -120,9 +131,9 @@ kdtree *construct_tree(unsigned int num_observations) {
   * @param current_index The current node to print from.
   * @param indent The current indentation level (increased on every recursion)
   * */
-static void inspect_tree_node(kdtree *tree_p, unsigned int current_index,
+static void inspect_tree_node(kdtree *tree_p, size_t current_index,
                               int indent) {
-   printf("%d", current_index);
+   printf("%zu", current_index);
    for (int i=1; i<=indent; i++) {
       if (i==indent) {
          printf("\\");
@@ -134,7 +145,7 @@ static void inspect_tree_node(kdtree *tree_p, unsigned int current_index,
    kdtree_node *cur_node = &tree_p->tree_nodes[current_index];
    if (cur_node->tag == TERMINAL) {
       printf(
-         "Terminal Node [Data Node %d] (%f, %f, %d)\n",
+         "Terminal Node [Data Node %zu] (%f, %f, %zu)\n",
          cur_node->data.observation_index,
          tree_p->observations[cur_node->data.observation_index].dimensions[
             Y],
@@ -163,7 +174,7 @@ static void inspect_tree_node(kdtree *tree_p, unsigned int current_index,
   * @param tree_p A pointer to the kdtree to print.
   */
 void inspect_tree(kdtree *tree_p) {
-   printf("Inspecting tree at %ld (%d observations)\n", (long) tree_p,
+   printf("Inspecting tree at %ld (%zu observations)\n", (long) tree_p,
           tree_p->num_observations);
    inspect_tree_node(tree_p, 0, 0);
 }
@@ -176,22 +187,56 @@ void inspect_tree(kdtree *tree_p) {
 void free_tree(kdtree *tree_p) {
    free(tree_p->tree_nodes);
    free(tree_p->observations);
+   free(tree_p->occupancy_boxes);
    free(tree_p);
 }
 
+/**
+  * Store an observation in a result_set (see query_kdtree_at).
+  *
+  * @param destination The result_set.
+  * @param found The observation to store.
+  */
+static void store_in_result_set(void *destination, observation *found) {
+   result_set *results = (result_set *) destination;
+   results->insert(results, found->dimensions[X], found->dimensions[Y],
+                   found->dimensions[T], found->file_record_index);
+}
+
+/**
+  * Store an observation in a hit_list (see query_kdtree_at).
+  *
+  * @param destination The hit_list.
+  * @param found The observation to store.
+  */
+static void store_in_hit_list(void *destination, observation *found) {
+   hit_list *hits = (hit_list *) destination;
+   hits->append(hits, found->dimensions[X], found->dimensions[Y],
+                found->dimensions[T], found->file_record_index);
+}
+
 /**
   * Recursively query the subtree stemming from the current_node_index node,
   * looking for observations within the given dimension bounds, and
-  * storing the results in the given result set.
+  * storing the results in the given destination.
   *
   * @param tree_p The tree to query.
   * @param bounds The dimension bounds defining the query.
-  * @param results The result_set to store the found results in.
+  * @param store Function used to store each found observation.
+  * @param destination Where to store the found results (passed to @a store).
   * @param current_node_index The index of the node to be queried from.
+  * @param filter Predicate which found observations must satisfy (or NULL).
+  * @param filter_context Passed unchanged to @a filter.
+  * @param counts The work done by the query is added to this (or NULL to not
+  *count it).
   */
 static void query_kdtree_at(kdtree *tree_p, dimension_bounds bounds,
-                            result_set *results,
-                            unsigned int current_node_index) {
+                            void (*store)(void *destination,
+                                          observation *found),
+                            void *destination,
+                            size_t current_node_index,
+                            int (*filter)(void *context, size_t record_index),
+                            void *filter_context, query_counts *counts) {
 
    // Lookup the current node
    kdtree_node *current_node = &tree_p->tree_nodes[current_node_index];
@@ -200,6 +245,7 @@ static void query_kdtree_at(kdtree *tree_p, dimension_bounds bounds,
       // Lookup the observation pointed to by the node
       observation *current_observation =
          &tree_p->observations[current_node->data.observation_index];
+      if (counts != NULL) counts->leaves_tested++;
 
       // Check to see if the observation falls within the bounds
       if (
@@ -208,15 +254,17 @@ static void query_kdtree_at(kdtree *tree_p, dimension_bounds bounds,
          (current_observation->dimensions[X] >= bounds[2*X + LOWER]) &&
          (current_observation->dimensions[X] <= bounds[2*X + UPPER]) &&
          (current_observation->dimensions[T] >= bounds[2*T + LOWER]) &&
-         (current_observation->dimensions[T] <= bounds[2*T + UPPER])) {
+         (current_observation->dimensions[T] <= bounds[2*T + UPPER]) &&
+         (filter == NULL ||
+          filter(filter_context, current_observation->file_record_index))) {
 
-         // Result falls within bounds: store in the result set
-         results->insert(results, current_observation->dimensions[X],
-                         current_observation->dimensions[Y],
-                         current_observation->dimensions[T],
-                         current_observation->file_record_index);
+         // Result falls within bounds: store it
+         store(destination, current_observation);
+         if (counts != NULL) counts->hits++;
       }
    } else {
+      if (counts != NULL) counts->nodes_visited++;
+
       // 3 cases - the discriminator can either be less than our search range,
       // within it, or above it
       // less than: search the left child of this node
@@ -226,14 +274,17 @@ static void query_kdtree_at(kdtree *tree_p, dimension_bounds bounds,
       if (current_node->data.discriminator >=
           bounds[2*(current_node->tag) + LOWER]) {
          //Search left child
-         query_kdtree_at(tree_p, bounds, results, LEFT_CHILD(current_node_index));
+         query_kdtree_at(tree_p, bounds, store, destination,
+                         LEFT_CHILD(current_node_index), filter,
+                         filter_context, counts);
       };
 
       if (current_node->data.discriminator <=
           bounds[2*(current_node->tag) + UPPER]) {
          //Search right child
-         query_kdtree_at(tree_p, bounds, results,
-                         RIGHT_CHILD(current_node_index));
+         query_kdtree_at(tree_p, bounds, store, destination,
+                         RIGHT_CHILD(current_node_index), filter,
+                         filter_context, counts);
       };
    };
 };
@@ -245,10 +296,179 @@ static void query_kdtree_at(kdtree *tree_p, dimension_bounds bounds,
 
 result_set *query_kdtree(spatial_index *toquery, dimension_bounds bounds) {
    result_set *results = result_set_init();
-   query_kdtree_at((kdtree *)(toquery->data_structure), bounds, results, 0);
+   query_kdtree_at((kdtree *)(toquery->data_structure), bounds,
+                   &store_in_result_set, results, 0, toquery->filter,
+                   toquery->filter_context, NULL);
    return results;
 }
 
+/**
+  * Query a kdtree for points within given bounds, counting the work done.
+  * @see index::query_counted
+  */
+result_set *query_counted_kdtree(spatial_index *toquery,
+                                 dimension_bounds bounds,
+                                 query_counts *counts) {
+   counts->nodes_visited = 0;
+   counts->leaves_tested = 0;
+   counts->hits = 0;
+   result_set *results = result_set_init();
+   query_kdtree_at((kdtree *)(toquery->data_structure), bounds,
+                   &store_in_result_set, results, 0, toquery->filter,
+                   toquery->filter_context, counts);
+   return results;
+}
+
+/**
+  * Query a kdtree for points within given bounds, appending them to a
+  *hit_list.
+  * @see index::query_append
+  */
+void query_append_kdtree(spatial_index *toquery, dimension_bounds bounds,
+                         hit_list *hits) {
+   query_kdtree_at((kdtree *)(toquery->data_structure), bounds,
+                   &store_in_hit_list, hits, 0, toquery->filter,
+                   toquery->filter_context, NULL);
+}
+
+/**
+  * Recursively estimate the number of observations in the subtree stemming from
+  *the current_node_index node which fall within the given dimension bounds.
+  *
+  * The tree is split at the median of each node, so each subtree holds
+  *approximately half the observations of its parent. A subtree whose region
+  *lies within the bounds is counted without being descended into, as is any
+  *subtree at ESTIMATE_MAX_DEPTH which overlaps the bounds.
+  *
+  * @param tree_p The tree to query.
+  * @param bounds The dimension bounds defining the query.
+  * @param region The region covered by the current node (lower X, upper X,
+  *lower Y, upper Y).
+  * @param current_node_index The index of the node to be queried from.
+  * @param depth The depth of the current node (0 for the root).
+  * @return The estimated number of observations.
+  */
+static float estimate_kdtree_count_at(kdtree *tree_p, dimension_bounds bounds,
+                                      float *region,
+                                      size_t current_node_index,
+                                      int depth) {
+   kdtree_node *current_node = &tree_p->tree_nodes[current_node_index];
+
+   if (current_node->tag == UNINITIALISED) {
+      return 0.0;
+   }
+
+   if (current_node->tag == TERMINAL) {
+      observation *current_observation =
+         &tree_p->observations[current_node->data.observation_index];
+      return (current_observation->dimensions[Y] >= bounds[2*Y + LOWER]) &&
+             (current_observation->dimensions[Y] <= bounds[2*Y + UPPER]) &&
+             (current_observation->dimensions[X] >= bounds[2*X + LOWER]) &&
+             (current_observation->dimensions[X] <= bounds[2*X + UPPER]);
+   }
+
+   if (depth >= ESTIMATE_MAX_DEPTH ||
+       ((region[2*X + LOWER] >= bounds[2*X + LOWER]) &&
+        (region[2*X + UPPER] <= bounds[2*X + UPPER]) &&
+        (region[2*Y + LOWER] >= bounds[2*Y + LOWER]) &&
+        (region[2*Y + UPPER] <= bounds[2*Y + UPPER]))) {
+      return ldexpf((float) tree_p->num_observations, -depth);
+   }
+
+   float estimate = 0.0;
+   int dimension = current_node->tag;
+   float discriminator = current_node->data.discriminator;
+   float child_region[4] = {region[0], region[1], region[2], region[3]};
+
+   if (discriminator >= bounds[2*dimension + LOWER]) {
+      child_region[2*dimension + UPPER] = discriminator;
+      estimate += estimate_kdtree_count_at(tree_p, bounds, child_region,
+                                           LEFT_CHILD(current_node_index),
+                                           depth + 1);
+      child_region[2*dimension + UPPER] = region[2*dimension + UPPER];
+   }
+   if (discriminator <= bounds[2*dimension + UPPER]) {
+      child_region[2*dimension + LOWER] = discriminator;
+      estimate += estimate_kdtree_count_at(tree_p, bounds, child_region,
+                                           RIGHT_CHILD(current_node_index),
+                                           depth + 1);
+   }
+   return estimate;
+}
+
+/**
+  * Estimate the number of observations of a kdtree within given bounds.
+  * @see index::estimate_count
+  */
+float estimate_kdtree_count(spatial_index *toquery, dimension_bounds bounds) {
+   float region[] = {-INFINITY, INFINITY, -INFINITY, INFINITY};
+   return estimate_kdtree_count_at((kdtree *)(toquery->data_structure), bounds,
+                                   region, 0, 0);
+}
+
+/**
+  * Recursively determine whether any observation of the subtree stemming from
+  *the current_node_index node may lie within the given bounds, from the
+  *stored bounding boxes of the subtrees.
+  *
+  * @param tree_p The tree to query.
+  * @param bounds The dimension bounds defining the query.
+  * @param current_node_index The index of the node to be queried from.
+  * @param depth The depth of the current node (0 for the root).
+  * @return 0 if no observation of the subtree lies within the bounds, 1 if
+  *one may.
+  */
+static int occupied_kdtree_at(kdtree *tree_p, dimension_bounds bounds,
+                              size_t current_node_index, int depth) {
+   float *box = &tree_p->occupancy_boxes[4 * current_node_index];
+   if (box[2*X + LOWER] > bounds[2*X + UPPER] ||
+       box[2*X + UPPER] < bounds[2*X + LOWER] ||
+       box[2*Y + LOWER] > bounds[2*Y + UPPER] ||
+       box[2*Y + UPPER] < bounds[2*Y + LOWER]) {
+      return 0;
+   }
+
+   // The box overlaps the bounds; look at the boxes of the children where
+   // they are stored
+   short int tag = tree_p->tree_nodes[current_node_index].tag;
+   if (depth + 1 >= OCCUPANCY_DEPTH || tag == TERMINAL) {
+      return 1;
+   }
+   return occupied_kdtree_at(tree_p, bounds, LEFT_CHILD(current_node_index),
+                             depth + 1) ||
+          occupied_kdtree_at(tree_p, bounds, RIGHT_CHILD(current_node_index),
+                             depth + 1);
+}
+
+/**
+  * Determine whether any observations of a kdtree may lie within given
+  *bounds.
+  * @see index::occupied
+  */
+int occupied_kdtree(spatial_index *toquery, dimension_bounds bounds) {
+   return occupied_kdtree_at((kdtree *)(toquery->data_structure), bounds, 0,
+                             0);
+}
+
+/**
+  * Append a block of the observations of a kdtree to a hit_list, in the order
+  *they are stored.
+  * @see index::scan
+  */
+void scan_kdtree(spatial_index *toscan, size_t first, size_t count,
+                 hit_list *hits) {
+   kdtree *tree_p = (kdtree *) toscan->data_structure;
+
+   for (size_t i = first; i < first + count; i++) {
+      observation *current_observation = &tree_p->observations[i];
+      if (toscan->filter == NULL ||
+          toscan->filter(toscan->filter_context,
+                         current_observation->file_record_index)) {
+         store_in_hit_list(hits, current_observation);
+      }
+   }
+}
+
 /**
   * Find the single-nearest neighbour to the given target point in the given
   *subtree marked by tree_index.
@@ -259,7 +479,7 @@ result_set *query_kdtree(spatial_index *toquery, dimension_bounds bounds) {
   * @return The closest observation to the given point.
   */
 observation *nearest_neighbour_recursive(kdtree *tree_p, float *target_point,
-                                         unsigned int tree_index) {
+                                         size_t tree_index) {
    kdtree_node *current_node = &tree_p->tree_nodes[tree_index];
 
    if (current_node->tag == TERMINAL) {
@@ -327,10 +547,10 @@ observation *nearest_neighbour(kdtree *tree_p, float *target_point) {
   */
 void verify_tree(kdtree *tree_p) {
    // Calculate the index which represents the first leaf node
-   unsigned int start_of_leaves = (tree_p->tree_num_nodes + 1) / 2;
+   size_t start_of_leaves = (tree_p->tree_num_nodes + 1) / 2;
 
    // Iterate over every leaf node
-   for (unsigned int current_leaf_node = start_of_leaves;
+   for (size_t current_leaf_node = start_of_leaves;
         current_leaf_node < tree_p->tree_num_nodes;
         current_leaf_node++) {
 
@@ -341,7 +561,7 @@ void verify_tree(kdtree *tree_p) {
       if (current_tree_node->tag == UNINITIALISED) {
          continue;
       }
-      unsigned int observation_index =
+      size_t observation_index =
          current_tree_node->data.observation_index;
 
       float dimensions[2];
@@ -352,9 +572,9 @@ void verify_tree(kdtree *tree_p) {
       // point is always on the correct side of the discriminator
       //Note that left children are always stored in odd node slots, and right
       // children in even node slots
-      unsigned int temp_tree_node_index = current_leaf_node;
+      size_t temp_tree_node_index = current_leaf_node;
       while(temp_tree_node_index > 0) {
-         unsigned int parent_tree_node = PARENT(temp_tree_node_index);
+         size_t parent_tree_node = PARENT(temp_tree_node_index);
 
          // All left children are stored in odd indices
          int is_left_child_of_parent = ((temp_tree_node_index % 2) == 1);
@@ -384,8 +604,9 @@ void verify_tree(kdtree *tree_p) {
                printf("right");
             }
             printf(
-               " child (%d) of a parent tree node stored at %d of discrimination "\
-               "type %d, the parent discriminator %f is invalid\n",
+               " child (%zu) of a parent tree node stored at %zu of "\
+               "discrimination type %d, the parent discriminator %f is "\
+               "invalid\n",
                temp_tree_node_index, parent_tree_node,
                parent_discriminator_type,
                parent_discriminator);
@@ -458,9 +679,9 @@ static int compare_longitudes(const void* a, const void* b) {
   *currently stored. Use -1 if the data is unsorted.
   */
 static void recursive_build_kd_tree(kdtree *tree_p,
-                                    unsigned int first_node_index,
-                                    unsigned int last_node_index,
-                                    unsigned int current_tree_index,
+                                    size_t first_node_index,
+                                    size_t last_node_index,
+                                    size_t current_tree_index,
                                     short int current_sort_dimension) {
 
    observation *observations = tree_p->observations;
@@ -489,7 +710,7 @@ static void recursive_build_kd_tree(kdtree *tree_p,
    if (current_sort_dimension == X) {
       x_min = observations[first_node_index].dimensions[X];
       x_max = observations[last_node_index].dimensions[X];
-      for (unsigned int current_index = first_node_index;
+      for (size_t current_index = first_node_index;
            current_index <= last_node_index; current_index++) {
          y_min = fmin(y_min, observations[current_index].dimensions[Y]);
          y_max = fmax(y_max, observations[current_index].dimensions[Y]);
@@ -497,13 +718,13 @@ static void recursive_build_kd_tree(kdtree *tree_p,
    } else if (current_sort_dimension == Y) {
       y_min = observations[first_node_index].dimensions[Y];
       y_max = observations[last_node_index].dimensions[Y];
-      for (unsigned int current_index = first_node_index;
+      for (size_t current_index = first_node_index;
            current_index <= last_node_index; current_index++) {
          x_min = fmin(x_min, observations[current_index].dimensions[X]);
          x_max = fmax(x_max, observations[current_index].dimensions[X]);
       }
    } else {
-      for (unsigned int current_index = first_node_index;
+      for (size_t current_index = first_node_index;
            current_index <= last_node_index; current_index+=2) {
          y_min = fmin(y_min, observations[current_index].dimensions[Y]);
          x_min = fmin(x_min, observations[current_index].dimensions[X]);
@@ -535,7 +756,7 @@ static void recursive_build_kd_tree(kdtree *tree_p,
    // Calculate the discriminator value, and the indices of the split point in
    // the data
    float discriminator;
-   unsigned int split_node_index;
+   size_t split_node_index;
    if (((last_node_index - first_node_index) % 2) != 0) {
       //even number of nodes
       split_node_index = first_node_index +
@@ -575,6 +796,65 @@ static void recursive_build_kd_tree(kdtree *tree_p,
    }
 }
 
+/**
+  * Recursively find the bounding box of the observations of the subtree
+  *stemming from the current_node_index node, storing it in the occupancy boxes
+  *of the tree where the node is shallower than OCCUPANCY_DEPTH.
+  *
+  * @param tree_p The tree.
+  * @param current_node_index The index of the node at the root of the subtree.
+  * @param depth The depth of the current node (0 for the root).
+  * @param box The bounding box (lower X, upper X, lower Y, upper Y) is stored
+  *here.
+  */
+static void find_subtree_box(kdtree *tree_p, size_t current_node_index,
+                             int depth, float *box) {
+   kdtree_node *current_node = &tree_p->tree_nodes[current_node_index];
+
+   if (current_node->tag == UNINITIALISED) {
+      box[2*X + LOWER] = box[2*Y + LOWER] = INFINITY;
+      box[2*X + UPPER] = box[2*Y + UPPER] = -INFINITY;
+   } else if (current_node->tag == TERMINAL) {
+      observation *current_observation =
+         &tree_p->observations[current_node->data.observation_index];
+      box[2*X + LOWER] = box[2*X + UPPER] = current_observation->dimensions[X];
+      box[2*Y + LOWER] = box[2*Y + UPPER] = current_observation->dimensions[Y];
+   } else {
+      float right_box[4];
+      find_subtree_box(tree_p, LEFT_CHILD(current_node_index), depth + 1, box);
+      find_subtree_box(tree_p, RIGHT_CHILD(current_node_index), depth + 1,
+                       right_box);
+      box[2*X + LOWER] = fminf(box[2*X + LOWER], right_box[2*X + LOWER]);
+      box[2*X + UPPER] = fmaxf(box[2*X + UPPER], right_box[2*X + UPPER]);
+      box[2*Y + LOWER] = fminf(box[2*Y + LOWER], right_box[2*Y + LOWER]);
+      box[2*Y + UPPER] = fmaxf(box[2*Y + UPPER], right_box[2*Y + UPPER]);
+   }
+
+   if (depth < OCCUPANCY_DEPTH) {
+      memcpy(&tree_p->occupancy_boxes[4 * current_node_index], box,
+             4 * sizeof(float));
+   }
+}
+
+/**
+  * Calculate the occupancy boxes of a filled kdtree (see occupied_kdtree).
+  *
+  * @param tree_p The filled kdtree.
+  */
+static void build_occupancy_boxes(kdtree *tree_p) {
+   size_t number_boxes = ((size_t) 1 << OCCUPANCY_DEPTH) - 1;
+   if (number_boxes > tree_p->tree_num_nodes) {
+      number_boxes = tree_p->tree_num_nodes;
+   }
+   tree_p->occupancy_boxes = malloc(4 * sizeof(float) * number_boxes);
+   if (tree_p->occupancy_boxes == NULL) {
+      fprintf(stderr, "Could not allocate space for the occupancy boxes\n");
+      exit(EXIT_FAILURE);
+   }
+   float root_box[4];
+   find_subtree_box(tree_p, 0, 0, root_box);
+}
+
 /**
   * Fill a constructed kdtree from the values found in the given reader.
   *
@@ -586,7 +866,7 @@ void fill_tree_from_reader(kdtree *tree_p, coordinate_reader *reader) {
    observation *observations = tree_p->observations;
 
    register int result;
-   for(unsigned int current_index = 0; current_index < reader->num_records;
+   for(size_t current_index = 0; current_index < reader->num_records;
        current_index++) {
       // Link the observations in the tree to the current record from the
       // coordinate reader
@@ -628,8 +908,8 @@ void write_kdtree_index_to_file(spatial_index *towrite, FILE *output_file) {
                                                output_file);
 
    // Write the sizes of the data
-   fwrite(&tree_p->num_observations, sizeof(unsigned int), 1, output_file);
-   fwrite(&tree_p->tree_num_nodes, sizeof(unsigned int), 1, output_file);
+   uint64_t sizes[] = {tree_p->num_observations, tree_p->tree_num_nodes};
+   fwrite(sizes, sizeof(uint64_t), 2, output_file);
 
    // Write the tree data to the file
    fwrite(tree_p->tree_nodes, sizeof(kdtree_node), tree_p->tree_num_nodes,
@@ -678,10 +958,10 @@ spatial_index *read_kdtree_index_from_file(FILE *input_file) {
    }
 
    // Read the sizes of data for the kdtree
-   unsigned int num_observations;
-   unsigned int tree_num_nodes;
-   fread(&num_observations, sizeof(unsigned int), 1, input_file);
-   fread(&tree_num_nodes, sizeof(unsigned int), 1, input_file);
+   uint64_t sizes[2];
+   fread(sizes, sizeof(uint64_t), 2, input_file);
+   size_t num_observations = sizes[0];
+   size_t tree_num_nodes = sizes[1];
 
    // Create tree
    kdtree *tree_p = construct_tree(num_observations);
@@ -689,7 +969,7 @@ spatial_index *read_kdtree_index_from_file(FILE *input_file) {
    // Check the computed number of tree nodes against the number read from file
    if (tree_num_nodes != tree_p->tree_num_nodes) {
       fprintf(stderr,
-              "Mismatch in number of tree nodes (read %d, computed %d)\n",
+              "Mismatch in number of tree nodes (read %zu, computed %zu)\n",
               tree_num_nodes,
               tree_p->tree_num_nodes);
       exit(EXIT_FAILURE);
@@ -700,6 +980,7 @@ spatial_index *read_kdtree_index_from_file(FILE *input_file) {
          input_file);
    fread(tree_p->observations, sizeof(observation), tree_p->num_observations,
          input_file);
+   build_occupancy_boxes(tree_p);
 
    // Check concluding header
    fread(&file_format_number, sizeof(unsigned int), 1, input_file);
@@ -729,6 +1010,13 @@ spatial_index *read_kdtree_index_from_file(FILE *input_file) {
    output_index->write_to_file = &write_kdtree_index_to_file;
    output_index->free = &free_kdtree_index;
    output_index->query = &query_kdtree;
+   output_index->query_append = &query_append_kdtree;
+   output_index->query_counted = &query_counted_kdtree;
+   output_index->estimate_count = &estimate_kdtree_count;
+   output_index->occupied = &occupied_kdtree;
+   output_index->scan = &scan_kdtree;
+   output_index->filter = NULL;
+   output_index->filter_context = NULL;
 
    return output_index;
 }
@@ -745,6 +1033,7 @@ spatial_index *generate_kdtree_index_from_coordinate_reader(
    kdtree *root_p = construct_tree(reader->num_records);
 
    fill_tree_from_reader(root_p, reader);
+   build_occupancy_boxes(root_p);
 
    #ifdef DEBUG
    printf("Verifying tree\n");
@@ -765,6 +1054,13 @@ spatial_index *generate_kdtree_index_from_coordinate_reader(
    output_index->write_to_file = &write_kdtree_index_to_file;
    output_index->free = &free_kdtree_index;
    output_index->query = &query_kdtree;
+   output_index->query_append = &query_append_kdtree;
+   output_index->query_counted = &query_counted_kdtree;
+   output_index->estimate_count = &estimate_kdtree_count;
+   output_index->occupied = &occupied_kdtree;
+   output_index->scan = &scan_kdtree;
+   output_index->filter = NULL;
+   output_index->filter_context = NULL;
 
    return output_index;
 }
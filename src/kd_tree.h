@@ -5,6 +5,8 @@
   */
 #ifndef  HEADER_KD_TREE_MINIMAL
 #define HEADER_KD_TREE_MINIMAL
+#include <stddef.h>
+
 #include "coordinate_reader.h"
 #include "spatial_index.h"
 #include "projector.h"
@@ -28,7 +30,7 @@ typedef struct {
 
       /** The observation index of this leaf node - used to lookup the
        *appropriate observation.*/
-      unsigned int observation_index;
+      size_t observation_index;
    } data;
 } kdtree_node;
 
@@ -40,7 +42,7 @@ typedef struct {
    float dimensions[3];
 
    /** The corresponding index into the original data files.*/
-   unsigned int file_record_index;
+   size_t file_record_index;
 } observation;
 
 /**
@@ -48,10 +50,10 @@ typedef struct {
   */
 typedef struct {
    /** The number of observations represented by this tree.*/
-   unsigned int num_observations;
+   size_t num_observations;
 
    /** The number of nodes (internal + leaf) in the tree.*/
-   unsigned int tree_num_nodes;
+   size_t tree_num_nodes;
 
    /** Pointer to a 1-dimensional array of nodes.*/
    kdtree_node *tree_nodes;
@@ -59,6 +61,12 @@ typedef struct {
    /** Pointer to a 1-dimensional array of observations.*/
    observation *observations;
 
+   /** The bounding box (lower X, upper X, lower Y, upper Y) of the
+    *observations beneath each node shallower than OCCUPANCY_DEPTH, stored
+    *four floats per node in node order (the box of a node with no
+    *observations has its lower bounds above its upper bounds).*/
+   float *occupancy_boxes;
+
 } kdtree;
 
 // Function prototypes - implementations id kd_tree.c
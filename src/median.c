@@ -1,25 +1,64 @@
 /**
   * @file
   *
-  * Implementation of an efficient algorithm for finding the median of an
+  * Implementation of efficient algorithms for finding the median of an
   *unsorted list of numbers.
   */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "median.h"
 #include "data_handling.h"
 
+/**
+  * Swap two values in an array.
+  *
+  * @param values An array of NUMERIC_WORKING_TYPE floating point numbers.
+  * @param a The index of the first value.
+  * @param b The index of the second value.
+  */
+static inline void swap(NUMERIC_WORKING_TYPE *values, int a, int b)
+{
+   NUMERIC_WORKING_TYPE swap_temp = values[a];
+   values[a] = values[b];
+   values[b] = swap_temp;
+}
+
+/**
+  * Choose a pivot for a sublist using the median-of-three rule, and move it to
+  *the start of the sublist.
+  *
+  * The first, middle and last values are ordered, and the middle (median) value
+  *is swapped into the first position. This avoids the quadratic behaviour of a
+  *first-value pivot on sorted or reverse-sorted data, and leaves a value no
+  *smaller than the pivot in the last position.
+  *
+  * @param values An array of NUMERIC_WORKING_TYPE floating point numbers.
+  * @param first The index of the first item in the selected sublist.
+  * @param last The index of the last item in the selected sublist.
+  */
+static void median_of_three_to_first(NUMERIC_WORKING_TYPE *values, int first,
+                                     int last)
+{
+   int middle = first + (last - first) / 2;
+
+   if (values[middle] < values[first]) swap(values, middle, first);
+   if (values[last] < values[first]) swap(values, last, first);
+   if (values[last] < values[middle]) swap(values, last, middle);
+
+   swap(values, first, middle);
+}
+
 /**
   * Partition a sublist of numbers (between first and last).
   *
-  * Partioning a list involves selecting a pivot (the first number in the last),
-  *and partially
-  * sorting the list until all values lesser than the pivot are positioned
-  *before the pivot,
-  * and all values greater than the pivot are position after the pivot. The
-  *index of the pivot
-  * in its final position is returned.
+  * Partioning a list involves selecting a pivot (the first number in the
+  *sublist), and partially sorting the list until all values lesser than the
+  *pivot are positioned before the pivot, and all values greater than the pivot
+  *are position after the pivot. The index of the pivot in its final position is
+  *returned. Values equal to the pivot stop both scans, so runs of equal values
+  *are split evenly rather than all falling to one side.
   * This is the same partition algorithm as used in Quicksort.
   *
   * @param values An array of NUMERIC_WORKING_TYPE floating point numbers.
@@ -34,7 +73,6 @@ static int partition(NUMERIC_WORKING_TYPE *values, int first, int last)
    NUMERIC_WORKING_TYPE pivot_value = values[first];
    register int i = first;
    register int j = last+1;
-   register NUMERIC_WORKING_TYPE swap_temp; //Used for swapping values
 
    do {
 
@@ -43,9 +81,7 @@ static int partition(NUMERIC_WORKING_TYPE *values, int first, int last)
 
       if (i<j)
       {
-         swap_temp = values[i];
-         values[i] = values[j];
-         values[j] = swap_temp;
+         swap(values, i, j);
       }
    } while (i<j);
 
@@ -55,100 +91,107 @@ static int partition(NUMERIC_WORKING_TYPE *values, int first, int last)
 }
 
 /**
-  * Select the kth value from an ascending ordered sublist.
+  * Restore the max-heap property below the given root of a heap.
+  *
+  * @param heap An array of NUMERIC_WORKING_TYPE floating point numbers arranged
+  *as a binary heap.
+  * @param root The index of the root of the subheap to restore.
+  * @param length The number of items in the heap.
+  */
+static void sift_down(NUMERIC_WORKING_TYPE *heap, int root, int length)
+{
+   int child;
+
+   while ((child = 2*root + 1) < length) {
+      // Select the larger of the two children
+      if (child + 1 < length && heap[child] < heap[child + 1]) child++;
+
+      if (heap[root] >= heap[child]) return;
+
+      swap(heap, root, child);
+      root = child;
+   }
+}
+
+/**
+  * Sort a sublist of numbers into ascending order using heapsort.
   *
-  * This function is equivalent to performing a sort on the list, and then
-  *selecting the kth item.
-  * However, this function only partially sorts the list until the desired item
-  *is known.
+  * This is only used as a fallback when selection is making poor progress, as
+  *it guarantees O(n log n) behaviour regardless of the input.
   *
   * @param values An array of NUMERIC_WORKING_TYPE floating point numbers.
-  * @param k The index of the desired item; first <= k <= last.
   * @param first The index of the first item in the selected sublist.
   * @param last The index of the last item in the selected sublist.
-  * @return The value of the kth item.
   */
-static NUMERIC_WORKING_TYPE single_selection(NUMERIC_WORKING_TYPE *values,
-                                             int k, int first,
-                                             int last)
+static void heap_sort(NUMERIC_WORKING_TYPE *values, int first, int last)
 {
-   int j;
+   NUMERIC_WORKING_TYPE *heap = &values[first];
+   int length = last - first + 1;
 
-   while(1)
-   {
-      // Partition the list
-      j = partition(values, first, last);
+   // Build the heap
+   for (int root = length/2 - 1; root >= 0; root--) {
+      sift_down(heap, root, length);
+   }
 
-      // Is this the position we are looking for?
-      if (k==j) {
-         // Found the right position - return the associated value
-         return values[j];
-      } else if (k<j) {
-         // The partition was greater than the position we are looking for
-         // Restrict the search to the positions lesser than the partition
-         last = j-1;
-      } else {
-         // The partition was lesser than the position we are looking for
-         // Restrict the search the positions greater than the partition
-         first = j+1;
-      }
+   // Repeatedly move the largest remaining value to the end
+   for (int end = length - 1; end > 0; end--) {
+      swap(heap, 0, end);
+      sift_down(heap, 0, end);
    }
 }
 
 /**
-  * Select the mean of the k1th and k2th value from an ascending ordered
-  *sublist.
+  * Move the kth value of a sublist into its position in ascending order.
+  *
+  * This function is equivalent to performing a sort on the sublist, but only
+  *partially sorts the list until the desired item is known. On return,
+  *values[k] holds the kth value, no value before k is greater than it, and no
+  *value after k is lesser than it.
   *
-  * This function is equivalent to performing a sort on the list, and then
-  *selecting the k1th and k2th item.
-  * However, this function only partially sorts the list until the desired item
-  *is known.
-  * The following constraints apply to k1 and k2: first <= k1 < k2 <= last; k2 -
-  *k1 = 1.
+  * Selection uses quickselect with a median-of-three pivot. As in introselect,
+  *if the number of partitions exceeds twice the logarithm of the sublist length
+  *(which can only happen on adversarial inputs), the remaining sublist is
+  *heapsorted instead, bounding the worst case at O(n log n).
   *
   * @param values An array of NUMERIC_WORKING_TYPE floating point numbers.
-  * @param length The length of the array.
-  * @param k1 The index of the first desired item.
-  * @param k2 The index of the second desired item.
-  * @return The mean of the values of k1 and k2.
+  * @param k The index of the desired item; first <= k <= last.
+  * @param first The index of the first item in the selected sublist.
+  * @param last The index of the last item in the selected sublist.
   */
-static NUMERIC_WORKING_TYPE mean_double_selection(NUMERIC_WORKING_TYPE *values,
-                                                  int length, int k1,
-                                                  int k2)
+static void select_kth(NUMERIC_WORKING_TYPE *values, int k, int first,
+                       int last)
 {
-   int first = 0;
-   int last = length-1;
    int j;
 
-   while(1)
+   // Allow 2*floor(log2(length)) partitions before falling back
+   int depth_limit = 0;
+   for (int length = last - first + 1; length > 1; length >>= 1) {
+      depth_limit += 2;
+   }
+
+   while (last > first)
    {
-      // Partition the data
-      j = partition(values, first, last);
+      if (depth_limit-- == 0) {
+         // Poor progress - finish with a guaranteed O(n log n) method
+         heap_sort(values, first, last);
+         return;
+      }
 
+      // Partition the list about a median-of-three pivot
+      median_of_three_to_first(values, first, last);
+      j = partition(values, first, last);
 
-      if (k2<j) {
-         // Partition is greater than both search positions,
-         // so restrict the search to values left of the partition
+      // Is this the position we are looking for?
+      if (k==j) {
+         return;
+      } else if (k<j) {
+         // The partition was greater than the position we are looking for
+         // Restrict the search to the positions lesser than the partition
          last = j-1;
-      } else if (k1>j) {
-         // Partition is lesser than both search positions,
-         // so restrict the search to values right of the partition
-         first = j+1;
-      } else if (k1==j) {
-         // Found the first value, so return the mean of this
-         // and the second value
-         return (values[j] +
-                 single_selection(values, j+1, j+1, length -1)) / 2.0;
-      } else if (k2==j) {
-         // Found the second value, so return the mean of this
-         // and the first value
-         return (single_selection(values, j-1, 0, j-1) + values[j]) / 2.0;
       } else {
-         //Shouldn't get here!
-         fprintf( stderr,
-            "A logical error occurred in the mean_double_selection algorithm - "\
-            "this is most likely a bug in Caspian.\n");
-         exit(EXIT_FAILURE);
+         // The partition was lesser than the position we are looking for
+         // Restrict the search the positions greater than the partition
+         first = j+1;
       }
    }
 }
@@ -156,6 +199,8 @@ static NUMERIC_WORKING_TYPE mean_double_selection(NUMERIC_WORKING_TYPE *values,
 /**
   * Compute the median of a list of values.
   *
+  * The list is partially reordered in place; no memory is allocated.
+  *
   * @param values The list of values to compute the median of.
   * @param length The number of items in the list.
   * @return The median of the list.
@@ -171,8 +216,116 @@ NUMERIC_WORKING_TYPE median(NUMERIC_WORKING_TYPE *values, int length)
    if (length==2) return (values[0] + values[1]) / 2.0;
 
    if (length % 2 == 0) {
-      return mean_double_selection(values, length, (length/2) - 1, (length/2));
+      // Select the lower of the 2 central values; the upper central value is
+      // then the smallest of the values after it
+      int k = (length/2) - 1;
+      select_kth(values, k, 0, length-1);
+
+      NUMERIC_WORKING_TYPE upper = values[k+1];
+      for (int i=k+2; i<length; i++) {
+         if (values[i] < upper) upper = values[i];
+      }
+      return (values[k] + upper) / 2.0;
    } else {
-      return single_selection(values, (length - 1)/2, 0, length-1);
+      select_kth(values, (length - 1)/2, 0, length-1);
+      return values[(length - 1)/2];
+   }
+}
+
+/**
+  * Find the bin of a histogram which contains the value of a given rank.
+  *
+  * @param counts The histogram (number of values in each bin).
+  * @param rank Pointer to the rank (0 being the lowest value) to find; on
+  *return, this is reduced to the rank within the returned bin.
+  * @return The index of the bin containing the value of the given rank.
+  */
+static int find_rank_in_histogram(unsigned int *counts, unsigned int *rank)
+{
+   int bin = 0;
+   while (counts[bin] <= *rank) {
+      *rank -= counts[bin];
+      bin++;
    }
+   return bin;
+}
+
+/**
+  * Select the value of a given rank from a list of small unsigned integer keys
+  *by counting, without reordering the list.
+  *
+  * 8-bit keys are counted in a single pass into 256 bins. 16-bit keys are
+  *counted in two radix passes of 256 bins each: the first over the high byte
+  *of every key, and the second over the low byte of the keys which share the
+  *selected high byte.
+  *
+  * @param keys The list of keys.
+  * @param length The number of keys in the list.
+  * @param key_bits The number of significant bits in each key (8 or 16).
+  * @param rank The rank of the desired key (0 <= rank < length).
+  * @return The key of the given rank.
+  */
+static unsigned int histogram_select(uint16_t *keys, int length, int key_bits,
+                                     unsigned int rank)
+{
+   unsigned int counts[256];
+
+   if (key_bits == 8) {
+      memset(counts, 0, sizeof(counts));
+      for (int i=0; i<length; i++) counts[keys[i]]++;
+      return find_rank_in_histogram(counts, &rank);
+   }
+
+   // First pass - count the high bytes
+   memset(counts, 0, sizeof(counts));
+   for (int i=0; i<length; i++) counts[keys[i] >> 8]++;
+   unsigned int high = find_rank_in_histogram(counts, &rank);
+
+   // Second pass - count the low bytes of keys in the selected high byte bin
+   memset(counts, 0, sizeof(counts));
+   for (int i=0; i<length; i++) {
+      if ((keys[i] >> 8) == high) counts[keys[i] & 0xff]++;
+   }
+   unsigned int low = find_rank_in_histogram(counts, &rank);
+
+   return (high << 8) | low;
+}
+
+/**
+  * Compute a percentile of a list of small unsigned integer keys using a
+  *counting histogram.
+  *
+  * This runs in O(length) time regardless of the input ordering, and does not
+  *modify the list. Percentiles which fall between two keys are linearly
+  *interpolated, such that the 50th percentile is identical to the median.
+  *Signed or offset data should be converted to keys (e.g. by adding 128 to an
+  *int8), and the offset subtracted from the result.
+  *
+  * @param keys The list of keys.
+  * @param length The number of keys in the list.
+  * @param key_bits The number of significant bits in each key (8 or 16).
+  * @param percentile The desired percentile (0 to 100).
+  * @return The percentile of the list.
+  */
+NUMERIC_WORKING_TYPE histogram_percentile(uint16_t *keys, int length,
+                                          int key_bits, double percentile)
+{
+   if (length==0) {
+      fprintf(stderr,
+              "histogram_percentile called with 0 values - a bug in Caspian\n");
+      exit(EXIT_FAILURE);
+   }
+
+   // Find the (fractional) rank of the percentile
+   double position = (percentile / 100.0) * (double) (length - 1);
+   unsigned int lower_rank = (unsigned int) position;
+   double fraction = position - (double) lower_rank;
+
+   NUMERIC_WORKING_TYPE lower = histogram_select(keys, length, key_bits,
+                                                 lower_rank);
+   if (fraction == 0.0) return lower;
+
+   NUMERIC_WORKING_TYPE upper = histogram_select(keys, length, key_bits,
+                                                 lower_rank + 1);
+   return lower + (upper - lower) * fraction;
 }
@@ -6,6 +6,8 @@
 
 #include "data_handling.h"
 
-// Function prototype - implementation in median.c
+// Function prototypes - implementation in median.c
 NUMERIC_WORKING_TYPE median(NUMERIC_WORKING_TYPE *values, int length);
+NUMERIC_WORKING_TYPE histogram_percentile(uint16_t *keys, int length,
+                                          int key_bits, double percentile);
 #endif
@@ -0,0 +1,195 @@
+/**
+  * @file
+  *
+  * Implementation of an unindexed list of observations. The list provides the
+  *spatial_index interface, but its queries must examine every observation, so
+  *it should only be used where each observation is visited once (by scanning
+  *the list).
+  */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coordinate_reader.h"
+#include "data_handling.h"
+#include "hit_list.h"
+#include "kd_tree.h"
+#include "observation_list.h"
+#include "result_set.h"
+#include "spatial_index.h"
+
+/**
+  * Determine whether an observation lies within given bounds, and is accepted
+  *by the filter of the list.
+  *
+  * @param list The observation list.
+  * @param current_observation The observation.
+  * @param bounds The dimension bounds.
+  * @return 1 if the observation should be returned by a query, 0 otherwise.
+  */
+static int observation_matches(spatial_index *list,
+                               observation *current_observation,
+                               dimension_bounds bounds) {
+   return (current_observation->dimensions[Y] >= bounds[2*Y + LOWER]) &&
+          (current_observation->dimensions[Y] <= bounds[2*Y + UPPER]) &&
+          (current_observation->dimensions[X] >= bounds[2*X + LOWER]) &&
+          (current_observation->dimensions[X] <= bounds[2*X + UPPER]) &&
+          (current_observation->dimensions[T] >= bounds[2*T + LOWER]) &&
+          (current_observation->dimensions[T] <= bounds[2*T + UPPER]) &&
+          (list->filter == NULL ||
+           list->filter(list->filter_context,
+                        current_observation->file_record_index));
+}
+
+/**
+  * Query an observation list for points within given bounds, by examining
+  *every observation.
+  * @see index::query
+  */
+static result_set *query_observation_list(spatial_index *toquery,
+                                          dimension_bounds bounds) {
+   observation *observations = (observation *) toquery->data_structure;
+   result_set *results = result_set_init();
+
+   for (size_t i = 0; i < toquery->num_observations; i++) {
+      if (observation_matches(toquery, &observations[i], bounds)) {
+         results->insert(results, observations[i].dimensions[X],
+                         observations[i].dimensions[Y],
+                         observations[i].dimensions[T],
+                         observations[i].file_record_index);
+      }
+   }
+   return results;
+}
+
+/**
+  * Query an observation list for points within given bounds, appending them
+  *to a hit_list.
+  * @see index::query_append
+  */
+static void query_append_observation_list(spatial_index *toquery,
+                                          dimension_bounds bounds,
+                                          hit_list *hits) {
+   observation *observations = (observation *) toquery->data_structure;
+
+   for (size_t i = 0; i < toquery->num_observations; i++) {
+      if (observation_matches(toquery, &observations[i], bounds)) {
+         hits->append(hits, observations[i].dimensions[X],
+                      observations[i].dimensions[Y],
+                      observations[i].dimensions[T],
+                      observations[i].file_record_index);
+      }
+   }
+}
+
+/**
+  * Estimate the number of observations of a list within given bounds. Without
+  *an index, no better estimate than every observation is available cheaply.
+  * @see index::estimate_count
+  */
+static float estimate_observation_list_count(spatial_index *toquery,
+                                             dimension_bounds bounds) {
+   return (float) toquery->num_observations;
+}
+
+/**
+  * Determine whether any observations of a list may lie within given bounds.
+  *Without an index, every region must be assumed to be occupied.
+  * @see index::occupied
+  */
+static int occupied_observation_list(spatial_index *toquery,
+                                     dimension_bounds bounds) {
+   return 1;
+}
+
+/**
+  * Append a block of the observations of a list to a hit_list.
+  * @see index::scan
+  */
+static void scan_observation_list(spatial_index *toscan, size_t first,
+                                  size_t count, hit_list *hits) {
+   observation *observations = (observation *) toscan->data_structure;
+
+   for (size_t i = first; i < first + count; i++) {
+      if (toscan->filter == NULL ||
+          toscan->filter(toscan->filter_context,
+                         observations[i].file_record_index)) {
+         hits->append(hits, observations[i].dimensions[X],
+                      observations[i].dimensions[Y],
+                      observations[i].dimensions[T],
+                      observations[i].file_record_index);
+      }
+   }
+}
+
+/**
+  * An observation list cannot be saved - this always exits.
+  * @see index::write_to_file
+  */
+static void write_observation_list_to_file(spatial_index *towrite,
+                                           FILE *output_file) {
+   fprintf(stderr,
+           "An observation list cannot be saved (this is probably a bug in "\
+           "Caspian)\n");
+   exit(EXIT_FAILURE);
+}
+
+/**
+  * Free an observation list.
+  *
+  * @param tofree The observation list to free.
+  */
+static void free_observation_list(spatial_index *tofree) {
+   free(tofree->data_structure);
+   free(tofree);
+}
+
+/**
+  * Read every observation from a coordinate_reader into an observation list.
+  *
+  * @param reader A coordinate_reader instance (source of geolocation
+  *information)
+  * @return Pointer to an index structure.
+  */
+spatial_index *generate_observation_list_from_coordinate_reader(
+   coordinate_reader *reader) {
+   observation *observations = malloc(sizeof(observation) *
+                                      reader->num_records);
+   if (observations == NULL) {
+      fprintf(stderr, "Could not allocate space for %zu observations\n",
+              reader->num_records);
+      exit(EXIT_FAILURE);
+   }
+
+   for (size_t current_index = 0; current_index < reader->num_records;
+        current_index++) {
+      observations[current_index].file_record_index = current_index;
+      if (!reader->read(reader, &observations[current_index].dimensions[X],
+                        &observations[current_index].dimensions[Y],
+                        &observations[current_index].dimensions[T])) {
+         printf("Failed to read all observations from files\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   spatial_index *output_index = malloc(sizeof(spatial_index));
+   if (output_index == NULL) {
+      fprintf(stderr, "Failed to allocate space for index\n");
+      exit(EXIT_FAILURE);
+   }
+
+   output_index->data_structure = observations;
+   output_index->input_projector = reader->input_projector;
+   output_index->num_observations = reader->num_records;
+   output_index->write_to_file = &write_observation_list_to_file;
+   output_index->free = &free_observation_list;
+   output_index->query = &query_observation_list;
+   output_index->query_append = &query_append_observation_list;
+   output_index->query_counted = NULL;
+   output_index->estimate_count = &estimate_observation_list_count;
+   output_index->occupied = &occupied_observation_list;
+   output_index->scan = &scan_observation_list;
+   output_index->filter = NULL;
+   output_index->filter_context = NULL;
+
+   return output_index;
+}
@@ -0,0 +1,18 @@
+/**
+  * @file
+  *
+  * An unindexed list of observations, for gridding engines which visit every
+  *observation once (see perform_scatter_gridding), and so do not need to build
+  *a spatial index.
+  */
+#ifndef HEADER_OBSERVATION_LIST
+#define HEADER_OBSERVATION_LIST
+
+#include "coordinate_reader.h"
+#include "spatial_index.h"
+
+// Function prototypes - implementation in observation_list.c
+spatial_index *generate_observation_list_from_coordinate_reader(
+   coordinate_reader *reader);
+
+#endif
@@ -57,6 +57,59 @@ spherical_coordinates _proj_inverse_project(projector *p, float y, float x) {
    return output;
 }
 
+/**
+  * Project many X/Y pairs to latitude/longitude pairs.
+  *
+  * @param p The proj-based projector to use.
+  * @param count The number of pairs.
+  * @param y The Y parts of the pairs (metres).
+  * @param x The X parts of the pairs (metres).
+  * @param output Array to receive the spherical coordinates of each pair.
+  */
+void _proj_inverse_project_many(projector *p, unsigned int count, float *y,
+                                float *x, spherical_coordinates *output) {
+   projPJ *projection = (projPJ *) p->internals;
+   for (unsigned int i=0; i<count; i++) {
+      projUV pj_input;
+      pj_input.u = y[i];
+      pj_input.v = x[i];
+      projUV pj_output = pj_inv(pj_input, projection);
+      output[i].longitude = pj_output.v * RAD_TO_DEG;
+      output[i].latitude = pj_output.u * RAD_TO_DEG;
+   }
+}
+
+/**
+  * Determine whether a projection is separable, i.e. whether it is one of the
+  *cylindrical projections in which latitude depends only on Y and longitude
+  *only on X.
+  *
+  * @param projection The initialised proj projection.
+  * @return 1 if the projection is separable, 0 otherwise.
+  */
+int _proj_is_separable(projPJ *projection) {
+   static char *separable_projections[] = {
+      "eqc", "latlong", "longlat", "latlon", "lonlat", "merc", "cea", "mill"
+   };
+   static int number_separable_projections = 8;
+
+   char *definition = pj_get_def(projection, 0);
+   char *name = strstr(definition, "+proj=");
+   int separable = 0;
+   if (name != NULL) {
+      name += strlen("+proj=");
+      size_t name_length = strcspn(name, " ");
+      for (int i=0; i<number_separable_projections; i++) {
+         if (strlen(separable_projections[i]) == name_length &&
+             strncmp(name, separable_projections[i], name_length) == 0) {
+            separable = 1;
+         }
+      }
+   }
+   pj_dalloc(definition);
+   return separable;
+}
+
 /**
   * Serialise a proj-based projector a file.
   *
@@ -114,6 +167,8 @@ projector *get_proj_projector_from_string(char *projection_string) {
    p->internals = (void *)projection;
    p->project = &_proj_project;
    p->inverse_project = &_proj_inverse_project;
+   p->inverse_project_many = &_proj_inverse_project_many;
+   p->separable = _proj_is_separable(projection);
    p->serialize_to_file = &_proj_serialize_to_file;
    p->free = &_proj_free;
 
@@ -181,6 +236,8 @@ projector *get_proj_projector_from_file(FILE *input_file) {
    p->internals = (void *)projection;
    p->project = &_proj_project;
    p->inverse_project = &_proj_inverse_project;
+   p->inverse_project_many = &_proj_inverse_project_many;
+   p->separable = _proj_is_separable(projection);
    p->serialize_to_file = &_proj_serialize_to_file;
    p->free = &_proj_free;
 
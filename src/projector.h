@@ -50,6 +50,17 @@ typedef struct projector_s {
    spherical_coordinates (*inverse_project)(struct projector_s *p, float y,
                                             float x);
 
+   /** Inverse project many X/Y pairs into spherical coordinate space (the
+    *nth output corresponding to the nth X and Y). */
+   void (*inverse_project_many)(struct projector_s *p, unsigned int count,
+                                float *y, float *x,
+                                spherical_coordinates *output);
+
+   /** Non-zero if latitude depends only on Y and longitude only on X (as in
+    *the cylindrical projections), so that the coordinates of a grid can be
+    *found from one row and one column. */
+   int separable;
+
    /** Serialise this projector to the a given file */
    void (*serialize_to_file)(struct projector_s *p, FILE *outputfile);
 
@@ -0,0 +1,348 @@
+/**
+  * @file
+  *
+  * Implementation of quantile_sketch
+  */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "quantile_sketch.h"
+
+/** The minimum capacity of any level of the sketch.*/
+#define MINIMUM_LEVEL_CAPACITY 8
+
+/** The ratio between the capacities of adjacent levels.*/
+#define LEVEL_CAPACITY_RATIO (2.0 / 3.0)
+
+/** The value of k used to relate the rank error to the level capacity.*/
+#define RANK_ERROR_CONSTANT 1.65
+
+/**
+  * A retained value together with its weight, used when answering queries.
+  */
+typedef struct {
+   /** The retained value.*/
+   NUMERIC_WORKING_TYPE value;
+
+   /** The number of input values this value represents.*/
+   unsigned long long weight;
+} weighted_value;
+
+/**
+  * Compare two NUMERIC_WORKING_TYPE values (for qsort).
+  */
+static int compare_values(const void *a, const void *b) {
+   NUMERIC_WORKING_TYPE x = *(const NUMERIC_WORKING_TYPE *) a;
+   NUMERIC_WORKING_TYPE y = *(const NUMERIC_WORKING_TYPE *) b;
+   return (x > y) - (x < y);
+}
+
+/**
+  * Compare two weighted_values by value (for qsort).
+  */
+static int compare_weighted_values(const void *a, const void *b) {
+   return compare_values(&((const weighted_value *) a)->value,
+                         &((const weighted_value *) b)->value);
+}
+
+/**
+  * Calculate the capacity of a level of a sketch.
+  *
+  * @param sketch The sketch.
+  * @param level The level (0 is the lowest level).
+  * @return The number of values that the level may hold before it is
+  *compacted.
+  */
+static int level_capacity(quantile_sketch *sketch, int level) {
+   int depth = sketch->number_levels - 1 - level;
+   int capacity = (int) ceil(sketch->k * pow(LEVEL_CAPACITY_RATIO, depth));
+   return capacity > MINIMUM_LEVEL_CAPACITY ? capacity : MINIMUM_LEVEL_CAPACITY;
+}
+
+/**
+  * Add a new (empty) level to the top of a sketch.
+  *
+  * @param sketch The sketch to add a level to.
+  */
+static void add_level(quantile_sketch *sketch) {
+   if (sketch->number_levels == sketch->allocated_levels) {
+      int new_allocation = sketch->allocated_levels * 2;
+      sketch->levels = realloc(sketch->levels,
+                               sizeof(NUMERIC_WORKING_TYPE *) * new_allocation);
+      sketch->level_sizes = realloc(sketch->level_sizes,
+                                    sizeof(int) * new_allocation);
+      sketch->level_allocations = realloc(sketch->level_allocations,
+                                          sizeof(int) * new_allocation);
+      if (sketch->levels == NULL || sketch->level_sizes == NULL ||
+          sketch->level_allocations == NULL) {
+         fprintf(stderr, "Could not allocate space for quantile sketch levels\n");
+         exit(EXIT_FAILURE);
+      }
+      for (int i = sketch->allocated_levels; i < new_allocation; i++) {
+         sketch->levels[i] = NULL;
+         sketch->level_sizes[i] = 0;
+         sketch->level_allocations[i] = 0;
+      }
+      sketch->allocated_levels = new_allocation;
+   }
+   sketch->level_sizes[sketch->number_levels] = 0;
+   sketch->number_levels++;
+
+   // Capacities depend on the number of levels, so recalculate the total
+   sketch->total_capacity = 0;
+   for (int i = 0; i < sketch->number_levels; i++) {
+      sketch->total_capacity += level_capacity(sketch, i);
+   }
+}
+
+/**
+  * Append a value to a level of a sketch, growing the level if required.
+  *
+  * @param sketch The sketch.
+  * @param level The level to append to.
+  * @param value The value to append.
+  */
+static void append_to_level(quantile_sketch *sketch, int level,
+                            NUMERIC_WORKING_TYPE value) {
+   if (sketch->level_sizes[level] == sketch->level_allocations[level]) {
+      int new_allocation = sketch->level_allocations[level] * 2;
+      if (new_allocation < MINIMUM_LEVEL_CAPACITY) {
+         new_allocation = MINIMUM_LEVEL_CAPACITY;
+      }
+      sketch->levels[level] = realloc(sketch->levels[level],
+                                      sizeof(NUMERIC_WORKING_TYPE) * new_allocation);
+      if (sketch->levels[level] == NULL) {
+         fprintf(stderr, "Could not allocate space for a quantile sketch level\n");
+         exit(EXIT_FAILURE);
+      }
+      sketch->level_allocations[level] = new_allocation;
+   }
+   sketch->levels[level][sketch->level_sizes[level]++] = value;
+}
+
+/**
+  * Generate a pseudo-random bit (xorshift32).
+  *
+  * @param sketch The sketch whose generator should be used.
+  * @return 0 or 1.
+  */
+static int random_bit(quantile_sketch *sketch) {
+   unsigned int x = sketch->random_state;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   sketch->random_state = x;
+   return (x >> 16) & 1;
+}
+
+/**
+  * Compact the lowest full level of a sketch, promoting every other value to
+  *the level above.
+  *
+  * @param sketch The sketch to compact.
+  */
+static void compact(quantile_sketch *sketch) {
+   int level = 0;
+   while (level < sketch->number_levels - 1 &&
+          sketch->level_sizes[level] < level_capacity(sketch, level)) {
+      level++;
+   }
+   if (level == sketch->number_levels - 1) {
+      add_level(sketch);
+   }
+
+   NUMERIC_WORKING_TYPE *values = sketch->levels[level];
+   int size = sketch->level_sizes[level];
+   qsort(values, size, sizeof(NUMERIC_WORKING_TYPE), &compare_values);
+
+   // With an odd number of values, one is left behind at this level
+   int remaining = size % 2;
+   for (int i = remaining + random_bit(sketch); i < size; i += 2) {
+      append_to_level(sketch, level + 1, values[i]);
+   }
+   sketch->level_sizes[level] = remaining;
+   sketch->retained -= (size - remaining) / 2;
+}
+
+/**
+  * Add a single value to a sketch.
+  *
+  * @param sketch The sketch to add the value to.
+  * @param value The value to add.
+  */
+void quantile_sketch_update(quantile_sketch *sketch,
+                            NUMERIC_WORKING_TYPE value) {
+   append_to_level(sketch, 0, value);
+   sketch->retained++;
+   sketch->count++;
+   if (sketch->retained >= sketch->total_capacity) {
+      compact(sketch);
+   }
+}
+
+/**
+  * Merge the values added to another sketch into a sketch. The values of each
+  *level of the other sketch are appended to the same level of the sketch (so
+  *that they keep their weight), and the sketch is then compacted until it is
+  *within its capacity again.
+  *
+  * @param sketch The sketch to merge into.
+  * @param other The sketch to merge from (which is not modified).
+  */
+void quantile_sketch_merge(quantile_sketch *sketch, quantile_sketch *other) {
+   while (sketch->number_levels < other->number_levels) {
+      add_level(sketch);
+   }
+   for (int level = 0; level < other->number_levels; level++) {
+      for (int i = 0; i < other->level_sizes[level]; i++) {
+         append_to_level(sketch, level, other->levels[level][i]);
+      }
+      sketch->retained += other->level_sizes[level];
+   }
+   sketch->count += other->count;
+   while (sketch->retained >= sketch->total_capacity) {
+      compact(sketch);
+   }
+}
+
+/**
+  * Estimate a percentile of the values added to a sketch.
+  *
+  * @param sketch The sketch to query (must contain at least one value).
+  * @param percentile The desired percentile (0 to 100).
+  * @return The estimated percentile.
+  */
+NUMERIC_WORKING_TYPE quantile_sketch_query(quantile_sketch *sketch,
+                                           double percentile) {
+   if (sketch->number_levels == 1) {
+      // No values have been discarded, so the percentile can be found exactly
+      // (level 0 is unordered, so sorting it in place is harmless)
+      NUMERIC_WORKING_TYPE *values = sketch->levels[0];
+      int length = sketch->level_sizes[0];
+      qsort(values, length, sizeof(NUMERIC_WORKING_TYPE), &compare_values);
+      double position = percentile / 100.0 * (length - 1);
+      int lower = (int) floor(position);
+      if (lower >= length - 1) {
+         return values[length - 1];
+      }
+      double fraction = position - lower;
+      return values[lower] + fraction * (values[lower + 1] - values[lower]);
+   }
+
+   // Gather every retained value along with its weight
+   size_t required_bytes = sizeof(weighted_value) * sketch->retained;
+   if (required_bytes > sketch->query_space_bytes) {
+      free(sketch->query_space);
+      sketch->query_space = malloc(required_bytes);
+      if (sketch->query_space == NULL) {
+         fprintf(stderr, "Could not allocate space for a quantile sketch query\n");
+         exit(EXIT_FAILURE);
+      }
+      sketch->query_space_bytes = required_bytes;
+   }
+   weighted_value *items = sketch->query_space;
+   int number_items = 0;
+   unsigned long long total_weight = 0;
+   for (int level = 0; level < sketch->number_levels; level++) {
+      unsigned long long weight = 1ULL << level;
+      for (int i = 0; i < sketch->level_sizes[level]; i++) {
+         items[number_items].value = sketch->levels[level][i];
+         items[number_items].weight = weight;
+         number_items++;
+      }
+      total_weight += weight * sketch->level_sizes[level];
+   }
+   qsort(items, number_items, sizeof(weighted_value), &compare_weighted_values);
+
+   // Return the first value whose cumulative weight reaches the desired rank
+   double target = percentile / 100.0 * total_weight;
+   unsigned long long cumulative_weight = 0;
+   for (int i = 0; i < number_items; i++) {
+      cumulative_weight += items[i].weight;
+      if (cumulative_weight >= target) {
+         return items[i].value;
+      }
+   }
+   return items[number_items - 1].value;
+}
+
+/**
+  * Empty a sketch, retaining its allocated memory for reuse.
+  *
+  * @param sketch The sketch to empty.
+  */
+void quantile_sketch_reset(quantile_sketch *sketch) {
+   for (int i = 0; i < sketch->number_levels; i++) {
+      sketch->level_sizes[i] = 0;
+   }
+   sketch->number_levels = 0;
+   sketch->retained = 0;
+   sketch->count = 0;
+   sketch->random_state = 2463534242U;
+   add_level(sketch);
+}
+
+/**
+  * Free a sketch.
+  *
+  * @param tofree The sketch to free.
+  */
+void quantile_sketch_free(quantile_sketch *tofree) {
+   for (int i = 0; i < tofree->allocated_levels; i++) {
+      free(tofree->levels[i]);
+   }
+   free(tofree->levels);
+   free(tofree->level_sizes);
+   free(tofree->level_allocations);
+   free(tofree->query_space);
+   free(tofree);
+}
+
+/**
+  * Initialise an empty quantile sketch.
+  *
+  * @param rank_error The desired normalised rank error (e.g. 0.01 for
+  *estimates within about 1% of the true rank).
+  * @return A pointer to an initialised quantile sketch.
+  */
+quantile_sketch *quantile_sketch_init(float rank_error) {
+   if (rank_error <= 0.0 || rank_error >= 1.0) {
+      fprintf(stderr, "Quantile sketch rank error must be between 0 and 1\n");
+      exit(EXIT_FAILURE);
+   }
+
+   quantile_sketch *sketch = malloc(sizeof(quantile_sketch));
+   if (sketch == NULL) {
+      fprintf(stderr, "Could not allocate space for a quantile_sketch struct\n");
+      exit(EXIT_FAILURE);
+   }
+   sketch->rank_error = rank_error;
+   sketch->k = (int) ceil(RANK_ERROR_CONSTANT / rank_error);
+   if (sketch->k < MINIMUM_LEVEL_CAPACITY) {
+      sketch->k = MINIMUM_LEVEL_CAPACITY;
+   }
+   sketch->number_levels = 0;
+   sketch->allocated_levels = 4;
+   sketch->levels = calloc(sketch->allocated_levels,
+                           sizeof(NUMERIC_WORKING_TYPE *));
+   sketch->level_sizes = calloc(sketch->allocated_levels, sizeof(int));
+   sketch->level_allocations = calloc(sketch->allocated_levels, sizeof(int));
+   if (sketch->levels == NULL || sketch->level_sizes == NULL ||
+       sketch->level_allocations == NULL) {
+      fprintf(stderr, "Could not allocate space for quantile sketch levels\n");
+      exit(EXIT_FAILURE);
+   }
+   sketch->query_space = NULL;
+   sketch->query_space_bytes = 0;
+
+   // Set up function pointers
+   sketch->update = &quantile_sketch_update;
+   sketch->merge = &quantile_sketch_merge;
+   sketch->query = &quantile_sketch_query;
+   sketch->reset = &quantile_sketch_reset;
+   sketch->free = &quantile_sketch_free;
+
+   sketch->reset(sketch);
+   return sketch;
+}
@@ -0,0 +1,115 @@
+/**
+  * @file
+  *
+  * Defines a streaming sketch for computing approximate quantiles in bounded
+  *memory.
+  */
+#ifndef HEADER_QUANTILE_SKETCH
+#define HEADER_QUANTILE_SKETCH
+
+#include "data_handling.h"
+
+/**
+  * A KLL quantile sketch.
+  *
+  * Values are added one at a time to a stack of levels; when the sketch is
+  *full, the lowest full level is sorted and every other value is promoted to
+  *the level above (with double the weight), and the rest are discarded. The
+  *capacity of each level decreases geometrically down the stack, so the number
+  *of retained values is bounded by roughly 3k regardless of the number of
+  *values added, and any quantile can be estimated with a normalised rank error
+  *of about 1.65/k.
+  *
+  * Until the first compaction the sketch holds every value, and quantiles are
+  *exact (and interpolated, as for histogram_percentile).
+  */
+typedef struct quantile_sketch_s {
+   /** The normalised rank error this sketch was initialised with.*/
+   float rank_error;
+
+   /** The accuracy parameter (the capacity of the highest level).*/
+   int k;
+
+   /** The number of levels currently in use.*/
+   int number_levels;
+
+   /** The values retained at each level; values at level h have weight
+    *2^h.*/
+   NUMERIC_WORKING_TYPE **levels;
+
+   /** The number of values retained at each level.*/
+   int *level_sizes;
+
+   /** The number of values allocated at each level.*/
+   int *level_allocations;
+
+   /** The number of levels allocated.*/
+   int allocated_levels;
+
+   /** The total capacity of all levels in use (cached).*/
+   int total_capacity;
+
+   /** The total number of values currently retained.*/
+   int retained;
+
+   /** The number of values added since the sketch was last reset.*/
+   unsigned long count;
+
+   /** State of the generator used to choose which values to promote
+    *(reset with the sketch, so that results are reproducible).*/
+   unsigned int random_state;
+
+   /** Working space for answering queries.*/
+   void *query_space;
+
+   /** The number of bytes allocated for query_space.*/
+   size_t query_space_bytes;
+
+   /**
+     * Add a single value to a sketch.
+     *
+     * @param sketch The sketch to add the value to.
+     * @param value The value to add.
+     */
+   void (*update)(struct quantile_sketch_s *sketch, NUMERIC_WORKING_TYPE value);
+
+   /**
+     * Merge the values added to another sketch into a sketch, as though they
+     *had been added to it (the estimates of the merged sketch are within the
+     *same rank error).
+     *
+     * @param sketch The sketch to merge into.
+     * @param other The sketch to merge from (which is not modified).
+     */
+   void (*merge)(struct quantile_sketch_s *sketch,
+                 struct quantile_sketch_s *other);
+
+   /**
+     * Estimate a percentile of the values added to a sketch.
+     *
+     * @param sketch The sketch to query (must contain at least one value).
+     * @param percentile The desired percentile (0 to 100).
+     * @return The estimated percentile.
+     */
+   NUMERIC_WORKING_TYPE (*query)(struct quantile_sketch_s *sketch,
+                                 double percentile);
+
+   /**
+     * Empty a sketch, retaining its allocated memory for reuse.
+     *
+     * @param sketch The sketch to empty.
+     */
+   void (*reset)(struct quantile_sketch_s *sketch);
+
+   /**
+     * Free a sketch.
+     *
+     * @param tofree The sketch to free.
+     */
+   void (*free)(struct quantile_sketch_s *tofree);
+} quantile_sketch;
+
+// Function prototype - implementation in quantile_sketch.c
+quantile_sketch *quantile_sketch_init(float rank_error);
+
+#endif
@@ -99,7 +99,7 @@ coordinate_reader *get_coordinate_reader_from_files(char *lat_filename,
 
    // Open the files for reading, check sizes
    struct stat lat_stat, lon_stat, time_stat;
-   int num_records;
+   size_t num_records;
    FILE *lat_file, *lon_file, *time_file;
 
    // Stat all the files to get their sizes (and check their existence!)
@@ -149,7 +149,7 @@ coordinate_reader *get_coordinate_reader_from_files(char *lat_filename,
    }
 
    // Calculate number of records in the file
-   num_records = (int) (lat_stat.st_size / sizeof(float));
+   num_records = (size_t) (lat_stat.st_size / sizeof(float));
 
    // Open the latitudes file
    lat_file = fopen(lat_filename, "r");
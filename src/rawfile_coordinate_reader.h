@@ -26,7 +26,7 @@ typedef struct rawfile_coordinate_reader_s {
    FILE *time_file;
 
    /** The index of the current record.*/
-   unsigned int current_record;
+   size_t current_record;
 } rawfile_coordinate_reader;
 
 // Function prototype - implementation in rawfile_coordinate_reader.c
@@ -9,10 +9,158 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "cpu_dispatch.h"
 #include "median.h"
+#include "quantile_sketch.h"
 #include "reduction_functions.h"
 #include "result_set.h"
 
+/** The number of observations retrieved at once by reductions which use
+ *numeric_gather */
+#define GATHER_CHUNK_SIZE 256
+
+/** The number of squared distance bins in a kernel_table */
+#define KERNEL_TABLE_LENGTH 16384
+
+/** Per-thread scratch space for reductions which must hold every value of a
+ *cell at once. This is grown as needed and reused between cells, so that
+ *these reductions do not allocate memory for each cell. */
+static void *scratch_space = NULL;
+
+/** The number of bytes which scratch_space can currently hold. */
+static size_t scratch_space_bytes = 0;
+#pragma omp threadprivate(scratch_space, scratch_space_bytes)
+
+/** Per-thread quantile sketch for the percentile reduction, reset and reused
+ *between cells. */
+static quantile_sketch *percentile_sketch = NULL;
+#pragma omp threadprivate(percentile_sketch)
+
+/** The largest mode table (as a power of two) used by the coded mode
+ *reduction. Cells which may hold more distinct codes than half this many are
+ *counted by sorting instead. */
+#define MODE_TABLE_MAX_BITS 31
+
+/** Per-thread open-addressing hash table used by the coded mode reduction to
+ *count occurrences of each code. Codes are stored as their unsigned integer
+ *values (see get_code).
+ *Only the slots listed in mode_used_slots are occupied, so the table can be
+ *emptied without clearing it all. */
+static uint64_t *mode_keys = NULL;
+static unsigned int *mode_counts = NULL;
+static unsigned int *mode_used_slots = NULL;
+static unsigned int mode_table_size = 0;
+#pragma omp threadprivate(mode_keys, mode_counts, mode_used_slots, \
+                          mode_table_size)
+
+/**
+  * Retrieve the calling thread's scratch space, ensuring it can hold at least
+  *the given number of bytes.
+  *
+  * @param number_bytes The number of bytes required.
+  * @return Pointer to the scratch space (valid until the next call from this
+  *thread).
+  */
+static void *get_scratch_space(size_t number_bytes) {
+   if (number_bytes > scratch_space_bytes) {
+      // Grow geometrically, so that a slowly increasing size doesn't cause
+      // a reallocation per cell
+      size_t new_bytes = scratch_space_bytes * 2;
+      if (new_bytes < number_bytes) {
+         new_bytes = number_bytes;
+      }
+
+      free(scratch_space);
+      scratch_space = malloc(new_bytes);
+      if (scratch_space == NULL) {
+         fprintf(stderr, "Couldn't allocate %ld bytes of scratch space\n",
+                 (long int) new_bytes);
+         exit(EXIT_FAILURE);
+      }
+      scratch_space_bytes = new_bytes;
+   }
+   return scratch_space;
+}
+
+/**
+  * Read the record indices of the next GATHER_CHUNK_SIZE (or fewer) items from
+  *a result set.
+  *
+  * @param set The result set to read from.
+  * @param indices Array of GATHER_CHUNK_SIZE items to store the record indices
+  *in.
+  * @param items Array of GATHER_CHUNK_SIZE items to store the result set items
+  *in (may be NULL).
+  * @return The number of record indices read (0 when the set is exhausted).
+  */
+static unsigned int next_index_chunk(result_set *set, size_t *indices,
+                                     result_set_item **items) {
+   unsigned int count = 0;
+   result_set_item *current_item;
+
+   while (count < GATHER_CHUNK_SIZE &&
+          (current_item = set->iterate(set)) != NULL) {
+      indices[count] = current_item->record_index;
+      if (items != NULL) {
+         items[count] = current_item;
+      }
+      count++;
+   }
+   return count;
+}
+
+/**
+  * Sum an array of numbers.
+  *
+  * Four partial sums are kept, so that the summation can be vectorised.
+  *
+  * @param values The numbers to sum.
+  * @param length The number of items in values.
+  * @return The sum of the numbers.
+  */
+MULTIVERSIONED
+static NUMERIC_WORKING_TYPE sum_values(NUMERIC_WORKING_TYPE *values,
+                                       unsigned int length) {
+   NUMERIC_WORKING_TYPE sums[4] = {0.0, 0.0, 0.0, 0.0};
+   unsigned int i = 0;
+
+   for (; i + 4 <= length; i += 4) {
+      sums[0] += values[i];
+      sums[1] += values[i + 1];
+      sums[2] += values[i + 2];
+      sums[3] += values[i + 3];
+   }
+   for (; i < length; i++) {
+      sums[0] += values[i];
+   }
+   return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+/**
+  * Update a running minimum and maximum with an array of numbers.
+  *
+  * @param values The numbers.
+  * @param length The number of items in values.
+  * @param minimum The running minimum, updated in place.
+  * @param maximum The running maximum, updated in place.
+  */
+MULTIVERSIONED
+static void min_max_values(NUMERIC_WORKING_TYPE *values, unsigned int length,
+                           NUMERIC_WORKING_TYPE *minimum,
+                           NUMERIC_WORKING_TYPE *maximum) {
+   NUMERIC_WORKING_TYPE current_minimum = *minimum;
+   NUMERIC_WORKING_TYPE current_maximum = *maximum;
+
+   for (unsigned int i = 0; i < length; i++) {
+      current_minimum = (values[i] < current_minimum) ? values[i] :
+                        current_minimum;
+      current_maximum = (values[i] > current_maximum) ? values[i] :
+                        current_maximum;
+   }
+   *minimum = current_minimum;
+   *maximum = current_maximum;
+}
+
 /**
   * Reduce numeric data by taking the mean.
   *
@@ -20,25 +168,23 @@
   */
 void reduce_numeric_mean(result_set *set, reduction_attrs *attrs,
                          dimension_bounds bounds, void *input_data,
-                         void *output_data, int output_index,
+                         void *output_data, size_t output_index,
                          dtype input_dtype,
                          dtype output_dtype) {
    register NUMERIC_WORKING_TYPE current_sum = 0.0;
-   register NUMERIC_WORKING_TYPE query_data_value;
    register unsigned int current_number_of_values = 0;
-   result_set_item *current_item;
+   size_t indices[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length, chunk_values;
 
-   // Iterate over items in the result set, skipping fill values,
+   // Retrieve the result set in chunks, skipping fill values,
    // and adding up and counting the non-fill values
-   while ((current_item = set->iterate(set)) != NULL) {
-      query_data_value = numeric_get(input_data, input_dtype,
-                                     current_item->record_index);
-
-      if(query_data_value == attrs->input_fill_value) {
-         continue;
-      }
-      current_sum += query_data_value;
-      current_number_of_values++;
+   while ((chunk_length = next_index_chunk(set, indices, NULL)) > 0) {
+      chunk_values = numeric_gather(input_data, input_dtype, indices,
+                                    chunk_length, attrs->input_fill_value,
+                                    values);
+      current_sum += sum_values(values, chunk_values);
+      current_number_of_values += chunk_values;
    }
 
    // Calculate the mean using the calculated sum and number of values
@@ -54,6 +200,51 @@ void reduce_numeric_mean(result_set *set, reduction_attrs *attrs,
    numeric_put(output_data, output_dtype, output_index, output_value);
 }
 
+/**
+  * Reduce a row of cells of numeric data by taking the mean of each.
+  *
+  * @see reduce_numeric_mean
+  * @see reduction_function::call_row
+  */
+void reduce_numeric_mean_row(hit_list *hits, unsigned int *offsets,
+                             int number_cells, float *centres_x,
+                             float centre_y, reduction_attrs *attrs,
+                             void *input_data, void *output_data,
+                             size_t output_index, dtype input_dtype,
+                             dtype output_dtype) {
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE *row_values = get_scratch_space(
+      sizeof(NUMERIC_WORKING_TYPE) * number_cells);
+
+   for (int c = 0; c < number_cells; c++) {
+      NUMERIC_WORKING_TYPE current_sum = 0.0;
+      unsigned int current_number_of_values = 0;
+
+      // The record indices of each cell are contiguous, so they can be
+      // gathered from directly
+      for (unsigned int first = offsets[c]; first < offsets[c + 1];
+           first += GATHER_CHUNK_SIZE) {
+         unsigned int chunk_length = offsets[c + 1] - first;
+         if (chunk_length > GATHER_CHUNK_SIZE) {
+            chunk_length = GATHER_CHUNK_SIZE;
+         }
+         unsigned int chunk_values = numeric_gather(
+            input_data, input_dtype, &hits->record_indices[first],
+            chunk_length, attrs->input_fill_value, values);
+         current_sum += sum_values(values, chunk_values);
+         current_number_of_values += chunk_values;
+      }
+
+      row_values[c] = (current_number_of_values == 0) ?
+                      attrs->output_fill_value :
+                      current_sum / (NUMERIC_WORKING_TYPE)
+                      current_number_of_values;
+   }
+
+   numeric_put_span(output_data, output_dtype, output_index, number_cells,
+                    row_values);
+}
+
 /**
   * Reduce coded data by using the nearest neighbour.
   *
@@ -61,7 +252,7 @@ void reduce_numeric_mean(result_set *set, reduction_attrs *attrs,
   */
 void reduce_coded_nearest_neighbour(result_set *set, reduction_attrs *attrs,
                                     dimension_bounds bounds, void *input_data,
-                                    void *output_data, int output_index,
+                                    void *output_data, size_t output_index,
                                     dtype input_dtype,
                                     dtype output_dtype) {
    register float lowest_distance = FLT_MAX;
@@ -74,8 +265,8 @@ void reduce_coded_nearest_neighbour(result_set *set, reduction_attrs *attrs,
    register short int value_stored = 0;
 
    // Calculate the midpoint of the cell
-   float32_t central_x = (bounds[X + LOWER] + bounds[X + UPPER]) / 2.0;
-   float32_t central_y = (bounds[Y + LOWER] + bounds[Y + UPPER]) / 2.0;
+   float32_t central_x = (bounds[2*X + LOWER] + bounds[2*X + UPPER]) / 2.0;
+   float32_t central_y = (bounds[2*Y + LOWER] + bounds[2*Y + UPPER]) / 2.0;
 
    result_set_item *current_item;
 
@@ -107,6 +298,243 @@ void reduce_coded_nearest_neighbour(result_set *set, reduction_attrs *attrs,
    free(best_value);
 }
 
+/**
+  * Ensure the calling thread's mode table has at least the given number of
+  *slots (which must be a power of two).
+  *
+  * @param table_size The number of slots required.
+  */
+static void reserve_mode_table(unsigned int table_size) {
+   if (table_size <= mode_table_size) {
+      return;
+   }
+   free(mode_keys);
+   free(mode_counts);
+   free(mode_used_slots);
+   mode_keys = malloc(sizeof(uint64_t) * table_size);
+   mode_counts = calloc(table_size, sizeof(unsigned int));
+   mode_used_slots = malloc(sizeof(unsigned int) * table_size);
+   if (mode_keys == NULL || mode_counts == NULL || mode_used_slots == NULL) {
+      fprintf(stderr, "Couldn't allocate a mode table of %u slots\n",
+              table_size);
+      exit(EXIT_FAILURE);
+   }
+   mode_table_size = table_size;
+}
+
+/**
+  * Free the calling thread's scratch space, mode table and percentile sketch,
+  *which are otherwise kept between cells (and gridding jobs). This should be
+  *called by every thread which may have used a reduction function, once
+  *gridding is complete.
+  */
+void reduction_thread_storage_free(void) {
+   free(scratch_space);
+   scratch_space = NULL;
+   scratch_space_bytes = 0;
+
+   free(mode_keys);
+   free(mode_counts);
+   free(mode_used_slots);
+   mode_keys = NULL;
+   mode_counts = NULL;
+   mode_used_slots = NULL;
+   mode_table_size = 0;
+
+   if (percentile_sketch != NULL) {
+      percentile_sketch->free(percentile_sketch);
+      percentile_sketch = NULL;
+   }
+}
+
+/**
+  * Read a code as the value of an unsigned integer of its size (in native
+  *byte order), so that codes compare the same way on any host.
+  *
+  * @param data Pointer to the coded data.
+  * @param input_dtype The (coded) dtype of the data.
+  * @param index The index of the code.
+  * @return The value of the code.
+  */
+static inline uint64_t get_code(void *data, dtype input_dtype, size_t index) {
+   char *code = &((char *) data)[index * input_dtype.size];
+   switch (input_dtype.size) {
+   case 1: {
+      uint8_t value;
+      memcpy(&value, code, 1);
+      return value;
+   }
+   case 2: {
+      uint16_t value;
+      memcpy(&value, code, 2);
+      return value;
+   }
+   case 4: {
+      uint32_t value;
+      memcpy(&value, code, 4);
+      return value;
+   }
+   default: {
+      uint64_t value;
+      memcpy(&value, code, 8);
+      return value;
+   }
+   }
+}
+
+/**
+  * Store a code read by get_code.
+  *
+  * @param data Pointer to the coded data.
+  * @param output_dtype The (coded) dtype of the data.
+  * @param index The index of the code.
+  * @param value The value of the code.
+  */
+static inline void put_code(void *data, dtype output_dtype, size_t index,
+                            uint64_t value) {
+   char *code = &((char *) data)[index * output_dtype.size];
+   switch (output_dtype.size) {
+   case 1: {
+      uint8_t narrowed = (uint8_t) value;
+      memcpy(code, &narrowed, 1);
+      break;
+   }
+   case 2: {
+      uint16_t narrowed = (uint16_t) value;
+      memcpy(code, &narrowed, 2);
+      break;
+   }
+   case 4: {
+      uint32_t narrowed = (uint32_t) value;
+      memcpy(code, &narrowed, 4);
+      break;
+   }
+   default:
+      memcpy(code, &value, 8);
+      break;
+   }
+}
+
+/**
+  * Compare two codes (for qsort).
+  */
+static int compare_codes(const void *a, const void *b) {
+   uint64_t code_a = *(const uint64_t *) a;
+   uint64_t code_b = *(const uint64_t *) b;
+   return (code_a > code_b) - (code_a < code_b);
+}
+
+/**
+  * Find the most common code of a cell by sorting its codes, for cells with
+  *too many observations to count in the mode table.
+  *
+  * @param set The observations of the cell.
+  * @param input_data The coded data.
+  * @param input_dtype The (coded) dtype of the data.
+  * @return The most common code (the lowest, of those equally common).
+  */
+static uint64_t sorted_coded_mode(result_set *set, void *input_data,
+                                  dtype input_dtype) {
+   uint64_t *codes = get_scratch_space(sizeof(uint64_t) * set->length);
+   size_t number_codes = 0;
+   result_set_item *current_item;
+   while ((current_item = set->iterate(set)) != NULL) {
+      codes[number_codes++] = get_code(input_data, input_dtype,
+                                       current_item->record_index);
+   }
+   qsort(codes, number_codes, sizeof(uint64_t), &compare_codes);
+
+   // Runs of equal codes are in increasing order of code, so only a strictly
+   // longer run replaces the best
+   uint64_t best_code = 0;
+   size_t best_count = 0;
+   for (size_t first = 0; first < number_codes;) {
+      size_t last = first + 1;
+      while (last < number_codes && codes[last] == codes[first]) last++;
+      if (last - first > best_count) {
+         best_code = codes[first];
+         best_count = last - first;
+      }
+      first = last;
+   }
+   return best_code;
+}
+
+/**
+  * Reduce coded data by taking the most common code (the mode).
+  *
+  * Codes are counted in a per-thread open-addressing hash table, sized to
+  *twice the number of observations (or the number of possible codes, for
+  *coded8 and coded16, if smaller), up to 2^MODE_TABLE_MAX_BITS slots. Cells
+  *which could fill more than half of the largest table are counted by sorting
+  *their codes instead, so the table never fills. Where several codes are
+  *equally common, the code with the lowest value (as an unsigned integer of its
+  *size) is chosen, so that the result does not depend on the order of the
+  *observations.
+  *
+  * @see reduction_function::call
+  */
+void reduce_coded_mode(result_set *set, reduction_attrs *attrs,
+                       dimension_bounds bounds, void *input_data,
+                       void *output_data, size_t output_index,
+                       dtype input_dtype,
+                       dtype output_dtype) {
+   // Choose a power of two table size with a load factor of at most 1/2
+   uint64_t most_codes = set->length;
+   if (input_dtype.size <= 2 && most_codes > 1ULL << (8 * input_dtype.size)) {
+      most_codes = 1ULL << (8 * input_dtype.size);
+   }
+   if (2 * most_codes > 1ULL << MODE_TABLE_MAX_BITS) {
+      put_code(output_data, output_dtype, output_index,
+               sorted_coded_mode(set, input_data, input_dtype));
+      return;
+   }
+   unsigned int table_bits = 4;
+   while ((1ULL << table_bits) < 2 * most_codes) {
+      table_bits++;
+   }
+   unsigned int table_size = 1U << table_bits;
+   unsigned int mask = table_size - 1;
+   reserve_mode_table(table_size);
+
+   unsigned int number_used = 0;
+   result_set_item *current_item;
+
+   // Count the occurrences of each code, using linear probing from a
+   // multiplicative (Fibonacci) hash
+   while ((current_item = set->iterate(set)) != NULL) {
+      uint64_t code = get_code(input_data, input_dtype,
+                               current_item->record_index);
+      unsigned int slot = (unsigned int) ((code * 0x9E3779B97F4A7C15ULL) >>
+                                          (64 - table_bits));
+      while (mode_counts[slot] != 0 && mode_keys[slot] != code) {
+         slot = (slot + 1) & mask;
+      }
+      if (mode_counts[slot] == 0) {
+         mode_keys[slot] = code;
+         mode_used_slots[number_used++] = slot;
+      }
+      mode_counts[slot]++;
+   }
+
+   // Find the most common code (a hardcoded fill value of 0 is used if there
+   // are no observations), emptying the table as we go
+   uint64_t best_code = 0;
+   unsigned int best_count = 0;
+   for (unsigned int i = 0; i < number_used; i++) {
+      unsigned int slot = mode_used_slots[i];
+      if (mode_counts[slot] > best_count ||
+          (mode_counts[slot] == best_count && mode_keys[slot] < best_code)) {
+         best_code = mode_keys[slot];
+         best_count = mode_counts[slot];
+      }
+      mode_counts[slot] = 0;
+   }
+
+   // Store the value
+   put_code(output_data, output_dtype, output_index, best_code);
+}
+
 /**
   * Reduce numeric data by using the nearest neighbour.
   *
@@ -114,15 +542,15 @@ void reduce_coded_nearest_neighbour(result_set *set, reduction_attrs *attrs,
   */
 void reduce_numeric_nearest_neighbour(result_set *set, reduction_attrs *attrs,
                                       dimension_bounds bounds, void *input_data,
-                                      void *output_data, int output_index,
+                                      void *output_data, size_t output_index,
                                       dtype input_dtype,
                                       dtype output_dtype) {
    register float lowest_distance = FLT_MAX;
    NUMERIC_WORKING_TYPE best_value = attrs->output_fill_value;
 
    // Calculate the midpoint of the cell
-   float32_t central_x = (bounds[X + LOWER] + bounds[X + UPPER]) / 2.0;
-   float32_t central_y = (bounds[Y + LOWER] + bounds[Y + UPPER]) / 2.0;
+   float32_t central_x = (bounds[2*X + LOWER] + bounds[2*X + UPPER]) / 2.0;
+   float32_t central_y = (bounds[2*Y + LOWER] + bounds[2*Y + UPPER]) / 2.0;
 
    result_set_item *current_item;
    register float current_distance;
@@ -150,18 +578,23 @@ void reduce_numeric_nearest_neighbour(result_set *set, reduction_attrs *attrs,
 }
 
 /**
-  * Reduce numeric data by using the value with the last time stamp.
+  * Reduce numeric data by using the value with the last time stamp. Where
+  *several observations are equally new, the one with the lowest record index
+  *(the first in the input files) is used, so that the result does not depend
+  *on the order in which the observations are found.
   *
   * @see reduction_function::call
   */
 void reduce_numeric_newest(result_set *set, reduction_attrs *attrs,
                            dimension_bounds bounds, void *input_data,
-                           void *output_data, int output_index,
+                           void *output_data, size_t output_index,
                            dtype input_dtype,
                            dtype output_dtype) {
    register float latest = -FLT_MAX;
    register NUMERIC_WORKING_TYPE query_data_value;
    register NUMERIC_WORKING_TYPE newest_data_value = attrs->output_fill_value;
+   size_t newest_record = 0;
+   int found = 0;
 
    result_set_item *current_item;
 
@@ -173,9 +606,13 @@ void reduce_numeric_newest(result_set *set, reduction_attrs *attrs,
       if(query_data_value == attrs->input_fill_value) {
          continue;
       }
-      if (current_item->t > latest) {
+      if (!found || current_item->t > latest ||
+          (current_item->t == latest &&
+           current_item->record_index < newest_record)) {
          latest = current_item->t;
          newest_data_value = query_data_value;
+         newest_record = current_item->record_index;
+         found = 1;
       }
    }
 
@@ -183,43 +620,136 @@ void reduce_numeric_newest(result_set *set, reduction_attrs *attrs,
    numeric_put(output_data, output_dtype, output_index, newest_data_value);
 }
 
+/**
+  * Determine whether a dtype is a narrow integer type, which can be reduced by
+  *counting (see histogram_percentile) rather than by selection.
+  *
+  * @param input_dtype The dtype to check.
+  * @return 1 if the dtype is an integer type of 16 bits or fewer, 0 otherwise.
+  */
+static int is_narrow_integer_dtype(dtype input_dtype) {
+   switch (input_dtype.specifier) {
+   case uint8:
+   case int8:
+   case uint16:
+   case int16:
+      return 1;
+   default:
+      return 0;
+   }
+}
+
+/**
+  * Compute a percentile of the non-fill values in a result set, where the
+  *input is of a narrow integer dtype (see is_narrow_integer_dtype).
+  *
+  * @param set The result set of observations.
+  * @param attrs The reduction attributes (used for the input fill value).
+  * @param input_data Pointer to the memory where the input data is stored.
+  * @param input_dtype The data type of the input array.
+  * @param percentile The desired percentile (0 to 100).
+  * @param result Where to store the percentile (if there were any values).
+  * @return The number of non-fill values found.
+  */
+static unsigned int narrow_integer_percentile(result_set *set,
+                                              reduction_attrs *attrs,
+                                              void *input_data,
+                                              dtype input_dtype,
+                                              double percentile,
+                                              NUMERIC_WORKING_TYPE *result) {
+   uint16_t *keys = get_scratch_space(sizeof(uint16_t) * set->length);
+   unsigned int number_keys = 0;
+   result_set_item *current_item;
+
+   // Shortcut macro - read the values of the given type, skipping fill values,
+   // and store them as unsigned keys by adding the given offset
+   #define collect_keys(type, offset) \
+   while ((current_item = set->iterate(set)) != NULL) { \
+      type value = ((type *) input_data)[current_item->record_index]; \
+      if ((NUMERIC_WORKING_TYPE) value == attrs->input_fill_value) { \
+         continue; \
+      } \
+      keys[number_keys++] = (uint16_t) (value + offset); \
+   }
+
+   int key_bits;
+   NUMERIC_WORKING_TYPE offset;
+   switch (input_dtype.specifier) {
+   case uint8:
+      collect_keys(uint8_t, 0);
+      key_bits = 8;
+      offset = 0.0;
+      break;
+   case int8:
+      collect_keys(int8_t, 128);
+      key_bits = 8;
+      offset = 128.0;
+      break;
+   case uint16:
+      collect_keys(uint16_t, 0);
+      key_bits = 16;
+      offset = 0.0;
+      break;
+   case int16:
+      collect_keys(int16_t, 32768);
+      key_bits = 16;
+      offset = 32768.0;
+      break;
+   default:
+      fprintf(stderr,
+              "narrow_integer_percentile received a dtype (%s) which is not a "\
+              "narrow integer - this is a bug in Caspian\n",
+              input_dtype.string);
+      exit(EXIT_FAILURE);
+   }
+
+   if (number_keys > 0) {
+      *result = histogram_percentile(keys, number_keys, key_bits,
+                                     percentile) - offset;
+   }
+   return number_keys;
+}
+
 /**
   * Reduce numeric data by taking the median.
   *
+  * Inputs of 8 and 16-bit integer dtypes are reduced by counting (see
+  *histogram_percentile); all other dtypes are reduced by selection (see
+  *median).
+  *
   * @see reduction_function::call
   */
 void reduce_numeric_median(result_set *set, reduction_attrs *attrs,
                            dimension_bounds bounds, void *input_data,
-                           void *output_data, int output_index,
+                           void *output_data, size_t output_index,
                            dtype input_dtype,
                            dtype output_dtype) {
+   // Narrow integer types can use a counting histogram rather than selection
+   if (is_narrow_integer_dtype(input_dtype)) {
+      NUMERIC_WORKING_TYPE output_value = attrs->output_fill_value;
+      narrow_integer_percentile(set, attrs, input_data, input_dtype, 50.0,
+                                &output_value);
+      numeric_put(output_data, output_dtype, output_index, output_value);
+      return;
+   }
+
    unsigned int maximum_number_results = set->length; // maximum because some
                                                       // will be fill values
    unsigned int current_number_results = 0;
-   register NUMERIC_WORKING_TYPE query_data_value;
+   size_t indices[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length;
 
-   // Create an array to store the numeric values of the results
-   NUMERIC_WORKING_TYPE *values = calloc(sizeof(NUMERIC_WORKING_TYPE),
-                                         maximum_number_results);
-   if (values == NULL) {
-      fprintf(
-         stderr,
-         "Couldn't allocate memory to store %d results in reduce_numeric_median\n",
-         maximum_number_results);
-      exit(EXIT_FAILURE);
-   }
+   // Use this thread's scratch space to store the numeric values of the
+   // results
+   NUMERIC_WORKING_TYPE *values = get_scratch_space(
+      sizeof(NUMERIC_WORKING_TYPE) * maximum_number_results);
 
-   result_set_item *current_item;
-
-   // Iterate over result set, skipping fill values, and storing the numeric
-   // value in the array just defined
-   while ((current_item = set->iterate(set)) != NULL) {
-      query_data_value = numeric_get(input_data, input_dtype,
-                                     current_item->record_index);
-      if(query_data_value == attrs->input_fill_value) {
-         continue;
-      }
-      values[current_number_results++] = query_data_value;
+   // Retrieve the result set in chunks, skipping fill values, and storing the
+   // numeric values contiguously in the array just defined
+   while ((chunk_length = next_index_chunk(set, indices, NULL)) > 0) {
+      current_number_results += numeric_gather(
+         input_data, input_dtype, indices, chunk_length,
+         attrs->input_fill_value, &values[current_number_results]);
    }
 
    // Compute the median
@@ -229,9 +759,298 @@ void reduce_numeric_median(result_set *set, reduction_attrs *attrs,
 
    // Store the median
    numeric_put(output_data, output_dtype, output_index, output_value);
+}
+
+/**
+  * Reduce numeric data by taking a kernel-weighted mean, with weights looked up
+  *by squared distance from the centre of the cell (see
+  *reduction_attrs::kernel).
+  *
+  * @see reduction_function::call
+  */
+void reduce_numeric_kernel_mean(result_set *set, reduction_attrs *attrs,
+                                dimension_bounds bounds, void *input_data,
+                                void *output_data, size_t output_index,
+                                dtype input_dtype,
+                                dtype output_dtype) {
+   NUMERIC_WORKING_TYPE current_sum = 0.0, total_weight = 0.0;
+   size_t indices[GATHER_CHUNK_SIZE];
+   result_set_item *items[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   char valid[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length;
+
+   const float *weights = attrs->kernel->weights;
+   const float scale = attrs->kernel->scale;
+   const int last_bin = attrs->kernel->length - 1;
+
+   // Compute the midpoint of the query cell
+   float central_x = (bounds[2*X + LOWER] + bounds[2*X + UPPER]) / 2.0;
+   float central_y = (bounds[2*Y + LOWER] + bounds[2*Y + UPPER]) / 2.0;
+
+   while ((chunk_length = next_index_chunk(set, indices, items)) > 0) {
+      numeric_gather_masked(input_data, input_dtype, indices, chunk_length,
+                            attrs->input_fill_value, values, valid);
+      for (unsigned int i=0; i<chunk_length; i++) {
+         if (!valid[i]) {
+            continue;
+         }
+         float dx = central_x - items[i]->x;
+         float dy = central_y - items[i]->y;
+         int bin = (int) ((dx * dx + dy * dy) * scale);
+         float weight = weights[(bin < last_bin) ? bin : last_bin];
+         current_sum += values[i] * weight;
+         total_weight += weight;
+      }
+   }
+
+   // Normalise and store. Store fill value if no results were found (or all
+   // had zero weight).
+   numeric_put(
+      output_data, output_dtype, output_index,
+      (total_weight == 0.0) ? attrs->output_fill_value :
+      current_sum / total_weight);
+}
+
+/**
+  * Reduce a row of cells of numeric data by taking the kernel-weighted mean of
+  *each.
+  *
+  * @see reduce_numeric_kernel_mean
+  * @see reduction_function::call_row
+  */
+void reduce_numeric_kernel_mean_row(hit_list *hits, unsigned int *offsets,
+                                    int number_cells, float *centres_x,
+                                    float centre_y, reduction_attrs *attrs,
+                                    void *input_data, void *output_data,
+                                    size_t output_index, dtype input_dtype,
+                                    dtype output_dtype) {
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   char valid[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE *row_values = get_scratch_space(
+      sizeof(NUMERIC_WORKING_TYPE) * number_cells);
+
+   const float *weights = attrs->kernel->weights;
+   const float scale = attrs->kernel->scale;
+   const int last_bin = attrs->kernel->length - 1;
+
+   for (int c = 0; c < number_cells; c++) {
+      NUMERIC_WORKING_TYPE current_sum = 0.0, total_weight = 0.0;
+      for (unsigned int first = offsets[c]; first < offsets[c + 1];
+           first += GATHER_CHUNK_SIZE) {
+         unsigned int chunk_length = offsets[c + 1] - first;
+         if (chunk_length > GATHER_CHUNK_SIZE) {
+            chunk_length = GATHER_CHUNK_SIZE;
+         }
+         numeric_gather_masked(input_data, input_dtype,
+                               &hits->record_indices[first], chunk_length,
+                               attrs->input_fill_value, values, valid);
+         for (unsigned int i=0; i<chunk_length; i++) {
+            if (!valid[i]) {
+               continue;
+            }
+            float dx = centres_x[c] - hits->x[first + i];
+            float dy = centre_y - hits->y[first + i];
+            int bin = (int) ((dx * dx + dy * dy) * scale);
+            float weight = weights[(bin < last_bin) ? bin : last_bin];
+            current_sum += values[i] * weight;
+            total_weight += weight;
+         }
+      }
+      row_values[c] = (total_weight == 0.0) ? attrs->output_fill_value :
+                      current_sum / total_weight;
+   }
 
-   // Free our working array
-   free(values);
+   numeric_put_span(output_data, output_dtype, output_index, number_cells,
+                    row_values);
+}
+
+/**
+  * Reduce numeric data by taking a mean, weighted by the per-observation
+  *weights in reduction_attrs::input_weights. Observations without a positive
+  *weight are ignored.
+  *
+  * @see reduction_function::call
+  */
+void reduce_numeric_input_weighted_mean(result_set *set, reduction_attrs *attrs,
+                                        dimension_bounds bounds,
+                                        void *input_data, void *output_data,
+                                        size_t output_index, dtype input_dtype,
+                                        dtype output_dtype) {
+   NUMERIC_WORKING_TYPE current_sum = 0.0, total_weight = 0.0;
+   size_t indices[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE weights[GATHER_CHUNK_SIZE];
+   char valid[GATHER_CHUNK_SIZE];
+   char weight_valid[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length;
+
+   // Retrieve the values and weights in chunks (weights have no fill value,
+   // so NAN is used, which never compares equal)
+   while ((chunk_length = next_index_chunk(set, indices, NULL)) > 0) {
+      numeric_gather_masked(input_data, input_dtype, indices, chunk_length,
+                            attrs->input_fill_value, values, valid);
+      numeric_gather_masked(attrs->input_weights, attrs->input_weights_dtype,
+                            indices, chunk_length, NAN, weights, weight_valid);
+      for (unsigned int i=0; i<chunk_length; i++) {
+         if (!valid[i] || !(weights[i] > 0.0)) {
+            continue;
+         }
+         current_sum += values[i] * weights[i];
+         total_weight += weights[i];
+      }
+   }
+
+   numeric_put(
+      output_data, output_dtype, output_index,
+      (total_weight == 0.0) ? attrs->output_fill_value :
+      current_sum / total_weight);
+}
+
+/**
+  * A value together with its weight, used by the weighted median.
+  */
+typedef struct {
+   /** The value.*/
+   NUMERIC_WORKING_TYPE value;
+
+   /** The weight of the value.*/
+   NUMERIC_WORKING_TYPE weight;
+} weighted_value;
+
+/**
+  * Compare two weighted_values by value (for qsort).
+  */
+static int compare_weighted_values(const void *a, const void *b) {
+   NUMERIC_WORKING_TYPE x = ((const weighted_value *) a)->value;
+   NUMERIC_WORKING_TYPE y = ((const weighted_value *) b)->value;
+   return (x > y) - (x < y);
+}
+
+/**
+  * Reduce numeric data by taking a weighted median, using the per-observation
+  *weights in reduction_attrs::input_weights. Observations without a positive
+  *weight are ignored. The weighted median is the smallest value at which the
+  *cumulative weight reaches half of the total; where it is exactly half, the
+  *mean of that value and the next is used, so that equal weights give the
+  *ordinary median.
+  *
+  * @see reduction_function::call
+  */
+void reduce_numeric_input_weighted_median(result_set *set,
+                                          reduction_attrs *attrs,
+                                          dimension_bounds bounds,
+                                          void *input_data, void *output_data,
+                                          size_t output_index,
+                                          dtype input_dtype,
+                                          dtype output_dtype) {
+   size_t indices[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE weights[GATHER_CHUNK_SIZE];
+   char valid[GATHER_CHUNK_SIZE];
+   char weight_valid[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length;
+
+   // Use this thread's scratch space to store the value/weight pairs
+   weighted_value *pairs = get_scratch_space(sizeof(weighted_value) *
+                                             set->length);
+   unsigned int number_pairs = 0;
+   NUMERIC_WORKING_TYPE total_weight = 0.0;
+
+   while ((chunk_length = next_index_chunk(set, indices, NULL)) > 0) {
+      numeric_gather_masked(input_data, input_dtype, indices, chunk_length,
+                            attrs->input_fill_value, values, valid);
+      numeric_gather_masked(attrs->input_weights, attrs->input_weights_dtype,
+                            indices, chunk_length, NAN, weights, weight_valid);
+      for (unsigned int i=0; i<chunk_length; i++) {
+         if (!valid[i] || !(weights[i] > 0.0)) {
+            continue;
+         }
+         pairs[number_pairs].value = values[i];
+         pairs[number_pairs].weight = weights[i];
+         total_weight += weights[i];
+         number_pairs++;
+      }
+   }
+
+   NUMERIC_WORKING_TYPE output_value = attrs->output_fill_value;
+   if (number_pairs > 0) {
+      qsort(pairs, number_pairs, sizeof(weighted_value),
+            &compare_weighted_values);
+
+      // Find the value at which the cumulative weight reaches half the total
+      NUMERIC_WORKING_TYPE half_weight = total_weight / 2.0;
+      NUMERIC_WORKING_TYPE cumulative_weight = 0.0;
+      for (unsigned int i=0; i<number_pairs; i++) {
+         cumulative_weight += pairs[i].weight;
+         if (cumulative_weight >= half_weight) {
+            output_value = pairs[i].value;
+            if (cumulative_weight == half_weight && i + 1 < number_pairs) {
+               output_value = (output_value + pairs[i + 1].value) / 2.0;
+            }
+            break;
+         }
+      }
+   }
+
+   numeric_put(output_data, output_dtype, output_index, output_value);
+}
+
+/**
+  * Reduce numeric data by taking a percentile (see reduction_attrs::percentile).
+  *
+  * Inputs of 8 and 16-bit integer dtypes are reduced exactly by counting (see
+  *histogram_percentile). Values of all other dtypes are streamed into a
+  *quantile_sketch, so that the memory used for each cell is bounded by the
+  *requested rank error rather than the number of observations.
+  *
+  * @see reduction_function::call
+  */
+void reduce_numeric_percentile(result_set *set, reduction_attrs *attrs,
+                               dimension_bounds bounds, void *input_data,
+                               void *output_data, size_t output_index,
+                               dtype input_dtype,
+                               dtype output_dtype) {
+   NUMERIC_WORKING_TYPE output_value = attrs->output_fill_value;
+
+   if (is_narrow_integer_dtype(input_dtype)) {
+      narrow_integer_percentile(set, attrs, input_data, input_dtype,
+                                attrs->percentile, &output_value);
+      numeric_put(output_data, output_dtype, output_index, output_value);
+      return;
+   }
+
+   // (Re)create this thread's sketch if the requested accuracy has changed
+   if (percentile_sketch == NULL ||
+       percentile_sketch->rank_error != attrs->percentile_rank_error) {
+      if (percentile_sketch != NULL) {
+         percentile_sketch->free(percentile_sketch);
+      }
+      percentile_sketch = quantile_sketch_init(attrs->percentile_rank_error);
+   } else {
+      percentile_sketch->reset(percentile_sketch);
+   }
+
+   size_t indices[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length;
+
+   // Retrieve the result set in chunks, streaming non-fill values into the
+   // sketch
+   while ((chunk_length = next_index_chunk(set, indices, NULL)) > 0) {
+      unsigned int number_values = numeric_gather(
+         input_data, input_dtype, indices, chunk_length,
+         attrs->input_fill_value, values);
+      for (unsigned int i = 0; i < number_values; i++) {
+         percentile_sketch->update(percentile_sketch, values[i]);
+      }
+   }
+
+   if (percentile_sketch->count > 0) {
+      output_value = percentile_sketch->query(percentile_sketch,
+                                              attrs->percentile);
+   }
+   numeric_put(output_data, output_dtype, output_index, output_value);
 }
 
 /**
@@ -241,38 +1060,40 @@ void reduce_numeric_median(result_set *set, reduction_attrs *attrs,
   */
 void reduce_numeric_weighted_mean(result_set *set, reduction_attrs *attrs,
                                   dimension_bounds bounds, void *input_data,
-                                  void *output_data, int output_index,
+                                  void *output_data, size_t output_index,
                                   dtype input_dtype,
                                   dtype output_dtype) {
    register NUMERIC_WORKING_TYPE current_sum = 0.0, total_distance = 0.0;
-   register NUMERIC_WORKING_TYPE query_data_value, current_distance; //Initialized
-                                                                     // on each
-                                                                     // loop
+   register NUMERIC_WORKING_TYPE current_distance; //Initialized on each loop
+   size_t indices[GATHER_CHUNK_SIZE];
+   result_set_item *items[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   char valid[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length;
 
    // Compute the midpoint of the query cell
    NUMERIC_WORKING_TYPE central_x =
-      (bounds[X + LOWER] + bounds[X + UPPER]) / 2.0;
+      (bounds[2*X + LOWER] + bounds[2*X + UPPER]) / 2.0;
    NUMERIC_WORKING_TYPE central_y =
-      (bounds[Y + LOWER] + bounds[Y + UPPER]) / 2.0;
-
-   result_set_item *current_item;
+      (bounds[2*Y + LOWER] + bounds[2*Y + UPPER]) / 2.0;
 
-   // Iterate over each result, skipping fill values, calculating the
+   // Retrieve the results in chunks, skipping fill values, calculating the
    // distance for each result, and counting both the total distance
    // between all results and the centre, and the distance-weighted
    // value
-   while ((current_item = set->iterate(set)) != NULL) {
-      query_data_value = numeric_get(input_data, input_dtype,
-                                     current_item->record_index);
-
-      if(query_data_value == attrs->input_fill_value) {
-         continue;
+   while ((chunk_length = next_index_chunk(set, indices, items)) > 0) {
+      numeric_gather_masked(input_data, input_dtype, indices, chunk_length,
+                            attrs->input_fill_value, values, valid);
+      for (unsigned int i=0; i<chunk_length; i++) {
+         if (!valid[i]) {
+            continue;
+         }
+         current_distance =
+            sqrt(powf(central_x - items[i]->x,
+                      2) + powf(central_y - items[i]->y, 2));
+         current_sum += values[i] * current_distance;
+         total_distance += current_distance;
       }
-      current_distance =
-         sqrt(powf(central_x - current_item->x,
-                   2) + powf(central_y - current_item->y, 2));
-      current_sum += query_data_value * current_distance;
-      total_distance += current_distance;
    }
 
    // Normalise the weighted mean by dividing the weighted sum by the
@@ -283,6 +1104,258 @@ void reduce_numeric_weighted_mean(result_set *set, reduction_attrs *attrs,
        0.0) ? attrs->output_fill_value : current_sum / total_distance);
 }
 
+/**
+  * Reduce a row of cells of numeric data by taking the distance-weighted mean
+  *of each.
+  *
+  * @see reduce_numeric_weighted_mean
+  * @see reduction_function::call_row
+  */
+void reduce_numeric_weighted_mean_row(hit_list *hits, unsigned int *offsets,
+                                      int number_cells, float *centres_x,
+                                      float centre_y, reduction_attrs *attrs,
+                                      void *input_data, void *output_data,
+                                      size_t output_index, dtype input_dtype,
+                                      dtype output_dtype) {
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   char valid[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE *row_values = get_scratch_space(
+      sizeof(NUMERIC_WORKING_TYPE) * number_cells);
+   NUMERIC_WORKING_TYPE central_y = centre_y;
+
+   for (int c = 0; c < number_cells; c++) {
+      NUMERIC_WORKING_TYPE current_sum = 0.0, total_distance = 0.0;
+      NUMERIC_WORKING_TYPE central_x = centres_x[c];
+      for (unsigned int first = offsets[c]; first < offsets[c + 1];
+           first += GATHER_CHUNK_SIZE) {
+         unsigned int chunk_length = offsets[c + 1] - first;
+         if (chunk_length > GATHER_CHUNK_SIZE) {
+            chunk_length = GATHER_CHUNK_SIZE;
+         }
+         numeric_gather_masked(input_data, input_dtype,
+                               &hits->record_indices[first], chunk_length,
+                               attrs->input_fill_value, values, valid);
+         for (unsigned int i=0; i<chunk_length; i++) {
+            if (!valid[i]) {
+               continue;
+            }
+            NUMERIC_WORKING_TYPE current_distance =
+               sqrt(powf(central_x - hits->x[first + i], 2) +
+                    powf(central_y - hits->y[first + i], 2));
+            current_sum += values[i] * current_distance;
+            total_distance += current_distance;
+         }
+      }
+      row_values[c] = (total_distance == 0.0) ? attrs->output_fill_value :
+                      current_sum / total_distance;
+   }
+
+   numeric_put_span(output_data, output_dtype, output_index, number_cells,
+                    row_values);
+}
+
+/**
+  * Compute several statistics of numeric data in a single pass over a result
+  *set, storing each in its own output.
+  *
+  * The mean and variance are accumulated using Welford's method, and the sum
+  *using Kahan (compensated) summation, so that large cells do not lose
+  *precision. The standard deviation and variance are population statistics
+  *(i.e. normalised by the number of values). If there are no non-fill values,
+  *the count and sum are stored as 0, and all other statistics as the output
+  *fill value.
+  *
+  * @param set The result set of observations to reduce.
+  * @param attrs A reduction_attrs instance.
+  * @param input_data Pointer to the memory where the input data is stored.
+  * @param input_dtype The data type of the input array.
+  * @param outputs The statistics to compute, and where to store them.
+  * @param number_outputs The number of items in outputs.
+  * @param output_index The index in each output array where the statistic
+  *should be stored.
+  */
+void reduce_numeric_statistics(result_set *set, reduction_attrs *attrs,
+                               void *input_data, dtype input_dtype,
+                               statistic_output *outputs, int number_outputs,
+                               size_t output_index) {
+   unsigned int count = 0;
+   NUMERIC_WORKING_TYPE mean = 0.0, squared_deviations = 0.0;
+   NUMERIC_WORKING_TYPE sum = 0.0, sum_compensation = 0.0;
+   NUMERIC_WORKING_TYPE minimum = 0.0, maximum = 0.0;
+   NUMERIC_WORKING_TYPE delta, corrected_value, new_sum;
+   size_t indices[GATHER_CHUNK_SIZE];
+   NUMERIC_WORKING_TYPE values[GATHER_CHUNK_SIZE];
+   unsigned int chunk_length, chunk_values;
+
+   // Retrieve the result set in chunks, skipping fill values, and updating all
+   // of the accumulators from each value
+   while ((chunk_length = next_index_chunk(set, indices, NULL)) > 0) {
+      chunk_values = numeric_gather(input_data, input_dtype, indices,
+                                    chunk_length, attrs->input_fill_value,
+                                    values);
+      if (count == 0 && chunk_values > 0) {
+         minimum = maximum = values[0];
+      }
+      min_max_values(values, chunk_values, &minimum, &maximum);
+
+      for (unsigned int i=0; i<chunk_values; i++) {
+         count++;
+
+         // Welford update of the mean and sum of squared deviations
+         delta = values[i] - mean;
+         mean += delta / (NUMERIC_WORKING_TYPE) count;
+         squared_deviations += delta * (values[i] - mean);
+
+         // Kahan summation
+         corrected_value = values[i] - sum_compensation;
+         new_sum = sum + corrected_value;
+         sum_compensation = (new_sum - sum) - corrected_value;
+         sum = new_sum;
+      }
+   }
+
+   // Store each of the requested statistics
+   NUMERIC_WORKING_TYPE output_value;
+   for (int o=0; o<number_outputs; o++) {
+      switch (outputs[o].stat) {
+      case statistic_count:
+         output_value = (NUMERIC_WORKING_TYPE) count;
+         break;
+      case statistic_sum:
+         output_value = sum;
+         break;
+      case statistic_mean:
+         output_value = (count == 0) ? attrs->output_fill_value : mean;
+         break;
+      case statistic_variance:
+         output_value = (count == 0) ? attrs->output_fill_value :
+                        squared_deviations / (NUMERIC_WORKING_TYPE) count;
+         break;
+      case statistic_stddev:
+         output_value = (count == 0) ? attrs->output_fill_value :
+                        sqrt(squared_deviations / (NUMERIC_WORKING_TYPE) count);
+         break;
+      case statistic_min:
+         output_value = (count == 0) ? attrs->output_fill_value : minimum;
+         break;
+      case statistic_max:
+         output_value = (count == 0) ? attrs->output_fill_value : maximum;
+         break;
+      default:
+         fprintf(stderr,
+                 "Unknown statistic (%d) - this is probably a bug in Caspian\n",
+                 outputs[o].stat);
+         exit(EXIT_FAILURE);
+      }
+      numeric_put(outputs[o].data_output, outputs[o].output_dtype,
+                  output_index, output_value);
+   }
+}
+
+/**
+  * Retrieve the statistic (for use with reduce_numeric_statistics) with the
+  *given name.
+  *
+  * @param name The name of the statistic (e.g. mean, stddev, count).
+  * @return The statistic, or undef_statistic if the name is not recognised.
+  */
+statistic get_statistic_by_name(char *name) {
+   static struct {
+      char *name;
+      statistic stat;
+   } statistics[] = {
+      {"mean", statistic_mean},
+      {"stddev", statistic_stddev},
+      {"variance", statistic_variance},
+      {"count", statistic_count},
+      {"sum", statistic_sum},
+      {"min", statistic_min},
+      {"max", statistic_max},
+   };
+   static int number_statistics = 7;
+
+   for (int i=0; i<number_statistics; i++) {
+      if (strcmp(statistics[i].name, name) == 0) {
+         return statistics[i].stat;
+      }
+   }
+   return undef_statistic;
+}
+
+/**
+  * Retrieve the kernel_type with the given name ('idw' or 'gaussian').
+  *
+  * @param name The name of the kernel.
+  * @return The kernel_type, or undef_kernel if the name is not recognised.
+  */
+kernel_type get_kernel_by_name(char *name) {
+   if (strcmp(name, "idw") == 0) {
+      return kernel_idw;
+   } else if (strcmp(name, "gaussian") == 0) {
+      return kernel_gaussian;
+   }
+   return undef_kernel;
+}
+
+/**
+  * Build a table of kernel weights.
+  *
+  * The table covers squared distances from 0 to max_squared_distance (the
+  *squared distance from the centre of a cell to the corner of its search box);
+  *larger squared distances use the last bin.
+  *
+  * @param kernel The kernel to tabulate.
+  * @param parameter The power of the distance (for kernel_idw, weight =
+  *1/distance^power) or the standard deviation in projection units (for
+  *kernel_gaussian, weight = exp(-distance^2 / (2 * sigma^2))).
+  * @param max_squared_distance The largest squared distance to tabulate.
+  * @return A pointer to an initialised kernel_table.
+  */
+kernel_table *kernel_table_init(kernel_type kernel, float parameter,
+                                float max_squared_distance) {
+   kernel_table *table = malloc(sizeof(kernel_table));
+   if (table == NULL) {
+      fprintf(stderr, "Could not allocate space for a kernel_table struct\n");
+      exit(EXIT_FAILURE);
+   }
+   table->length = KERNEL_TABLE_LENGTH;
+   table->scale = table->length / max_squared_distance;
+   table->weights = malloc(sizeof(float) * table->length);
+   if (table->weights == NULL) {
+      fprintf(stderr, "Could not allocate space for kernel weights\n");
+      exit(EXIT_FAILURE);
+   }
+
+   for (int i = 0; i < table->length; i++) {
+      // Evaluate the kernel at the centre of each bin (which also keeps the
+      // inverse distance weight at the origin finite)
+      double squared_distance = (i + 0.5) / table->scale;
+      switch (kernel) {
+      case kernel_idw:
+         table->weights[i] = pow(squared_distance, -parameter / 2.0);
+         break;
+      case kernel_gaussian:
+         table->weights[i] = exp(-squared_distance /
+                                 (2.0 * parameter * parameter));
+         break;
+      default:
+         fprintf(stderr, "Unknown kernel type %d\n", kernel);
+         exit(EXIT_FAILURE);
+      }
+   }
+   return table;
+}
+
+/**
+  * Free a kernel_table.
+  *
+  * @param table The kernel_table to free.
+  */
+void kernel_table_free(kernel_table *table) {
+   free(table->weights);
+   free(table);
+}
+
 /**
   * Retrieve an instance of the named reduction_function.
   *
@@ -292,14 +1365,22 @@ void reduce_numeric_weighted_mean(result_set *set, reduction_attrs *attrs,
 reduction_function get_reduction_function_by_name(char *name) {
    static reduction_function reduction_functions[] = {
       {"undef", undef_style, NULL},
-      {"mean", numeric, &reduce_numeric_mean},
-      {"weighted_mean", numeric, &reduce_numeric_weighted_mean},
+      {"mean", numeric, &reduce_numeric_mean, &reduce_numeric_mean_row},
+      {"weighted_mean", numeric, &reduce_numeric_weighted_mean,
+       &reduce_numeric_weighted_mean_row},
+      {"kernel_mean", numeric, &reduce_numeric_kernel_mean,
+       &reduce_numeric_kernel_mean_row},
+      {"input_weighted_mean", numeric, &reduce_numeric_input_weighted_mean},
+      {"input_weighted_median", numeric,
+       &reduce_numeric_input_weighted_median},
       {"median", numeric, &reduce_numeric_median},
+      {"percentile", numeric, &reduce_numeric_percentile},
       {"coded_nearest_neighbour", coded, &reduce_coded_nearest_neighbour},
+      {"coded_mode", coded, &reduce_coded_mode},
       {"numeric_nearest_neighbour", numeric, &reduce_numeric_nearest_neighbour},
       {"newest", numeric, &reduce_numeric_newest},
    };
-   static int number_reduction_functions = 7;
+   static int number_reduction_functions = 12;
 
    reduction_function result = reduction_functions[0]; //undef
 
@@ -7,8 +7,32 @@
 #define HEADER_REDUCTION_FUNCTIONS
 
 #include "data_handling.h"
+#include "hit_list.h"
 #include "result_set.h"
 
+/**
+  * Enumeration of the distance weighting kernels available to the kernel_mean
+  *reduction.
+  */
+typedef enum {kernel_idw, kernel_gaussian, undef_kernel} kernel_type;
+
+/**
+  * A table of kernel weights, indexed by squared distance from the centre of a
+  *cell, so that weights can be looked up without computing square roots,
+  *powers or exponentials for each observation.
+  */
+typedef struct {
+   /** The weight for each squared distance bin (each evaluated at the centre
+    *of the bin). */
+   float *weights;
+
+   /** The number of bins. */
+   int length;
+
+   /** The number of bins per unit of squared distance. */
+   float scale;
+} kernel_table;
+
 /**
   * Define a standard set of parameters that can be passed to a reduction
   *function.
@@ -21,6 +45,24 @@ typedef struct {
    /** The 'fill value' of the output data (i.e. the value that indicates that
     *there was insufficient data for a particular grid cell */
    NUMERIC_WORKING_TYPE output_fill_value;
+
+   /** The percentile (0 to 100) computed by the percentile reduction */
+   float percentile;
+
+   /** The normalised rank error allowed when the percentile reduction
+    *estimates a percentile using a quantile_sketch */
+   float percentile_rank_error;
+
+   /** The weights used by the kernel_mean reduction */
+   kernel_table *kernel;
+
+   /** Pointer to memory where a weight for each observation is stored, used
+    *by the input_weighted_mean and input_weighted_median reductions (NULL if
+    *not available) */
+   void *input_weights;
+
+   /** The (numeric) type of input_weights */
+   dtype input_weights_dtype;
 } reduction_attrs;
 
 /**
@@ -55,13 +97,78 @@ typedef struct {
       dimension_bounds bounds,
       void *input_data,
       void *output_data,
-      int output_index,
+      size_t output_index,
+      dtype input_dtype,
+      dtype output_dtype
+      );
+
+   /** Optional (NULL if not supported): reduce a row of adjacent cells at
+     *once, storing the reduced values contiguously. This avoids the per-cell
+     *call overhead, and allows the values of a row to be stored together.
+     *
+     * @param hits The observations found for every cell of the row.
+     * @param offsets The observations of cell c are items offsets[c] to
+     *offsets[c + 1] - 1 of @a hits (so there are number_cells + 1 offsets).
+     * @param number_cells The number of cells in the row.
+     * @param centres_x The x-coordinate of the centre of each cell.
+     * @param centre_y The y-coordinate of the centre of every cell.
+     * @param attrs A reduction_attrs instance.
+     * @param input_data Pointer to the memory where the input data is stored.
+     * @param output_data Pointer to the memory where the output data is stored.
+     * @param output_index The index in the output array where the reduced value
+     *of the first cell should be stored (the other cells follow it).
+     * @param input_dtype The data type of the input array.
+     * @param output_dtype The data type of the output array.
+     */
+   void (*call_row)(
+      hit_list *hits,
+      unsigned int *offsets,
+      int number_cells,
+      float *centres_x,
+      float centre_y,
+      reduction_attrs *attrs,
+      void *input_data,
+      void *output_data,
+      size_t output_index,
       dtype input_dtype,
       dtype output_dtype
       );
 } reduction_function;
 
+/**
+  * Enumeration of the statistics which can be computed together from a single
+  *result set by reduce_numeric_statistics.
+  */
+typedef enum {statistic_mean, statistic_stddev, statistic_variance,
+              statistic_count, statistic_sum, statistic_min, statistic_max,
+              undef_statistic} statistic;
+
+/**
+  * A single output of reduce_numeric_statistics - the statistic to compute, and
+  *where to store it.
+  */
+typedef struct {
+   /** The statistic to store in this output. */
+   statistic stat;
+
+   /** Pointer to the memory where the statistic should be stored. */
+   char *data_output;
+
+   /** The data type of the output array. */
+   dtype output_dtype;
+} statistic_output;
+
 // Function prototypes - implementation in reduction_funtions.c
 reduction_function get_reduction_function_by_name(char *name);
 int reduction_function_is_undef(reduction_function f);
+statistic get_statistic_by_name(char *name);
+kernel_type get_kernel_by_name(char *name);
+kernel_table *kernel_table_init(kernel_type kernel, float parameter,
+                                float max_squared_distance);
+void kernel_table_free(kernel_table *table);
+void reduction_thread_storage_free(void);
+void reduce_numeric_statistics(result_set *set, reduction_attrs *attrs,
+                               void *input_data, dtype input_dtype,
+                               statistic_output *outputs, int number_outputs,
+                               size_t output_index);
 #endif
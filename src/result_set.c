@@ -19,7 +19,7 @@
   * @param record_index The index of the new item.
   */
 void result_set_insert(result_set *set, float x, float y, float t,
-                       int record_index) {
+                       size_t record_index) {
    result_set_item *new_item = malloc(sizeof(result_set_item));
    if (new_item == NULL) {
       fprintf(stderr, "Could not allocate space for a single result_set_item\n");
@@ -67,6 +67,47 @@ result_set_item *result_set_iterate(result_set *set) {
    return to_return;
 }
 
+/**
+  * Reset iteration to the start of a result_set.
+  *
+  * @param set The result_set to rewind.
+  */
+void result_set_rewind(result_set *set) {
+   set->current = set->head;
+}
+
+/**
+  * Remove every item from a result_set which does not satisfy a predicate,
+  *and rewind it.
+  *
+  * @param set The result_set to filter.
+  * @param predicate A function returning non-zero for items to keep.
+  * @param context Passed unchanged to @a predicate.
+  */
+void result_set_retain(result_set *set,
+                       int (*predicate)(void *context, size_t record_index),
+                       void *context) {
+   result_set_item **link = &set->head;
+   result_set_item *current = set->head;
+   set->tail = NULL;
+
+   // Walk the list, unlinking and freeing rejected items
+   while (current != NULL) {
+      result_set_item *next = current->next;
+      if (predicate(context, current->record_index)) {
+         *link = current;
+         link = &current->next;
+         set->tail = current;
+      } else {
+         free(current);
+         set->length--;
+      }
+      current = next;
+   }
+   *link = NULL;
+   set->current = set->head;
+}
+
 /**
   * Free a result_set.
   *
@@ -106,5 +147,7 @@ result_set *result_set_init() {
    set->insert = &result_set_insert;
    set->free = &result_set_free;
    set->iterate = &result_set_iterate;
+   set->rewind = &result_set_rewind;
+   set->retain = &result_set_retain;
    return set;
 }
@@ -1,6 +1,7 @@
 #ifndef  HEADER_RESULT_SET
 #define HEADER_RESULT_SET
 #include <pthread.h>
+#include <stddef.h>
 
 /**
   * Singly-linked list of individual results (used as part of a result_set).
@@ -16,7 +17,7 @@ typedef struct result_set_item_s {
    float t;
 
    /** The index of the result item.*/
-   int record_index;
+   size_t record_index;
 
    /** The next result_set_item in the linked list.*/
    struct result_set_item_s *next;
@@ -52,7 +53,7 @@ typedef struct result_set_s {
      * @param record_index The index of the new item.
      */
    void (* insert)(struct result_set_s *set, float x, float y, float t,
-                   int record_index);
+                   size_t record_index);
 
    /**
      * Free a result_set.
@@ -69,6 +70,27 @@ typedef struct result_set_s {
      */
    result_set_item *(*iterate)(struct result_set_s *set);
 
+   /**
+     * Reset iteration to the start of a result_set, such that it can be
+     *iterated over (e.g. reduced) again.
+     *
+     * @param set The result_set to rewind.
+     */
+   void (*rewind)(struct result_set_s *set);
+
+   /**
+     * Remove every item from a result_set which does not satisfy a predicate,
+     *and rewind it.
+     *
+     * @param set The result_set to filter.
+     * @param predicate A function returning non-zero for items to keep, given
+     *@a context and the record index of the item.
+     * @param context Passed unchanged to @a predicate.
+     */
+   void (*retain)(struct result_set_s *set,
+                  int (*predicate)(void *context, size_t record_index),
+                  void *context);
+
 } result_set;
 
 // Function prototypes - implemented in result_set.c
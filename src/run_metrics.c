@@ -0,0 +1,221 @@
+/**
+  * @file
+  *
+  * Implementation of run_metrics
+  */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "run_metrics.h"
+
+/** The number of records read from the source of a timed coordinate reader at
+ *a time.*/
+#define TIMED_READER_BLOCK_SIZE 4096
+
+/** The name of each run_phase, as written to the JSON file.*/
+static const char *phase_names[NUMBER_PHASES] = {
+   "ingest", "index", "query", "reduction", "gridding", "total"
+};
+
+/**
+  * Read a monotonic clock, which is unaffected by changes to the system time.
+  *
+  * @return The time in nanoseconds since an arbitrary (fixed) point.
+  */
+uint64_t monotonic_nanoseconds(void) {
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/**
+  * Initialise a run_metrics struct, with every timer and counter at zero.
+  *
+  * @param metrics The run_metrics to initialise.
+  */
+void run_metrics_init(run_metrics *metrics) {
+   memset(metrics, 0, sizeof(run_metrics));
+}
+
+/**
+  * Count a single query of the index.
+  *
+  * @param metrics The run_metrics to count the query in.
+  * @param number_hits The number of observations found by the query.
+  */
+void run_metrics_count_query(run_metrics *metrics, size_t number_hits) {
+   int bucket = 0;
+   while (bucket < RESULT_SIZE_BUCKETS - 1 && (number_hits >> bucket) != 0) {
+      bucket++;
+   }
+   metrics->queries++;
+   metrics->hits += number_hits;
+   metrics->result_sizes[bucket]++;
+}
+
+/**
+  * Add the timers and counters of one run_metrics (for example, those of one
+  *thread) to another.
+  *
+  * @param total The run_metrics to add to.
+  * @param part The run_metrics to add.
+  */
+void run_metrics_merge(run_metrics *total, run_metrics *part) {
+   for (int p=0; p<NUMBER_PHASES; p++) {
+      total->phase_nanoseconds[p] += part->phase_nanoseconds[p];
+   }
+   total->cells += part->cells;
+   total->queries += part->queries;
+   total->hits += part->hits;
+   for (int b=0; b<RESULT_SIZE_BUCKETS; b++) {
+      total->result_sizes[b] += part->result_sizes[b];
+   }
+}
+
+/**
+  * Write the timers and counters of a run as a JSON object. The result size
+  *histogram is written as a list of buckets, each with the smallest and
+  *largest number of hits it counts, up to the last bucket used.
+  *
+  * @param metrics The run_metrics to write.
+  * @param output_file The file to write to.
+  */
+void run_metrics_write(run_metrics *metrics, FILE *output_file) {
+   fprintf(output_file, "{\n  \"phases_ns\": {");
+   for (int p=0; p<NUMBER_PHASES; p++) {
+      fprintf(output_file, "%s\n    \"%s\": %llu", (p > 0) ? "," : "",
+              phase_names[p],
+              (unsigned long long) metrics->phase_nanoseconds[p]);
+   }
+   fprintf(output_file, "\n  },\n");
+   fprintf(output_file, "  \"observations\": %llu,\n",
+           (unsigned long long) metrics->observations);
+   fprintf(output_file, "  \"threads\": %d,\n", metrics->threads);
+   fprintf(output_file, "  \"cells\": %llu,\n",
+           (unsigned long long) metrics->cells);
+   fprintf(output_file, "  \"queries\": %llu,\n",
+           (unsigned long long) metrics->queries);
+   fprintf(output_file, "  \"hits\": %llu,\n",
+           (unsigned long long) metrics->hits);
+
+   int last_bucket = 0;
+   for (int b=0; b<RESULT_SIZE_BUCKETS; b++) {
+      if (metrics->result_sizes[b] > 0) last_bucket = b;
+   }
+   fprintf(output_file, "  \"result_size_histogram\": [");
+   for (int b=0; b<=last_bucket; b++) {
+      unsigned long long smallest = (b == 0) ? 0 : 1ULL << (b - 1);
+      unsigned long long largest = (b == 0) ? 0 : (1ULL << b) - 1;
+      fprintf(output_file,
+              "%s\n    {\"min\": %llu, \"max\": %llu, \"count\": %llu}",
+              (b > 0) ? "," : "", smallest, largest,
+              (unsigned long long) metrics->result_sizes[b]);
+   }
+   fprintf(output_file, "\n  ]\n}\n");
+}
+
+/**
+  * Define the internals of a timed coordinate reader: a buffer of records
+  *read ahead from its source.
+  */
+typedef struct {
+   /** The coordinate reader which is timed.*/
+   coordinate_reader *source;
+
+   /** The buffered records.*/
+   float x[TIMED_READER_BLOCK_SIZE], y[TIMED_READER_BLOCK_SIZE],
+         t[TIMED_READER_BLOCK_SIZE];
+
+   /** The number of records in the buffer.*/
+   int length;
+
+   /** The number of records already returned from the buffer.*/
+   int position;
+
+   /** The time spent reading from the source is added to this.*/
+   uint64_t *nanoseconds;
+} timed_coordinate_reader;
+
+/*
+  * Read a single observation from a timed coordinate reader, refilling its
+  *buffer from the source when it is empty.
+  *
+  * @see coordinate_reader::read
+  */
+static int timed_coordinate_reader_read(coordinate_reader *reader, float *x,
+                                        float *y, float *t) {
+   timed_coordinate_reader *internals =
+      (timed_coordinate_reader *) reader->internals;
+
+   if (internals->position == internals->length) {
+      uint64_t start = monotonic_nanoseconds();
+      coordinate_reader *source = internals->source;
+      internals->length = 0;
+      internals->position = 0;
+      while (internals->length < TIMED_READER_BLOCK_SIZE &&
+             source->read(source, &internals->x[internals->length],
+                          &internals->y[internals->length],
+                          &internals->t[internals->length])) {
+         internals->length++;
+      }
+      *internals->nanoseconds += monotonic_nanoseconds() - start;
+      if (internals->length == 0) {
+         return 0;
+      }
+   }
+
+   *x = internals->x[internals->position];
+   *y = internals->y[internals->position];
+   *t = internals->t[internals->position];
+   internals->position++;
+   return 1;
+}
+
+/*
+  * Free a timed coordinate reader, and its source.
+  *
+  * @see coordinate_reader::free
+  */
+static void timed_coordinate_reader_free(coordinate_reader *tofree) {
+   timed_coordinate_reader *internals =
+      (timed_coordinate_reader *) tofree->internals;
+   internals->source->free(internals->source);
+   free(internals);
+   free(tofree);
+}
+
+/**
+  * Construct a coordinate reader which reads from another, adding the time
+  *spent reading (and projecting) the coordinates to a timer. The records are
+  *read from the source a block at a time, so that the clock is only read once
+  *per block.
+  *
+  * @param source The coordinate reader to time (which is freed with the timed
+  *reader).
+  * @param nanoseconds The time spent reading is added to this.
+  * @return A pointer to an initialised coordinate_reader.
+  */
+coordinate_reader *get_timed_coordinate_reader(coordinate_reader *source,
+                                               uint64_t *nanoseconds) {
+   coordinate_reader *reader = malloc(sizeof(coordinate_reader));
+   timed_coordinate_reader *internals = malloc(
+      sizeof(timed_coordinate_reader));
+   if (reader == NULL || internals == NULL) {
+      fprintf(stderr, "Failed to allocate space for a coordinate reader\n");
+      exit(EXIT_FAILURE);
+   }
+   internals->source = source;
+   internals->length = 0;
+   internals->position = 0;
+   internals->nanoseconds = nanoseconds;
+
+   reader->internals = internals;
+   reader->num_records = source->num_records;
+   reader->input_projector = source->input_projector;
+   reader->read = &timed_coordinate_reader_read;
+   reader->free = &timed_coordinate_reader_free;
+   return reader;
+}
@@ -0,0 +1,84 @@
+/**
+  * @file
+  *
+  * Defines timers and counters which record where the time of a run is spent,
+  *so that they can be written to a JSON file and tracked between runs.
+  */
+#ifndef HEADER_RUN_METRICS
+#define HEADER_RUN_METRICS
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coordinate_reader.h"
+
+/** The number of buckets of the result size histogram (bucket 0 counts empty
+ *results, and bucket b counts results of 2^(b-1) to 2^b - 1 hits).*/
+#define RESULT_SIZE_BUCKETS 33
+
+/**
+  * Enumeration of the timed phases of a run.
+  */
+typedef enum {
+   /** Reading and projecting the input coordinates.*/
+   phase_ingest,
+
+   /** Building the index from the coordinates, or loading it from disk.*/
+   phase_index,
+
+   /** Querying the index for the observations of each cell.*/
+   phase_query,
+
+   /** Reducing the observations of each cell into its outputs.*/
+   phase_reduction,
+
+   /** Gridding as a whole (including the query and reduction phases).*/
+   phase_gridding,
+
+   /** The whole run.*/
+   phase_total,
+
+   /** The number of phases (not a phase).*/
+   NUMBER_PHASES
+} run_phase;
+
+/**
+  * Timers and counters of a run. This struct should be initialised with
+  *run_metrics_init.
+  */
+typedef struct {
+   /** The time spent in each phase, in nanoseconds. The query and reduction
+    *phases are summed over every thread, so may exceed the gridding phase.*/
+   uint64_t phase_nanoseconds[NUMBER_PHASES];
+
+   /** The number of cells gridded (including cells filled because the index
+    *holds no observations near them).*/
+   uint64_t cells;
+
+   /** The number of queries of the index.*/
+   uint64_t queries;
+
+   /** The total number of observations found by the queries.*/
+   uint64_t hits;
+
+   /** The number of queries finding each range of numbers of observations
+    *(see RESULT_SIZE_BUCKETS).*/
+   uint64_t result_sizes[RESULT_SIZE_BUCKETS];
+
+   /** The number of observations of the index.*/
+   uint64_t observations;
+
+   /** The number of threads available for gridding.*/
+   int threads;
+} run_metrics;
+
+// Function prototypes - implementation in run_metrics.c
+uint64_t monotonic_nanoseconds(void);
+void run_metrics_init(run_metrics *metrics);
+void run_metrics_count_query(run_metrics *metrics, size_t number_hits);
+void run_metrics_merge(run_metrics *total, run_metrics *part);
+void run_metrics_write(run_metrics *metrics, FILE *output_file);
+coordinate_reader *get_timed_coordinate_reader(coordinate_reader *source,
+                                               uint64_t *nanoseconds);
+
+#endif
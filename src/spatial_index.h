@@ -6,12 +6,30 @@
   */
 #ifndef HEADER_INDEX
 #define HEADER_INDEX
+#include <stddef.h>
 #include <stdio.h>
 
 #include "data_handling.h"
+#include "hit_list.h"
 #include "projector.h"
 #include "result_set.h"
 
+/**
+  * The work done by a single query of a spatial index (see
+  *spatial_index::query_counted).
+  */
+typedef struct {
+   /** The number of internal nodes visited.*/
+   unsigned int nodes_visited;
+
+   /** The number of leaves whose observation was tested against the
+    *bounds.*/
+   unsigned int leaves_tested;
+
+   /** The number of observations found.*/
+   unsigned int hits;
+} query_counts;
+
 /**
   * A spatial index (efficient way to query spatial data for records)
   */
@@ -27,7 +45,20 @@ typedef struct spatial_index_s {
    projector *input_projector;
 
    /** The number of data observations represented by this index.*/
-   unsigned int num_observations;
+   size_t num_observations;
+
+   /**
+     * Optional predicate applied to each observation found by a query, before
+     *it is stored; observations for which it returns 0 are omitted from the
+     *result set (NULL to keep every observation).
+     *
+     * @param context The value of @a filter_context.
+     * @param record_index The index of the observation in the data files.
+     */
+   int (*filter)(void *context, size_t record_index);
+
+   /** Passed unchanged to @a filter.*/
+   void *filter_context;
 
    /**
      * Write this index to file, such that it may be reloaded later.
@@ -53,6 +84,72 @@ typedef struct spatial_index_s {
      */
    result_set *(*query)(struct spatial_index_s *toquery,
                         dimension_bounds bounds);
+
+   /**
+     * Query this index for a set of observations, appending them to a
+     *hit_list (so that the results of several queries can be collected
+     *without allocating memory for each observation).
+     *
+     * @param toquery The index to query.
+     * @param bounds The bounds of the query (as for @a query).
+     * @param hits The hit_list to append the observations to.
+     */
+   void (*query_append)(struct spatial_index_s *toquery,
+                        dimension_bounds bounds, hit_list *hits);
+
+   /**
+     * Query this index as @a query does, also counting the work done by the
+     *query, so that slow regions can be diagnosed. NULL if the index cannot
+     *count its queries.
+     *
+     * @param toquery The index to query.
+     * @param bounds The bounds of the query (as for @a query).
+     * @param counts The counts of the query are stored here.
+     * @return A result_set containing the results of the query.
+     */
+   result_set *(*query_counted)(struct spatial_index_s *toquery,
+                                dimension_bounds bounds,
+                                query_counts *counts);
+
+   /**
+     * Cheaply estimate the number of observations within the given bounds.
+     *The estimate need not be exact (the filter is not applied, for example);
+     *it is used to balance work between threads.
+     *
+     * @param toquery The index to query.
+     * @param bounds The bounds of the query (as for @a query).
+     * @return The estimated number of observations within the bounds.
+     */
+   float (*estimate_count)(struct spatial_index_s *toquery,
+                           dimension_bounds bounds);
+
+   /**
+     * Cheaply determine whether any observations may lie within the given
+     *bounds, so that empty regions can be skipped without being queried. The
+     *answer is conservative: a region may be reported as occupied when it is
+     *empty, but never the reverse (the filter and the time bounds are not
+     *applied).
+     *
+     * @param toquery The index to query.
+     * @param bounds The bounds of the query (as for @a query).
+     * @return 0 if no observations lie within the bounds, 1 if some may.
+     */
+   int (*occupied)(struct spatial_index_s *toquery, dimension_bounds bounds);
+
+   /**
+     * Append a block of the observations of this index to a hit_list,
+     *regardless of their position (so that every observation can be visited
+     *once, in blocks). The observations are numbered from 0 to
+     *num_observations - 1, in no particular order; those numbered first to
+     *first + count - 1 are appended (omitting any rejected by @a filter).
+     *
+     * @param toscan The index to scan.
+     * @param first The number of the first observation to append.
+     * @param count The number of observations to append.
+     * @param hits The hit_list to append the observations to.
+     */
+   void (*scan)(struct spatial_index_s *toscan, size_t first, size_t count,
+                hit_list *hits);
 } spatial_index;
 
 #endif
@@ -0,0 +1,309 @@
+/**
+  * @file
+  *
+  * Implementation of validity_mask
+  */
+
+// Define xopen source macro to enable stat (with nanosecond times)
+#define _XOPEN_SOURCE 700
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "validity_mask.h"
+
+/** The suffix appended to a data filename to give its cached mask filename */
+#define VALIDITY_MASK_SUFFIX ".valid"
+
+/**
+  * Calculate the number of 64-bit words needed for a given number of
+  *observations.
+  */
+#define number_words(num_observations) (((num_observations) + 63) / 64)
+
+/**
+  * Write a validity mask to file, such that it may be reloaded later.
+  *
+  * @see validity_mask::write_to_file
+  */
+void write_validity_mask_to_file(validity_mask *towrite, FILE *output_file,
+                                 dtype input_dtype,
+                                 NUMERIC_WORKING_TYPE fill_value,
+                                 data_file_stamp data_stamp) {
+   unsigned int file_format_number = VALIDITY_MASK_FILE_FORMAT;
+   uint64_t stored_num_observations = towrite->num_observations;
+   int specifier = input_dtype.specifier;
+   double stored_fill_value = fill_value;
+
+   // Write a header identifying the data the mask describes
+   fwrite(&file_format_number, sizeof(unsigned int), 1, output_file);
+   fwrite(&stored_num_observations, sizeof(uint64_t), 1, output_file);
+   fwrite(&specifier, sizeof(int), 1, output_file);
+   fwrite(&stored_fill_value, sizeof(double), 1, output_file);
+   fwrite(&data_stamp.modification_seconds, sizeof(int64_t), 1, output_file);
+   fwrite(&data_stamp.modification_nanoseconds, sizeof(int64_t), 1,
+          output_file);
+   fwrite(&data_stamp.size, sizeof(uint64_t), 1, output_file);
+
+   // Write the bitmap
+   fwrite(towrite->bits, sizeof(uint64_t),
+          number_words(towrite->num_observations), output_file);
+
+   // Write a concluding header
+   fwrite(&file_format_number, sizeof(unsigned int), 1, output_file);
+}
+
+/**
+  * Mark every observation which is valid in another mask as valid in this
+  *one.
+  *
+  * @see validity_mask::merge
+  */
+void merge_validity_masks(validity_mask *target, validity_mask *other) {
+   if (target->num_observations != other->num_observations) {
+      fprintf(stderr,
+              "Cannot merge validity masks of different lengths (%zu and "\
+              "%zu)\n",
+              target->num_observations, other->num_observations);
+      exit(EXIT_FAILURE);
+   }
+   size_t number_valid = 0;
+   for (size_t i = 0; i < number_words(target->num_observations); i++) {
+      target->bits[i] |= other->bits[i];
+      number_valid += __builtin_popcountll(target->bits[i]);
+   }
+   target->number_valid = number_valid;
+}
+
+/**
+  * Free a validity mask.
+  *
+  * @see validity_mask::free
+  */
+void free_validity_mask(validity_mask *tofree) {
+   free(tofree->bits);
+   free(tofree);
+}
+
+/**
+  * Allocate an empty validity mask (with every observation marked invalid).
+  *
+  * @param num_observations The number of observations in the mask.
+  * @return A pointer to an initialised validity_mask.
+  */
+static validity_mask *allocate_validity_mask(size_t num_observations) {
+   validity_mask *mask = malloc(sizeof(validity_mask));
+   if (mask == NULL) {
+      fprintf(stderr, "Failed to allocate space for a validity mask\n");
+      exit(EXIT_FAILURE);
+   }
+   mask->bits = calloc(number_words(num_observations), sizeof(uint64_t));
+   if (mask->bits == NULL) {
+      fprintf(stderr, "Failed to allocate space for a validity bitmap of %zu "\
+              "observations\n", num_observations);
+      exit(EXIT_FAILURE);
+   }
+   mask->num_observations = num_observations;
+   mask->number_valid = 0;
+
+   mask->write_to_file = &write_validity_mask_to_file;
+   mask->merge = &merge_validity_masks;
+   mask->free = &free_validity_mask;
+   return mask;
+}
+
+/**
+  * Generate a validity mask by scanning a data array for fill values.
+  *
+  * @param data Pointer to the memory where the data is stored.
+  * @param input_dtype The (numeric) dtype of the data.
+  * @param num_observations The number of observations in the data.
+  * @param fill_value Observations equal to this value are marked invalid.
+  * @return A pointer to an initialised validity_mask.
+  */
+validity_mask *generate_validity_mask(void *data, dtype input_dtype,
+                                      size_t num_observations,
+                                      NUMERIC_WORKING_TYPE fill_value) {
+   validity_mask *mask = allocate_validity_mask(num_observations);
+   size_t words = number_words(num_observations);
+   size_t number_valid = 0;
+
+   // Each thread builds whole words, so no synchronisation is required
+   #pragma omp parallel for reduction(+:number_valid)
+   for (size_t w = 0; w < words; w++) {
+      uint64_t word = 0;
+      size_t first = w * 64;
+      size_t last = (first + 64 < num_observations) ? first + 64 :
+                          num_observations;
+      for (size_t i = first; i < last; i++) {
+         if (numeric_get(data, input_dtype, i) != fill_value) {
+            word |= (uint64_t) 1 << (i - first);
+         }
+      }
+      mask->bits[w] = word;
+      number_valid += __builtin_popcountll(word);
+   }
+   mask->number_valid = number_valid;
+   return mask;
+}
+
+/**
+  * Read a validity mask from file, checking that it describes the expected
+  *data.
+  *
+  * @param input_file The file from which to read the mask.
+  * @param input_dtype The dtype of the data.
+  * @param num_observations The number of observations in the data.
+  * @param fill_value The fill value of the data.
+  * @param data_stamp The version of the data file.
+  * @return A pointer to an initialised validity_mask, or NULL if the file is
+  *not a valid mask or describes different (e.g. since modified) data.
+  */
+validity_mask *read_validity_mask_from_file(FILE *input_file,
+                                            dtype input_dtype,
+                                            size_t num_observations,
+                                            NUMERIC_WORKING_TYPE fill_value,
+                                            data_file_stamp data_stamp) {
+   unsigned int file_format_number;
+   uint64_t file_num_observations;
+   int specifier;
+   double file_fill_value;
+   data_file_stamp file_stamp;
+
+   // Read and check the header
+   if (fread(&file_format_number, sizeof(unsigned int), 1, input_file) != 1 ||
+       fread(&file_num_observations, sizeof(uint64_t), 1, input_file) != 1 ||
+       fread(&specifier, sizeof(int), 1, input_file) != 1 ||
+       fread(&file_fill_value, sizeof(double), 1, input_file) != 1 ||
+       fread(&file_stamp.modification_seconds, sizeof(int64_t), 1,
+             input_file) != 1 ||
+       fread(&file_stamp.modification_nanoseconds, sizeof(int64_t), 1,
+             input_file) != 1 ||
+       fread(&file_stamp.size, sizeof(uint64_t), 1, input_file) != 1) {
+      return NULL;
+   }
+   if (file_format_number != VALIDITY_MASK_FILE_FORMAT ||
+       file_num_observations != num_observations ||
+       specifier != (int) input_dtype.specifier ||
+       file_fill_value != (double) fill_value ||
+       file_stamp.modification_seconds != data_stamp.modification_seconds ||
+       file_stamp.modification_nanoseconds !=
+       data_stamp.modification_nanoseconds ||
+       file_stamp.size != data_stamp.size) {
+      return NULL;
+   }
+
+   // Read the bitmap, and check the concluding header
+   validity_mask *mask = allocate_validity_mask(num_observations);
+   size_t words = number_words(num_observations);
+   if (fread(mask->bits, sizeof(uint64_t), words, input_file) != words ||
+       fread(&file_format_number, sizeof(unsigned int), 1, input_file) != 1 ||
+       file_format_number != VALIDITY_MASK_FILE_FORMAT) {
+      mask->free(mask);
+      return NULL;
+   }
+
+   for (size_t i = 0; i < words; i++) {
+      mask->number_valid += __builtin_popcountll(mask->bits[i]);
+   }
+   return mask;
+}
+
+/**
+  * Obtain the validity mask of a data file, reading it from a cache file next
+  *to the data file (the data filename with VALIDITY_MASK_SUFFIX appended) if
+  *it is up to date, and otherwise generating it and attempting to save it
+  *there. A mask is up to date if the modification time (to the nanosecond)
+  *and size of the data file are those it was generated from. It is saved to a
+  *temporary file which is then renamed, so that a crashed or concurrent run
+  *never leaves a partial mask in its place.
+  *
+  * @param data_filename The filename of the data.
+  * @param data Pointer to the memory where the data is stored.
+  * @param input_dtype The (numeric) dtype of the data.
+  * @param num_observations The number of observations in the data.
+  * @param fill_value Observations equal to this value are marked invalid.
+  * @param verbosity Set as >=1 for verbose output, 0 for silence.
+  * @return A pointer to an initialised validity_mask.
+  */
+validity_mask *get_cached_validity_mask(char *data_filename, void *data,
+                                        dtype input_dtype,
+                                        size_t num_observations,
+                                        NUMERIC_WORKING_TYPE fill_value,
+                                        int verbosity) {
+   struct stat data_stat;
+   if (stat(data_filename, &data_stat) != 0) {
+      fprintf(stderr, "Could not stat the data file %s (%s)\n", data_filename,
+              strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+   data_file_stamp data_stamp;
+   data_stamp.modification_seconds = (int64_t) data_stat.st_mtim.tv_sec;
+   data_stamp.modification_nanoseconds = (int64_t) data_stat.st_mtim.tv_nsec;
+   data_stamp.size = (uint64_t) data_stat.st_size;
+
+   char *mask_filename = malloc(strlen(data_filename) +
+                                strlen(VALIDITY_MASK_SUFFIX) + 1);
+   if (mask_filename == NULL) {
+      fprintf(stderr, "Failed to allocate space for a filename\n");
+      exit(EXIT_FAILURE);
+   }
+   strcpy(mask_filename, data_filename);
+   strcat(mask_filename, VALIDITY_MASK_SUFFIX);
+
+   // Try to use the cached mask
+   validity_mask *mask = NULL;
+   FILE *mask_file = fopen(mask_filename, "r");
+   if (mask_file != NULL) {
+      mask = read_validity_mask_from_file(mask_file, input_dtype,
+                                          num_observations, fill_value,
+                                          data_stamp);
+      fclose(mask_file);
+      if (verbosity > 0) {
+         printf("%s validity mask %s\n", (mask != NULL) ? "Loaded" :
+                "Ignoring out of date", mask_filename);
+      }
+   }
+
+   // Otherwise, generate and cache it (which may fail, e.g. if the data is in
+   // a read-only directory, in which case the mask is simply not cached)
+   if (mask == NULL) {
+      mask = generate_validity_mask(data, input_dtype, num_observations,
+                                    fill_value);
+
+      size_t temporary_length = strlen(mask_filename) + 32;
+      char *temporary_filename = malloc(temporary_length);
+      if (temporary_filename == NULL) {
+         fprintf(stderr, "Failed to allocate space for a filename\n");
+         exit(EXIT_FAILURE);
+      }
+      snprintf(temporary_filename, temporary_length, "%s.%ld", mask_filename,
+               (long) getpid());
+
+      mask_file = fopen(temporary_filename, "wb");
+      int written = 0;
+      if (mask_file != NULL) {
+         mask->write_to_file(mask, mask_file, input_dtype, fill_value,
+                             data_stamp);
+         written = !ferror(mask_file);
+         written = (fclose(mask_file) == 0) && written;
+      }
+      if (written && rename(temporary_filename, mask_filename) == 0) {
+         if (verbosity > 0) printf("Saved validity mask %s\n", mask_filename);
+      } else {
+         if (verbosity > 0) {
+            printf("Could not save validity mask %s (%s)\n", mask_filename,
+                   strerror(errno));
+         }
+         unlink(temporary_filename);
+      }
+      free(temporary_filename);
+   }
+
+   free(mask_filename);
+   return mask;
+}
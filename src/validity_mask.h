@@ -0,0 +1,96 @@
+/**
+  * @file
+  *
+  * Defines a bitmap marking which observations of a data file are not fill
+  *values, so that fill values can be skipped before data is gathered.
+  */
+#ifndef HEADER_VALIDITY_MASK
+#define HEADER_VALIDITY_MASK
+#include <stdio.h>
+
+#include "data_handling.h"
+
+/** The file format number of cached validity masks */
+#define VALIDITY_MASK_FILE_FORMAT 3
+
+/**
+  * Identifies the version of a data file which a cached validity mask was
+  *generated from.
+  */
+typedef struct {
+   /** The modification time of the data file, in whole seconds.*/
+   int64_t modification_seconds;
+
+   /** The nanoseconds of the modification time of the data file.*/
+   int64_t modification_nanoseconds;
+
+   /** The size of the data file, in bytes.*/
+   uint64_t size;
+} data_file_stamp;
+
+/**
+  * A bitmap with one bit per observation of a data file, set if the
+  *observation is not a fill value.
+  */
+typedef struct validity_mask_s {
+   /** The bitmap (observation i is bit i % 64 of word i / 64).*/
+   uint64_t *bits;
+
+   /** The number of observations represented by this mask.*/
+   size_t num_observations;
+
+   /** The number of observations marked as valid.*/
+   size_t number_valid;
+
+   /**
+     * Write this mask to file, such that it may be reloaded later.
+     *
+     * @param towrite The mask to write out to file.
+     * @param output_file The file to write the mask to.
+     * @param input_dtype The dtype of the data the mask was generated from.
+     * @param fill_value The fill value the mask was generated with.
+     * @param data_stamp The version of the data file.
+     */
+   void (*write_to_file)(struct validity_mask_s *towrite, FILE *output_file,
+                         dtype input_dtype, NUMERIC_WORKING_TYPE fill_value,
+                         data_file_stamp data_stamp);
+
+   /**
+     * Mark every observation which is valid in another mask as valid in this
+     *one.
+     *
+     * @param target The mask to update.
+     * @param other A mask of the same number of observations.
+     */
+   void (*merge)(struct validity_mask_s *target, struct validity_mask_s *other);
+
+   /**
+     * Free this mask.
+     *
+     * @param tofree The mask to free.
+     */
+   void (*free)(struct validity_mask_s *tofree);
+} validity_mask;
+
+/**
+  * Determine whether an observation is marked as valid in a validity_mask.
+  */
+#define validity_mask_is_valid(mask, index) \
+   (((mask)->bits[(index) >> 6] >> ((index) & 63)) & 1)
+
+// Function prototypes - implementations in validity_mask.c
+validity_mask *generate_validity_mask(void *data, dtype input_dtype,
+                                      size_t num_observations,
+                                      NUMERIC_WORKING_TYPE fill_value);
+validity_mask *read_validity_mask_from_file(FILE *input_file,
+                                            dtype input_dtype,
+                                            size_t num_observations,
+                                            NUMERIC_WORKING_TYPE fill_value,
+                                            data_file_stamp data_stamp);
+validity_mask *get_cached_validity_mask(char *data_filename, void *data,
+                                        dtype input_dtype,
+                                        size_t num_observations,
+                                        NUMERIC_WORKING_TYPE fill_value,
+                                        int verbosity);
+
+#endif
@@ -0,0 +1,65 @@
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/median.h"
+#include "../src/data_handling.h"
+
+/**
+  * Benchmark the median selection on inputs which are typically worst-case for
+  *naive quickselect (sorted and constant data, as is common in heavily
+  *cloud-masked products), alongside random data for comparison.
+  */
+
+#define BENCH_LENGTH 1000001
+#define BENCH_REPEATS 5
+
+/** Fill the array with the named input pattern */
+static void fill(NUMERIC_WORKING_TYPE *values, int length, char *pattern) {
+   for (int i = 0; i < length; i++) {
+      if (strcmp(pattern, "random") == 0) {
+         values[i] = (NUMERIC_WORKING_TYPE) rand();
+      } else if (strcmp(pattern, "sorted") == 0) {
+         values[i] = (NUMERIC_WORKING_TYPE) i;
+      } else if (strcmp(pattern, "reverse sorted") == 0) {
+         values[i] = (NUMERIC_WORKING_TYPE) (length - i);
+      } else if (strcmp(pattern, "all equal") == 0) {
+         values[i] = 1.0;
+      } else if (strcmp(pattern, "two values") == 0) {
+         values[i] = (NUMERIC_WORKING_TYPE) (i % 2);
+      } else {
+         values[i] = (NUMERIC_WORKING_TYPE) ((i < length / 2) ? i : length - i);
+      }
+   }
+}
+
+int main(void) {
+   char *patterns[] = {"random", "sorted", "reverse sorted", "all equal",
+                       "two values", "organ pipe"};
+   int number_patterns = 6;
+
+   NUMERIC_WORKING_TYPE *values = malloc(sizeof(NUMERIC_WORKING_TYPE) *
+                                         BENCH_LENGTH);
+   if (values == NULL) {
+      fprintf(stderr, "Couldn't allocate benchmark values\n");
+      return EXIT_FAILURE;
+   }
+
+   printf("median of %d values, best of %d runs\n", BENCH_LENGTH,
+          BENCH_REPEATS);
+   for (int p = 0; p < number_patterns; p++) {
+      double best = -1.0;
+      for (int r = 0; r < BENCH_REPEATS; r++) {
+         fill(values, BENCH_LENGTH, patterns[p]);
+         double start = omp_get_wtime();
+         median(values, BENCH_LENGTH);
+         double elapsed = omp_get_wtime() - start;
+         if (best < 0.0 || elapsed < best) best = elapsed;
+      }
+      printf("  %-16s %10.3f ms\n", patterns[p], best * 1000.0);
+   }
+
+   free(values);
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+// Define posix source macro to enable truncate
+#define _POSIX_C_SOURCE 200809L
+
+#include <check.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/coordinate_cache.h"
+#include "../src/grid.h"
+#include "../src/projector.h"
+
+#define CACHE_DIRECTORY "check_coordinate_cache_dir"
+#define WIDTH 20
+#define HEIGHT 10
+
+// A projector which serialises as its (string) internals, so that projectors
+// can be told apart by the cache
+static void serialize_test_projector(projector *p, FILE *outputfile) {
+   fputs((char *) p->internals, outputfile);
+}
+
+static projector test_projector(char *name) {
+   projector p;
+   memset(&p, 0, sizeof(projector));
+   p.internals = name;
+   p.serialize_to_file = &serialize_test_projector;
+   return p;
+}
+
+static void fill_raster(float32_t *raster) {
+   for (int i = 0; i < WIDTH * HEIGHT; i++) {
+      raster[i] = (float32_t) i * 0.25f - 10.0f;
+   }
+}
+
+// Truncate every file in the cache directory to the given length
+static void truncate_cache(off_t length) {
+   DIR *directory = opendir(CACHE_DIRECTORY);
+   fail_if(directory == NULL);
+   struct dirent *entry;
+   char path[512];
+   while ((entry = readdir(directory)) != NULL) {
+      if (entry->d_name[0] == '.') continue;
+      snprintf(path, sizeof(path), "%s/%s", CACHE_DIRECTORY, entry->d_name);
+      fail_unless(truncate(path, length) == 0);
+   }
+   closedir(directory);
+}
+
+static void setup(void) {
+   system("rm -rf " CACHE_DIRECTORY " && mkdir " CACHE_DIRECTORY);
+}
+
+static void teardown(void) {
+   system("rm -rf " CACHE_DIRECTORY);
+}
+
+START_TEST(test_round_trip) {
+   projector p = test_projector("first");
+   grid *g = initialise_grid(WIDTH, HEIGHT, 1.0, 1.0, 0.0, 0.0, 5.0, 5.0, &p);
+   float32_t raster[WIDTH * HEIGHT], loaded[WIDTH * HEIGHT];
+   fill_raster(raster);
+
+   // Nothing is cached yet
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, g, "lats", loaded));
+
+   // A stored raster is loaded back exactly, under its own name only
+   save_cached_coordinates(CACHE_DIRECTORY, g, "lats", raster);
+   memset(loaded, 0, sizeof(loaded));
+   fail_unless(load_cached_coordinates(CACHE_DIRECTORY, g, "lats", loaded));
+   fail_unless(memcmp(raster, loaded, sizeof(raster)) == 0);
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, g, "lons", loaded));
+
+   g->free(g);
+} END_TEST
+
+START_TEST(test_stale_key) {
+   projector p = test_projector("first");
+   projector other_p = test_projector("second");
+   grid *g = initialise_grid(WIDTH, HEIGHT, 1.0, 1.0, 0.0, 0.0, 5.0, 5.0, &p);
+   float32_t raster[WIDTH * HEIGHT], loaded[WIDTH * HEIGHT];
+   fill_raster(raster);
+   save_cached_coordinates(CACHE_DIRECTORY, g, "lats", raster);
+
+   // A grid differing in its centre, resolution, sampling or projection is
+   // not filled from the raster of another
+   grid *moved = initialise_grid(WIDTH, HEIGHT, 1.0, 1.0, 0.0, 0.0, 5.5, 5.0,
+                                 &p);
+   grid *finer = initialise_grid(WIDTH, HEIGHT, 0.5, 1.0, 0.0, 0.0, 5.0, 5.0,
+                                 &p);
+   grid *sampled = initialise_grid(WIDTH, HEIGHT, 1.0, 1.0, 2.0, 2.0, 5.0,
+                                   5.0, &p);
+   grid *reprojected = initialise_grid(WIDTH, HEIGHT, 1.0, 1.0, 0.0, 0.0,
+                                       5.0, 5.0, &other_p);
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, moved, "lats", loaded));
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, finer, "lats", loaded));
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, sampled, "lats", loaded));
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, reprojected, "lats",
+                                   loaded));
+
+   g->free(g);
+   moved->free(moved);
+   finer->free(finer);
+   sampled->free(sampled);
+   reprojected->free(reprojected);
+} END_TEST
+
+START_TEST(test_damaged_file) {
+   projector p = test_projector("first");
+   grid *g = initialise_grid(WIDTH, HEIGHT, 1.0, 1.0, 0.0, 0.0, 5.0, 5.0, &p);
+   float32_t raster[WIDTH * HEIGHT], loaded[WIDTH * HEIGHT];
+   fill_raster(raster);
+
+   // A truncated raster is treated as missing
+   save_cached_coordinates(CACHE_DIRECTORY, g, "lats", raster);
+   truncate_cache(sizeof(raster) / 2);
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, g, "lats", loaded));
+
+   // As is an empty one, or one which has grown
+   truncate_cache(0);
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, g, "lats", loaded));
+   truncate_cache(sizeof(raster) + 1);
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY, g, "lats", loaded));
+
+   // A cache directory which does not exist holds nothing, and storing into
+   // it is not fatal
+   fail_if(load_cached_coordinates(CACHE_DIRECTORY "/missing", g, "lats",
+                                   loaded));
+   save_cached_coordinates(CACHE_DIRECTORY "/missing", g, "lats", raster);
+
+   g->free(g);
+} END_TEST
+
+Suite *coordinate_cache_suite(void) {
+   Suite *s = suite_create("coordinate_cache");
+
+   TCase *cache_testcase = tcase_create("cache");
+   tcase_add_checked_fixture(cache_testcase, setup, teardown);
+   tcase_add_test(cache_testcase, test_round_trip);
+   tcase_add_test(cache_testcase, test_stale_key);
+   tcase_add_test(cache_testcase, test_damaged_file);
+   suite_add_tcase(s, cache_testcase);
+
+   return s;
+}
+
+int main(void) {
+   Suite *s = coordinate_cache_suite();
+   SRunner *suite_runner = srunner_create(s);
+   srunner_run_all(suite_runner, CK_NORMAL);
+   int failures = srunner_ntests_failed(suite_runner);
+   srunner_free(suite_runner);
+   return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
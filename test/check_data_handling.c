@@ -51,6 +51,69 @@ START_TEST(test_coded_handling) {
    fail_unless(input == output);
 } END_TEST
 
+START_TEST(test_numeric_gather) {
+   char *dtype_names[] = {"uint8", "int32", "float32", "float64"};
+   size_t indices[37];
+   NUMERIC_WORKING_TYPE packed[37], masked[37];
+   char valid[37];
+
+   for (int d = 0; d < 4; d++) {
+      dtype current_d = dtype_string_parse(dtype_names[d]);
+      void *data = malloc(current_d.size * 100);
+
+      // Every third number is a fill value
+      for (int i = 0; i < 100; i++) {
+         numeric_put(data, current_d, i, (i % 3 == 0) ? 99.0 : (float) i);
+      }
+
+      // Gather in a scrambled order, long enough to cover vector and scalar
+      // paths
+      for (int i = 0; i < 37; i++) {
+         indices[i] = (i * 7) % 100;
+      }
+
+      unsigned int packed_count = numeric_gather(data, current_d, indices, 37,
+                                                 99.0, packed);
+      unsigned int masked_count = numeric_gather_masked(data, current_d,
+                                                        indices, 37, 99.0,
+                                                        masked, valid);
+      fail_unless(packed_count == masked_count);
+
+      // Check against numeric_get
+      unsigned int expected_count = 0;
+      for (int i = 0; i < 37; i++) {
+         NUMERIC_WORKING_TYPE expected = numeric_get(data, current_d,
+                                                     indices[i]);
+         fail_unless(masked[i] == expected);
+         fail_unless(valid[i] == (expected != 99.0));
+         if (expected != 99.0) {
+            fail_unless(packed[expected_count++] == expected);
+         }
+      }
+      fail_unless(packed_count == expected_count);
+      free(data);
+   }
+} END_TEST
+
+START_TEST(test_numeric_put_span) {
+   char *dtype_names[] = {"uint8", "int16", "float32", "float64"};
+   NUMERIC_WORKING_TYPE values[10];
+   for (int i = 0; i < 10; i++) values[i] = i * 3.0;
+
+   for (int d = 0; d < 4; d++) {
+      dtype current_d = dtype_string_parse(dtype_names[d]);
+      void *data = calloc(20, current_d.size);
+
+      // Store at an offset, and check the surrounding values are untouched
+      numeric_put_span(data, current_d, 5, 10, values);
+      for (int i = 0; i < 20; i++) {
+         NUMERIC_WORKING_TYPE expected = (i >= 5 && i < 15) ? values[i - 5] :
+                                         0.0;
+         fail_unless(numeric_get(data, current_d, i) == expected);
+      }
+      free(data);
+   }
+} END_TEST
 
 Suite *dtype_suite(void) {
    Suite *s = suite_create("dtype");
@@ -64,6 +127,8 @@ Suite *dtype_suite(void) {
    // Numeric data handling
    TCase *numeric_testcase = tcase_create("numeric data");
    tcase_add_test(numeric_testcase, test_numeric_handling);
+   tcase_add_test(numeric_testcase, test_numeric_gather);
+   tcase_add_test(numeric_testcase, test_numeric_put_span);
    suite_add_tcase(s, numeric_testcase);
 
    // Coded data handling
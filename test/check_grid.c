@@ -27,12 +27,36 @@ START_TEST(test_grid_creation) {
 
 } END_TEST
 
+START_TEST(test_overview_grid) {
+   projector *p = get_proj_projector_from_string("+proj=eqc +datum=WGS84");
+   grid *g = initialise_grid(5, 3, 2.0, 1.0, 0.0, 0.0, 10.0, 20.0, p);
+   set_time_constraints(g, 0.0, 1000.0);
+   grid *o = initialise_overview_grid(g, 1);
+
+   // Partial blocks are included in the last row and column
+   fail_unless(o->width == 3);
+   fail_unless(o->height == 2);
+   fail_unless(o->horizontal_resolution == 2.0);
+   fail_unless(o->vertical_resolution == 4.0);
+   fail_unless(o->horizontal_sampling_offset == 1.0);
+   fail_unless(o->time_max == 1000.0);
+
+   // The top left corner is shared with the grid
+   fail_unless(o->central_x - 1.5 * 2.0 == g->central_x - 2.5 * 1.0);
+   fail_unless(o->central_y + 1.0 * 4.0 == g->central_y + 1.5 * 2.0);
+
+   o->free(o);
+   g->free(g);
+   p->free(p);
+} END_TEST
+
 Suite *grid_suite(void) {
    Suite *s = suite_create("grid");
 
    // Grid creation test case
    TCase *grid_testcase = tcase_create("grid");
    tcase_add_test(grid_testcase, test_grid_creation);
+   tcase_add_test(grid_testcase, test_overview_grid);
    suite_add_tcase(s, grid_testcase);
 
    return s;
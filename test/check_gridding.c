@@ -0,0 +1,117 @@
+#include <check.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../src/data_handling.h"
+#include "../src/gridding.h"
+#include "../src/io_spec.h"
+
+START_TEST(test_qa_filter) {
+   // QA values which pass or fail on their bits, or on the minimum
+   float64_t qa_values[] = {0.0, 1.0, 4.0, 5.0, -1.0, 2.5};
+   qa_filter filter;
+   filter.qa_data = qa_values;
+   filter.qa_dtype = dtype_string_parse("float64");
+   filter.reject_mask = 0x4;
+   filter.minimum = -INFINITY;
+   fail_unless(qa_filter_accepts(&filter, 0));
+   fail_unless(qa_filter_accepts(&filter, 1));
+   fail_if(qa_filter_accepts(&filter, 2));
+   fail_if(qa_filter_accepts(&filter, 3));
+   fail_if(qa_filter_accepts(&filter, 4));
+   fail_unless(qa_filter_accepts(&filter, 5));
+
+   filter.minimum = 1.0;
+   fail_if(qa_filter_accepts(&filter, 0));
+   fail_unless(qa_filter_accepts(&filter, 1));
+   fail_unless(qa_filter_accepts(&filter, 5));
+} END_TEST
+
+START_TEST(test_qa_filter_unrepresentable) {
+   // QA values with no bits to test fail a reject mask
+   float64_t qa_values[] = {NAN, INFINITY, -INFINITY, 1e30, -1e30, 0x1p63,
+                            -0x1p63, 0x1p62};
+   qa_filter filter;
+   filter.qa_data = qa_values;
+   filter.qa_dtype = dtype_string_parse("float64");
+   filter.reject_mask = 0x1;
+   filter.minimum = -INFINITY;
+   for (int i = 0; i < 6; i++) {
+      fail_if(qa_filter_accepts(&filter, i));
+   }
+   fail_unless(qa_filter_accepts(&filter, 6));
+   fail_unless(qa_filter_accepts(&filter, 7));
+
+   // Without a mask, only the minimum applies (which a NaN never passes)
+   filter.reject_mask = 0;
+   fail_if(qa_filter_accepts(&filter, 0));
+   for (int i = 1; i < 8; i++) {
+      fail_unless(qa_filter_accepts(&filter, i));
+   }
+} END_TEST
+
+START_TEST(test_running_sums) {
+   // Boxes of cells (first_u, last_u, first_v, last_v) touching each edge,
+   // covering the whole grid, covering single cells, and spanning the blocks
+   // of columns which are summed separately
+   int width = 150, height = 23;
+   int boxes[][4] = {{0, 149, 0, 22}, {0, 0, 0, 0}, {149, 149, 22, 22},
+                     {0, 10, 5, 22}, {130, 149, 0, 3}, {5, 120, 7, 7},
+                     {63, 64, 0, 22}, {0, 149, 11, 11}, {3, 148, 1, 21}};
+   int number_boxes = sizeof(boxes) / sizeof(boxes[0]);
+
+   size_t stride = width + 1;
+   NUMERIC_WORKING_TYPE *corners = calloc(stride * (height + 1),
+                                          sizeof(NUMERIC_WORKING_TYPE));
+   NUMERIC_WORKING_TYPE *expected = calloc((size_t) width * height,
+                                           sizeof(NUMERIC_WORKING_TYPE));
+   for (int b = 0; b < number_boxes; b++) {
+      NUMERIC_WORKING_TYPE value = b + 1;
+      mark_box(corners, stride, boxes[b][0], boxes[b][1], boxes[b][2],
+               boxes[b][3], value);
+      for (int v = boxes[b][2]; v <= boxes[b][3]; v++) {
+         for (int u = boxes[b][0]; u <= boxes[b][1]; u++) {
+            expected[v * width + u] += value;
+         }
+      }
+   }
+
+   // The running sums give the total of the boxes covering each cell
+   running_sums(corners, width, height);
+   for (int v = 0; v < height; v++) {
+      for (int u = 0; u < width; u++) {
+         fail_unless(corners[v * stride + u] == expected[v * width + u],
+                     "cell (%d, %d) was %f, not %f", u, v,
+                     (double) corners[v * stride + u],
+                     (double) expected[v * width + u]);
+      }
+   }
+
+   free(corners);
+   free(expected);
+} END_TEST
+
+Suite *gridding_suite(void) {
+   Suite *s = suite_create("gridding");
+
+   TCase *qa_testcase = tcase_create("qa filter");
+   tcase_add_test(qa_testcase, test_qa_filter);
+   tcase_add_test(qa_testcase, test_qa_filter_unrepresentable);
+   suite_add_tcase(s, qa_testcase);
+
+   TCase *running_sums_testcase = tcase_create("running sums");
+   tcase_add_test(running_sums_testcase, test_running_sums);
+   suite_add_tcase(s, running_sums_testcase);
+
+   return s;
+}
+
+int main(void) {
+   Suite *s = gridding_suite();
+   SRunner *suite_runner = srunner_create(s);
+   srunner_run_all(suite_runner, CK_NORMAL);
+   int failures = srunner_ntests_failed(suite_runner);
+   srunner_free(suite_runner);
+   return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,61 @@
+#include <check.h>
+#include <stdlib.h>
+
+#include "../src/hit_list.h"
+
+START_TEST(test_hit_list) {
+
+   // Setup the hit list
+   hit_list *h = hit_list_init();
+
+   // Check that it is marked as empty
+   fail_unless(h->length == 0);
+
+   // Add enough hits to force the storage to grow, and check the length is
+   // correct after each append
+   for (int i = 0; i < 1000; i++) {
+      h->append(h, i + 1.0, i + 2.0, i + 3.0, i);
+      fail_unless(h->length == i + 1);
+   }
+   fail_unless(h->allocated >= 1000);
+
+   // Check the values
+   for (int i = 0; i < 1000; i++) {
+      fail_unless(h->x[i] == i + 1.0);
+      fail_unless(h->y[i] == i + 2.0);
+      fail_unless(h->t[i] == i + 3.0);
+      fail_unless(h->record_indices[i] == i);
+   }
+
+   // Clear, and check the storage is kept and the list can be reused
+   unsigned int allocated = h->allocated;
+   h->clear(h);
+   fail_unless(h->length == 0);
+   fail_unless(h->allocated == allocated);
+   h->append(h, 0.0, 0.0, 0.0, 42);
+   fail_unless(h->length == 1 && h->record_indices[0] == 42);
+
+   // Cleanup
+   h->free(h);
+
+} END_TEST
+
+Suite *hit_list_suite(void) {
+   Suite *s = suite_create("hit list");
+
+   // Hit List test case
+   TCase *hit_list_testcase = tcase_create("hit list");
+   tcase_add_test(hit_list_testcase, test_hit_list);
+   suite_add_tcase(s, hit_list_testcase);
+
+   return s;
+}
+
+int main(void) {
+   Suite *s = hit_list_suite();
+   SRunner *suite_runner = srunner_create(s);
+   srunner_run_all(suite_runner, CK_NORMAL);
+   int failures = srunner_ntests_failed(suite_runner);
+   srunner_free(suite_runner);
+   return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -24,6 +24,28 @@ START_TEST(test_output) {
    system("rm -f check_io_helper_output_test");
 } END_TEST
 
+START_TEST(test_existing_output) {
+   // Create an output file, and write to it
+   memory_mapped_file *m = open_memory_mapped_output_file("check_io_helper_existing_test", 128);
+   ((char *) m->memory_mapped_data)[0] = 1;
+   ((char *) m->memory_mapped_data)[127] = 2;
+   m->close(m);
+
+   // Reopen it, check that its contents are intact, and update them
+   m = open_memory_mapped_existing_output_file("check_io_helper_existing_test", 128);
+   fail_unless(((char *) m->memory_mapped_data)[0] == 1, "First byte was lost");
+   fail_unless(((char *) m->memory_mapped_data)[127] == 2, "Last byte was lost");
+   ((char *) m->memory_mapped_data)[0] = 3;
+   m->close(m);
+
+   m = open_memory_mapped_existing_output_file("check_io_helper_existing_test", 128);
+   fail_unless(((char *) m->memory_mapped_data)[0] == 3, "Update was lost");
+   m->close(m);
+
+   // Remove the created file
+   system("rm -f check_io_helper_existing_test");
+} END_TEST
+
 
 Suite *io_helper_suite(void) {
    Suite *s = suite_create("io helper");
@@ -36,6 +58,7 @@ Suite *io_helper_suite(void) {
    // Output test case
    TCase *output_testcase = tcase_create("output files");
    tcase_add_test(output_testcase, test_output);
+   tcase_add_test(output_testcase, test_existing_output);
    suite_add_tcase(s, output_testcase);
 
    return s;
@@ -47,6 +47,32 @@ START_TEST(test_valid_kdtree) {
    result_set *r = si->query(si, bounds);
    fail_unless(r->length == records_stored);
 
+   // Estimate - a query covering everything is counted from the root
+   fail_unless(si->estimate_count(si, bounds) == (float) records_stored);
+
+   // Occupancy - everything is occupied, but nothing lies beyond the edge of
+   // the projected globe
+   fail_unless(si->occupied(si, bounds));
+   float beyond_bounds[] = {3e7, 4e7, -INFINITY, INFINITY, -INFINITY, INFINITY};
+   fail_if(si->occupied(si, beyond_bounds));
+
+   // Count - a counted query finds the same observations as the query, counts
+   // them, and (when small) tests only some of the observations
+   query_counts counts;
+   float small_bounds[] = {-1e6, 1e6, -1e6, 1e6, -INFINITY, INFINITY};
+   result_set *small = si->query(si, small_bounds);
+   result_set *counted = si->query_counted(si, small_bounds, &counts);
+   fail_unless(counted->length == small->length);
+   fail_unless(counts.hits == counted->length);
+   fail_unless(counts.leaves_tested >= counts.hits);
+   fail_unless(counts.nodes_visited > 0);
+   fail_unless(counts.leaves_tested < (unsigned int) records_stored);
+   small->free(small);
+   counted->free(counted);
+   counted = si->query_counted(si, beyond_bounds, &counts);
+   fail_unless(counts.hits == 0 && counted->length == 0);
+   counted->free(counted);
+
    // Serialize/Deserialize
    FILE *serialized_index = fopen("test_kdtree_index", "wb");
    si->write_to_file(si, serialized_index);
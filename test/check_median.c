@@ -27,6 +27,52 @@ START_TEST(test_median) {
    fail_unless(result_2 == 3.65);
 } END_TEST
 
+START_TEST(test_median_worst_cases) {
+   // Inputs which are quadratic for a first-value pivot quickselect; these
+   // should complete well within the test timeout
+   int length = 200001;
+   NUMERIC_WORKING_TYPE *values = malloc(sizeof(NUMERIC_WORKING_TYPE) * length);
+
+   // Sorted
+   for (int i = 0; i < length; i++) values[i] = (NUMERIC_WORKING_TYPE) i;
+   fail_unless(median(values, length) == 100000.0);
+
+   // Reverse sorted (even length)
+   for (int i = 0; i < length - 1; i++) values[i] = (NUMERIC_WORKING_TYPE) -i;
+   fail_unless(median(values, length - 1) == -99999.5);
+
+   // All equal
+   for (int i = 0; i < length; i++) values[i] = 7.0;
+   fail_unless(median(values, length) == 7.0);
+
+   // Organ pipe (ascending then descending)
+   for (int i = 0; i < length; i++) {
+      values[i] = (NUMERIC_WORKING_TYPE) ((i < length / 2) ? i : length - i);
+   }
+   fail_unless(median(values, length) == 50000.0);
+
+   free(values);
+} END_TEST
+
+START_TEST(test_histogram_percentile) {
+   // 8-bit keys - compare against the selection-based median
+   uint16_t keys_8[] = {200, 3, 17, 17, 255, 0, 42, 99};
+   NUMERIC_WORKING_TYPE values_8[] = {200, 3, 17, 17, 255, 0, 42, 99};
+   fail_unless(histogram_percentile(keys_8, 8, 8, 50.0) == median(values_8, 8));
+   fail_unless(histogram_percentile(keys_8, 7, 8, 50.0) == 17.0);
+   fail_unless(histogram_percentile(keys_8, 8, 8, 0.0) == 0.0);
+   fail_unless(histogram_percentile(keys_8, 8, 8, 100.0) == 255.0);
+
+   // 16-bit keys, with the ranks falling in different high byte bins
+   uint16_t keys_16[] = {65535, 256, 255, 1000, 1, 40000};
+   fail_unless(histogram_percentile(keys_16, 6, 16, 50.0) == 628.0);
+   fail_unless(histogram_percentile(keys_16, 5, 16, 50.0) == 256.0);
+   fail_unless(histogram_percentile(keys_16, 6, 16, 20.0) == 255.0);
+
+   // The list must not be modified
+   fail_unless(keys_16[0] == 65535 && keys_16[5] == 40000);
+} END_TEST
+
 Suite *median_suite(void) {
    Suite *s = suite_create("median");
 
@@ -38,6 +84,8 @@ Suite *median_suite(void) {
    // median test case
    TCase *median_testcase = tcase_create("median");
    tcase_add_test(median_testcase, test_median);
+   tcase_add_test(median_testcase, test_median_worst_cases);
+   tcase_add_test(median_testcase, test_histogram_percentile);
    suite_add_tcase(s, median_testcase);
 
    return s;
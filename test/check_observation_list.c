@@ -0,0 +1,162 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/coordinate_reader.h"
+#include "../src/data_handling.h"
+#include "../src/hit_list.h"
+#include "../src/observation_list.h"
+#include "../src/result_set.h"
+#include "../src/spatial_index.h"
+
+#define WIDTH 100
+#define HEIGHT 50
+#define NUMBER_RECORDS (WIDTH * HEIGHT)
+
+// Coordinates of each record, read back by the test coordinate reader
+static float xs[NUMBER_RECORDS], ys[NUMBER_RECORDS], ts[NUMBER_RECORDS];
+static size_t next_record = 0;
+
+static int read_test_coordinates(coordinate_reader *source, float *x, float *y,
+                                 float *t) {
+   if (next_record >= source->num_records) return 0;
+   *x = xs[next_record];
+   *y = ys[next_record];
+   *t = ts[next_record];
+   next_record++;
+   return 1;
+}
+
+static int accept_even(void *context, size_t record_index) {
+   return record_index % 2 == 0;
+}
+
+// Brute force whether a record lies within bounds (and passes the filter)
+static int expected_match(size_t i, float *bounds, int filtered) {
+   return xs[i] >= bounds[0] && xs[i] <= bounds[1] &&
+          ys[i] >= bounds[2] && ys[i] <= bounds[3] &&
+          ts[i] >= bounds[4] && ts[i] <= bounds[5] &&
+          (!filtered || i % 2 == 0);
+}
+
+static spatial_index *setup_list(void) {
+   for (int i = 0; i < NUMBER_RECORDS; i++) {
+      xs[i] = (float) (i % WIDTH);
+      ys[i] = (float) (i / WIDTH);
+      ts[i] = (float) (i % 10);
+   }
+   next_record = 0;
+   coordinate_reader reader;
+   memset(&reader, 0, sizeof(coordinate_reader));
+   reader.num_records = NUMBER_RECORDS;
+   reader.read = &read_test_coordinates;
+   return generate_observation_list_from_coordinate_reader(&reader);
+}
+
+START_TEST(test_observation_list_query) {
+   spatial_index *list = setup_list();
+   fail_unless(list->num_observations == NUMBER_RECORDS);
+
+   float bounds[] = {10.5, 30.0, 5.0, 20.5, 2.0, 7.0};
+   for (int filtered = 0; filtered <= 1; filtered++) {
+      list->filter = filtered ? &accept_even : NULL;
+
+      // Count the expected matches
+      int number_expected = 0;
+      for (size_t i = 0; i < NUMBER_RECORDS; i++) {
+         number_expected += expected_match(i, bounds, filtered);
+      }
+      fail_unless(number_expected > 0);
+
+      // Query - every result is expected, with its coordinates, and none are
+      // repeated
+      char *seen = calloc(NUMBER_RECORDS, sizeof(char));
+      result_set *r = list->query(list, bounds);
+      fail_unless(r->length == number_expected);
+      result_set_item *item;
+      while ((item = r->iterate(r)) != NULL) {
+         size_t i = item->record_index;
+         fail_unless(expected_match(i, bounds, filtered));
+         fail_unless(item->x == xs[i] && item->y == ys[i] && item->t == ts[i]);
+         fail_if(seen[i]);
+         seen[i] = 1;
+      }
+      r->free(r);
+
+      // Query append - the hits follow those already in the list
+      hit_list *hits = hit_list_init();
+      hits->append(hits, 0.0, 0.0, 0.0, NUMBER_RECORDS);
+      list->query_append(list, bounds, hits);
+      fail_unless(hits->length == number_expected + 1);
+      fail_unless(hits->record_indices[0] == NUMBER_RECORDS);
+      for (unsigned int h = 1; h < hits->length; h++) {
+         size_t i = hits->record_indices[h];
+         fail_unless(seen[i]);
+         fail_unless(hits->x[h] == xs[i] && hits->y[h] == ys[i] &&
+                     hits->t[h] == ts[i]);
+      }
+      hits->free(hits);
+      free(seen);
+
+      // Estimates never fall short of the true count, and every region may
+      // be occupied
+      fail_unless(list->estimate_count(list, bounds) >= number_expected);
+      fail_unless(list->occupied(list, bounds));
+   }
+
+   list->free(list);
+} END_TEST
+
+START_TEST(test_observation_list_scan) {
+   spatial_index *list = setup_list();
+
+   for (int filtered = 0; filtered <= 1; filtered++) {
+      list->filter = filtered ? &accept_even : NULL;
+
+      // Scan in uneven blocks - every (accepted) observation is visited once,
+      // in order
+      hit_list *hits = hit_list_init();
+      size_t expected_next = 0;
+      for (size_t first = 0; first < NUMBER_RECORDS; first += 333) {
+         size_t count = NUMBER_RECORDS - first;
+         if (count > 333) count = 333;
+         hits->clear(hits);
+         list->scan(list, first, count, hits);
+         for (unsigned int h = 0; h < hits->length; h++) {
+            size_t i = hits->record_indices[h];
+            fail_unless(i == expected_next);
+            fail_unless(hits->x[h] == xs[i] && hits->y[h] == ys[i] &&
+                        hits->t[h] == ts[i]);
+            expected_next += filtered ? 2 : 1;
+         }
+      }
+      fail_unless(expected_next == NUMBER_RECORDS);
+      hits->free(hits);
+   }
+
+   list->free(list);
+} END_TEST
+
+Suite *observation_list_suite(void) {
+   Suite *s = suite_create("observation_list");
+
+   TCase *query_testcase = tcase_create("query");
+   tcase_add_test(query_testcase, test_observation_list_query);
+   suite_add_tcase(s, query_testcase);
+
+   TCase *scan_testcase = tcase_create("scan");
+   tcase_add_test(scan_testcase, test_observation_list_scan);
+   suite_add_tcase(s, scan_testcase);
+
+   return s;
+}
+
+int main(void) {
+   Suite *s = observation_list_suite();
+   SRunner *suite_runner = srunner_create(s);
+   srunner_run_all(suite_runner, CK_NORMAL);
+   int failures = srunner_ntests_failed(suite_runner);
+   srunner_free(suite_runner);
+   return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -22,6 +22,19 @@ START_TEST(test_proj) {
    fail_unless(sc.latitude == 30.0);
    fail_unless(sc.longitude == 45.0);
 
+   // Inverse-project several pairs at once and compare
+   float ys[] = {3339584.75, -3339584.75};
+   float xs[] = {5009377.0, -5009377.0};
+   spherical_coordinates many[2];
+   p->inverse_project_many(p, 2, ys, xs, many);
+   fail_unless(many[0].latitude == 30.0);
+   fail_unless(many[0].longitude == 45.0);
+   fail_unless(many[1].latitude == -30.0);
+   fail_unless(many[1].longitude == -45.0);
+
+   // Equirectangular is separable
+   fail_unless(p->separable);
+
    // Serialize and de-serialize
    FILE *f = fopen("test_proj_serialize", "wb");
    p->serialize_to_file(p, f);
@@ -43,6 +56,14 @@ START_TEST(test_proj) {
 
 } END_TEST
 
+START_TEST(test_proj_not_separable) {
+   projector *p = get_proj_projector_from_string(
+      "+proj=stere +lat_0=90 +datum=WGS84");
+   fail_if(p == NULL);
+   fail_if(p->separable);
+   p->free(p);
+} END_TEST
+
 START_TEST(test_proj_invalid) {
    // Create the projector
    projector *p = get_proj_projector_from_string("not a valid projection");
@@ -61,6 +82,7 @@ Suite *proj_projector_suite(void) {
    // Correct test case
    TCase *proj_testcase = tcase_create("proj");
    tcase_add_test(proj_testcase, test_proj);
+   tcase_add_test(proj_testcase, test_proj_not_separable);
    suite_add_tcase(s, proj_testcase);
 
    // Testt error handling
@@ -0,0 +1,127 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "../src/data_handling.h"
+#include "../src/quantile_sketch.h"
+
+START_TEST(test_exact_while_small) {
+   quantile_sketch *sketch = quantile_sketch_init(0.01);
+
+   // Small inputs are held in full, so percentiles are exact and interpolated
+   NUMERIC_WORKING_TYPE values[] = {5.0, 1.0, 3.0, 4.3, 2.8, 9.9};
+   for (int i = 0; i < 6; i++) {
+      sketch->update(sketch, values[i]);
+   }
+   fail_unless(sketch->count == 6);
+   fail_unless(fabs(sketch->query(sketch, 50.0) - 3.65) < 1E-9);
+   fail_unless(sketch->query(sketch, 0.0) == 1.0);
+   fail_unless(sketch->query(sketch, 100.0) == 9.9);
+
+   // After a reset, the sketch is empty and can be reused
+   sketch->reset(sketch);
+   fail_unless(sketch->count == 0);
+   sketch->update(sketch, 42.0);
+   fail_unless(sketch->query(sketch, 90.0) == 42.0);
+
+   sketch->free(sketch);
+} END_TEST
+
+START_TEST(test_rank_error) {
+   float rank_error = 0.01;
+   quantile_sketch *sketch = quantile_sketch_init(rank_error);
+
+   // Add a permutation of 0..length-1, so that the true rank of a value is
+   // the value itself
+   int length = 1000003;
+   for (int i = 0; i < length; i++) {
+      sketch->update(sketch, (NUMERIC_WORKING_TYPE) ((i * 7919L) % length));
+   }
+   fail_unless(sketch->count == length);
+
+   // Memory must be bounded, rather than growing with the input
+   fail_unless(sketch->retained < 4 * sketch->k);
+
+   double percentiles[] = {1.0, 10.0, 25.0, 50.0, 75.0, 90.0, 99.0};
+   for (int i = 0; i < 7; i++) {
+      NUMERIC_WORKING_TYPE estimate = sketch->query(sketch, percentiles[i]);
+      double true_value = percentiles[i] / 100.0 * (length - 1);
+      fail_unless(fabs(estimate - true_value) / length < 2 * rank_error,
+                  "Percentile %f estimated as %f", percentiles[i], estimate);
+   }
+
+   // Results must be reproducible after a reset
+   NUMERIC_WORKING_TYPE first_median = sketch->query(sketch, 50.0);
+   sketch->reset(sketch);
+   for (int i = 0; i < length; i++) {
+      sketch->update(sketch, (NUMERIC_WORKING_TYPE) ((i * 7919L) % length));
+   }
+   fail_unless(sketch->query(sketch, 50.0) == first_median);
+
+   sketch->free(sketch);
+} END_TEST
+
+START_TEST(test_merge) {
+   float rank_error = 0.01;
+   quantile_sketch *sketch = quantile_sketch_init(rank_error);
+   quantile_sketch *other = quantile_sketch_init(rank_error);
+
+   // Small sketches merge exactly
+   sketch->update(sketch, 5.0);
+   sketch->update(sketch, 1.0);
+   other->update(other, 3.0);
+   sketch->merge(sketch, other);
+   fail_unless(sketch->count == 3);
+   fail_unless(sketch->query(sketch, 50.0) == 3.0);
+   fail_unless(other->count == 1);
+
+   // Merging the halves of a permutation of 0..length-1 keeps the rank error
+   // of a sketch which was given the whole permutation
+   int length = 1000003;
+   sketch->reset(sketch);
+   other->reset(other);
+   for (int i = 0; i < length; i++) {
+      quantile_sketch *half = (i % 2 == 0) ? sketch : other;
+      half->update(half, (NUMERIC_WORKING_TYPE) ((i * 7919L) % length));
+   }
+   sketch->merge(sketch, other);
+   fail_unless(sketch->count == length);
+   fail_unless(sketch->retained < 4 * sketch->k);
+
+   double percentiles[] = {1.0, 10.0, 25.0, 50.0, 75.0, 90.0, 99.0};
+   for (int i = 0; i < 7; i++) {
+      NUMERIC_WORKING_TYPE estimate = sketch->query(sketch, percentiles[i]);
+      double true_value = percentiles[i] / 100.0 * (length - 1);
+      fail_unless(fabs(estimate - true_value) / length < 2 * rank_error,
+                  "Percentile %f estimated as %f", percentiles[i], estimate);
+   }
+
+   sketch->free(sketch);
+   other->free(other);
+} END_TEST
+
+START_TEST(invalid_rank_error) {
+   quantile_sketch_init(0.0);
+} END_TEST
+
+Suite *quantile_sketch_suite(void) {
+   Suite *s = suite_create("quantile_sketch");
+
+   TCase *sketch_testcase = tcase_create("quantile_sketch");
+   tcase_add_test(sketch_testcase, test_exact_while_small);
+   tcase_add_test(sketch_testcase, test_rank_error);
+   tcase_add_test(sketch_testcase, test_merge);
+   tcase_add_exit_test(sketch_testcase, invalid_rank_error, EXIT_FAILURE);
+   suite_add_tcase(s, sketch_testcase);
+
+   return s;
+}
+
+int main(void) {
+   Suite *s = quantile_sketch_suite();
+   SRunner *suite_runner = srunner_create(s);
+   srunner_run_all(suite_runner, CK_NORMAL);
+   int failures = srunner_ntests_failed(suite_runner);
+   srunner_free(suite_runner);
+   return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
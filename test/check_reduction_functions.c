@@ -1,8 +1,10 @@
 #include <check.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../src/data_handling.h"
+#include "../src/hit_list.h"
 #include "../src/reduction_functions.h"
 #include "../src/result_set.h"
 
@@ -79,6 +81,110 @@ START_TEST(test_numeric_weighted_mean) {
 
 } END_TEST
 
+START_TEST(test_numeric_kernel_mean) {
+   reduction_function f = get_reduction_function_by_name("kernel_mean");
+   fail_if(reduction_function_is_undef(f));
+   fail_unless(get_kernel_by_name("idw") == kernel_idw);
+   fail_unless(get_kernel_by_name("gaussian") == kernel_gaussian);
+   fail_unless(get_kernel_by_name("does_not_exist") == undef_kernel);
+   reduction_attrs kernel_attrs = {-999.0, -999.0};
+
+   // The table holds the kernel evaluated at the centre of each bin
+   kernel_table *idw = kernel_table_init(kernel_idw, 2.0, 20000.0);
+   for (int i = 0; i < idw->length; i += 1000) {
+      double squared_distance = (i + 0.5) / idw->scale;
+      fail_unless(fabs(idw->weights[i] * squared_distance - 1.0) < 1E-5);
+   }
+
+   // Compute the inverse distance weighted mean directly; the nearest
+   // observations fall in the first few bins, so allow for some error
+   double weighted_sum = 0.0, total_weight = 0.0;
+   for (int i = 0; i < 100; i++) {
+      if (i % 4 == 0) continue;
+      double squared_distance = pow(50.0 - i, 2) + pow(50.0 - (i + 1), 2);
+      weighted_sum += i * 5.0 / squared_distance;
+      total_weight += 1.0 / squared_distance;
+   }
+   kernel_attrs.kernel = idw;
+   f.call(results, &kernel_attrs, bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(fabs(numeric_get(output_data, float32_d, 10) -
+                    weighted_sum / total_weight) < 1.0);
+
+   // The centre is taken from the bounds of each dimension, so a box which
+   // is wider than it is tall, with the same centre, gives the same result
+   float wide_bounds[] = {0.0, 100.0, 30.0, 70.0, -INFINITY, +INFINITY};
+   results->rewind(results);
+   f.call(results, &kernel_attrs, wide_bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(fabs(numeric_get(output_data, float32_d, 10) -
+                    weighted_sum / total_weight) < 1.0);
+   kernel_table_free(idw);
+
+   // A very wide gaussian weights every observation equally
+   kernel_table *gaussian = kernel_table_init(kernel_gaussian, 1E6, 20000.0);
+   kernel_attrs.kernel = gaussian;
+   results->rewind(results);
+   f.call(results, &kernel_attrs, bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(fabs(numeric_get(output_data, float32_d, 10) - 250.0) < 1E-3);
+
+   // An empty result set gives the fill value
+   result_set *empty = result_set_init();
+   f.call(empty, &kernel_attrs, bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == -999.0);
+   empty->free(empty);
+   kernel_table_free(gaussian);
+} END_TEST
+
+START_TEST(test_numeric_input_weighted) {
+   reduction_function mean_f = get_reduction_function_by_name(
+      "input_weighted_mean");
+   reduction_function median_f = get_reduction_function_by_name(
+      "input_weighted_median");
+   fail_if(reduction_function_is_undef(mean_f));
+   fail_if(reduction_function_is_undef(median_f));
+
+   reduction_attrs weighted_attrs = {-999.0, -999.0};
+   weighted_attrs.input_weights_dtype = dtype_string_parse("uint8");
+   uint8_t weights[100];
+   weighted_attrs.input_weights = weights;
+
+   // Equal weights give the ordinary mean and median
+   for (int i = 0; i < 100; i++) weights[i] = 3;
+   mean_f.call(results, &weighted_attrs, bounds, input_data, output_data, 10,
+               float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 250.0);
+   results->rewind(results);
+   median_f.call(results, &weighted_attrs, bounds, input_data, output_data, 10,
+                 float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 250.0);
+
+   // Zero weights exclude observations; only 5 (weight 1), 10 (weight 1) and
+   // 495 (weight 4) remain
+   for (int i = 0; i < 100; i++) weights[i] = 0;
+   weights[1] = 1;
+   weights[2] = 1;
+   weights[99] = 4;
+   results->rewind(results);
+   mean_f.call(results, &weighted_attrs, bounds, input_data, output_data, 10,
+               float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) ==
+               (5.0 + 10.0 + 4 * 495.0) / 6.0);
+   results->rewind(results);
+   median_f.call(results, &weighted_attrs, bounds, input_data, output_data, 10,
+                 float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 495.0);
+
+   // With no positive weights, the fill value is stored
+   weights[1] = weights[2] = weights[99] = 0;
+   results->rewind(results);
+   median_f.call(results, &weighted_attrs, bounds, input_data, output_data, 10,
+                 float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == -999.0);
+} END_TEST
+
 START_TEST(test_numeric_median) {
    // Get the reduction function
    reduction_function f = get_reduction_function_by_name("median");
@@ -92,6 +198,78 @@ START_TEST(test_numeric_median) {
 
 } END_TEST
 
+START_TEST(test_numeric_median_narrow_integers) {
+   reduction_function f = get_reduction_function_by_name("median");
+   char *dtype_names[] = {"uint8", "int8", "uint16", "int16"};
+   reduction_attrs integer_attrs = {99.0, -999.0};
+
+   for (int d = 0; d < 4; d++) {
+      dtype narrow_d = dtype_string_parse(dtype_names[d]);
+      void *narrow_data = malloc(narrow_d.size * 100);
+      for (int i = 0; i < 100; i++) {
+         // Include negatives for the signed types, and some fill values
+         numeric_put(narrow_data, narrow_d, i,
+                     (i % 4 == 0) ? 99.0 : (float) ((i * 37) % 61) -
+                     ((d % 2) ? 30.0 : 0.0));
+         numeric_put(input_data, float32_d, i,
+                     numeric_get(narrow_data, narrow_d, i));
+      }
+
+      // The histogram path should agree with the selection path
+      f.call(results, &integer_attrs, bounds, narrow_data, output_data, 10,
+             narrow_d, float32_d);
+      NUMERIC_WORKING_TYPE narrow_result = numeric_get(output_data, float32_d,
+                                                       10);
+      results->rewind(results);
+      f.call(results, &integer_attrs, bounds, input_data, output_data, 10,
+             float32_d, float32_d);
+      NUMERIC_WORKING_TYPE float_result = numeric_get(output_data, float32_d,
+                                                      10);
+      results->rewind(results);
+
+      fail_unless(narrow_result == float_result);
+      free(narrow_data);
+   }
+} END_TEST
+
+START_TEST(test_numeric_percentile) {
+   reduction_function f = get_reduction_function_by_name("percentile");
+   fail_if(reduction_function_is_undef(f));
+   reduction_attrs percentile_attrs = {-999.0, -999.0, 50.0, 0.01};
+
+   // The 50th percentile is the median
+   f.call(results, &percentile_attrs, bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 250.0);
+
+   // Other percentiles interpolate between the non-fill values (5..495)
+   percentile_attrs.percentile = 90.0;
+   results->rewind(results);
+   f.call(results, &percentile_attrs, bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 448.0);
+
+   // Narrow integer types agree with the float path
+   dtype int16_d = dtype_string_parse("int16");
+   void *integer_data = malloc(int16_d.size * 100);
+   for (int i = 0; i < 100; i++) {
+      numeric_put(integer_data, int16_d, i, numeric_get(input_data, float32_d,
+                                                         i));
+   }
+   results->rewind(results);
+   f.call(results, &percentile_attrs, bounds, integer_data, output_data, 10,
+          int16_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 448.0);
+   free(integer_data);
+
+   // An empty result set gives the fill value
+   result_set *empty = result_set_init();
+   f.call(empty, &percentile_attrs, bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == -999.0);
+   empty->free(empty);
+} END_TEST
+
 START_TEST(test_numeric_nearest_neighbour) {
    // Get the reduction function
    reduction_function f = get_reduction_function_by_name("numeric_nearest_neighbour");
@@ -106,6 +284,42 @@ START_TEST(test_numeric_nearest_neighbour) {
 
 } END_TEST
 
+START_TEST(test_cell_centre) {
+   // A cell away from the diagonal of the observations, centred on (72, 11):
+   // the nearest observation is 41 (at (41, 42)), and the weighted mean is
+   // found from the distance of each observation to the same centre
+   float cell_bounds[] = {62.0, 82.0, 1.0, 21.0, -INFINITY, +INFINITY};
+
+   reduction_function f =
+      get_reduction_function_by_name("numeric_nearest_neighbour");
+   f.call(results, &r_attrs, cell_bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 205.0);
+
+   dtype coded32_d = dtype_string_parse("coded32");
+   float coded_result;
+   f = get_reduction_function_by_name("coded_nearest_neighbour");
+   results->rewind(results);
+   f.call(results, &r_attrs, cell_bounds, input_data, output_data, 10,
+          coded32_d, coded32_d);
+   coded_get(output_data, coded32_d, 10, &coded_result);
+   fail_unless(coded_result == 205.0);
+
+   double weighted_sum = 0.0, total_distance = 0.0;
+   for (int i = 0; i < 100; i++) {
+      if (i % 4 == 0) continue;
+      double distance = sqrt(pow(72.0 - i, 2) + pow(11.0 - (i + 1), 2));
+      weighted_sum += i * 5.0 * distance;
+      total_distance += distance;
+   }
+   f = get_reduction_function_by_name("weighted_mean");
+   results->rewind(results);
+   f.call(results, &r_attrs, cell_bounds, input_data, output_data, 10,
+          float32_d, float32_d);
+   fail_unless(fabs(numeric_get(output_data, float32_d, 10) -
+                    weighted_sum / total_distance) < 1E-3);
+} END_TEST
+
 START_TEST(test_coded_nearest_neighbour) {
    // Get the reduction function
    reduction_function f = get_reduction_function_by_name("coded_nearest_neighbour");
@@ -123,6 +337,72 @@ START_TEST(test_coded_nearest_neighbour) {
 
 } END_TEST
 
+// Store or read a code as an unsigned integer of the size of its dtype
+static void put_test_code(void *data, dtype coded_d, int i, uint64_t code) {
+   switch (coded_d.size) {
+   case 1: ((uint8_t *) data)[i] = code; break;
+   case 2: ((uint16_t *) data)[i] = code; break;
+   case 4: ((uint32_t *) data)[i] = code; break;
+   default: ((uint64_t *) data)[i] = code; break;
+   }
+}
+
+static uint64_t get_test_code(void *data, dtype coded_d, int i) {
+   switch (coded_d.size) {
+   case 1: return ((uint8_t *) data)[i];
+   case 2: return ((uint16_t *) data)[i];
+   case 4: return ((uint32_t *) data)[i];
+   default: return ((uint64_t *) data)[i];
+   }
+}
+
+START_TEST(test_coded_mode) {
+   reduction_function f = get_reduction_function_by_name("coded_mode");
+   fail_if(reduction_function_is_undef(f));
+
+   char *dtype_names[] = {"coded8", "coded16", "coded32", "coded64"};
+   for (int d = 0; d < 4; d++) {
+      dtype coded_d = dtype_string_parse(dtype_names[d]);
+      void *coded_data = calloc(100, coded_d.size);
+      void *coded_output = calloc(100, coded_d.size);
+
+      // Codes 0-6 repeating, with code 5 filling the last 20 positions to
+      // make it the most common
+      for (int i = 0; i < 100; i++) {
+         put_test_code(coded_data, coded_d, i, (i >= 80) ? 5 : i % 7);
+      }
+      f.call(results, &r_attrs, bounds, coded_data, coded_output, 10,
+             coded_d, coded_d);
+      uint64_t result = get_test_code(coded_output, coded_d, 10);
+      fail_unless(result == 5, "%s mode was %d", dtype_names[d], (int) result);
+
+      // Ties are broken by choosing the lowest code (by value, whatever the
+      // order of its bytes)
+      uint64_t high_code = (coded_d.size == 1) ? 0x81 : 0x0180;
+      uint64_t low_code = (coded_d.size == 1) ? 0x18 : 0x0081;
+      for (int i = 0; i < 100; i++) {
+         put_test_code(coded_data, coded_d, i, (i % 2) ? high_code : low_code);
+      }
+      results->rewind(results);
+      f.call(results, &r_attrs, bounds, coded_data, coded_output, 10,
+             coded_d, coded_d);
+      fail_unless(get_test_code(coded_output, coded_d, 10) == low_code);
+      results->rewind(results);
+
+      free(coded_data);
+      free(coded_output);
+   }
+
+   // An empty result set gives a code of 0
+   dtype coded32_d = dtype_string_parse("coded32");
+   result_set *empty = result_set_init();
+   ((uint32_t *) output_data)[10] = 1;
+   f.call(empty, &r_attrs, bounds, input_data, output_data, 10, coded32_d,
+          coded32_d);
+   fail_unless(((uint32_t *) output_data)[10] == 0);
+   empty->free(empty);
+} END_TEST
+
 START_TEST(test_numeric_newest) {
    // Get the reduction function
    reduction_function f = get_reduction_function_by_name("newest");
@@ -134,6 +414,115 @@ START_TEST(test_numeric_newest) {
    NUMERIC_WORKING_TYPE result = numeric_get(output_data, float32_d, 10);
    fail_unless(result == 495.0);
 
+   // Where observations are equally new, the lowest record index is used,
+   // whatever the order they are found in
+   result_set *tied = result_set_init();
+   tied->insert(tied, 50.0, 50.0, 1000.0, 7);
+   tied->insert(tied, 50.0, 50.0, 1000.0, 3);
+   tied->insert(tied, 50.0, 50.0, 1000.0, 5);
+   f.call(tied, &r_attrs, bounds, input_data, output_data, 10, float32_d,
+          float32_d);
+   fail_unless(numeric_get(output_data, float32_d, 10) == 15.0);
+   tied->free(tied);
+
+} END_TEST
+
+START_TEST(test_numeric_statistics) {
+   statistic_output outputs[7];
+   char *names[] = {"mean", "stddev", "variance", "count", "sum", "min",
+                    "max"};
+   float statistic_data[7];
+   for (int i = 0; i < 7; i++) {
+      outputs[i].stat = get_statistic_by_name(names[i]);
+      fail_if(outputs[i].stat == undef_statistic);
+      outputs[i].data_output = (char *) statistic_data;
+      outputs[i].output_dtype = float32_d;
+   }
+   fail_unless(get_statistic_by_name("does_not_exist") == undef_statistic);
+
+   // Compute the expected population variance directly
+   double expected_variance = 0.0;
+   for (int i = 0; i < 100; i++) {
+      if (i % 4 != 0) expected_variance += pow(i * 5.0 - 250.0, 2) / 75.0;
+   }
+
+   // Store each statistic at a different index
+   for (int i = 0; i < 7; i++) {
+      results->rewind(results);
+      reduce_numeric_statistics(results, &r_attrs, input_data, float32_d,
+                                &outputs[i], 1, i);
+   }
+   fail_unless(statistic_data[0] == 250.0);
+   fail_unless(fabs(statistic_data[1] - sqrt(expected_variance)) < 1E-3);
+   fail_unless(fabs(statistic_data[2] - expected_variance) < 1E-1);
+   fail_unless(statistic_data[3] == 75.0);
+   fail_unless(statistic_data[4] == 18750.0);
+   fail_unless(statistic_data[5] == 5.0);
+   fail_unless(statistic_data[6] == 495.0);
+
+   // An empty result set gives fill values (and a zero count)
+   result_set *empty = result_set_init();
+   reduce_numeric_statistics(empty, &r_attrs, input_data, float32_d, outputs,
+                             3, 0);
+   fail_unless(statistic_data[0] == -999.0);
+   empty->rewind(empty);
+   reduce_numeric_statistics(empty, &r_attrs, input_data, float32_d,
+                             &outputs[3], 1, 0);
+   fail_unless(statistic_data[0] == 0.0);
+   empty->free(empty);
+} END_TEST
+
+START_TEST(test_row_reductions) {
+   // Split the observations into a row of three cells (the second empty),
+   // both as a hit_list and as a result set per cell
+   unsigned int offsets[] = {0, 40, 40, 100};
+   float centres_x[] = {20.0, 50.0, 80.0};
+   float cell_bounds[3][6];
+   hit_list *hits = hit_list_init();
+   result_set *cell_results[3];
+   for (int c = 0; c < 3; c++) {
+      float cell[] = {centres_x[c] - 10.0, centres_x[c] + 10.0, 25.0, 75.0,
+                      -INFINITY, +INFINITY};
+      memcpy(cell_bounds[c], cell, sizeof(cell));
+      cell_results[c] = result_set_init();
+      for (unsigned int i = offsets[c]; i < offsets[c + 1]; i++) {
+         hits->append(hits, i, i + 1, i + 2, i);
+         cell_results[c]->insert(cell_results[c], i, i + 1, i + 2, i);
+      }
+   }
+   fail_unless(hits->length == 100);
+
+   reduction_attrs row_attrs = {-999.0, -999.0};
+   row_attrs.kernel = kernel_table_init(kernel_idw, 2.0, 20000.0);
+   float *row_output = malloc(sizeof(float) * 4);
+
+   // Every reduction with a row version must match its per-cell version
+   char *names[] = {"mean", "weighted_mean", "kernel_mean"};
+   for (int r = 0; r < 3; r++) {
+      reduction_function f = get_reduction_function_by_name(names[r]);
+      fail_if(f.call_row == NULL);
+      row_output[3] = 123.0;
+      f.call_row(hits, offsets, 3, centres_x, 50.0, &row_attrs, input_data,
+                 row_output, 0, float32_d, float32_d);
+      fail_unless(row_output[3] == 123.0);
+      for (int c = 0; c < 3; c++) {
+         cell_results[c]->rewind(cell_results[c]);
+         f.call(cell_results[c], &row_attrs, cell_bounds[c], input_data,
+                output_data, c, float32_d, float32_d);
+         fail_unless(row_output[c] == ((float *) output_data)[c]);
+      }
+      fail_unless(row_output[1] == -999.0);
+   }
+
+   // Reductions without a row version leave it unset
+   fail_unless(get_reduction_function_by_name("median").call_row == NULL);
+
+   free(row_output);
+   kernel_table_free(row_attrs.kernel);
+   for (int c = 0; c < 3; c++) {
+      cell_results[c]->free(cell_results[c]);
+   }
+   hits->free(hits);
 } END_TEST
 
 Suite *reduction_function_suite(void) {
@@ -154,26 +543,49 @@ Suite *reduction_function_suite(void) {
    TCase *weighted_mean_testcase = tcase_create("weighted_mean");
    tcase_add_checked_fixture(weighted_mean_testcase, setup, teardown);
    tcase_add_test(weighted_mean_testcase, test_numeric_weighted_mean);
+   tcase_add_test(weighted_mean_testcase, test_numeric_kernel_mean);
+   tcase_add_test(weighted_mean_testcase, test_numeric_input_weighted);
    suite_add_tcase(s, weighted_mean_testcase);
 
    // Median testcase
    TCase *median_testcase = tcase_create("median");
    tcase_add_checked_fixture(median_testcase, setup, teardown);
    tcase_add_test(median_testcase, test_numeric_median);
+   tcase_add_test(median_testcase, test_numeric_median_narrow_integers);
+   tcase_add_test(median_testcase, test_numeric_percentile);
    suite_add_tcase(s, median_testcase);
 
+   // Statistics testcase
+   TCase *statistics_testcase = tcase_create("statistics");
+   tcase_add_checked_fixture(statistics_testcase, setup, teardown);
+   tcase_add_test(statistics_testcase, test_numeric_statistics);
+   suite_add_tcase(s, statistics_testcase);
+
    // Coded Nearest neighbour testcase
    TCase *coded_nearest_neighbour_testcase = tcase_create("coded_nearest_neighbour");
    tcase_add_checked_fixture(coded_nearest_neighbour_testcase, setup, teardown);
    tcase_add_test(coded_nearest_neighbour_testcase, test_coded_nearest_neighbour);
    suite_add_tcase(s, coded_nearest_neighbour_testcase);
 
+   // Coded mode testcase
+   TCase *coded_mode_testcase = tcase_create("coded_mode");
+   tcase_add_checked_fixture(coded_mode_testcase, setup, teardown);
+   tcase_add_test(coded_mode_testcase, test_coded_mode);
+   suite_add_tcase(s, coded_mode_testcase);
+
    // Numeric Nearest neighbour testcase
    TCase *numeric_nearest_neighbour_testcase = tcase_create("numeric_nearest_neighbour");
    tcase_add_checked_fixture(numeric_nearest_neighbour_testcase, setup, teardown);
    tcase_add_test(numeric_nearest_neighbour_testcase, test_numeric_nearest_neighbour);
+   tcase_add_test(numeric_nearest_neighbour_testcase, test_cell_centre);
    suite_add_tcase(s, numeric_nearest_neighbour_testcase);
 
+   // Row reduction testcase
+   TCase *row_testcase = tcase_create("row");
+   tcase_add_checked_fixture(row_testcase, setup, teardown);
+   tcase_add_test(row_testcase, test_row_reductions);
+   suite_add_tcase(s, row_testcase);
+
    // Newest testcase
    TCase *newest_testcase = tcase_create("newest");
    tcase_add_checked_fixture(newest_testcase, setup, teardown);
@@ -3,6 +3,10 @@
 
 #include "../src/result_set.h"
 
+int is_odd(void *context, size_t record_index) {
+   return record_index % 2;
+}
+
 START_TEST(test_result_set) {
 
    // Setup the result set
@@ -31,6 +35,30 @@ START_TEST(test_result_set) {
 
    fail_unless(iterated_results == 10);
 
+   // Rewind, and check the items can be iterated over again
+   s->rewind(s);
+   iterated_results = 0;
+   while ((current_item = s->iterate(s)) != NULL) {
+      iterated_results++;
+      fail_unless(current_item->record_index == iterated_results);
+   }
+   fail_unless(iterated_results == 10);
+
+   // Keep only the odd records, and check the remaining items and length
+   s->retain(s, &is_odd, NULL);
+   fail_unless(s->length == 5);
+   iterated_results = 0;
+   while ((current_item = s->iterate(s)) != NULL) {
+      fail_unless(current_item->record_index == 2 * iterated_results + 1);
+      iterated_results++;
+   }
+   fail_unless(iterated_results == 5);
+   fail_unless(s->tail->record_index == 9);
+
+   // Items can still be added after filtering
+   s->insert(s, 0.0, 0.0, 0.0, 11);
+   fail_unless(s->length == 6 && s->tail->record_index == 11);
+
    // Cleanup
    s->free(s);
 
@@ -0,0 +1,101 @@
+#include <check.h>
+#include <stdlib.h>
+
+#include "../src/coordinate_reader.h"
+#include "../src/run_metrics.h"
+
+START_TEST(test_count_queries) {
+   run_metrics metrics, thread_metrics;
+   run_metrics_init(&metrics);
+   run_metrics_init(&thread_metrics);
+
+   // Results are counted in power of two buckets, with empty results apart
+   run_metrics_count_query(&thread_metrics, 0);
+   run_metrics_count_query(&thread_metrics, 1);
+   run_metrics_count_query(&thread_metrics, 2);
+   run_metrics_count_query(&thread_metrics, 3);
+   run_metrics_count_query(&thread_metrics, 1000);
+   fail_unless(thread_metrics.queries == 5);
+   fail_unless(thread_metrics.hits == 1006);
+   fail_unless(thread_metrics.result_sizes[0] == 1);
+   fail_unless(thread_metrics.result_sizes[1] == 1);
+   fail_unless(thread_metrics.result_sizes[2] == 2);
+   fail_unless(thread_metrics.result_sizes[10] == 1);
+
+   // Merging adds every counter and timer
+   thread_metrics.phase_nanoseconds[phase_query] = 7;
+   thread_metrics.cells = 4;
+   run_metrics_merge(&metrics, &thread_metrics);
+   run_metrics_merge(&metrics, &thread_metrics);
+   fail_unless(metrics.queries == 10);
+   fail_unless(metrics.hits == 2012);
+   fail_unless(metrics.cells == 8);
+   fail_unless(metrics.result_sizes[2] == 4);
+   fail_unless(metrics.phase_nanoseconds[phase_query] == 14);
+
+   // The clock never goes backwards
+   uint64_t first = monotonic_nanoseconds();
+   fail_unless(monotonic_nanoseconds() >= first);
+} END_TEST
+
+static size_t records_read;
+static int freed;
+
+static int count_read(coordinate_reader *source, float *x, float *y,
+                      float *t) {
+   if (records_read == source->num_records) return 0;
+   *x = *y = *t = (float) records_read++;
+   return 1;
+}
+
+static void count_free(coordinate_reader *tofree) {
+   freed = 1;
+}
+
+START_TEST(test_timed_coordinate_reader) {
+   coordinate_reader source;
+   source.num_records = 10000;
+   source.input_projector = NULL;
+   source.read = &count_read;
+   source.free = &count_free;
+   records_read = 0;
+   freed = 0;
+
+   uint64_t nanoseconds = 0;
+   coordinate_reader *reader = get_timed_coordinate_reader(&source,
+                                                           &nanoseconds);
+   fail_unless(reader->num_records == 10000);
+
+   // Every record is passed through in order, then the reader is exhausted
+   float x, y, t;
+   for (size_t i=0; i<10000; i++) {
+      fail_unless(reader->read(reader, &x, &y, &t) == 1);
+      fail_unless(x == (float) i && y == (float) i && t == (float) i);
+   }
+   fail_unless(reader->read(reader, &x, &y, &t) == 0);
+   fail_unless(nanoseconds > 0);
+
+   // The source is freed with the timed reader
+   reader->free(reader);
+   fail_unless(freed);
+} END_TEST
+
+Suite *run_metrics_suite(void) {
+   Suite *s = suite_create("run metrics");
+
+   TCase *run_metrics_testcase = tcase_create("run metrics");
+   tcase_add_test(run_metrics_testcase, test_count_queries);
+   tcase_add_test(run_metrics_testcase, test_timed_coordinate_reader);
+   suite_add_tcase(s, run_metrics_testcase);
+
+   return s;
+}
+
+int main(void) {
+   Suite *s = run_metrics_suite();
+   SRunner *suite_runner = srunner_create(s);
+   srunner_run_all(suite_runner, CK_NORMAL);
+   int failures = srunner_ntests_failed(suite_runner);
+   srunner_free(suite_runner);
+   return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
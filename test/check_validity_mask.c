@@ -0,0 +1,156 @@
+// Define posix source macro to enable ftruncate
+#define _POSIX_C_SOURCE 200809L
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/data_handling.h"
+#include "../src/validity_mask.h"
+
+START_TEST(test_generate) {
+   // Every third value (and the last) is a fill value
+   int length = 200;
+   float data[200];
+   for (int i = 0; i < length; i++) {
+      data[i] = (i % 3 == 0 || i == length - 1) ? -999.0 : (float) i;
+   }
+   dtype float32_d = dtype_string_parse("float32");
+   validity_mask *mask = generate_validity_mask(data, float32_d, length,
+                                                -999.0);
+   fail_unless(mask->num_observations == length);
+   int number_valid = 0;
+   for (int i = 0; i < length; i++) {
+      fail_unless(validity_mask_is_valid(mask, i) == (data[i] != -999.0));
+      number_valid += (data[i] != -999.0);
+   }
+   fail_unless(mask->number_valid == number_valid);
+
+   // Merging marks observations valid in either mask (the last value is a
+   // fill value in both)
+   for (int i = 0; i < length; i++) {
+      data[i] = (i % 3 == 0) ? (float) i : -999.0;
+   }
+   validity_mask *other = generate_validity_mask(data, float32_d, length,
+                                                 -999.0);
+   mask->merge(mask, other);
+   fail_unless(mask->number_valid == length - 1);
+   fail_if(validity_mask_is_valid(mask, length - 1));
+
+   other->free(other);
+   mask->free(mask);
+} END_TEST
+
+START_TEST(test_file_round_trip) {
+   uint16_t data[100];
+   for (int i = 0; i < 100; i++) data[i] = (i % 7 == 0) ? 0 : i;
+   dtype uint16_d = dtype_string_parse("uint16");
+   dtype int16_d = dtype_string_parse("int16");
+   validity_mask *mask = generate_validity_mask(data, uint16_d, 100, 0.0);
+   data_file_stamp stamp = {1234, 500, 200};
+
+   FILE *f = fopen("check_validity_mask_test", "w");
+   mask->write_to_file(mask, f, uint16_d, 0.0, stamp);
+   fclose(f);
+
+   // The mask can be read back for the same data
+   f = fopen("check_validity_mask_test", "r");
+   validity_mask *read = read_validity_mask_from_file(f, uint16_d, 100, 0.0,
+                                                      stamp);
+   fclose(f);
+   fail_if(read == NULL);
+   fail_unless(read->number_valid == mask->number_valid);
+   for (int i = 0; i < 100; i++) {
+      fail_unless(validity_mask_is_valid(read, i) ==
+                  validity_mask_is_valid(mask, i));
+   }
+   read->free(read);
+
+   // but not for different data, fill values, dtypes, modification times
+   // (even within the same second) or sizes
+   data_file_stamp later = {1235, 500, 200};
+   data_file_stamp same_second = {1234, 501, 200};
+   data_file_stamp resized = {1234, 500, 201};
+   f = fopen("check_validity_mask_test", "r");
+   fail_unless(read_validity_mask_from_file(f, uint16_d, 101, 0.0, stamp) ==
+               NULL);
+   rewind(f);
+   fail_unless(read_validity_mask_from_file(f, uint16_d, 100, 1.0, stamp) ==
+               NULL);
+   rewind(f);
+   fail_unless(read_validity_mask_from_file(f, int16_d, 100, 0.0, stamp) ==
+               NULL);
+   rewind(f);
+   fail_unless(read_validity_mask_from_file(f, uint16_d, 100, 0.0, later) ==
+               NULL);
+   rewind(f);
+   fail_unless(read_validity_mask_from_file(f, uint16_d, 100, 0.0,
+                                            same_second) == NULL);
+   rewind(f);
+   fail_unless(read_validity_mask_from_file(f, uint16_d, 100, 0.0, resized) ==
+               NULL);
+   fclose(f);
+
+   mask->free(mask);
+   remove("check_validity_mask_test");
+} END_TEST
+
+START_TEST(test_cached) {
+   float data[100];
+   for (int i = 0; i < 100; i++) data[i] = (i % 3 == 0) ? -1.0 : i;
+   dtype float32_d = dtype_string_parse("float32");
+   FILE *f = fopen("check_validity_mask_data", "wb");
+   fwrite(data, sizeof(float), 100, f);
+   fclose(f);
+
+   // The first mask is generated and saved, and then loaded
+   validity_mask *generated = get_cached_validity_mask(
+      "check_validity_mask_data", data, float32_d, 100, -1.0, 0);
+   validity_mask *loaded = get_cached_validity_mask(
+      "check_validity_mask_data", data, float32_d, 100, -1.0, 0);
+   fail_unless(loaded->number_valid == generated->number_valid);
+   loaded->free(loaded);
+
+   // A truncated mask (e.g. from a crashed run) is regenerated
+   f = fopen("check_validity_mask_data.valid", "r+b");
+   fail_if(f == NULL);
+   fail_unless(ftruncate(fileno(f), 20) == 0);
+   fclose(f);
+   loaded = get_cached_validity_mask("check_validity_mask_data", data,
+                                     float32_d, 100, -1.0, 0);
+   fail_unless(loaded->number_valid == generated->number_valid);
+   for (int i = 0; i < 100; i++) {
+      fail_unless(validity_mask_is_valid(loaded, i) ==
+                  validity_mask_is_valid(generated, i));
+   }
+   loaded->free(loaded);
+   generated->free(generated);
+
+   remove("check_validity_mask_data");
+   remove("check_validity_mask_data.valid");
+} END_TEST
+
+Suite *validity_mask_suite(void) {
+   Suite *s = suite_create("validity mask");
+
+   TCase *generate_testcase = tcase_create("generate");
+   tcase_add_test(generate_testcase, test_generate);
+   suite_add_tcase(s, generate_testcase);
+
+   TCase *file_testcase = tcase_create("files");
+   tcase_add_test(file_testcase, test_file_round_trip);
+   tcase_add_test(file_testcase, test_cached);
+   suite_add_tcase(s, file_testcase);
+
+   return s;
+}
+
+int main(void) {
+   Suite *s = validity_mask_suite();
+   SRunner *suite_runner = srunner_create(s);
+   srunner_run_all(suite_runner, CK_NORMAL);
+   int failures = srunner_ntests_failed(suite_runner);
+   srunner_free(suite_runner);
+   return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}